@@ -0,0 +1,156 @@
+/**
+ *  @file batch_mapper.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_BATCH_MAPPER_H
+#define CCNY_RGBD_BATCH_MAPPER_H
+
+#include <cstdio>
+#include <ros/ros.h>
+#include <tf/tf.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/apps/visual_odometry.h"
+#include "ccny_rgbd/apps/keyframe_mapper.h"
+#include "ccny_rgbd/structures/rgbd_frame_factory.h"
+
+namespace ccny_rgbd {
+
+/** @brief Offline batch processing of a recorded session.
+ *
+ * Reads the RGBD frames from a bag (with the rgbd_image_proc output
+ * topics), or from an RGBDRecorder recording, and drives the
+ * VisualOdometry and KeyframeMapper in-process, frame by frame. No
+ * frames are dropped, and processing runs as fast as the CPU allows.
+ *
+ * The bag topics are parameters (rgb_topic, depth_topic, info_topic).
+ * Bags of raw OpenNI data (camera/* topics, from openni_record.launch)
+ * need to go through rgbd_image_proc first: see openni_preprocess.launch
+ * in ccny_openni_launch.
+ *
+ * The base to camera transform is taken from the /tf messages in
+ * the bag, if present.
+ *
+ * When done, the keyframe graph is optionally generated and solved,
+ * and the following are written to the output path:
+ *  - trajectory.txt: the VO pose of the base frame for every frame
+ *    (timestamp tx ty tz qx qy qz qw)
+ *  - keyframes/: the keyframes, with their final poses
+ *  - map.pcd: the aggregate map (optional)
+ *
+ * The parameters of the VO and the mapper are read from the same
+ * private namespace. The param server is still required, but no
+ * topics, services or tf are used for the processing itself.
+ */
+class BatchMapper
+{
+  public:
+
+    /** @brief Constructor from ROS nodehandles
+     * @param nh the public nodehandle
+     * @param nh_private the private nodehandle
+     */
+    BatchMapper(const ros::NodeHandle& nh,
+                const ros::NodeHandle& nh_private);
+
+    /** @brief Default destructor
+     */
+    virtual ~BatchMapper();
+
+    /** @brief Processes the whole input, and writes the outputs
+     * @retval true  Successfully processed the input
+     * @retval false The input could not be read, or saving failed
+     */
+    bool run();
+
+  private:
+
+    // **** ROS-related
+
+    ros::NodeHandle nh_;                ///< the public nodehandle
+    ros::NodeHandle nh_private_;        ///< the private nodehandle
+
+    // **** parameters
+
+    std::string input_;        ///< the input bag (.bag) or RGBD recording
+    std::string output_path_;  ///< the output directory
+
+    std::string rgb_topic_;    ///< RGB topic in the bag
+    std::string depth_topic_;  ///< depth topic in the bag
+    std::string info_topic_;   ///< camera info topic in the bag
+
+    int queue_size_;           ///< synchronizer queue size
+    bool solve_graph_;         ///< whether to generate and solve the keyframe graph
+    bool save_pcd_map_;        ///< whether to save the aggregate map as map.pcd
+
+    // **** variables
+
+    boost::shared_ptr<VisualOdometry> visual_odometry_; ///< the VO, driven in-process
+    boost::shared_ptr<KeyframeMapper> keyframe_mapper_; ///< the mapper, driven in-process
+
+    RGBDFrameFactory frame_factory_; ///< Creates (and recycles) the mapper frames
+
+    tf::Transformer bag_tf_;  ///< the transforms recorded in the bag
+    bool initialized_;        ///< whether the base to camera tf was set
+
+    FILE * trajectory_file_;  ///< the output trajectory
+
+    int frame_count_;         ///< number of frames processed
+    int keyframe_count_;      ///< number of keyframes inserted
+
+    // **** private functions
+
+    /** @brief Initializes all the parameters from the ROS param server
+     */
+    void initParams();
+
+    /** @brief Feeds the frames of a bag to RGBDCallback
+     */
+    bool processBag();
+
+    /** @brief Feeds the frames of an RGBD recording to RGBDCallback
+     */
+    bool processRecording();
+
+    /** @brief Processes a frame with the VO, then the mapper
+     *
+     * @param rgb_msg RGB message (8UC3 or mono8)
+     * @param depth_msg Depth message (16UC1 in mm, or 32FC1 in m)
+     * @param info_msg CameraInfo message, applies to both RGB and depth images
+     */
+    void RGBDCallback(const ImageMsg::ConstPtr& rgb_msg,
+                      const ImageMsg::ConstPtr& depth_msg,
+                      const CameraInfoMsg::ConstPtr& info_msg);
+
+    /** @brief Sets the VO base to camera transform from the bag transforms
+     * (or identity, if there are none)
+     */
+    void initBaseToCameraTf(const std_msgs::Header& header);
+
+    /** @brief Writes out the keyframes (and optionally the map)
+     */
+    bool saveOutputs();
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_BATCH_MAPPER_H
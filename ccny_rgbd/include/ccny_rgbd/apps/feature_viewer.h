@@ -33,7 +33,9 @@
 
 #include "ccny_rgbd/types.h"
 #include "ccny_rgbd/rgbd_util.h"
+#include "ccny_rgbd/covariance_marker_publisher.h"
 #include "ccny_rgbd/structures/rgbd_frame.h"
+#include "ccny_rgbd/structures/rgbd_frame_factory.h"
 #include "ccny_rgbd/features/feature_detector.h"
 #include "ccny_rgbd/features/orb_detector.h"
 #include "ccny_rgbd/features/surf_detector.h"
@@ -129,15 +131,26 @@ class FeatureViewer
     
     /** @brief If true, publish the covariance markers
      * 
-     * Note: this might decrease performance
+     * The markers are built in a background thread
      */
     bool publish_covariances_;
+
+    double covariances_rate_; ///< maximum covariance marker rate, in Hz
  
     // **** variables
 
     boost::mutex mutex_; ///< state mutex
     int  frame_count_; ///< RGBD frame counter
 
+    bool cloud_subscribed_;       ///< Whether the cloud topic has any subscribers
+    bool covariances_subscribed_; ///< Whether the covariance topic has any subscribers
+
+    /** @brief Builds the covariance markers off the callback thread
+     */
+    boost::shared_ptr<CovarianceMarkerPublisher> covariance_marker_publisher_;
+
+    RGBDFrameFactory frame_factory_; ///< Creates (and recycles) the RGBD frames
+
     FeatureDetectorPtr feature_detector_; ///< The feature detector object
 
     // **** private functions
@@ -177,6 +190,12 @@ class FeatureViewer
      * Note: this might decrease performance
      */
     void showKeypointImage(RGBDFrame& frame);
+
+    /** @brief Called when a subscriber connects to or disconnects from
+     * the cloud or covariance topics. The outputs are only built when
+     * there are subscribers.
+     */
+    void connectCallback();
     
     /** @brief ROS dynamic reconfigure callback function
      */
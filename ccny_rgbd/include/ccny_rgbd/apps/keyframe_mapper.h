@@ -32,16 +32,31 @@
 #include <pcl/filters/passthrough.h>
 #include <tf/transform_listener.h>
 #include <visualization_msgs/Marker.h>
+#include <geometry_msgs/PointStamped.h>
 #include <boost/regex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <octomap/octomap.h>
 #include <octomap/OcTree.h>
 #include <octomap/ColorOcTree.h>
 
 #include "ccny_rgbd/types.h"
 #include "ccny_rgbd/structures/rgbd_frame.h"
+#include "ccny_rgbd/structures/rgbd_frame_factory.h"
 #include "ccny_rgbd/structures/rgbd_keyframe.h"
+#include "ccny_rgbd/structures/keyframe_journal.h"
 #include "ccny_rgbd/mapping/keyframe_graph_detector.h"
 #include "ccny_rgbd/mapping/keyframe_graph_solver_g2o.h"
+#include "ccny_rgbd/mapping/tsdf_volume.h"
+#include "ccny_rgbd/mapping/surfel_map.h"
+#include "ccny_rgbd/mapping/map_query.h"
+#include "ccny_rgbd/mapping/occupancy_grid_2d.h"
+#include "ccny_rgbd/mapping/sharded_octree_builder.h"
+#include "ccny_rgbd/mapping/octree_util.h"
+#include "ccny_rgbd/mapping/submap_manager.h"
+#include "ccny_rgbd/mapping/tiled_map.h"
+#include "ccny_rgbd/mapping/map_streamer.h"
 
 #include "ccny_rgbd/GenerateGraph.h"
 #include "ccny_rgbd/SolveGraph.h"
@@ -50,6 +65,10 @@
 #include "ccny_rgbd/PublishKeyframes.h"
 #include "ccny_rgbd/Save.h"
 #include "ccny_rgbd/Load.h"
+#include "ccny_rgbd/QueryOccupancy.h"
+#include "ccny_rgbd/CastRays.h"
+#include "ccny_rgbd/QueryDistance.h"
+#include "ccny_rgbd/LoadMapRegion.h"
 
 namespace ccny_rgbd {
 
@@ -85,6 +104,19 @@ class KeyframeMapper
      */
     void initParams();
 
+    /** @brief processes an incoming RGBD frame with a given pose,
+     * and determines whether a keyframe should be inserted
+     * 
+     * Called by the subscription callback, or directly by in-process
+     * users (such as the batch mapper).
+     * 
+     * @param frame the incoming RGBD frame (image)
+     * @param pose the pose of the camera frame when RGBD image was taken
+     * @retval true a keyframe was inserted
+     * @retval false no keyframe was inserted
+     */
+    bool processFrame(const RGBDFrame& frame, const tf::Transform& pose);
+
     /** @brief ROS callback to publish keyframes as point clouds
      * 
      * The argument should be a regular expression string matching the
@@ -115,6 +147,11 @@ class KeyframeMapper
      * 
      * The argument should be a string with the directory where to save
      * the keyframes.
+     * 
+     * With a journal (see \ref journal_path_), the directory only gets
+     * a compacted copy of the journal (keyframes.journal), instead of 
+     * one subdirectory per keyframe. load_keyframes reads both formats,
+     * but other tools only read the subdirectories.
      */
     bool saveKeyframesSrvCallback(
       Save::Request& request,
@@ -144,6 +181,75 @@ class KeyframeMapper
       Save::Request& request,
       Save::Response& response);
     
+    /** @brief ROS callback to create a TSDF mesh of the map and save it
+     * to a .ply file.
+     * 
+     * The live TSDF volume is used if there is one (see 
+     * \ref tsdf_integration_), otherwise a volume is built from all
+     * the keyframes. The resolution is controlled via the 
+     * \ref tsdf_res_ parameter.
+     * 
+     * The argument should be the path to the .ply file
+     */
+    bool saveMeshSrvCallback(
+      Save::Request& request,
+      Save::Response& response);
+    
+    /** @brief ROS callback to save the surfel map to a .ply file.
+     * 
+     * The live surfel map is used if there is one (see 
+     * \ref surfel_map_), otherwise the surfels are fused from all
+     * the keyframes.
+     * 
+     * The argument should be the path to the .ply file
+     */
+    bool saveSurfelMapSrvCallback(
+      Save::Request& request,
+      Save::Response& response);
+
+    /** @brief ROS callback to save the pcd map as a tiled map: one
+     * .pcd file per tile of \ref map_tile_size_ meters, and an index.
+     * 
+     * The argument should be the path to the map directory
+     */
+    bool saveTiledMapSrvCallback(
+      Save::Request& request,
+      Save::Response& response);
+
+    /** @brief ROS callback to load the tiles of a tiled map which 
+     * overlap a box, and publish them on the map_region topic
+     */
+    bool loadMapRegionSrvCallback(
+      LoadMapRegion::Request& request,
+      LoadMapRegion::Response& response);
+    
+    /** @brief ROS callback for batched occupancy lookups in the 
+     * live query map (see \ref query_map_)
+     */
+    bool queryOccupancySrvCallback(
+      QueryOccupancy::Request& request,
+      QueryOccupancy::Response& response);
+
+    /** @brief ROS callback for batched ray casts in the live query map
+     */
+    bool castRaysSrvCallback(
+      CastRays::Request& request,
+      CastRays::Response& response);
+
+    /** @brief ROS callback for batched distances to the nearest occupied
+     * voxel of the live query map
+     */
+    bool queryDistanceSrvCallback(
+      QueryDistance::Request& request,
+      QueryDistance::Response& response);
+
+    /** @brief In-process access to the live query map.
+     * 
+     * The map is updated by the mapper's callbacks, so queries should
+     * be made from the same thread.
+     */
+    const MapQuery& getMapQuery() const { return map_query_; }
+
     /** @brief ROS callback load keyframes from disk
      * 
      * The argument should be a string with the directory pointing to 
@@ -205,6 +311,17 @@ class KeyframeMapper
     ros::Publisher poses_pub_;        ///< ROS publisher for the keyframe poses
     ros::Publisher kf_assoc_pub_;     ///< ROS publisher for the keyframe associations
     ros::Publisher path_pub_;         ///< ROS publisher for the keyframe path
+    ros::Publisher grid_map_pub_;     ///< ROS publisher for the 2D occupancy grid (latched)
+    ros::Publisher grid_tiles_pub_;   ///< ROS publisher for the changed 2D grid tiles
+    ros::Publisher map_region_pub_;   ///< ROS publisher for the loaded tiled map regions
+    ros::Publisher map_stream_pub_;   ///< ROS publisher for the map stream chunks
+
+    /** @brief ROS subscriber for the focus of the map stream (the 
+     * viewer's camera, or a region of interest) */
+    ros::Subscriber stream_focus_sub_;
+
+    /** @brief Timer which sends the map stream */
+    ros::Timer stream_timer_;
     
     /** @brief ROS service to generate the graph correpondences */
     ros::ServiceServer generate_graph_service_;
@@ -227,6 +344,23 @@ class KeyframeMapper
     /** @brief ROS service to save octomap to disk */
     ros::ServiceServer save_octomap_service_;
     
+    /** @brief ROS service to save the TSDF mesh to disk */
+    ros::ServiceServer save_mesh_service_;
+    
+    /** @brief ROS service to save the surfel map to disk */
+    ros::ServiceServer save_surfel_map_service_;
+
+    /** @brief ROS service to save the map as tiles to disk */
+    ros::ServiceServer save_tiled_map_service_;
+
+    /** @brief ROS service to load a region of a tiled map */
+    ros::ServiceServer load_map_region_service_;
+    
+    /** @brief ROS services to query the live map */
+    ros::ServiceServer query_occupancy_service_;
+    ros::ServiceServer cast_rays_service_;
+    ros::ServiceServer query_distance_service_;
+    
     /** @brief ROS service to load all keyframes from disk */
     ros::ServiceServer load_kf_service_;
     
@@ -235,6 +369,8 @@ class KeyframeMapper
 
     tf::TransformListener tf_listener_; ///< ROS transform listener
 
+    RGBDFrameFactory frame_factory_; ///< Creates (and recycles) the RGBD frames
+
     /** @brief Image transport for RGB message subscription */
     boost::shared_ptr<ImageTransport> rgb_it_;
     
@@ -259,26 +395,138 @@ class KeyframeMapper
     double kf_dist_eps_;  ///< linear distance threshold between keyframes
     double kf_angle_eps_; ///< angular distance threshold between keyframes
     bool octomap_with_color_; ///< whetehr to save Octomaps with color info      
+    double octomap_shard_size_; ///< side of the octomap shards built in parallel (in meters)
+    int octomap_n_threads_;     ///< octomap building threads (0 = number of cores)
+    /** @brief Whether to cast one octomap ray per unique end point leaf 
+     * (faster) instead of one per point. Rays then go to leaf centers 
+     * rather than to the measured points, so the maps differ slightly. */
+    bool octomap_discretize_;
+    double octomap_max_range_;  ///< octomap rays are cut at this length (in meters, negative = unlimited)
     double max_map_z_;   ///< maximum z (in fixed frame) when exporting maps.
+
+    /** @brief File of the keyframe journal (empty = no journal).
+     * 
+     * If the file exists on startup, the keyframes are recovered from it.
+     */
+    std::string journal_path_;
+    int journal_queue_size_; ///< maximum number of records waiting to be journaled
+
+    bool save_depth_rvl_; ///< whether to save keyframe depth images as RVL (or png)
+
+    double tsdf_res_;        ///< TSDF voxel size (in meters)
+    double tsdf_trunc_;      ///< TSDF truncation distance (in meters)
+    double tsdf_max_weight_; ///< TSDF maximum integration weight
+    int tsdf_n_threads_;     ///< TSDF integration threads (0 = number of cores)
+
+    /** @brief What is integrated into the live TSDF volume as the 
+     * mapper runs:
+     *  - "none": no live volume, it is built from the keyframes on demand
+     *  - "keyframes": every new keyframe
+     *  - "frames": every incoming frame
+     */
+    std::string tsdf_integration_;
+
+    /** @brief Whether to keep a live surfel map, which fuses each new 
+     * keyframe, and is deformed after the graph is solved
+     */
+    bool surfel_map_;
+    int surfel_pixel_step_;        ///< one surfel measurement every n pixels
+    double surfel_assoc_dist_;     ///< surfel association distance (in meters)
+    double surfel_assoc_angle_;    ///< surfel association angle (in radians)
+    double surfel_min_confidence_; ///< surfels below this confidence are not saved
+
+    /** @brief Whether to keep a live occupancy octree (at \ref octomap_res_)
+     * for the map query services. Each new keyframe is inserted, and
+     * the octree is rebuilt after the graph is solved.
+     */
+    bool query_map_;
+    double query_max_distance_; ///< distance queries are capped at this value (in meters)
+
+    /** @brief Whether to keep a live 2D occupancy grid, projected from 
+     * the keyframes (between \ref grid_min_z_ and \ref max_map_z_).
+     * After the graph is solved, only the keyframes which moved are 
+     * re-projected.
+     */
+    bool grid_map_;
+    double grid_res_;   ///< 2D grid cell size (in meters)
+    double grid_min_z_; ///< points below this z (in fixed frame) are floor
+
+    /** @brief Number of consecutive keyframes fused into each submap 
+     * of the pcd map (0 = no submaps). The submaps move with their 
+     * anchor keyframes, so the map is not rebuilt after the graph
+     * is solved.
+     */
+    int submap_size_;
+
+    double map_tile_size_; ///< side of the tiles of tiled maps (in meters)
+
+    /** @brief Whether to stream the pcd map on the map_stream topic, 
+     * at several levels of detail, coarse levels first, then finer 
+     * levels around the stream focus. Only the changed parts of 
+     * the map are sent again.
+     */
+    bool stream_map_;
+    double stream_res_;           ///< voxel size of the finest stream level (in meters)
+    int stream_levels_;           ///< number of stream levels of detail
+    double stream_focus_radius_;  ///< radius of the finest level around the focus (in meters)
+    double stream_rate_;          ///< rate at which stream chunks are sent (in Hz)
+    int stream_bandwidth_;        ///< stream budget (in bytes per second)
+    double stream_update_period_; ///< minimum time between stream map updates (in seconds)
           
     // state vars
     bool manual_add_;   ///< flag indicating whetehr a manual add has been requested
 
+    bool keyframes_subscribed_;  ///< whether the keyframe cloud topic has subscribers
+    bool poses_subscribed_;      ///< whether the keyframe pose topic has subscribers
+    bool kf_assoc_subscribed_;   ///< whether the association topic has subscribers
+    bool path_subscribed_;       ///< whether the keyframe path topic has subscribers
+    bool grid_map_subscribed_;   ///< whether the 2D grid topic has subscribers
+    bool grid_tiles_subscribed_; ///< whether the 2D grid tile topic has subscribers
+    int stream_subscribers_;     ///< number of subscribers of the map stream topic
+
+    bool stream_map_changed_;        ///< whether the map changed since it was last streamed
+    bool stream_focus_received_;     ///< whether a viewer sent a stream focus
+    ros::Time stream_map_time_;      ///< when the streamed map was last updated
+
+    boost::thread stream_thread_;           ///< rebuilds the streamed map
+    boost::mutex stream_mutex_;             ///< guards the stream snapshot and flags
+    boost::condition_variable stream_cond_; ///< signals a pending stream snapshot
+    bool stream_running_;                   ///< cleared on destruction to stop the stream thread
+    bool stream_pending_;                   ///< whether a snapshot waits for (or is in) a rebuild
+
+    /** @brief Images, camera models and poses of the keyframes, 
+     * for the stream thread */
+    KeyframeVector stream_keyframes_;
+
     KeyframeGraphDetector graph_detector_;  ///< builds graph from the keyframes
     KeyframeGraphSolver * graph_solver_;    ///< optimizes the graph for global alignement
 
     KeyframeAssociationVector associations_; ///< keyframe associations that form the graph
+
+    /** @brief Streams the keyframes and pose updates to disk */
+    boost::shared_ptr<KeyframeJournal> journal_;
+
+    /** @brief The live TSDF volume (if \ref tsdf_integration_ is not "none") */
+    boost::shared_ptr<TSDFVolume> tsdf_;
+
+    /** @brief The live surfel map (if \ref surfel_map_ is set) */
+    boost::shared_ptr<SurfelMap> surfels_;
+
+    /** @brief The live occupancy octree (if \ref query_map_ is set) */
+    boost::shared_ptr<octomap::OcTree> query_tree_;
     
-    PathMsg path_msg_;    /// < contains a vector of positions of the camera (not base) pose
+    MapQuery map_query_; ///< answers queries on \ref query_tree_
+
+    /** @brief The live 2D occupancy grid (if \ref grid_map_ is set) */
+    boost::shared_ptr<OccupancyGrid2D> grid_;
+
+    /** @brief The submaps of the pcd map (if \ref submap_size_ is set) */
+    boost::shared_ptr<SubmapManager> submaps_;
+
+    /** @brief The map streamer (if \ref stream_map_ is set) */
+    boost::shared_ptr<MapStreamer> streamer_;
     
-    /** @brief processes an incoming RGBD frame with a given pose,
-     * and determines whether a keyframe should be inserted
-     * @param frame the incoming RGBD frame (image)
-     * @param pose the pose of the base frame when RGBD image was taken
-     * @retval true a keyframe was inserted
-     * @retval false no keyframe was inserted
-     */
-    bool processFrame(const RGBDFrame& frame, const tf::Transform& pose);
+    PathMsg path_msg_;    /// < contains a vector of positions of the camera (not base) pose
     
     /** @brief creates a keyframe from an RGBD frame and inserts it in
      * the keyframe vector.
@@ -308,6 +556,12 @@ class KeyframeMapper
     /** @brief Publishes all the path message
      */
     void publishPath();
+
+    /** @brief Called when a subscriber connects to or disconnects from
+     * any of the output topics. Outputs are only built when there
+     * are subscribers.
+     */
+    void connectCallback();
     
     /** @brief Save the full map to disk as pcd
      * @param path path to save the map to
@@ -332,6 +586,100 @@ class KeyframeMapper
      * @param tree reference to the octomap octree
      */
     void buildOctomap(octomap::OcTree& tree);
+
+    /** @brief Save a TSDF mesh of the map to disk as ply
+     * @param path path to save the mesh to
+     * @retval true save was successful
+     * @retval false save failed.
+     */
+    bool saveMesh(const std::string& path);
+
+    /** @brief Integrates all keyframes into a TSDF volume
+     * @param volume the TSDF volume
+     */
+    void buildTSDF(TSDFVolume& volume);
+
+    /** @brief Rebuilds the live TSDF volume (if any) from the keyframes,
+     * after their poses changed or they were replaced
+     */
+    void rebuildLiveTSDF();
+
+    /** @brief Fuses all keyframes into a surfel map, with the keyframe
+     * indices as anchors
+     * @param map the surfel map
+     */
+    void buildSurfelMap(SurfelMap& map);
+    
+    /** @brief Builds the octomap scan of a keyframe
+     * @param keyframe the keyframe
+     * @param scan the scan end points, in the keyframe (camera) frame
+     */
+    void buildKeyframeScan(const RGBDKeyframe& keyframe, octomap::Pointcloud& scan);
+
+    /** @brief Inserts the scan of a keyframe into an octomap octree
+     * @param tree reference to the octomap octree
+     * @param keyframe the keyframe
+     */
+    void insertKeyframeScan(octomap::OcTree& tree, const RGBDKeyframe& keyframe);
+
+    /** @brief Restores the keyframe associations saved with the keyframes
+     * 
+     * The associations are cleared if the file does not exist or can 
+     * not be read. Associations which reference keyframes that were not 
+     * loaded are dropped.
+     * 
+     * @param filename the associations file
+     */
+    void loadAssociations(const std::string& filename);
+
+    /** @brief Rebuilds the live query octree (if any) from the keyframes,
+     * after their poses changed or they were replaced
+     */
+    void rebuildQueryMap();
+
+    /** @brief Projects the scan of a keyframe into the live 2D grid,
+     * replacing its previous projection
+     * @param kf_idx the keyframe index
+     */
+    void insertGridScan(int kf_idx);
+
+    /** @brief Re-projects the keyframes which are new to the live 2D 
+     * grid, or moved since they were projected, and publishes the changes
+     */
+    void updateGrid();
+
+    /** @brief Publishes the changed tiles and the full 2D grid, if 
+     * they have subscribers
+     */
+    void publishGrid();
+
+    /** @brief Publishes the full 2D grid
+     */
+    void publishGridMap();
+
+    /** @brief Sets the focus of the map stream
+     * @param focus_msg a point, in any frame which can be transformed
+     *        to the fixed frame
+     */
+    void streamFocusCallback(const geometry_msgs::PointStamped::ConstPtr& focus_msg);
+
+    /** @brief Hands the keyframes to the stream thread if the map 
+     * changed, and sends the next chunks within the stream budget
+     */
+    void streamTimerCallback(const ros::TimerEvent& event);
+
+    /** @brief Main loop of the stream thread: rebuilds the streamed 
+     * map from the latest keyframe snapshot
+     */
+    void spinStream();
+
+    /** @brief Builds the map to stream from a keyframe snapshot. 
+     * Each keyframe is downsampled to the finest stream level first.
+     * @param keyframes the keyframe snapshot
+     * @param map_cloud the output map, in the fixed frame
+     */
+    void buildStreamMap(const KeyframeVector& keyframes, 
+                        PointCloudT& map_cloud) const;
     
     /** @brief Builds an octomap octree from all keyframes, with color
      * @param tree reference to the octomap octree
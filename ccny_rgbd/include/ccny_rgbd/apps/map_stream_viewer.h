@@ -0,0 +1,91 @@
+/**
+ *  @file map_stream_viewer.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_MAP_STREAM_VIEWER_H
+#define CCNY_RGBD_MAP_STREAM_VIEWER_H
+
+#include <ros/ros.h>
+#include <pcl_ros/point_cloud.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/mapping/map_stream_assembler.h"
+
+namespace ccny_rgbd {
+
+/** @brief Receives the map stream of a KeyframeMapper, and 
+ * republishes the reassembled map as a point cloud (for example, 
+ * for rviz on a remote machine).
+ */
+class MapStreamViewer
+{
+  public:
+
+    /** @brief Constructor from ROS nodehandles
+     * @param nh the public nodehandle
+     * @param nh_private the private nodehandle
+     */
+    MapStreamViewer(const ros::NodeHandle& nh,
+                    const ros::NodeHandle& nh_private);
+
+    /** @brief Default destructor
+     */
+    virtual ~MapStreamViewer();
+
+  private:
+
+    // **** ROS-related
+
+    ros::NodeHandle nh_;                ///< the public nodehandle
+    ros::NodeHandle nh_private_;        ///< the private nodehandle
+
+    ros::Subscriber stream_sub_;        ///< ROS subscriber for the map stream chunks
+    ros::Publisher cloud_pub_;          ///< ROS publisher for the reassembled map
+    ros::Timer publish_timer_;          ///< Timer which publishes the reassembled map
+
+    // **** parameters
+
+    double publish_rate_;  ///< rate at which the map is republished (in Hz)
+
+    // **** variables
+
+    MapStreamAssembler assembler_;  ///< the received map
+    bool changed_;                  ///< whether chunks arrived since the last publish
+
+    // **** private functions
+
+    /** @brief Initializes all the parameters from the ROS param server
+     */
+    void initParams();
+
+    /** @brief Stores a received chunk
+     */
+    void streamCallback(const MapStreamChunk::ConstPtr& chunk_msg);
+
+    /** @brief Publishes the reassembled map, if it changed
+     */
+    void publishTimerCallback(const ros::TimerEvent& event);
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_MAP_STREAM_VIEWER_H
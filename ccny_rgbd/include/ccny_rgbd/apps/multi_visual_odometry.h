@@ -0,0 +1,91 @@
+/**
+ *  @file multi_visual_odometry.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_MULTI_VISUAL_ODOMETRY_H
+#define CCNY_RGBD_MULTI_VISUAL_ODOMETRY_H
+
+#include <ros/ros.h>
+
+#include "ccny_rgbd/apps/visual_odometry.h"
+
+namespace ccny_rgbd {
+
+/** @brief Runs visual odometry on several independent RGBD streams
+ * in one process.
+ *
+ * Each stream is a VisualOdometry instance in its own namespace, 
+ * with its own feature model and pose: it subscribes to 
+ * [stream]/rgbd/*, publishes [stream]/vo, etc., and reads its 
+ * parameters from ~[stream]/.
+ *
+ * All the streams share one pool of spinner threads. A thread takes
+ * whichever callback is ready next, so a busy stream does not hold 
+ * up the others. Each stream can set its own latency target 
+ * (~[stream]/max_latency), beyond which it drops frames.
+ */
+class MultiVisualOdometry
+{
+  public:
+
+    /** @brief Constructor from ROS nodehandles
+     * @param nh the public nodehandle
+     * @param nh_private the private nodehandle
+     */
+    MultiVisualOdometry(const ros::NodeHandle& nh,
+                        const ros::NodeHandle& nh_private);
+
+    /** @brief Default destructor
+     */
+    virtual ~MultiVisualOdometry();
+
+  private:
+
+    // **** ROS-related
+
+    ros::NodeHandle nh_;                ///< the public nodehandle
+    ros::NodeHandle nh_private_;        ///< the private nodehandle
+
+    /** @brief The shared pool of spinner threads */
+    boost::shared_ptr<ros::AsyncSpinner> spinner_;
+
+    // **** parameters
+
+    std::vector<std::string> stream_names_; ///< the stream namespaces
+
+    int n_threads_; ///< number of spinner threads (0 = one per core)
+
+    // **** variables
+
+    /** @brief The VO of each stream */
+    std::vector<boost::shared_ptr<VisualOdometry> > streams_;
+
+    // **** private functions
+
+    /** @brief Initializes all the parameters from the ROS param server
+     */
+    void initParams();
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_MULTI_VISUAL_ODOMETRY_H
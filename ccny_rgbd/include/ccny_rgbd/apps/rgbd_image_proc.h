@@ -24,8 +24,13 @@
 #ifndef CCNY_RGBD_RGBD_IMAGE_PROC_H
 #define CCNY_RGBD_RGBD_IMAGE_PROC_H
 
+#include <fstream>
+#include <unistd.h>
 #include <ros/ros.h>
 #include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <opencv2/opencv.hpp>
 #include <cv_bridge/cv_bridge.h>
 #include <pcl/point_cloud.h>
@@ -35,10 +40,85 @@
 #include "ccny_rgbd/types.h"
 #include "ccny_rgbd/rgbd_util.h"
 #include "ccny_rgbd/proc_util.h"
+#include "ccny_rgbd/parallel_for.h"
 #include "ccny_rgbd/RGBDImageProcConfig.h"
 
 namespace ccny_rgbd {
 
+/** @brief The rectification state derived from the calibration and the
+ * image size: undistortion maps, rectified unwarp coefficients and the 
+ * optimal new camera matrices. 
+ */
+struct RectificationMaps
+{
+  cv::Size size_in;   ///< size of the incoming images
+  double scale;       ///< resampling scale the maps were built for
+  
+  /** @brief RGB rectification maps */
+  cv::Mat map_rgb_1, map_rgb_2;
+  
+  /** @brief Depth rectification maps */
+  cv::Mat map_depth_1, map_depth_2;
+  
+  /** @brief depth unwarp polynomial coefficient matrices,
+   * after recitfication and resizing
+   */
+  cv::Mat coeff_0_rect, coeff_1_rect, coeff_2_rect;
+  
+  /** @brief optimal intrinsics after rectification */
+  cv::Mat intr_rect_rgb, intr_rect_depth;
+  
+  /** @brief RGB CameraInfo derived from optimal matrices */
+  CameraInfoMsg rgb_rect_info_msg;   
+  
+  /** @brief Depth CameraInfo derived from optimal matrices */
+  CameraInfoMsg depth_rect_info_msg; 
+};
+
+typedef boost::shared_ptr<RectificationMaps> RectificationMapsPtr;
+
+/** @brief A frame after rectification, with everything needed to 
+ * build and publish its outputs.
+ */
+struct RectifiedFrame
+{
+  RectificationMapsPtr maps;   ///< the maps the frame was rectified with
+
+  cv::Mat rgb_img_rect;        ///< rectified rgb image
+  cv::Mat depth_img_rect_reg;  ///< rectified depth image, registered to rgb
+
+  std_msgs::Header rgb_header;    ///< header of the rgb image
+  std_msgs::Header depth_header;  ///< header of the depth image
+  std_msgs::Header info_header;   ///< header of the camera info and cloud
+  std::string rgb_encoding;       ///< encoding of the rgb image
+  std::string depth_encoding;     ///< encoding of the depth image
+
+  // **** outputs, decided when the frame arrives
+
+  bool cloud;            ///< whether to build and publish the cloud
+
+  /** @brief Copy of the cloud publisher, since reconfiguration may 
+   * replace or shut down \ref RGBDImageProc::cloud_publisher_ while 
+   * the frame is being published */
+  ros::Publisher cloud_publisher;
+
+  bool cloud_organized;  ///< see \ref RGBDImageProc::cloud_organized_
+  bool cloud_compact;    ///< see \ref RGBDImageProc::cloud_compact_
+  int pyramid_levels;    ///< number of pyramid levels to publish
+
+  // **** durations, in ms
+
+  double dur_rgb;        ///< rgb rectification
+  double dur_rectify;    ///< depth rectification
+  double dur_unwarp;     ///< depth unwarping
+  double dur_reproject;  ///< depth registration
+  double dur_branches;   ///< the rgb and depth branches together
+};
+
+typedef boost::shared_ptr<RectifiedFrame> RectifiedFramePtr;
+
+class RectifyBranches;
+
 /** @brief Processes the raw output of OpenNI sensors to create
  * a stream of RGB-D images.
  * 
@@ -52,9 +132,27 @@ namespace ccny_rgbd {
  * The app then publishes the resulting pair of RGB and depth images, together
  * with a camera info which has no distortion, and the optimal new camera matrix
  * for both images.
+ * 
+ * Optionally, the app also publishes a pyramid of the output images (see
+ * \ref pyramid_levels_ param). Level N is published on rgbd/pyrN/rgb,
+ * rgbd/pyrN/depth and rgbd/pyrN/info, and is half the size of level N-1.
+ * Levels are only computed when they (or a deeper level) have subscribers.
+ * 
+ * The rectification maps are built in a background thread, whenever the 
+ * image size or the scale changes. The previous maps stay in use until 
+ * the new ones are ready. Built maps are cached on disk (see 
+ * \ref maps_cache_path_ param), keyed by a hash of the calibration and
+ * the output size.
+ * 
+ * The rgb and the depth images are rectified concurrently, since they 
+ * are independent until the cloud is built. The cloud, the output 
+ * messages and the pyramid are then built and published on an output 
+ * thread, while the next frame is rectified (see \ref parallel_ param).
  */    
 class RGBDImageProc 
 {
+  friend class RectifyBranches;
+
   typedef RGBDImageProcConfig ProcConfig;
   typedef dynamic_reconfigure::Server<ProcConfig> ProcConfigServer;
   
@@ -104,6 +202,10 @@ class RGBDImageProc
     ImagePublisher depth_publisher_;    ///< ROS depth image publisher
     ros::Publisher info_publisher_;     ///< ROS camera info publisher
     ros::Publisher cloud_publisher_;    ///< ROS PointCloud publisher
+
+    std::vector<ImagePublisher> pyr_rgb_publishers_;   ///< rgb publishers for pyramid levels 1..N-1
+    std::vector<ImagePublisher> pyr_depth_publishers_; ///< depth publishers for pyramid levels 1..N-1
+    std::vector<ros::Publisher> pyr_info_publishers_;  ///< info publishers for pyramid levels 1..N-1
     
     ProcConfigServer config_server_;    ///< ROS dynamic reconfigure server
     
@@ -115,6 +217,23 @@ class RGBDImageProc
     bool verbose_;             ///< Whether to print the rectification and unwarping messages
     bool unwarp_;             ///< Whether to perform depth unwarping based on polynomial model
     bool publish_cloud_;      ///< Whether to calculate and publish the dense PointCloud
+    bool cloud_organized_;    ///< Whether the PointCloud keeps the image layout (with NaNs)
+    bool cloud_compact_;      ///< Whether the PointCloud stores int16 x_mm, y_mm, z_mm instead of float32 x, y, z
+
+    /** @brief Whether to rectify the rgb and depth images concurrently,
+     * and to build the outputs on a separate thread, pipelined with the
+     * next frame
+     */
+    bool parallel_;
+
+    /** @brief Number of pyramid levels, including the full resolution 
+     * output. 1 disables the pyramid.
+     */
+    int pyramid_levels_;
+
+    /** @brief Depth pooling mode for the pyramid (see \ref DepthPoolMode)
+     */
+    int pyramid_pool_mode_;
     
     /** @brief Downasampling scale (0, 1]. For example, 
      * 2.0 will result in an output image half the size of the input
@@ -131,9 +250,15 @@ class RGBDImageProc
      */
     std::string calib_warp_filename_;
    
+    /** @brief Directory for cached rectification maps. Empty 
+     * disables the cache.
+     */
+    std::string maps_cache_path_;
+   
     // **** state variables
     
-    bool initialized_;      ///< whether we have initialized from the first image
+    bool cloud_subscribed_; ///< whether the cloud topic has any subscribers
+    int pyramid_levels_needed_; ///< number of pyramid levels with subscribers
     boost::mutex mutex_;    ///< state mutex
     
     // **** calibration
@@ -144,44 +269,105 @@ class RGBDImageProc
      */
     int fit_mode_;        
     
-    cv::Size size_in_; ///< Size of the incoming images. 
-    
     /** @brief depth unwarp polynomial coefficient matrices */
     cv::Mat coeff_0_, coeff_1_, coeff_2_;   
     
-    /** @brief depth unwarp polynomial coefficient matrices,
-     * after recitfication and resizing
-     */
-    cv::Mat coeff_0_rect_, coeff_1_rect_, coeff_2_rect_;  
-    
     /** @brief extrinsic matrix between IR and RGB camera */
     cv::Mat ir2rgb_;    
    
-    /** @brief optimal intrinsics after rectification */
-    cv::Mat intr_rect_rgb_, intr_rect_depth_;  
-    
-    /** @brief RGB CameraInfo derived from optimal matrices */
-    CameraInfoMsg rgb_rect_info_msg_;   
-    
-    /** @brief Depth CameraInfo derived from optimal matrices */
-    CameraInfoMsg depth_rect_info_msg_; 
-    
-    /** @brief RGB rectification maps */
-    cv::Mat map_rgb_1_,   map_rgb_2_;
-    
-    /** @brief Depth rectification maps */
-    cv::Mat map_depth_1_, map_depth_2_;
+    // **** rectification maps
+
+    /** @brief The maps currently in use. Swapped (under \ref mutex_) when 
+     * the background thread finishes building new ones.
+     */
+    RectificationMapsPtr maps_;
+
+    bool maps_building_;          ///< whether the map thread is running
+    boost::thread maps_thread_;   ///< background thread building the maps
+
+    // **** output thread
+
+    boost::mutex output_mutex_;          ///< guards the pending frame
+    boost::condition_variable output_cond_; ///< signals changes of the pending frame
+    boost::thread output_thread_;        ///< builds and publishes the outputs
+    bool output_running_;                ///< cleared on destruction to stop the output thread
+    RectifiedFramePtr output_frame_;     ///< frame waiting for the output thread
     
-    /** @brief Initializes the rectification maps from CameraInfo 
+    /** @brief Computes the rectification maps from CameraInfo 
      * messages
      * 
      * @param rgb_info_msg input camera info for RGB image
      * @param depth_info_msg input camera info for depth image
+     * @param maps the output maps; size_in and scale need to be set
      */
     void initMaps(
       const CameraInfoMsg::ConstPtr& rgb_info_msg,
-      const CameraInfoMsg::ConstPtr& depth_info_msg);
+      const CameraInfoMsg::ConstPtr& depth_info_msg,
+      RectificationMaps& maps);
+
+    /** @brief Entry point of the map thread: loads the maps from the 
+     * cache, or builds (and caches) them, then swaps them in.
+     * 
+     * @param rgb_info_msg input camera info for RGB image
+     * @param depth_info_msg input camera info for depth image
+     * @param size_in size of the incoming images
+     * @param scale the resampling scale
+     */
+    void buildMaps(
+      CameraInfoMsg::ConstPtr rgb_info_msg,
+      CameraInfoMsg::ConstPtr depth_info_msg,
+      cv::Size size_in,
+      double scale);
+
+    /** @brief Returns the cache file name for a set of maps, based 
+     * on a hash of everything the maps depend on
+     */
+    std::string getMapsCacheFilename(
+      const CameraInfoMsg& rgb_info_msg,
+      const CameraInfoMsg& depth_info_msg,
+      const cv::Size& size_in,
+      double scale);
+
+    /** @brief Loads rectification maps from a cache file
+     * @retval true the maps were loaded
+     * @retval false the file is missing or invalid
+     */
+    bool loadMapsFromCache(const std::string& filename, RectificationMaps& maps);
+
+    /** @brief Saves rectification maps to a cache file
+     * @retval true the maps were saved
+     * @retval false saving failed
+     */
+    bool saveMapsToCache(const std::string& filename, const RectificationMaps& maps);
     
+    /** @brief Rectifies the rgb image
+     * 
+     * @param rgb_img the input rgb image
+     * @param frame the frame, with the maps set
+     */
+    void rectifyRGB(const cv::Mat& rgb_img, RectifiedFrame& frame) const;
+
+    /** @brief Rectifies, unwarps and registers the depth image
+     * 
+     * @param depth_img the input depth image
+     * @param frame the frame, with the maps set
+     */
+    void rectifyDepth(const cv::Mat& depth_img, RectifiedFrame& frame) const;
+
+    /** @brief Hands a frame to the output thread. Waits if the previous
+     * frame was not taken yet, so at most one frame is pending.
+     */
+    void queueFrame(const RectifiedFramePtr& frame);
+
+    /** @brief Main loop of the output thread
+     */
+    void spinOutput();
+
+    /** @brief Builds and publishes the cloud, the images, the camera 
+     * info and the pyramid of a frame
+     */
+    void publishFrame(const RectifiedFrame& frame);
+
     /** @brief Loads intrinsic and extrinsic calibration 
      * info from files 
      */
@@ -194,6 +380,38 @@ class RGBDImageProc
     /** @brief ROS dynamic reconfigure callback function
      */
     void reconfigCallback(ProcConfig& config, uint32_t level);
+
+    /** @brief Advertises the cloud topic, with subscriber status callbacks
+     */
+    void advertiseCloud();
+
+    /** @brief Builds and publishes the pyramid levels which have subscribers
+     * 
+     * @param maps the rectification maps used for level 0
+     * @param n_levels number of levels, including level 0
+     * @param rgb_img_rect level 0 rgb image
+     * @param depth_img_rect_reg level 0 (registered) depth image
+     * @param rgb_header header for the rgb images and camera infos
+     * @param rgb_encoding encoding of the rgb images
+     * @param depth_header header for the depth images
+     * @param depth_encoding encoding of the depth images
+     */
+    void publishPyramid(
+      const RectificationMaps& maps,
+      int n_levels,
+      const cv::Mat& rgb_img_rect,
+      const cv::Mat& depth_img_rect_reg,
+      const std_msgs::Header& rgb_header,
+      const std::string& rgb_encoding,
+      const std_msgs::Header& depth_header,
+      const std::string& depth_encoding);
+
+    /** @brief Called when a subscriber connects to or disconnects from
+     * the cloud or pyramid topics. These outputs are only built when 
+     * there are subscribers. Takes \ref mutex_, since the nodelet may
+     * run it concurrently with the image and reconfigure callbacks.
+     */
+    void connectCallback();
 };
 
 } //namespace ccny_rgbd
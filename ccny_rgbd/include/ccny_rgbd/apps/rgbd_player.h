@@ -0,0 +1,129 @@
+/**
+ *  @file rgbd_player.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_RGBD_PLAYER_H
+#define CCNY_RGBD_RGBD_PLAYER_H
+
+#include <deque>
+#include <ros/ros.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/rgbd_recording.h"
+
+namespace ccny_rgbd {
+
+/** @brief Plays back a recording made by RGBDRecorder, on the
+ * same topics as RGBDImageProc.
+ *
+ * The frames are decoded ahead of time by a separate thread, so
+ * the playback rate is not limited by the decoding. The recording
+ * can be played back at a multiple of the real-time rate, or as
+ * fast as possible.
+ */
+class RGBDPlayer
+{
+  public:
+
+    /** @brief Constructor from ROS nodehandles
+     * @param nh the public nodehandle
+     * @param nh_private the private nodehandle
+     */
+    RGBDPlayer(const ros::NodeHandle& nh,
+               const ros::NodeHandle& nh_private);
+
+    /** @brief Default destructor
+     */
+    virtual ~RGBDPlayer();
+
+  private:
+
+    /** @brief A decoded frame, waiting to be published */
+    struct DecodedFrame
+    {
+      ImageMsg::Ptr rgb_msg;        ///< the RGB image
+      ImageMsg::Ptr depth_msg;      ///< the depth image
+      CameraInfoMsg::Ptr info_msg;  ///< the camera info, stamped like the RGB image
+    };
+
+    // **** ROS-related
+
+    ros::NodeHandle nh_;                ///< the public nodehandle
+    ros::NodeHandle nh_private_;        ///< the private nodehandle
+
+    ImageTransport rgb_image_transport_;   ///< ROS image transport for rgb message
+    ImageTransport depth_image_transport_; ///< ROS image transport for depth message
+
+    image_transport::Publisher rgb_publisher_;   ///< ROS rgb image publisher
+    image_transport::Publisher depth_publisher_; ///< ROS depth image publisher
+    ros::Publisher info_publisher_;              ///< ROS camera info publisher
+    ros::Publisher clock_publisher_;             ///< ROS clock publisher
+
+    // **** parameters
+
+    std::string filename_; ///< the input recording file
+    int queue_size_;       ///< Publisher queue size
+
+    /** @brief Playback rate, as a multiple of real time.
+     * A rate of 0 plays back as fast as possible. */
+    double rate_;
+
+    double start_;         ///< start time, in seconds from the first frame
+    bool publish_clock_;   ///< whether to publish the recording time on /clock
+    int prefetch_size_;    ///< number of frames decoded ahead
+
+    // **** variables
+
+    RGBDRecordingReader reader_; ///< the recording (used by the decoder thread only)
+
+    boost::thread decoder_thread_;  ///< reads and decodes the frames
+    boost::thread playback_thread_; ///< publishes the decoded frames
+
+    boost::mutex mutex_;              ///< guards the queue and the flags
+    boost::condition_variable cond_;  ///< signals changes of the queue
+
+    std::deque<DecodedFrame> decoded_; ///< frames decoded ahead
+    bool decoding_done_;               ///< whether the last frame was decoded
+    bool running_;                     ///< cleared to stop the threads
+
+    // **** private functions
+
+    /** @brief Initializes all the parameters from the ROS param server
+     */
+    void initParams();
+
+    /** @brief Main loop of the decoder thread
+     * @param first_frame index of the first frame to play back
+     */
+    void spinDecoder(unsigned int first_frame);
+
+    /** @brief Main loop of the playback thread
+     */
+    void spinPlayback();
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_RGBD_PLAYER_H
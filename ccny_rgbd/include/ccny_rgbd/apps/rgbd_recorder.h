@@ -0,0 +1,154 @@
+/**
+ *  @file rgbd_recorder.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_RGBD_RECORDER_H
+#define CCNY_RGBD_RGBD_RECORDER_H
+
+#include <map>
+#include <ros/ros.h>
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/rgbd_recording.h"
+
+namespace ccny_rgbd {
+
+/** @brief Records the RGBD output of RGBDImageProc to a compressed
+ * recording file.
+ *
+ * The frames are encoded (JPEG RGB, RVL depth) on a pool of
+ * threads, and written in order by a separate I/O thread, so the
+ * callback only queues the messages. When the encoders or the disk
+ * fall behind, and the queue is full, new frames are dropped.
+ */
+class RGBDRecorder
+{
+  public:
+
+    /** @brief Constructor from ROS nodehandles
+     * @param nh the public nodehandle
+     * @param nh_private the private nodehandle
+     */
+    RGBDRecorder(const ros::NodeHandle& nh,
+                 const ros::NodeHandle& nh_private);
+
+    /** @brief Default destructor. Writes out the queued frames
+     * and closes the recording.
+     */
+    virtual ~RGBDRecorder();
+
+  private:
+
+    /** @brief An encoded frame, waiting to be written */
+    struct EncodedFrame
+    {
+      RGBDRecordingFrame frame;          ///< the compressed images
+      CameraInfoMsg::ConstPtr info_msg;  ///< the camera info of the frame
+    };
+
+    typedef boost::shared_ptr<EncodedFrame> EncodedFramePtr;
+
+    // **** ROS-related
+
+    ros::NodeHandle nh_;                ///< the public nodehandle
+    ros::NodeHandle nh_private_;        ///< the private nodehandle
+
+    /** @brief Callback syncronizer */
+    boost::shared_ptr<RGBDSynchronizer3> sync_;
+
+    /** @brief RGB message subscriber */
+    ImageSubFilter      sub_rgb_;
+
+    /** @brief Depth message subscriber */
+    ImageSubFilter      sub_depth_;
+
+    /** @brief Camera info message subscriber */
+    CameraInfoSubFilter sub_info_;
+
+    // **** parameters
+
+    std::string filename_;  ///< the output recording file
+    int queue_size_;        ///< Subscription queue size
+    int jpeg_quality_;      ///< JPEG quality of the RGB images, 0 to 100
+    int n_threads_;         ///< number of encoder threads
+    int chunk_size_;        ///< number of frames per recording chunk
+    int max_queue_size_;    ///< max. number of frames being encoded or written
+
+    // **** variables
+
+    /** @brief The recording. Used by the I/O thread only. */
+    boost::shared_ptr<RGBDRecordingWriter> writer_;
+
+    boost::asio::io_service io_service_;  ///< queue of encoding jobs
+    boost::shared_ptr<boost::asio::io_service::work> work_; ///< keeps the encoders running
+    boost::thread_group encoder_threads_; ///< the encoder thread pool
+    boost::thread io_thread_;             ///< writes the frames, in order
+
+    boost::mutex mutex_;              ///< guards the queue and the counters
+    boost::condition_variable cond_;  ///< signals newly encoded frames
+
+    /** @brief Encoded frames, by sequence number. A NULL frame
+     * failed to encode, and is skipped */
+    std::map<unsigned int, EncodedFramePtr> encoded_;
+
+    unsigned int next_seq_;    ///< sequence number of the next received frame
+    unsigned int next_write_;  ///< sequence number of the next frame to write
+    unsigned int n_pending_;   ///< frames received, but not written yet
+    unsigned int n_dropped_;   ///< frames dropped because the queue was full
+    bool running_;             ///< cleared to stop the I/O thread
+
+    // **** private functions
+
+    /** @brief Main callback for RGB, Depth, and CameraInfo messages
+     *
+     * @param rgb_msg RGB message (8UC3 or mono8)
+     * @param depth_msg Depth message (16UC1 in mm, or 32FC1 in m)
+     * @param info_msg CameraInfo message, applies to both RGB and depth images
+     */
+    void RGBDCallback(const ImageMsg::ConstPtr& rgb_msg,
+                      const ImageMsg::ConstPtr& depth_msg,
+                      const CameraInfoMsg::ConstPtr& info_msg);
+
+    /** @brief Initializes all the parameters from the ROS param server
+     */
+    void initParams();
+
+    /** @brief Encodes a frame (runs on the encoder threads). A frame 
+     * which fails to encode is queued as null, so the writer skips it.
+     */
+    void encodeFrame(unsigned int seq,
+                     const ImageMsg::ConstPtr& rgb_msg,
+                     const ImageMsg::ConstPtr& depth_msg,
+                     const CameraInfoMsg::ConstPtr& info_msg);
+
+    /** @brief Main loop of the I/O thread
+     */
+    void spinWriter();
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_RGBD_RECORDER_H
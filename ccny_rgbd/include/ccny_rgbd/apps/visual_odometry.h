@@ -29,10 +29,12 @@
 #include <geometry_msgs/PoseStamped.h>
 #include <tf/transform_listener.h>
 #include <tf/transform_broadcaster.h>
+#include <boost/thread/mutex.hpp>
 
 #include "ccny_rgbd/types.h"
 #include "ccny_rgbd/rgbd_util.h"
 #include "ccny_rgbd/structures/rgbd_frame.h"
+#include "ccny_rgbd/structures/rgbd_frame_factory.h"
 #include "ccny_rgbd/features/feature_detector.h"
 #include "ccny_rgbd/features/orb_detector.h"
 #include "ccny_rgbd/features/surf_detector.h"
@@ -73,13 +75,48 @@ class VisualOdometry
      */
     virtual ~VisualOdometry();
 
+    /** @brief Estimates the motion from an RGBD frame, updates the
+     * pose and publishes the outputs.
+     * 
+     * Called by the subscription callback, or directly by in-process
+     * users (such as the batch mapper).
+     * 
+     * @param rgb_msg RGB message (8UC3 or mono8)
+     * @param depth_msg Depth message (16UC1 in mm, or 32FC1 in m)
+     * @param info_msg CameraInfo message, applies to both RGB and depth images
+     * @retval true  the frame was processed
+     * @retval false the base to camera transform is not available yet
+     */
+    bool processFrame(const ImageMsg::ConstPtr& rgb_msg,
+                      const ImageMsg::ConstPtr& depth_msg,
+                      const CameraInfoMsg::ConstPtr& info_msg);
+
+    /** @brief Sets the transform from the base to the camera frame,
+     * instead of looking it up from tf on the first frame.
+     */
+    void setBaseToCameraTf(const tf::Transform& b2c);
+
+    /** @brief The transform from the base to the camera frame
+     */
+    const tf::Transform& getBaseToCameraTf() const { return b2c_; }
+
+    /** @brief The current pose: the transform from the fixed to the base frame
+     */
+    const tf::Transform& getPose() const { return f2b_; }
+
+    /** @brief The moving (base) frame
+     */
+    const std::string& getBaseFrame() const { return base_frame_; }
+
   private:
 
     // **** ROS-related
 
     ros::NodeHandle nh_;                ///< the public nodehandle
     ros::NodeHandle nh_private_;        ///< the private nodehandle
-    tf::TransformListener tf_listener_; ///< ROS transform listener
+    /** @brief ROS transform listener. Released once the base to
+     * camera transform is found, so it does not keep receiving tf. */
+    boost::shared_ptr<tf::TransformListener> tf_listener_;
     tf::TransformBroadcaster tf_broadcaster_; ///< ROS transform broadcaster
     ros::Publisher odom_publisher_;           ///< ROS Odometry publisher
     ros::Publisher pose_stamped_publisher_;   ///< ROS pose stamped publisher
@@ -148,22 +185,37 @@ class VisualOdometry
     bool publish_cloud_; 
     
     int queue_size_;  ///< Subscription queue size
+
+    /** @brief Maximum age (in seconds) of an incoming frame. Older 
+     * frames, and frames arriving while the previous one is still 
+     * being processed, are dropped. 0 = no limit.
+     */
+    double max_latency_;
     
     // **** variables
 
     bool initialized_; ///< Whether the init_time and b2c_ variables have been set
     int  frame_count_; ///< RGBD frame counter
+    int  drop_count_;  ///< number of frames dropped because of max_latency_
     ros::Time init_time_; ///< Time of first RGBD message
 
+    bool cloud_subscribed_; ///< Whether the feature cloud topic has any subscribers
+
     tf::Transform b2c_;  ///< Transform from the base to the camera frame, wrt base frame
     tf::Transform f2b_;  ///< Transform from the fixed to the base frame, wrt fixed frame
 
+    RGBDFrameFactory frame_factory_; ///< Creates (and recycles) the RGBD frames
+
     boost::shared_ptr<FeatureDetector> feature_detector_; ///< The feature detector object
 
     MotionEstimation * motion_estimation_; ///< The motion estimation object
   
     PathMsg path_msg_; ///< contains a vector of positions of the Base frame.
 
+    /** @brief Held while a frame is processed, and by the reconfigure 
+     * and connect callbacks, which may run on other spinner threads */
+    boost::mutex mutex_;
+
     // **** private functions
     
     /** @brief Main callback for RGB, Depth, and CameraInfo messages
@@ -211,10 +263,16 @@ class VisualOdometry
      */
     void publishFeatureCloud(RGBDFrame& frame);
 
+    /** @brief Called when a subscriber connects to or disconnects from
+     * the feature cloud topic. The cloud is only built when there 
+     * are subscribers.
+     */
+    void connectCallback();
+
     /** @brief Caches the transform from the base frame to the camera frame
      * @param header header of the incoming message, used to stamp things correctly
      */
-    bool getBaseToCameraTf(const std_msgs::Header& header);
+    bool lookupBaseToCameraTf(const std_msgs::Header& header);
     
     /** @brief ROS dynamic reconfigure callback function for GFT
      */
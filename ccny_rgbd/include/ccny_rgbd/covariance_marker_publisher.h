@@ -0,0 +1,123 @@
+/**
+ *  @file covariance_marker_publisher.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_COVARIANCE_MARKER_PUBLISHER_H
+#define CCNY_RGBD_COVARIANCE_MARKER_PUBLISHER_H
+
+#include <ros/ros.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <visualization_msgs/Marker.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/rgbd_util.h"
+
+namespace ccny_rgbd {
+
+/** @brief Publishes 3-sigma covariance axes as a LINE_LIST marker,
+ * building the marker in a background thread.
+ *
+ * The caller hands over a snapshot of the distributions through update(),
+ * which only copies the data. The eigen-decomposition and the marker
+ * construction happen in the worker thread, at most once per period.
+ * Snapshots which arrive while the worker is busy, or before the period
+ * has elapsed, are dropped.
+ */
+class CovarianceMarkerPublisher
+{
+  public:
+
+    /** @brief Constructor
+     * @param publisher an advertised visualization_msgs::Marker publisher
+     * @param ns the marker namespace
+     * @param rate maximum publishing rate, in Hz (0 = no limit)
+     * @param r red color component of the marker
+     * @param g green color component of the marker
+     * @param b blue color component of the marker
+     */
+    CovarianceMarkerPublisher(
+      const ros::Publisher& publisher,
+      const std::string& ns,
+      double rate,
+      float r, float g, float b);
+
+    /** @brief Default destructor. Stops the worker thread.
+     */
+    virtual ~CovarianceMarkerPublisher();
+
+    /** @brief Hands a snapshot of the distributions to the worker thread
+     * @param header the marker header
+     * @param means vector of 3x1 matrices of positions (3D means)
+     * @param covariances vector of 3x3 covariance matrices
+     * @retval true the snapshot was accepted
+     * @retval false the snapshot was dropped (worker busy or throttled)
+     */
+    bool update(
+      const std_msgs::Header& header,
+      const Vector3fVector& means,
+      const Matrix3fVector& covariances);
+
+  private:
+
+    ros::Publisher publisher_;  ///< the marker publisher
+    std::string ns_;            ///< the marker namespace
+    ros::WallDuration period_;  ///< minimum time between markers
+
+    float r_, g_, b_;           ///< the marker color
+
+    boost::mutex mutex_;               ///< guards the pending snapshot
+    boost::condition_variable cond_;   ///< signals a pending snapshot
+    boost::thread thread_;             ///< the worker thread
+
+    bool running_;    ///< cleared on destruction to stop the worker
+    bool pending_;    ///< whether a snapshot is waiting for the worker
+
+    ros::WallTime last_update_;  ///< time the last snapshot was accepted
+
+    // **** pending snapshot (guarded by mutex_)
+
+    std_msgs::Header header_;
+    Vector3fVector means_;
+    SymmetricMatrix3fBatch covariances_;
+
+    // **** worker buffers
+
+    std_msgs::Header w_header_;
+    Vector3fVector w_means_;
+    SymmetricMatrix3fBatch w_covariances_;
+    Vector3fVector w_eigenvalues_;
+    Matrix3fVector w_eigenvectors_;
+
+    /** @brief Main loop of the worker thread
+     */
+    void spin();
+
+    /** @brief Builds and publishes the marker from the worker buffers
+     */
+    void publishMarker();
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_COVARIANCE_MARKER_PUBLISHER_H
@@ -0,0 +1,78 @@
+/**
+ *  @file depth_traits.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ * 
+ *  @section LICENSE
+ * 
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_DEPTH_TRAITS_H
+#define CCNY_RGBD_DEPTH_TRAITS_H
+
+#include <limits>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+namespace ccny_rgbd {
+
+/** @brief Compile-time description of a depth image pixel type.
+ * 
+ * Code which iterates over depth images is templated on the pixel type,
+ * and uses these traits for the validity test and the conversion to 
+ * meters. Each inner loop is then specialized at compile time, and 
+ * depth images are used in their native format, without conversion.
+ * 
+ * The supported types are:
+ *  - uint16_t (16UC1, in mm, 0 = invalid)
+ *  - float (32FC1, in meters, 0 or NaN = invalid)
+ */
+template <typename T>
+struct DepthTraits {};
+
+template <>
+struct DepthTraits<uint16_t>
+{
+  static inline bool valid(uint16_t depth) { return depth != 0; }
+  static inline double toMeters(uint16_t depth) { return depth * 0.001; }
+  static inline float toMillimeters(uint16_t depth) { return depth; }
+  static inline int cvType() { return CV_16UC1; }
+};
+
+template <>
+struct DepthTraits<float>
+{
+  // comparisons with NaN are false
+  static inline bool valid(float depth) 
+  { 
+    return depth > 0.0f && depth < std::numeric_limits<float>::infinity(); 
+  }
+  static inline double toMeters(float depth) { return depth; }
+  static inline float toMillimeters(float depth) { return depth * 1000.0f; }
+  static inline int cvType() { return CV_32FC1; }
+};
+
+/** @brief Checks if a depth image has a supported type (16UC1 or 32FC1)
+ */
+inline bool isSupportedDepthType(const cv::Mat& depth_img)
+{
+  return depth_img.type() == CV_16UC1 || depth_img.type() == CV_32FC1;
+}
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_DEPTH_TRAITS_H
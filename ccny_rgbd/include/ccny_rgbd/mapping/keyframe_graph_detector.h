@@ -61,6 +61,14 @@ class KeyframeGraphDetector
       KeyframeVector& keyframes,
       KeyframeAssociationVector& associations);
 
+    /** @brief Version of the keyframe descriptor set
+     * 
+     * The keypoints and descriptors are recomputed from the keyframe 
+     * images. The RANSAC inlier matches of an association index them, 
+     * so they are only valid for the same version.
+     */
+    std::string getDescriptorVersion() const;
+
    protected:
   
     ros::NodeHandle nh_;          ///< the public nodehandle
@@ -115,6 +123,12 @@ class KeyframeGraphDetector
      */
     int n_keypoints_;
 
+    /** @brief Initial SURF threshold; halved until n_keypoints_
+     * keypoints are detected, or min_surf_threshold_ is reached
+     */
+    double init_surf_threshold_;
+    double min_surf_threshold_;  ///< lowest SURF threshold
+
     /** @brief Goes through all the keyframes and fills out the
      * required information (features, distributinos, etc)
      * which will be needed by RANSAC matching
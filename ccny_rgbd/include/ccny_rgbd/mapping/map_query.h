@@ -0,0 +1,149 @@
+/**
+ *  @file map_query.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_MAP_QUERY_H
+#define CCNY_RGBD_MAP_QUERY_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <octomap/octomap.h>
+#include <octomap/OcTree.h>
+
+#include "ccny_rgbd/mapping/voxel_index.h"
+
+namespace ccny_rgbd {
+
+/** @brief Fast point queries on an occupancy octree, for planners.
+ * 
+ * Answers occupancy lookups, ray casts, and distances to the nearest
+ * occupied voxel. The distances come from a Euclidean distance 
+ * transform, which is computed on demand in small blocks and cached
+ * until the map changes, so repeated queries in the same region 
+ * are lookups.
+ * 
+ * Felzenszwalb, P.F.; Huttenlocher, D.P. Distance Transforms of 
+ * Sampled Functions. Theory of Computing 8, 2012.
+ */
+class MapQuery
+{
+  public:
+
+    /** @brief Occupancy of a voxel
+     */
+    enum Occupancy { UNKNOWN = -1, FREE = 0, OCCUPIED = 1 };
+
+    /** @brief Constructor
+     * @param max_distance [m] distances are capped at this value; 
+     *        larger values make the distance blocks more expensive
+     */
+    MapQuery(double max_distance = 1.0);
+
+    /** @brief Default destructor
+     */
+    virtual ~MapQuery();
+
+    /** @brief Sets the map which is queried, and clears the cache
+     * @param tree the occupancy octree (NULL = no map)
+     */
+    void setMap(const boost::shared_ptr<const octomap::OcTree>& tree);
+
+    /** @brief Clears the distance cache. Must be called whenever 
+     * the map is modified.
+     */
+    void invalidate();
+
+    /** @brief Whether there is a map to query
+     */
+    bool hasMap() const { return tree_.get() != NULL; }
+
+    /** @brief Occupancy of the voxel containing a point
+     * @param point the point
+     * @return the occupancy (UNKNOWN outside the map)
+     */
+    Occupancy getOccupancy(const octomap::point3d& point) const;
+
+    /** @brief Casts a ray until the first occupied voxel
+     * @param origin the origin of the ray
+     * @param direction the direction of the ray (need not be normalized)
+     * @param max_range [m] maximum length of the ray (negative = unlimited)
+     * @param ignore_unknown whether unknown voxels are traversed like 
+     *        free ones, or stop the ray
+     * @param end the center of the occupied (or unknown) voxel which
+     *        was hit, or the end of the ray
+     * @retval true an occupied voxel was hit
+     * @retval false nothing was hit, or the ray stopped at an unknown voxel
+     */
+    bool castRay(const octomap::point3d& origin, 
+                 const octomap::point3d& direction,
+                 double max_range,
+                 bool ignore_unknown,
+                 octomap::point3d& end) const;
+
+    /** @brief Distance from a point to the nearest occupied voxel
+     * 
+     * The distance is measured between voxel centers, and capped at 
+     * the maximum distance.
+     * 
+     * @param point the point
+     * @return the distance, in meters
+     */
+    double getDistance(const octomap::point3d& point) const;
+
+    /** @brief Sets the maximum distance, and clears the cache
+     * @param max_distance the maximum distance, in meters
+     */
+    void setMaxDistance(double max_distance);
+
+    /** @brief The maximum distance, in meters
+     */
+    double getMaxDistance() const { return max_distance_; }
+
+  private:
+
+    static const int BLOCK_SIZE = 8; ///< voxels per distance block side
+    static const int BLOCK_VOXELS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+
+    /** @brief Distances of a block of voxels, in meters. Voxels are 
+     * indexed as (z * BLOCK_SIZE + y) * BLOCK_SIZE + x.
+     */
+    struct DistanceBlock
+    {
+      float distance[BLOCK_VOXELS];
+    };
+
+    typedef boost::shared_ptr<DistanceBlock> DistanceBlockPtr;
+    typedef boost::unordered_map<VoxelIndex, DistanceBlockPtr, VoxelIndexHash> DistanceBlockMap;
+
+    boost::shared_ptr<const octomap::OcTree> tree_; ///< the map
+    double max_distance_;                           ///< distance cap, in meters
+
+    mutable DistanceBlockMap distance_cache_; ///< distance blocks, by block key
+
+    /** @brief Computes the distances of a block (in octree key units)
+     */
+    void computeDistanceBlock(const VoxelIndex& index, DistanceBlock& block) const;
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_MAP_QUERY_H
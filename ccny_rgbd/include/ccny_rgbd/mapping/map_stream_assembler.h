@@ -0,0 +1,97 @@
+/**
+ *  @file map_stream_assembler.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_MAP_STREAM_ASSEMBLER_H
+#define CCNY_RGBD_MAP_STREAM_ASSEMBLER_H
+
+#include <vector>
+#include <string>
+#include <boost/unordered_map.hpp>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/mapping/voxel_index.h"
+#include "ccny_rgbd/MapStreamChunk.h"
+
+namespace ccny_rgbd {
+
+/** @brief Reassembles a map from the chunks sent by a \ref MapStreamer.
+ * 
+ * The assembler keeps the latest content of every block of every 
+ * level. A chunk without voxels removes its block.
+ * 
+ * The assembled cloud shows each region at the finest level received 
+ * for it: a voxel of level l is left out when the block of level l + 1 
+ * which contains it was received, since that block (or a finer one) 
+ * already covers it.
+ */
+class MapStreamAssembler
+{
+  public:
+
+    /** @brief Default constructor
+     */
+    MapStreamAssembler();
+
+    /** @brief Default destructor
+     */
+    virtual ~MapStreamAssembler();
+
+    /** @brief Stores (or removes) the block of a chunk
+     * @param chunk the chunk
+     */
+    void addChunk(const MapStreamChunk& chunk);
+
+    /** @brief Forgets all the blocks
+     */
+    void clear();
+
+    /** @brief Builds the point cloud of the map, one point per voxel
+     * @param cloud the output cloud, in the frame of the chunks
+     */
+    void getCloud(PointCloudT& cloud) const;
+
+    /** @brief Number of blocks stored, over all the levels
+     */
+    int getNumBlocks() const;
+
+  private:
+
+    /** @brief The voxels of one block of one level
+     */
+    struct Block
+    {
+      std::vector<uint8_t> voxels;  ///< x, y, z of each voxel, within the block
+      std::vector<uint8_t> colors;  ///< r, g, b of each voxel
+    };
+
+    typedef boost::unordered_map<VoxelIndex, Block, VoxelIndexHash> BlockMap;
+
+    std::vector<BlockMap> levels_;     ///< the blocks of each level, coarsest first
+    std::vector<double> voxel_sizes_;  ///< voxel size of each level
+    std::vector<int> block_sizes_;     ///< voxels per block side of each level
+    std::string frame_id_;             ///< frame of the chunks
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_MAP_STREAM_ASSEMBLER_H
@@ -0,0 +1,142 @@
+/**
+ *  @file map_streamer.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_MAP_STREAMER_H
+#define CCNY_RGBD_MAP_STREAMER_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <tf/transform_datatypes.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/mapping/voxel_index.h"
+#include "ccny_rgbd/MapStreamChunk.h"
+
+namespace ccny_rgbd {
+
+/** @brief Streams a map to remote viewers, coarse levels of detail 
+ * first, then finer levels near a focus point.
+ * 
+ * The map is voxelized at several levels of detail; each level 
+ * doubles the voxel size of the next finer one. The voxels of each 
+ * level are grouped into blocks (chunks) of BLOCK_SIZE^3 voxels, 
+ * which are sent with 6 bytes per voxel.
+ * 
+ * The streamer remembers the content of the chunks which were sent. 
+ * When the map is updated (for example, after graph optimization),
+ * only the chunks which changed are sent again, and chunks which 
+ * became empty are sent as removals.
+ * 
+ * Pending chunks are sent within a byte budget per call, ordered by
+ * level, then by distance to the focus. The coarsest level covers
+ * the whole map; level l only covers the blocks within 
+ * focus_radius * 2^(n_levels - 1 - l) of the focus, unless an older 
+ * version of the block was already sent.
+ * 
+ * The methods are thread-safe. setMap voxelizes without holding the 
+ * lock, so the map can be replaced from a worker thread while chunks 
+ * are being sent. See \ref MapStreamAssembler for the receiving side.
+ */
+class MapStreamer
+{
+  public:
+
+    static const int BLOCK_SIZE = 32; ///< voxels per block side
+
+    /** @brief Constructor
+     * @param resolution [m] voxel size of the finest level
+     * @param n_levels number of levels of detail
+     * @param focus_radius [m] radius around the focus of the finest level
+     */
+    MapStreamer(double resolution = 0.05, 
+                int n_levels = 4,
+                double focus_radius = 5.0);
+
+    /** @brief Default destructor
+     */
+    virtual ~MapStreamer();
+
+    /** @brief Replaces the map, and marks the chunks which changed
+     * @param cloud the map, in the fixed frame
+     */
+    void setMap(const PointCloudT& cloud);
+
+    /** @brief Sets the point around which the finer levels are sent
+     * @param focus the focus, in the fixed frame
+     */
+    void setFocus(const tf::Vector3& focus);
+
+    /** @brief Forgets which chunks were sent, so the whole map is 
+     * sent again (for example, to a new subscriber)
+     */
+    void resend();
+
+    /** @brief Returns the next chunks to send, and marks them as sent
+     * @param max_bytes the byte budget (at least one chunk is returned,
+     *        if any is pending)
+     * @param chunks the output chunks; the headers are not set
+     * @return the size of the chunks, in bytes
+     */
+    int getChunks(int max_bytes, std::vector<MapStreamChunk::Ptr>& chunks);
+
+  private:
+
+    /** @brief The voxels of one block of one level
+     */
+    struct Chunk
+    {
+      std::vector<uint8_t> voxels;  ///< x, y, z of each voxel, within the block
+      std::vector<uint8_t> colors;  ///< r, g, b of each voxel
+      uint64_t signature;           ///< hash of the content
+      uint64_t sent_signature;      ///< hash of the content sent (0 = not sent)
+    };
+
+    typedef boost::shared_ptr<Chunk> ChunkPtr;
+    typedef boost::unordered_map<VoxelIndex, ChunkPtr, VoxelIndexHash> ChunkMap;
+
+    double resolution_;    ///< voxel size of the finest level
+    int n_levels_;         ///< number of levels of detail
+    double focus_radius_;  ///< radius around the focus of the finest level
+
+    boost::mutex mutex_;          ///< guards the focus and the chunks
+
+    tf::Vector3 focus_;           ///< the focus, in the fixed frame
+    std::vector<ChunkMap> levels_; ///< the chunks of each level, coarsest first
+
+    /** @brief Voxel size of a level
+     */
+    double getVoxelSize(int level) const 
+    { 
+      return resolution_ * (1 << (n_levels_ - 1 - level)); 
+    }
+
+    /** @brief Voxelizes the map at one level, into chunks
+     */
+    void buildLevel(const PointCloudT& cloud, int level, ChunkMap& chunks) const;
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_MAP_STREAMER_H
@@ -0,0 +1,176 @@
+/**
+ *  @file occupancy_grid_2d.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_OCCUPANCY_GRID_2D_H
+#define CCNY_RGBD_OCCUPANCY_GRID_2D_H
+
+#include <vector>
+#include <limits>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <tf/transform_datatypes.h>
+#include <nav_msgs/OccupancyGrid.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/mapping/voxel_index.h"
+
+namespace ccny_rgbd {
+
+/** @brief 2D occupancy grid, built incrementally from 3D scans.
+ * 
+ * Points between min_z and max_z are obstacles, points below min_z 
+ * are floor, and points above max_z are ignored. Each scan marks the 
+ * cells of its obstacles as occupied, and the cells on the 2D rays 
+ * from the sensor to its obstacles and floor as free. Points are 
+ * binned into cells first, so one ray is cast per cell, and each scan
+ * updates each cell at most once.
+ * 
+ * The grid keeps the log-odds contribution of every scan, and the 
+ * log-odds are summed without clamping. A scan can therefore be 
+ * removed or re-inserted with a new pose (for example, after graph 
+ * optimization), without rebuilding the grid.
+ * 
+ * Cells are stored in square tiles, allocated on demand. The tiles
+ * changed since the last call to \ref getChangedTiles are tracked,
+ * so only they need to be published.
+ */
+class OccupancyGrid2D
+{
+  public:
+
+    /** @brief Constructor
+     * @param resolution [m] cell size
+     * @param min_z [m] points below this height are floor
+     * @param max_z [m] points above this height are ignored
+     * @param tile_size number of cells per tile side
+     */
+    OccupancyGrid2D(double resolution = 0.05,
+                    double min_z = 0.05,
+                    double max_z = std::numeric_limits<double>::infinity(),
+                    int tile_size = 64);
+
+    /** @brief Default destructor
+     */
+    virtual ~OccupancyGrid2D();
+
+    /** @brief Inserts a scan, replacing the previous scan with the same id
+     * @param id the scan id (for example, the keyframe index)
+     * @param cloud the scan, in the grid frame (NaN points are skipped)
+     * @param pose the pose of the sensor, in the grid frame
+     */
+    void insertScan(int id, const PointCloudT& cloud, const tf::Transform& pose);
+
+    /** @brief Removes a scan from the grid
+     * @param id the scan id
+     */
+    void removeScan(int id);
+
+    /** @brief Whether a scan with the given id is in the grid
+     */
+    bool hasScan(int id) const;
+
+    /** @brief The sensor pose a scan was inserted with
+     */
+    const tf::Transform& getScanPose(int id) const;
+
+    /** @brief Removes all the scans and cells
+     */
+    void clear();
+
+    /** @brief Returns (and forgets) the tiles changed since the last call
+     * @param tiles the changed tile indices (z = 0)
+     */
+    void getChangedTiles(std::vector<VoxelIndex>& tiles);
+
+    /** @brief Builds an occupancy grid message for a single tile
+     * @param tile the tile index (z = 0)
+     * @param msg the output message; the header is not set
+     */
+    void getTileMsg(const VoxelIndex& tile, nav_msgs::OccupancyGrid& msg) const;
+
+    /** @brief Builds an occupancy grid message for the whole grid
+     * @param msg the output message; the header is not set
+     */
+    void getMapMsg(nav_msgs::OccupancyGrid& msg) const;
+
+  private:
+
+    /** @brief A square tile of cells, indexed as y * tile_size + x
+     */
+    struct Tile
+    {
+      std::vector<float> log_odds;    ///< sum of the scan contributions
+      std::vector<uint16_t> n_scans;  ///< number of scans which observed the cell
+    };
+
+    /** @brief The contribution of a scan to the grid
+     */
+    struct Scan
+    {
+      tf::Transform pose;                            ///< sensor pose
+      std::vector<std::pair<uint64_t, float> > cells; ///< cell key, log-odds
+    };
+
+    typedef boost::shared_ptr<Tile> TilePtr;
+    typedef boost::unordered_map<VoxelIndex, TilePtr, VoxelIndexHash> TileMap;
+
+    double resolution_;  ///< cell size, in meters
+    double min_z_;       ///< obstacle height limits
+    double max_z_;       
+    int tile_size_;      ///< cells per tile side
+
+    float log_odds_hit_;   ///< contribution of an occupied cell
+    float log_odds_miss_;  ///< contribution of a free cell
+
+    TileMap tiles_;                         ///< the allocated tiles
+    boost::unordered_map<int, Scan> scans_; ///< the scans, by id
+    boost::unordered_set<VoxelIndex, VoxelIndexHash> changed_tiles_; ///< changed since the last query
+
+    /** @brief Adds (sign = 1) or removes (sign = -1) a scan's contribution
+     */
+    void applyScan(const Scan& scan, int sign);
+
+    /** @brief Occupancy of a cell, as in the OccupancyGrid message
+     * @return -1 (unknown), or 0 to 100
+     */
+    int8_t getCellValue(const Tile& tile, int i) const;
+
+    /** @brief Packs 2D cell coordinates into a key
+     */
+    static inline uint64_t cellKey(int x, int y)
+    {
+      return ((uint64_t)(uint32_t)x << 32) | (uint64_t)(uint32_t)y;
+    }
+
+    /** @brief Floor division of a cell coordinate by the tile size
+     */
+    inline int tileOf(int cell) const
+    {
+      return cell >= 0 ? cell / tile_size_ : (cell + 1) / tile_size_ - 1;
+    }
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_OCCUPANCY_GRID_2D_H
@@ -0,0 +1,80 @@
+/**
+ *  @file octree_util.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_OCTREE_UTIL_H
+#define CCNY_RGBD_OCTREE_UTIL_H
+
+#include <octomap/octomap.h>
+#include <octomap/OcTree.h>
+
+namespace ccny_rgbd {
+
+/** @brief Computes the free and occupied leaves of a scan, with one 
+ * ray per unique end point leaf.
+ * 
+ * The end points are binned into leaves first, and a ray is cast
+ * to the center of each occupied leaf. The free leaves of all the 
+ * rays are collected in a single set. A dense scan has many end 
+ * points per leaf, so this casts far fewer rays than 
+ * OcTree::computeUpdate.
+ * 
+ * The result is close to, but not the same as computeUpdate: rays 
+ * end at leaf centers rather than at the measured points, so they 
+ * may cross slightly different leaves near the end points.
+ * 
+ * End points beyond the maximum range are not marked as occupied; 
+ * their rays are cut at the maximum range, and only mark free space 
+ * up to (not including) the leaf at the cut, as in computeUpdate.
+ * 
+ * @param tree the octree (only used for its key space)
+ * @param scan the scan end points, in the map frame
+ * @param origin the sensor origin, in the map frame
+ * @param max_range [m] maximum ray length (negative = unlimited)
+ * @param free_cells the output free leaves
+ * @param occupied_cells the output occupied leaves
+ */
+void computeDiscreteUpdate(
+  const octomap::OcTree& tree,
+  const octomap::Pointcloud& scan,
+  const octomap::point3d& origin,
+  double max_range,
+  octomap::KeySet& free_cells,
+  octomap::KeySet& occupied_cells);
+
+/** @brief Inserts a scan into an octree, with one ray per unique end 
+ * point leaf (see \ref computeDiscreteUpdate)
+ * 
+ * @param tree the octree
+ * @param scan the scan end points, in the map frame
+ * @param origin the sensor origin, in the map frame
+ * @param max_range [m] maximum ray length (negative = unlimited)
+ */
+void insertDiscreteScan(
+  octomap::OcTree& tree,
+  const octomap::Pointcloud& scan,
+  const octomap::point3d& origin,
+  double max_range);
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_OCTREE_UTIL_H
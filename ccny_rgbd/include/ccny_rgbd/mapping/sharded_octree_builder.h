@@ -0,0 +1,204 @@
+/**
+ *  @file sharded_octree_builder.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_SHARDED_OCTREE_BUILDER_H
+#define CCNY_RGBD_SHARDED_OCTREE_BUILDER_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <octomap/octomap.h>
+#include <octomap/OcTree.h>
+#include <octomap/ColorOcTree.h>
+
+#include "ccny_rgbd/mapping/voxel_index.h"
+
+namespace ccny_rgbd {
+
+class ComputeScanUpdates;
+class ApplyShardUpdates;
+
+/** @brief Builds an octomap octree from many scans, on several threads.
+ * 
+ * The map is split into cubic shards, each an independent octree in 
+ * the same key space. Scans are queued, and integrated in batches:
+ *  - the rays of each scan are cast (in parallel over the scans), and
+ *    the free and occupied keys are routed to the shards
+ *  - each shard applies the updates of the batch in scan order (in 
+ *    parallel over the shards)
+ * 
+ * The shards are disjoint, so every leaf gets the same updates, in the
+ * same order, as with serial insertScan calls on a single octree, and 
+ * the result is the same.
+ * 
+ * With discretize set, each scan casts one ray per unique end point
+ * leaf (see \ref computeDiscreteUpdate) instead of one per point.
+ * 
+ * The shards are merged into a single octree at the end. Merging 
+ * takes time proportional to the mapped volume (pruned leaves are 
+ * expanded), rather than to the number of rays.
+ */
+class ShardedOctreeBuilder
+{
+  friend class ComputeScanUpdates;
+  friend class ApplyShardUpdates;
+
+  public:
+
+    typedef octomap::ColorOcTreeNode::Color Color;
+
+    /** @brief Constructor
+     * @param resolution [m] leaf size of the octree
+     * @param shard_size [m] shard side, rounded up to a power of 2 leaves
+     * @param n_threads number of threads (0 = number of cores)
+     * @param discretize whether to cast one ray per unique end point leaf
+     * @param max_range [m] maximum ray length (negative = unlimited)
+     */
+    ShardedOctreeBuilder(double resolution = 0.05,
+                         double shard_size = 6.4,
+                         int n_threads = 0,
+                         bool discretize = false,
+                         double max_range = -1.0);
+
+    /** @brief Default destructor
+     */
+    virtual ~ShardedOctreeBuilder();
+
+    /** @brief Queues a scan for integration
+     * @param scan the scan end points, in the map frame
+     * @param origin the sensor origin, in the map frame
+     */
+    void insertScan(const octomap::Pointcloud& scan, 
+                    const octomap::point3d& origin);
+
+    /** @brief Queues a scan for integration, with the colors of its 
+     * end points. The color of a leaf is the color of the last end 
+     * point which fell in it.
+     * @param scan the scan end points, in the map frame
+     * @param origin the sensor origin, in the map frame
+     * @param colors the end point colors, one per point
+     */
+    void insertScan(const octomap::Pointcloud& scan, 
+                    const octomap::point3d& origin,
+                    const std::vector<Color>& colors);
+
+    /** @brief Integrates the queued scans
+     */
+    void flush();
+
+    /** @brief Integrates the queued scans, and merges the shards into
+     * an octree. The occupancy log-odds are added, so the octree should
+     * be empty.
+     * @param tree the output octree
+     */
+    void merge(octomap::OcTree& tree);
+
+    /** @brief Integrates the queued scans, and merges the shards 
+     * (with colors) into an octree. The occupancy log-odds are added, 
+     * so the octree should be empty.
+     * @param tree the output octree
+     */
+    void merge(octomap::ColorOcTree& tree);
+
+    /** @brief Removes all the shards and queued scans
+     */
+    void clear();
+
+    /** @brief Number of allocated shards
+     */
+    int getNumShards() const { return shards_.size(); }
+
+  private:
+
+    /** @brief A scan waiting to be integrated
+     */
+    struct QueuedScan
+    {
+      octomap::Pointcloud points;  ///< end points, in the map frame
+      octomap::point3d origin;     ///< sensor origin, in the map frame
+      std::vector<Color> colors;   ///< end point colors (may be empty)
+    };
+
+    /** @brief The part of a scan update which falls in one shard
+     */
+    struct ShardUpdate
+    {
+      std::vector<octomap::OcTreeKey> free;      ///< keys to update as free
+      std::vector<octomap::OcTreeKey> occupied;  ///< keys to update as occupied
+      std::vector<std::pair<octomap::OcTreeKey, Color> > colors; ///< end point colors
+    };
+
+    typedef boost::unordered_map<VoxelIndex, ShardUpdate, VoxelIndexHash> ScanUpdate;
+
+    typedef boost::unordered_map<
+      octomap::OcTreeKey, Color, octomap::OcTreeKey::KeyHash> ColorMap;
+
+    /** @brief An independent octree, holding the leaves of one shard
+     */
+    struct Shard
+    {
+      boost::shared_ptr<octomap::OcTree> tree; ///< the occupancy
+      ColorMap colors;                         ///< the latest color of each leaf
+    };
+
+    typedef boost::shared_ptr<Shard> ShardPtr;
+    typedef boost::unordered_map<VoxelIndex, ShardPtr, VoxelIndexHash> ShardMap;
+
+    double resolution_;        ///< leaf size, in meters
+    int shard_shift_;          ///< shard index = key >> shard_shift_
+    int n_threads_;            ///< number of threads
+    unsigned int batch_size_;  ///< number of scans integrated at once
+    bool discretize_;          ///< whether to cast one ray per unique end point leaf
+    double max_range_;         ///< maximum ray length, in meters
+
+    std::vector<QueuedScan> queue_; ///< scans waiting to be integrated
+    ShardMap shards_;               ///< the allocated shards
+
+    /** @brief Casts the rays of a scan, and routes its keys to shards
+     */
+    void computeScanUpdate(const QueuedScan& scan, ScanUpdate& update) const;
+
+    /** @brief Applies the updates of a batch of scans to one shard, 
+     * in scan order
+     */
+    void applyShardUpdates(const VoxelIndex& index, 
+                           const std::vector<ScanUpdate>& updates);
+
+    /** @brief Adds the leaves of all the shards to an octree
+     */
+    template <typename TreeT>
+    void mergeOccupancy(TreeT& tree);
+
+    /** @brief The shard which contains a key
+     */
+    inline VoxelIndex shardOf(const octomap::OcTreeKey& key) const
+    {
+      return VoxelIndex(key[0] >> shard_shift_, 
+                        key[1] >> shard_shift_, 
+                        key[2] >> shard_shift_);
+    }
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_SHARDED_OCTREE_BUILDER_H
@@ -0,0 +1,138 @@
+/**
+ *  @file submap_manager.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_SUBMAP_MANAGER_H
+#define CCNY_RGBD_SUBMAP_MANAGER_H
+
+#include <vector>
+#include <limits>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/rgbd_util.h"
+#include "ccny_rgbd/structures/rgbd_keyframe.h"
+
+namespace ccny_rgbd {
+
+class UpdateSubmaps;
+
+/** @brief Groups consecutive keyframes into submaps, each with a 
+ * locally fused point cloud, in the frame of its anchor (first) 
+ * keyframe.
+ * 
+ * Graph optimization mostly moves whole stretches of keyframes, 
+ * and leaves the relative poses within a submap unchanged. The global
+ * map is then recomposed by moving each submap with its anchor pose,
+ * instead of rebuilding the point clouds of all the keyframes. A 
+ * submap is only fused again if the pose of one of its keyframes 
+ * changed relative to its anchor.
+ */
+class SubmapManager
+{
+  friend class UpdateSubmaps;
+
+  public:
+
+    /** @brief Constructor
+     * @param submap_size number of keyframes per submap
+     * @param resolution [m] voxel size of the submap clouds
+     * @param max_range [m] maximum range of the keyframe points
+     * @param max_stdev [m] maximum depth uncertainty of the keyframe points
+     * @param n_threads number of threads fusing submaps (0 = number of cores)
+     */
+    SubmapManager(int submap_size = 10,
+                  double resolution = 0.01,
+                  double max_range = 5.5,
+                  double max_stdev = 0.03,
+                  int n_threads = 0);
+
+    /** @brief Default destructor
+     */
+    virtual ~SubmapManager();
+
+    /** @brief Brings the submaps up to date with the keyframes.
+     * 
+     * New keyframes are fused into the last submap (or a new one), and
+     * submaps whose keyframes moved relative to their anchor are fused 
+     * again. The keyframes are only appended to, or optimized; if they
+     * are replaced, call \ref clear first.
+     * 
+     * @param keyframes the keyframes
+     */
+    void update(const KeyframeVector& keyframes);
+
+    /** @brief Composes the global map from the submaps, at the 
+     * current anchor poses. Call \ref update first.
+     * @param keyframes the keyframes
+     * @param map_cloud the output map, voxel-filtered
+     * @param max_z [m] points above this height are dropped
+     */
+    void compose(const KeyframeVector& keyframes, 
+                 PointCloudT& map_cloud,
+                 double max_z = std::numeric_limits<double>::infinity()) const;
+
+    /** @brief Removes all the submaps
+     */
+    void clear();
+
+    /** @brief Number of submaps
+     */
+    int getNumSubmaps() const { return submaps_.size(); }
+
+  private:
+
+    /** @brief A group of consecutive keyframes, fused in the frame of
+     * the first one
+     */
+    struct Submap
+    {
+      int anchor;  ///< index of the anchor (first) keyframe
+      int size;    ///< number of keyframes in the submap
+
+      /** @brief The keyframe poses relative to the anchor, when fused */
+      std::vector<tf::Transform> relative_poses;
+
+      PointCloudT cloud; ///< fused cloud, in the anchor frame
+    };
+
+    int submap_size_;    ///< keyframes per submap
+    double resolution_;  ///< voxel size of the submap clouds
+    double max_range_;   ///< maximum range of the keyframe points
+    double max_stdev_;   ///< maximum depth uncertainty of the keyframe points
+    int n_threads_;      ///< number of threads
+
+    std::vector<Submap> submaps_; ///< the submaps, in keyframe order
+
+    /** @brief Whether a keyframe of a submap moved relative to the 
+     * anchor since it was fused
+     */
+    bool isStale(const Submap& submap, const KeyframeVector& keyframes) const;
+
+    /** @brief Fuses the keyframes of a submap which are not fused 
+     * yet, or all of them if the submap is stale
+     */
+    void updateSubmap(Submap& submap, const KeyframeVector& keyframes);
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_SUBMAP_MANAGER_H
@@ -0,0 +1,205 @@
+/**
+ *  @file surfel_map.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_SURFEL_MAP_H
+#define CCNY_RGBD_SURFEL_MAP_H
+
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include <tf/transform_datatypes.h>
+
+#include "ccny_rgbd/structures/rgbd_frame.h"
+#include "ccny_rgbd/mapping/voxel_index.h"
+
+namespace ccny_rgbd {
+
+template <typename DepthT> class ComputeSurfelMeasurements;
+
+/** @brief A surface element: a small oriented disk
+ */
+struct Surfel
+{
+  float x, y, z;     ///< position, in meters
+  float nx, ny, nz;  ///< unit normal, towards the observed free space
+  float radius;      ///< disk radius, in meters
+  float confidence;  ///< number of fused observations
+  uint8_t r, g, b;   ///< color
+  int anchor;        ///< the anchor (keyframe) which created the surfel
+};
+
+/** @brief Map of surfels, fused in place as frames are integrated.
+ * 
+ * Each frame is turned into surfel measurements (one per pixel_step
+ * pixels, with normals from the depth image). The map surfels are 
+ * splatted into the image to find the surfel seen by each measurement 
+ * (projective association). Associated measurements are averaged into 
+ * their surfel, weighted by its confidence; the others become new 
+ * surfels. A spatial hash finds the surfels inside the view.
+ * 
+ * Every surfel remembers the anchor (keyframe) it was created from. 
+ * When the anchor poses change, the surfels are moved rigidly with
+ * their anchor, without integrating the frames again.
+ * 
+ * Keller, M. et al. Real-time 3D Reconstruction in Dynamic Scenes 
+ * using Point-based Fusion. 3DV 2013.
+ */
+class SurfelMap
+{
+  public:
+
+    /** @brief Constructor
+     * @param pixel_step one measurement is made every pixel_step pixels
+     * @param assoc_dist [m] maximum distance of a measurement from the 
+     *        plane of its associated surfel
+     * @param assoc_angle [rad] maximum angle between the normals of a
+     *        measurement and its associated surfel
+     * @param max_confidence the confidence (fusion weight) is capped at
+     *        this value, so the surfels can still adapt to changes
+     * @param cell_size [m] cell size of the spatial hash
+     */
+    SurfelMap(int pixel_step = 2,
+              double assoc_dist = 0.05,
+              double assoc_angle = 30.0 * M_PI / 180.0,
+              double max_confidence = 64.0,
+              double cell_size = 0.10);
+
+    /** @brief Default destructor
+     */
+    virtual ~SurfelMap();
+
+    /** @brief Integrates an RGBD frame
+     * 
+     * @param frame the frame (16UC1 or 32FC1 depth)
+     * @param pose the pose of the camera (optical) frame in the map frame
+     * @param anchor the anchor index of the new surfels (for example, 
+     *        the keyframe index)
+     * @param max_range [m] depth beyond this is ignored
+     */
+    void integrate(const RGBDFrame& frame, 
+                   const tf::Transform& pose,
+                   int anchor,
+                   double max_range);
+
+    /** @brief Moves the surfels rigidly with their anchors.
+     * 
+     * Each surfel is transformed by the change of its anchor pose since
+     * it was last integrated or deformed. Anchors without a new pose 
+     * are left in place.
+     * 
+     * @param anchor_poses the new anchor poses, indexed by anchor
+     */
+    void deform(const std::vector<tf::Transform>& anchor_poses);
+
+    /** @brief Finds the surfels inside a box
+     * @param min_x the lower x limit of the box
+     * @param min_y the lower y limit of the box
+     * @param min_z the lower z limit of the box
+     * @param max_x the upper x limit of the box
+     * @param max_y the upper y limit of the box
+     * @param max_z the upper z limit of the box
+     * @param indices the output surfel indices
+     */
+    void findSurfels(double min_x, double min_y, double min_z,
+                     double max_x, double max_y, double max_z,
+                     std::vector<unsigned int>& indices) const;
+
+    /** @brief Removes all the surfels
+     */
+    void clear();
+
+    /** @brief The surfels
+     */
+    const std::vector<Surfel>& getSurfels() const { return surfels_; }
+
+  private:
+
+    template <typename DepthT> friend class ComputeSurfelMeasurements;
+
+    typedef boost::unordered_map<VoxelIndex, std::vector<unsigned int>, VoxelIndexHash> CellMap;
+
+    /** @brief A surfel measured in a frame, in the map frame
+     */
+    struct Measurement
+    {
+      bool valid;
+      Surfel surfel;
+    };
+
+    int pixel_step_;         ///< one measurement every pixel_step_ pixels
+    double assoc_dist_;      ///< maximum association distance
+    double cos_assoc_angle_; ///< cosine of the maximum association angle
+    double max_confidence_;  ///< maximum surfel confidence
+    double cell_size_;       ///< spatial hash cell size
+
+    std::vector<Surfel> surfels_;  ///< the surfels
+    CellMap cells_;                ///< surfel indices, hashed by position
+
+    /** @brief Pose of each anchor when its surfels were last moved */
+    std::vector<tf::Transform> anchor_poses_;
+
+    std::vector<Measurement> measurements_; ///< measurement grid of the last frame
+    std::vector<int> index_map_;            ///< surfel seen by each measurement (-1 = none)
+    std::vector<float> depth_map_;          ///< depth of the surfel in index_map_
+
+    /** @brief Computes a row of the measurement grid
+     */
+    template <typename DepthT>
+    void computeMeasurementsT(const RGBDFrame& frame, 
+                              const tf::Transform& pose,
+                              int anchor,
+                              double max_range,
+                              int row);
+
+    /** @brief Splats the surfels near the view into the index map
+     */
+    void buildIndexMap(const RGBDFrame& frame, 
+                       const tf::Transform& pose,
+                       int rows, int cols);
+
+    /** @brief Moves a surfel to a new hash cell, if needed
+     */
+    void rehashSurfel(unsigned int index, const VoxelIndex& old_cell);
+
+    /** @brief Hash cell of a surfel
+     */
+    VoxelIndex getCell(const Surfel& surfel) const
+    {
+      return VoxelIndex::fromPoint(surfel.x, surfel.y, surfel.z, 1.0 / cell_size_);
+    }
+};
+
+/** @brief Saves surfels as a binary PLY file, with normals,
+ * radius and confidence.
+ * @param path the output file
+ * @param map the surfel map
+ * @param min_confidence surfels with a lower confidence are skipped
+ * @retval true  Successfully saved the surfels
+ * @retval false Saving failed
+ */
+bool saveSurfelMapPLY(const std::string& path, 
+                      const SurfelMap& map,
+                      double min_confidence = 1.0);
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_SURFEL_MAP_H
@@ -0,0 +1,104 @@
+/**
+ *  @file tiled_map.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_TILED_MAP_H
+#define CCNY_RGBD_TILED_MAP_H
+
+#include <string>
+#include <vector>
+#include <tf/transform_datatypes.h>
+
+#include "ccny_rgbd/types.h"
+#include "ccny_rgbd/mapping/voxel_index.h"
+
+namespace ccny_rgbd {
+
+/** @brief The index file of a tiled map.
+ * 
+ * A tiled map is a directory with one binary .pcd file per cubic 
+ * tile, and an index.yml file which lists the tiles. Consumers read 
+ * the index, and only load the tiles around a region of interest.
+ */
+struct TiledMapIndex
+{
+  /** @brief One tile of the map
+   */
+  struct Tile
+  {
+    VoxelIndex index;     ///< tile coordinates (tile origin / tile size)
+    int n_points;         ///< number of points in the tile
+    std::string filename; ///< .pcd file, relative to the map directory
+  };
+
+  double tile_size;         ///< tile side, in meters
+  std::vector<Tile> tiles;  ///< the non-empty tiles
+};
+
+/** @brief Saves a point cloud as a tiled map. The tiles are written 
+ * in parallel.
+ * 
+ * @param path the map directory (created if needed)
+ * @param cloud the map cloud
+ * @param tile_size [m] tile side
+ * @param n_threads number of threads (0 = number of cores)
+ * @retval true  Successfully saved the map
+ * @retval false Saving failed
+ */
+bool saveTiledMap(
+  const std::string& path,
+  const PointCloudT& cloud,
+  double tile_size,
+  int n_threads = 0);
+
+/** @brief Loads the index of a tiled map
+ * @param path the map directory
+ * @param index the output index
+ * @retval true  Successfully loaded the index
+ * @retval false Loading failed
+ */
+bool loadTiledMapIndex(
+  const std::string& path,
+  TiledMapIndex& index);
+
+/** @brief Loads the tiles of a tiled map which overlap a box. The 
+ * tiles are read in parallel, and loaded whole.
+ * 
+ * @param path the map directory
+ * @param index the index of the map
+ * @param min_point the minimum corner of the box
+ * @param max_point the maximum corner of the box
+ * @param cloud the output cloud
+ * @param n_threads number of threads (0 = number of cores)
+ * @return the number of tiles loaded, or -1 if loading failed
+ */
+int loadTiledMapRegion(
+  const std::string& path,
+  const TiledMapIndex& index,
+  const tf::Vector3& min_point,
+  const tf::Vector3& max_point,
+  PointCloudT& cloud,
+  int n_threads = 0);
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_TILED_MAP_H
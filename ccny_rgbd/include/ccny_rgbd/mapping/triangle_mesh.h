@@ -0,0 +1,67 @@
+/**
+ *  @file triangle_mesh.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_TRIANGLE_MESH_H
+#define CCNY_RGBD_TRIANGLE_MESH_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+namespace ccny_rgbd {
+
+/** @brief A colored mesh vertex
+ */
+struct MeshVertex
+{
+  float x, y, z;     ///< position, in meters
+  uint8_t r, g, b;   ///< color
+};
+
+/** @brief An indexed, colored triangle mesh
+ */
+struct TriangleMesh
+{
+  std::vector<MeshVertex> vertices; ///< the vertices
+  std::vector<uint32_t> indices;    ///< vertex indices, three per triangle
+
+  /** @brief Number of triangles in the mesh
+   */
+  size_t getNumTriangles() const { return indices.size() / 3; }
+
+  /** @brief Removes all the vertices and triangles
+   */
+  void clear() { vertices.clear(); indices.clear(); }
+};
+
+/** @brief Saves a mesh as a binary PLY file
+ * @param path the output file
+ * @param mesh the mesh
+ * @retval true  Successfully saved the mesh
+ * @retval false Saving failed
+ */
+bool saveMeshPLY(const std::string& path, const TriangleMesh& mesh);
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_TRIANGLE_MESH_H
@@ -0,0 +1,187 @@
+/**
+ *  @file tsdf_volume.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_TSDF_VOLUME_H
+#define CCNY_RGBD_TSDF_VOLUME_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <tf/transform_datatypes.h>
+
+#include "ccny_rgbd/structures/rgbd_frame.h"
+#include "ccny_rgbd/mapping/triangle_mesh.h"
+#include "ccny_rgbd/mapping/voxel_index.h"
+
+namespace ccny_rgbd {
+
+template <typename DepthT> class IntegrateBlocks;
+
+/** @brief Truncated signed distance function (TSDF) volume, 
+ * stored in a hash of small voxel blocks.
+ * 
+ * Only the blocks near an observed surface are allocated, so memory
+ * grows with the surface area, not with the extent of the map.
+ * 
+ * Frames are integrated by projecting each voxel of the blocks in 
+ * the truncation band into the depth image (projective TSDF), and
+ * the blocks are processed in parallel. The zero crossing of the 
+ * TSDF is extracted as a triangle mesh with marching cubes.
+ * 
+ * Newcombe, R.A. et al. KinectFusion: Real-Time Dense Surface Mapping 
+ * and Tracking. ISMAR 2011.
+ * 
+ * Niessner, M. et al. Real-time 3D Reconstruction at Scale using 
+ * Voxel Hashing. SIGGRAPH Asia 2013.
+ */
+class TSDFVolume
+{
+  public:
+
+    static const int BLOCK_SIZE = 8; ///< voxels per block side
+    static const int BLOCK_VOXELS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+
+    typedef VoxelIndex BlockIndex; ///< coordinates of a block (in block units)
+
+    /** @brief A block of voxels, stored as separate arrays so the
+     * integration loops run over contiguous memory. Voxels are 
+     * indexed as (z * BLOCK_SIZE + y) * BLOCK_SIZE + x.
+     */
+    struct Block
+    {
+      float tsdf[BLOCK_VOXELS];    ///< truncated distance, in [-1, 1] 
+      float weight[BLOCK_VOXELS];  ///< integration weight (0 = unobserved)
+      uint8_t r[BLOCK_VOXELS];     ///< red
+      uint8_t g[BLOCK_VOXELS];     ///< green
+      uint8_t b[BLOCK_VOXELS];     ///< blue
+
+      Block();
+    };
+
+    typedef boost::shared_ptr<Block> BlockPtr;
+    typedef boost::unordered_map<BlockIndex, BlockPtr, VoxelIndexHash> BlockMap;
+
+    /** @brief Constructor
+     * @param voxel_size the voxel side, in meters
+     * @param truncation the truncation distance, in meters
+     * @param max_weight the integration weight is capped at this value, 
+     *        so the volume can still adapt to changes
+     * @param n_threads number of integration threads (0 = number of cores)
+     */
+    TSDFVolume(double voxel_size = 0.01, 
+               double truncation = 0.04,
+               double max_weight = 64.0,
+               int n_threads = 0);
+
+    /** @brief Default destructor
+     */
+    virtual ~TSDFVolume();
+
+    /** @brief Integrates an RGBD frame.
+     * 
+     * @param frame the frame (16UC1 or 32FC1 depth)
+     * @param pose the pose of the camera (optical) frame in the 
+     *        volume frame
+     * @param max_range [m] depth beyond this is ignored
+     */
+    void integrate(const RGBDFrame& frame, 
+                   const tf::Transform& pose,
+                   double max_range);
+
+    /** @brief Extracts the zero crossing of the TSDF as a triangle mesh.
+     * 
+     * Triangles are oriented with their normals pointing towards 
+     * the observed free space. Vertices are shared between triangles.
+     * 
+     * @param mesh the output mesh
+     */
+    void extractMesh(TriangleMesh& mesh) const;
+
+    /** @brief Removes all the blocks
+     */
+    void clear();
+
+    /** @brief Number of allocated blocks
+     */
+    size_t getNumBlocks() const { return blocks_.size(); }
+
+    /** @brief The voxel side, in meters
+     */
+    double getVoxelSize() const { return voxel_size_; }
+
+  private:
+
+    template <typename DepthT> friend class IntegrateBlocks;
+
+    double voxel_size_;  ///< voxel side, in meters
+    double truncation_;  ///< truncation distance, in meters
+    double max_weight_;  ///< maximum integration weight
+    int n_threads_;      ///< number of integration threads
+
+    BlockMap blocks_;    ///< the allocated blocks
+
+    /** @brief Allocates the blocks which intersect the truncation band
+     * of the frame's depth measurements.
+     * @param blocks the (new or existing) blocks, in no particular order
+     */
+    template <typename DepthT>
+    void allocateBlocksT(const RGBDFrame& frame, 
+                         const tf::Transform& pose,
+                         double max_range,
+                         std::vector<BlockMap::value_type*>& blocks);
+
+    /** @brief Updates the voxels of one block from the frame
+     */
+    template <typename DepthT>
+    void integrateBlockT(const RGBDFrame& frame,
+                         const tf::Transform& pose_inv,
+                         double max_range,
+                         const BlockIndex& index,
+                         Block& block) const;
+
+    /** @brief Extracts the triangles of the cubes whose lowest corner
+     * is in the given block.
+     * @param edge_vertices maps an edge of the voxel grid to the index
+     *        of the vertex on it
+     */
+    void extractBlockMesh(const BlockIndex& index, 
+                          const Block& block,
+                          TriangleMesh& mesh,
+                          boost::unordered_map<uint64_t, uint32_t>& edge_vertices) const;
+
+    /** @brief Returns the block with the given index, or NULL
+     */
+    const Block * findBlock(const BlockIndex& index) const;
+
+    /** @brief Block index of a voxel coordinate
+     */
+    static inline int blockOf(int voxel)
+    {
+      // rounds down for negative coordinates
+      return voxel >= 0 ? voxel / BLOCK_SIZE : (voxel + 1) / BLOCK_SIZE - 1;
+    }
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_TSDF_VOLUME_H
@@ -0,0 +1,83 @@
+/**
+ *  @file voxel_index.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_VOXEL_INDEX_H
+#define CCNY_RGBD_VOXEL_INDEX_H
+
+#include <cmath>
+#include <cstddef>
+
+namespace ccny_rgbd {
+
+/** @brief Integer coordinates of a cell in a regular 3D grid,
+ * used as a key of spatial hashes.
+ */
+struct VoxelIndex
+{
+  int x, y, z;
+
+  VoxelIndex() { }
+  VoxelIndex(int x, int y, int z): x(x), y(y), z(z) { }
+
+  /** @brief The cell which contains a point
+   * @param px the x coordinate of the point
+   * @param py the y coordinate of the point
+   * @param pz the z coordinate of the point
+   * @param inv_size the inverse of the cell size
+   */
+  static VoxelIndex fromPoint(double px, double py, double pz, double inv_size)
+  {
+    return VoxelIndex((int)floor(px * inv_size), 
+                      (int)floor(py * inv_size), 
+                      (int)floor(pz * inv_size));
+  }
+
+  bool operator==(const VoxelIndex& other) const
+  {
+    return x == other.x && y == other.y && z == other.z;
+  }
+
+  bool operator!=(const VoxelIndex& other) const
+  {
+    return !(*this == other);
+  }
+};
+
+/** @brief Spatial hash of a cell index
+ * 
+ * Teschner, M. et al. Optimized Spatial Hashing for Collision 
+ * Detection of Deformable Objects. VMV 2003.
+ */
+struct VoxelIndexHash
+{
+  size_t operator()(const VoxelIndex& index) const
+  {
+    return ((size_t)index.x * 73856093u) ^ 
+           ((size_t)index.y * 19349669u) ^ 
+           ((size_t)index.z * 83492791u);
+  }
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_VOXEL_INDEX_H
@@ -0,0 +1,225 @@
+/**
+ *  @file parallel_for.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_PARALLEL_FOR_H
+#define CCNY_RGBD_PARALLEL_FOR_H
+
+#include <algorithm>
+#include <deque>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace ccny_rgbd {
+
+/** @brief A piece of work which can be run by the threads 
+ * of the \ref ParallelForPool.
+ */
+class ParallelForTask
+{
+  public:
+
+    ParallelForTask(): active_(0) { }
+    virtual ~ParallelForTask() { }
+
+    virtual void run() = 0;
+
+  private:
+
+    friend class ParallelForPool;
+
+    int active_; ///< pool threads running the task, guarded by the pool mutex
+};
+
+/** @brief Process-wide set of persistent threads used by \ref parallelFor.
+ * 
+ * Threads are created the first time they are needed and wait for 
+ * work between calls, so calling parallelFor on every frame does not 
+ * create or join any threads.
+ */
+class ParallelForPool
+{
+  public:
+
+    static ParallelForPool& instance()
+    {
+      static ParallelForPool pool;
+      return pool;
+    }
+
+    ~ParallelForPool()
+    {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        running_ = false;
+      }
+      cond_.notify_all();
+      threads_.join_all();
+    }
+
+    /** @brief Queues a task to be run by n pool threads.
+     * 
+     * The pool grows to at least n threads.
+     */
+    void post(ParallelForTask& task, int n)
+    {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        for (int i = 0; i < n; ++i) queue_.push_back(&task);
+        while (n_threads_ < n)
+        {
+          threads_.create_thread(boost::bind(&ParallelForPool::spin, this));
+          ++n_threads_;
+        }
+      }
+      cond_.notify_all();
+    }
+
+    /** @brief Takes the task out of the queue and waits until no 
+     * pool thread runs it any more.
+     * 
+     * Copies of the task which no thread picked up are dropped, so 
+     * waiting never depends on a free pool thread (parallelFor may 
+     * be nested).
+     */
+    void finish(ParallelForTask& task)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      queue_.erase(
+        std::remove(queue_.begin(), queue_.end(), &task), queue_.end());
+      while (task.active_ > 0) done_cond_.wait(lock);
+    }
+
+  private:
+
+    boost::mutex mutex_;                   ///< guards the state below
+    boost::condition_variable cond_;       ///< signals queued tasks
+    boost::condition_variable done_cond_;  ///< signals finished tasks
+    std::deque<ParallelForTask*> queue_;   ///< tasks not picked up yet
+    boost::thread_group threads_;          ///< the pool threads
+    int n_threads_;                        ///< number of pool threads
+    bool running_;                         ///< cleared on destruction
+
+    ParallelForPool(): n_threads_(0), running_(true) { }
+
+    void spin()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (true)
+      {
+        while (running_ && queue_.empty()) cond_.wait(lock);
+        if (!running_) return;
+
+        ParallelForTask * task = queue_.front();
+        queue_.pop_front();
+        ++task->active_;
+
+        lock.unlock();
+        task->run();
+        lock.lock();
+
+        --task->active_;
+        done_cond_.notify_all();
+      }
+    }
+};
+
+/** @brief Shared state of the threads of a \ref parallelFor call.
+ * 
+ * The range is handed out in small chunks on demand, so threads 
+ * which get cheap items keep taking work from the others.
+ */
+template <typename Body>
+class ParallelForWorker: public ParallelForTask
+{
+  public:
+
+    ParallelForWorker(int begin, int end, int chunk_size, const Body& body):
+      next_(begin), end_(end), chunk_size_(chunk_size), body_(body) { }
+
+    void run()
+    {
+      int begin, end;
+      while (nextChunk(begin, end))
+        for (int i = begin; i < end; ++i) body_(i);
+    }
+
+  private:
+
+    boost::mutex mutex_; ///< guards next_
+    int next_;           ///< first item which was not handed out yet
+    int end_;            ///< end of the range
+    int chunk_size_;     ///< number of items handed out at once
+
+    const Body& body_;   ///< the loop body
+
+    bool nextChunk(int& begin, int& end)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (next_ >= end_) return false;
+      begin = next_;
+      end = std::min(next_ + chunk_size_, end_);
+      next_ = end;
+      return true;
+    }
+};
+
+/** @brief Calls body(i) for every i in [begin, end), on several threads.
+ * 
+ * The calling thread takes part in the loop, helped by threads of the 
+ * persistent \ref ParallelForPool. Returns when all the items are done. 
+ * The body must be safe to call concurrently for different items.
+ * 
+ * @param begin the first item
+ * @param end one past the last item
+ * @param body the loop body, called as body(i)
+ * @param n_threads number of threads, including the calling one 
+ *        (0 = number of cores, 1 = serial)
+ * @param chunk_size number of items a thread takes at once
+ */
+template <typename Body>
+void parallelFor(int begin, int end, const Body& body, 
+                 int n_threads = 0, int chunk_size = 1)
+{
+  if (n_threads <= 0) 
+    n_threads = std::max(1u, boost::thread::hardware_concurrency());
+  n_threads = std::min(n_threads, end - begin);
+
+  if (n_threads <= 1)
+  {
+    for (int i = begin; i < end; ++i) body(i);
+    return;
+  }
+
+  ParallelForWorker<Body> worker(begin, end, std::max(chunk_size, 1), body);
+
+  ParallelForPool& pool = ParallelForPool::instance();
+  pool.post(worker, n_threads - 1);
+  worker.run();
+  pool.finish(worker);
+}
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_PARALLEL_FOR_H
@@ -0,0 +1,255 @@
+/**
+ *  @file payload.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_PAYLOAD_H
+#define CCNY_RGBD_PAYLOAD_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <ros/serialization.h>
+#include <tf/transform_datatypes.h>
+#include <opencv2/core/core.hpp>
+
+namespace ccny_rgbd {
+
+// Binary (de)serialization helpers shared by the on-disk formats
+// (keyframe journal, RGBD recordings). Values are stored in host
+// byte order.
+
+/** @brief FNV-1a checksum of a record payload */
+inline uint32_t payloadChecksum(const uint8_t* data, size_t size)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i)
+  {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/** @brief Writes one record, framed as [type][size][payload][checksum] */
+inline bool writeFramedRecord(FILE * file, uint32_t type, const std::vector<uint8_t>& payload)
+{
+  uint32_t size = payload.size();
+  uint32_t sum  = payloadChecksum(payload.empty() ? NULL : &payload[0], size);
+
+  return
+    fwrite(&type, sizeof(type), 1, file) == 1 &&
+    fwrite(&size, sizeof(size), 1, file) == 1 &&
+    (size == 0 || fwrite(&payload[0], size, 1, file) == 1) &&
+    fwrite(&sum,  sizeof(sum),  1, file) == 1;
+}
+
+/** @brief Reads one framed record. Fails on EOF, and on incomplete
+ * or corrupted records. */
+inline bool readFramedRecord(FILE * file, uint32_t& type, std::vector<uint8_t>& payload)
+{
+  uint32_t size, sum;
+
+  if (fread(&type, sizeof(type), 1, file) != 1) return false;
+  if (fread(&size, sizeof(size), 1, file) != 1) return false;
+
+  // a torn size field could ask for an absurd amount of memory
+  const uint32_t max_size = 256 * 1024 * 1024;
+  if (size > max_size) return false;
+
+  payload.resize(size);
+  if (size > 0 && fread(&payload[0], size, 1, file) != 1) return false;
+  if (fread(&sum, sizeof(sum), 1, file) != 1) return false;
+
+  return sum == payloadChecksum(payload.empty() ? NULL : &payload[0], size);
+}
+
+/** @brief Appends binary data to a record payload */
+class PayloadWriter
+{
+  public:
+
+    PayloadWriter(std::vector<uint8_t>& buffer): buffer_(buffer) { buffer_.clear(); }
+
+    template <typename T>
+    void put(const T& value)
+    {
+      putBytes(&value, sizeof(T));
+    }
+
+    void putBytes(const void * data, size_t size)
+    {
+      size_t offset = buffer_.size();
+      buffer_.resize(offset + size);
+      if (size > 0) memcpy(&buffer_[offset], data, size);
+    }
+
+    template <typename M>
+    void putMsg(const M& msg)
+    {
+      uint32_t size = ros::serialization::serializationLength(msg);
+      put(size);
+      size_t offset = buffer_.size();
+      buffer_.resize(offset + size);
+      ros::serialization::OStream stream(&buffer_[offset], size);
+      ros::serialization::serialize(stream, msg);
+    }
+
+    void putString(const std::string& s)
+    {
+      put<uint32_t>(s.size());
+      putBytes(s.data(), s.size());
+    }
+
+    void putBlob(const std::vector<uint8_t>& data)
+    {
+      put<uint32_t>(data.size());
+      putBytes(data.empty() ? NULL : &data[0], data.size());
+    }
+
+    void putTransform(const tf::Transform& t)
+    {
+      const tf::Vector3& o = t.getOrigin();
+      tf::Quaternion q = t.getRotation();
+      double v[7] = { o.x(), o.y(), o.z(), q.x(), q.y(), q.z(), q.w() };
+      putBytes(v, sizeof(v));
+    }
+
+    void putMat(const cv::Mat& mat)
+    {
+      int32_t header[3] = { mat.rows, mat.cols, mat.type() };
+      putBytes(header, sizeof(header));
+
+      size_t row_size = mat.cols * mat.elemSize();
+      for (int v = 0; v < mat.rows; ++v)
+        putBytes(mat.ptr(v), row_size);
+    }
+
+  private:
+
+    std::vector<uint8_t>& buffer_;
+};
+
+/** @brief Reads binary data from a record payload, with bounds checks */
+class PayloadReader
+{
+  public:
+
+    PayloadReader(const std::vector<uint8_t>& buffer):
+      buffer_(buffer), offset_(0) { }
+
+    template <typename T>
+    bool get(T& value)
+    {
+      return getBytes(&value, sizeof(T));
+    }
+
+    bool getBytes(void * data, size_t size)
+    {
+      if (offset_ + size > buffer_.size()) return false;
+      if (size > 0) memcpy(data, &buffer_[offset_], size);
+      offset_ += size;
+      return true;
+    }
+
+    template <typename M>
+    bool getMsg(M& msg)
+    {
+      uint32_t size;
+      if (!get(size) || offset_ + size > buffer_.size()) return false;
+      ros::serialization::IStream stream(
+        const_cast<uint8_t*>(&buffer_[offset_]), size);
+
+      // a corrupted message overruns the stream
+      try
+      {
+        ros::serialization::deserialize(stream, msg);
+      }
+      catch(const std::exception&)
+      {
+        return false;
+      }
+
+      offset_ += size;
+      return true;
+    }
+
+    bool getString(std::string& s)
+    {
+      uint32_t size;
+      if (!get(size) || offset_ + size > buffer_.size()) return false;
+      s.assign((const char*)&buffer_[0] + offset_, size);
+      offset_ += size;
+      return true;
+    }
+
+    bool getBlob(std::vector<uint8_t>& data)
+    {
+      uint32_t size;
+      if (!get(size) || offset_ + size > buffer_.size()) return false;
+      data.assign(buffer_.begin() + offset_, buffer_.begin() + offset_ + size);
+      offset_ += size;
+      return true;
+    }
+
+    bool getTransform(tf::Transform& t)
+    {
+      double v[7];
+      if (!getBytes(v, sizeof(v))) return false;
+      t.setOrigin(tf::Vector3(v[0], v[1], v[2]));
+      t.setRotation(tf::Quaternion(v[3], v[4], v[5], v[6]));
+      return true;
+    }
+
+    bool getMat(cv::Mat& mat)
+    {
+      int32_t header[3];
+      if (!getBytes(header, sizeof(header))) return false;
+
+      // check the header against the payload before allocating
+      int rows = header[0];
+      int cols = header[1];
+      int type = header[2];
+      if (rows < 0 || cols < 0) return false;
+      if ((type & ~CV_MAT_TYPE_MASK) != 0 || CV_MAT_DEPTH(type) > CV_64F) 
+        return false;
+      if ((uint64_t)rows * (uint64_t)cols * CV_ELEM_SIZE(type) > 
+          buffer_.size() - offset_) 
+        return false;
+
+      mat.create(rows, cols, type);
+      size_t row_size = mat.cols * mat.elemSize();
+      for (int v = 0; v < mat.rows; ++v)
+        if (!getBytes(mat.ptr(v), row_size)) return false;
+      return true;
+    }
+
+  private:
+
+    const std::vector<uint8_t>& buffer_;
+    size_t offset_;
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_PAYLOAD_H
@@ -24,6 +24,7 @@
 #ifndef CCNY_RGBD_PROC_UTIL_H
 #define CCNY_RGBD_PROC_UTIL_H
 
+#include <iostream>
 #include <opencv2/opencv.hpp>
 
 namespace ccny_rgbd {
@@ -63,6 +64,79 @@ void unwarpDepthImage(
   const cv::Mat& coeff2,
   int fit_mode=DEPTH_FIT_QUADRATIC);
 
+/** @brief Pooling modes for downsampling depth images
+ * 
+ * The modes include:
+ *  - DEPTH_POOL_MIN (closest valid reading)
+ *  - DEPTH_POOL_MEDIAN (lower median of the valid readings)
+ * 
+ * Both modes only consider valid (non-zero) readings and 
+ * never interpolate between them, so no depth values are 
+ * invented across object boundaries.
+ */
+enum DepthPoolMode {
+  DEPTH_POOL_MIN,
+  DEPTH_POOL_MEDIAN
+};
+
+/** @brief Downsamples a depth image by a factor of 2, pooling each 
+ * 2x2 block of valid readings.
+ * 
+ * A block with no valid readings produces an invalid (0) output.
+ * 
+ * @param depth_img_in input depth image (16UC1, in mm)
+ * @param depth_img_out output depth image (16UC1, in mm), half the size
+ * @param pool_mode the pooling mode, see \ref DepthPoolMode
+ */
+void pyrDownDepthImage(
+  const cv::Mat& depth_img_in,
+  cv::Mat& depth_img_out,
+  int pool_mode=DEPTH_POOL_MEDIAN);
+
+/** @brief Downsamples an RGB (or mono) image by a factor of 2, 
+ * averaging each 2x2 block (box filter).
+ * 
+ * @param img_in input image
+ * @param img_out output image, half the size
+ */
+void pyrDownImage(
+  const cv::Mat& img_in,
+  cv::Mat& img_out);
+
+/** @brief Scales an intrinsic matrix to match an image downsampled 
+ * by a factor of 2 with \ref pyrDownImage or \ref pyrDownDepthImage
+ * 
+ * @param intr_in input intrinsic matrix (3x3, CV_64F)
+ * @param intr_out output intrinsic matrix
+ */
+void pyrDownIntrinsics(
+  const cv::Mat& intr_in,
+  cv::Mat& intr_out);
+
+/** @brief Writes a matrix to a binary stream (type, size and raw data).
+ * 
+ * Much faster than cv::FileStorage for large matrices such as 
+ * rectification maps.
+ * 
+ * @param stream the output stream
+ * @param mat the matrix to write
+ * @retval true the matrix was written
+ * @retval false writing failed
+ */
+bool writeMatBinary(std::ostream& stream, const cv::Mat& mat);
+
+/** @brief Reads a matrix written by \ref writeMatBinary
+ * 
+ * The header is checked (valid type, and no more data than is left 
+ * in the stream) before the matrix is allocated.
+ * 
+ * @param stream the input stream, which needs to be seekable
+ * @param mat the output matrix
+ * @retval true the matrix was read
+ * @retval false reading failed, or the header is invalid
+ */
+bool readMatBinary(std::istream& stream, cv::Mat& mat);
+
 } // namespace ccny_rgbd
 
 #endif // CCNY_RGBD_PROC_UTIL_H
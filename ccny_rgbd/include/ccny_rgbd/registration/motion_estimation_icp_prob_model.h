@@ -33,6 +33,7 @@
 #include <visualization_msgs/Marker.h>
 
 #include "ccny_rgbd/types.h"
+#include "ccny_rgbd/covariance_marker_publisher.h"
 #include "ccny_rgbd/registration/motion_estimation.h"
 #include "ccny_rgbd/Save.h"
 //#include "ccny_rgbd/Load.h"
@@ -140,6 +141,12 @@ class MotionEstimationICPProbModel: public MotionEstimation
      */
     bool publish_model_cov_;
 
+    /** @brief Maximum rate (Hz) at which covariance markers are published.
+     * 
+     * The markers are built in a background thread.
+     */
+    double model_cov_rate_;
+
     /** @brief Maximum squared Mahalanobis distance for associating points
      * between the data and the model, derived.
      */
@@ -159,7 +166,14 @@ class MotionEstimationICPProbModel: public MotionEstimation
 
     KdTree model_tree_;     ///< Kdtree of model_ptr_
 
+    /** @brief Builds the covariance markers off the VO thread
+     */
+    boost::shared_ptr<CovarianceMarkerPublisher> covariance_marker_publisher_;
+
     Matrix3f I_;            ///< 3x3 Identity matrix
+
+    bool model_subscribed_;     ///< Whether the model cloud topic has any subscribers
+    bool model_cov_subscribed_; ///< Whether the covariance topic has any subscribers
     
     tf::Transform f2b_; ///< Transform from fixed to moving frame
     
@@ -253,9 +267,16 @@ class MotionEstimationICPProbModel: public MotionEstimation
       const Vector3f& data_mean,
       const Matrix3f& data_cov);
 
-    /** @brief Publish covariance markers of the mdoel for visualization
+    /** @brief Hands the model covariances to the background marker
+     * publisher for visualization
      */
     void publishCovariances();
+
+    /** @brief Called when a subscriber connects to or disconnects from
+     * the model topics. The outputs are only built when there are 
+     * subscribers.
+     */
+    void connectCallback();
     
     /** @brief ROS service to save model to a file
      * @todo this is only saving the point cloud, not the actual distributions
@@ -0,0 +1,249 @@
+/**
+ *  @file rgbd_recording.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_RGBD_RECORDING_H
+#define CCNY_RGBD_RGBD_RECORDING_H
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <std_msgs/Header.h>
+
+#include "ccny_rgbd/types.h"
+
+namespace ccny_rgbd {
+
+/** @brief An RGBD frame, as stored in a recording.
+ *
+ * The RGB image is JPEG-compressed, and the depth image is
+ * RVL-compressed (lossless, to the millimeter).
+ */
+struct RGBDRecordingFrame
+{
+  std_msgs::Header rgb_header;     ///< header of the RGB image
+  std_msgs::Header depth_header;   ///< header of the depth image
+  uint32_t info_id;                ///< index of the camera info in the recording
+
+  std::string rgb_encoding;        ///< bgr8 or mono8
+  std::vector<uint8_t> rgb_data;   ///< JPEG-compressed RGB image
+
+  std::string depth_encoding;      ///< 16UC1 or 32FC1
+  std::vector<uint8_t> depth_data; ///< RVL-compressed depth image
+};
+
+/** @brief Compresses an RGB and a depth image into a recording frame
+ *
+ * @param rgb_msg the RGB image (any color encoding, or mono8)
+ * @param depth_msg the depth image (16UC1 or 32FC1)
+ * @param jpeg_quality JPEG quality of the RGB image, 0 to 100
+ * @param frame the output frame. The info id is not set.
+ * @retval true  Successfully encoded the images
+ * @retval false The images have unsupported encodings, or could 
+ *               not be encoded
+ */
+bool encodeRGBDRecordingFrame(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  int jpeg_quality,
+  RGBDRecordingFrame& frame);
+
+/** @brief Decompresses a recording frame into RGB and depth images
+ *
+ * @param frame the recording frame
+ * @param rgb_msg the output RGB image
+ * @param depth_msg the output depth image, in the recorded encoding
+ * @retval true  Successfully decoded the images
+ * @retval false The data is corrupted
+ */
+bool decodeRGBDRecordingFrame(
+  const RGBDRecordingFrame& frame,
+  ImageMsg::Ptr& rgb_msg,
+  ImageMsg::Ptr& depth_msg);
+
+/** @brief Writes RGBD frames to a chunked, indexed recording file.
+ *
+ * The file is a sequence of chunks, each framed as
+ * [type][payload size][payload][checksum]. A data chunk holds the
+ * camera info and frame records of several frames; it is written
+ * (and flushed) once it is full. Camera infos are only stored when
+ * the calibration changes, and are shared by the frames which
+ * follow them.
+ *
+ * On close, an index of all the records and their time stamps is
+ * appended, followed by a footer which points to it. A recording
+ * without a footer (for example, after a crash) can still be read:
+ * the index is rebuilt by scanning the data chunks.
+ *
+ * The writer is not thread-safe.
+ */
+class RGBDRecordingWriter
+{
+  public:
+
+    /** @brief Constructor
+     * @param chunk_size number of frames per data chunk
+     */
+    RGBDRecordingWriter(unsigned int chunk_size = 30);
+
+    /** @brief Default destructor. Closes the file.
+     */
+    virtual ~RGBDRecordingWriter();
+
+    /** @brief Creates a new recording, overwriting any existing file
+     * @param filename the recording file
+     * @retval true  the recording is open
+     * @retval false the file could not be created
+     */
+    bool open(const std::string& filename);
+
+    /** @brief Writes out the last chunk and the index, and closes the file
+     * @retval true  Successfully closed the recording
+     * @retval false Writing failed
+     */
+    bool close();
+
+    /** @brief Whether the recording is open
+     */
+    bool isOpen() const { return file_ != NULL; }
+
+    /** @brief Adds a camera info, if its calibration differs from the
+     * previous one.
+     *
+     * @param info_msg the camera info
+     * @return the id of the camera info, to be used by the frames
+     */
+    uint32_t addCameraInfo(const CameraInfoMsg& info_msg);
+
+    /** @brief Adds a frame
+     * @param frame the frame, with the id of its camera info
+     * @retval true  Successfully added the frame
+     * @retval false Writing failed
+     */
+    bool addFrame(const RGBDRecordingFrame& frame);
+
+    /** @brief The number of frames added so far
+     */
+    unsigned int getNumFrames() const { return frame_offsets_.size(); }
+
+  private:
+
+    unsigned int chunk_size_; ///< number of frames per data chunk
+
+    FILE * file_;             ///< the recording file
+    uint64_t file_offset_;    ///< current size of the file
+
+    std::vector<uint8_t> chunk_;  ///< the data chunk being filled
+    std::vector<uint8_t> record_; ///< serialization buffer for a record
+    unsigned int chunk_frames_;   ///< number of frames in the current chunk
+
+    bool has_info_;           ///< whether a camera info was added
+    CameraInfoMsg last_info_; ///< the last camera info added
+
+    std::vector<uint64_t> info_offsets_;  ///< file offsets of the camera info records
+    std::vector<uint64_t> frame_offsets_; ///< file offsets of the frame records
+    std::vector<ros::Time> frame_stamps_; ///< time stamps of the frames
+
+    /** @brief Appends record_ to the current chunk
+     * @return the file offset of the record
+     */
+    uint64_t appendRecord(uint32_t type);
+
+    /** @brief Writes out the current chunk, if not empty
+     */
+    bool writeChunk();
+};
+
+/** @brief Reads RGBD frames from a recording, in random order.
+ *
+ * See RGBDRecordingWriter for the file format.
+ */
+class RGBDRecordingReader
+{
+  public:
+
+    /** @brief Default constructor
+     */
+    RGBDRecordingReader();
+
+    /** @brief Default destructor. Closes the file.
+     */
+    virtual ~RGBDRecordingReader();
+
+    /** @brief Opens a recording, and reads its index and camera infos
+     * @param filename the recording file
+     * @retval true  the recording is open
+     * @retval false the file could not be opened, or is not a recording
+     */
+    bool open(const std::string& filename);
+
+    /** @brief Closes the file
+     */
+    void close();
+
+    /** @brief The number of frames in the recording
+     */
+    unsigned int getNumFrames() const { return frame_offsets_.size(); }
+
+    /** @brief The time stamp (of the RGB image) of a frame
+     */
+    const ros::Time& getStamp(unsigned int i) const { return frame_stamps_[i]; }
+
+    /** @brief The camera info with the given id, or NULL
+     */
+    CameraInfoMsg::ConstPtr getCameraInfo(uint32_t id) const;
+
+    /** @brief Reads a frame
+     * @param i the index of the frame
+     * @param frame the output frame
+     * @retval true  Successfully read the frame
+     * @retval false Reading failed
+     */
+    bool readFrame(unsigned int i, RGBDRecordingFrame& frame);
+
+  private:
+
+    FILE * file_; ///< the recording file
+
+    std::vector<CameraInfoMsg::Ptr> infos_;  ///< all the camera infos
+    std::vector<uint64_t> frame_offsets_;    ///< file offsets of the frame records
+    std::vector<ros::Time> frame_stamps_;    ///< time stamps of the frames
+
+    std::vector<uint8_t> record_; ///< buffer for reading records
+
+    /** @brief Reads the index written by the footer
+     */
+    bool readIndex();
+
+    /** @brief Rebuilds the index by scanning the data chunks
+     */
+    bool scanChunks();
+
+    /** @brief Reads the record at a given file offset into record_
+     */
+    bool readRecord(uint64_t offset, uint32_t& type);
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_RGBD_RECORDING_H
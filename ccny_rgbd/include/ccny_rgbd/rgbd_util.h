@@ -151,6 +151,18 @@ void convertMatToCameraInfo(
   const cv::Mat& intr,
   CameraInfoMsg& camera_info_msg);
 
+/** @brief Checks if two CameraInfoMsgs hold the same calibration
+ * 
+ * The headers are ignored, except for the frame id.
+ * 
+ * @param a the first CameraInfoMsg
+ * @param b the second CameraInfoMsg
+ * @retval true the calibrations are identical
+ */
+bool sameCameraCalibration(
+  const CameraInfoMsg& a,
+  const CameraInfoMsg& b);
+
 /** @brief Returns the duration, in ms, from a given time
  * 
  * @param start the start time
@@ -239,7 +251,7 @@ void buildRegisteredDepthImage(
 
 /** @brief Constructs a point cloud, a depth image and intrinsic matrix
  * 
- * @param depth_img_rect rectified depth image (16UC1, in mm) 
+ * @param depth_img_rect rectified depth image (16UC1 in mm, or 32FC1 in meters) 
  * @param intr_rect_ir intinsic matrix of the rectified depth image
  * @param cloud reference to teh output point cloud
  */
@@ -253,8 +265,8 @@ void buildPointCloud(
  * Prior to calling this functions, both images need to be rectified, 
  * and the depth image has to be registered into the frame of the RGB image.
  * 
- * @param depth_img_rect_reg rectified and registered depth image (16UC1, in mm) 
- * @param rgb_img_rect rectified rgb image (8UC3)
+ * @param depth_img_rect_reg rectified and registered depth image (16UC1 in mm, or 32FC1 in meters) 
+ * @param rgb_img_rect rectified rgb image (8UC3), or mono image (8UC1)
  * @param intr_rect_rgb intrinsic matrix
  * @param cloud reference to the output point cloud
  */
@@ -264,6 +276,64 @@ void buildPointCloud(
   const cv::Mat& intr_rect_rgb,
   PointCloudT& cloud);
 
+/** @brief Constructs a colored point cloud message directly from the 
+ * depth and RGB images, without going through a pcl::PointCloud.
+ * 
+ * The points are packed without padding. The default layout is 
+ * x, y, z (float32, meters) and rgb (packed, 16 bytes per point). 
+ * The compact layout has the fields x_mm, y_mm, z_mm (int16, 
+ * millimeters), followed by rgb (10 bytes per point). It is not
+ * readable as a pcl::PointXYZRGB cloud.
+ * 
+ * In the organized layout, the cloud has the same size as the images,
+ * and invalid points are NaN (or 0 in the compact layout). Otherwise, 
+ * only the valid points are stored.
+ * 
+ * The message data buffer is resized, not reallocated, so a message
+ * can be reused between calls.
+ * 
+ * @param depth_img_rect_reg rectified and registered depth image (16UC1 in mm, or 32FC1 in meters) 
+ * @param rgb_img_rect rectified rgb image (8UC3), or mono image (8UC1)
+ * @param intr_rect_rgb intrinsic matrix
+ * @param cloud reference to the output point cloud message
+ * @param organized whether to use the organized layout
+ * @param compact whether to use the compact layout
+ */
+void buildPointCloud2(
+  const cv::Mat& depth_img_rect_reg,
+  const cv::Mat& rgb_img_rect,
+  const cv::Mat& intr_rect_rgb,
+  PointCloud2Msg& cloud,
+  bool organized = false,
+  bool compact = false);
+
+/** @brief Reads the color of a pixel from a BGR (8UC3) or 
+ * mono (8UC1) image. Mono pixels are returned as gray.
+ *
+ * @param img the input image
+ * @param u the pixel column
+ * @param v the pixel row
+ * @param r output red component
+ * @param g output green component
+ * @param b output blue component
+ */
+inline void getPixelColor(
+  const cv::Mat& img, int u, int v,
+  uint8_t& r, uint8_t& g, uint8_t& b)
+{
+  if (img.channels() == 1)
+  {
+    r = g = b = img.at<uint8_t>(v, u);
+  }
+  else
+  {
+    const cv::Vec3b& c = img.at<cv::Vec3b>(v, u);
+    r = c[2];
+    g = c[1];
+    b = c[0];
+  }
+}
+
 /** @brief converts a 32FC1 depth image (in meters) to a
  * 16UC1 depth image (in mm).
  *
@@ -274,6 +344,60 @@ void depthImageFloatTo16bit(
   const cv::Mat& depth_image_in,
   cv::Mat& depth_image_out);
 
+/** @brief converts a 16UC1 depth image (in mm) to a
+ * 32FC1 depth image (in meters). Invalid (zero) pixels become NaN.
+ *
+ * @param depth_image_in the input 16UC1 image
+ * @param depth_image_out the output 32FC1 image
+ */
+void depthImage16bitToFloat(
+  const cv::Mat& depth_image_in,
+  cv::Mat& depth_image_out);
+
+/** @brief A batch of symmetric 3x3 matrices, stored as a
+ * structure of arrays (one array per unique matrix entry)
+ */
+struct SymmetricMatrix3fBatch
+{
+  FloatVector xx, xy, xz, yy, yz, zz;
+
+  void resize(unsigned int size);
+  unsigned int size() const { return xx.size(); }
+
+  /** @brief Fills the batch from a vector of 3x3 matrices,
+   * reusing the allocated memory when possible
+   */
+  void assign(const Matrix3fVector& matrices);
+};
+
+/** @brief Closed-form eigen-decomposition of a symmetric 3x3 matrix
+ *
+ * Uses the trigonometric solution for the eigenvalues and cross products
+ * for the eigenvectors. Much cheaper than the iterative cv::eigen for
+ * the small, well-conditioned covariance matrices used here.
+ *
+ * @param m the input symmetric matrix
+ * @param eigenvalues output eigenvalues, in descending order
+ * @param eigenvectors output matrix, with the eigenvectors stored as
+ *        rows (same convention as cv::eigen)
+ */
+void eigenSymmetric3x3(
+  const Matrix3f& m,
+  Vector3f& eigenvalues,
+  Matrix3f& eigenvectors);
+
+/** @brief Closed-form eigen-decomposition of a batch of symmetric
+ * 3x3 matrices
+ *
+ * @param batch the input matrices
+ * @param eigenvalues output eigenvalues, in descending order
+ * @param eigenvectors output matrices, with the eigenvectors stored as rows
+ */
+void eigenSymmetric3x3(
+  const SymmetricMatrix3fBatch& batch,
+  Vector3fVector& eigenvalues,
+  Matrix3fVector& eigenvectors);
+
 } // namespace ccny_rgbd
 
 #endif // CCNY_RGBD_RGBD_UTIL_H
@@ -0,0 +1,93 @@
+/**
+ *  @file rvl_codec.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_RVL_CODEC_H
+#define CCNY_RGBD_RVL_CODEC_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+namespace ccny_rgbd {
+
+/** @brief Lossless compression of a depth image, using run-length
+ * and variable-length coding (RVL).
+ *
+ * The image is coded as alternating runs of invalid (zero) and
+ * valid pixels. The valid pixels are coded as zig-zag deltas from
+ * the previous valid pixel, in variable-length 4-bit nibbles.
+ *
+ * Wilson, A.D. Fast Lossless Depth Image Compression. ISS 2017.
+ *
+ * 32FC1 images (in meters) are converted to millimeters first, so
+ * they are only preserved to the millimeter.
+ *
+ * @param depth_img the input depth image (16UC1 in mm, or 32FC1 in meters)
+ * @param buffer the output compressed data (resized, not reallocated)
+ */
+void compressDepthRVL(
+  const cv::Mat& depth_img,
+  std::vector<uint8_t>& buffer);
+
+/** @brief Decompresses an RVL depth image
+ *
+ * @param data the compressed data
+ * @param size the size of the compressed data, in bytes
+ * @param depth_img the output 16UC1 depth image, in mm
+ * The header is checked against the data before the image is 
+ * allocated: the data must code exactly rows * cols pixels.
+ *
+ * @retval true  Successfully decoded the image
+ * @retval false The data is truncated or corrupted
+ */
+bool decompressDepthRVL(
+  const uint8_t* data,
+  size_t size,
+  cv::Mat& depth_img);
+
+/** @brief Saves a depth image as an RVL file
+ *
+ * @param filename the output file
+ * @param depth_img the depth image (16UC1 in mm, or 32FC1 in meters)
+ * @retval true  Successfully saved the image
+ * @retval false Saving failed
+ */
+bool saveDepthRVL(
+  const std::string& filename,
+  const cv::Mat& depth_img);
+
+/** @brief Loads a depth image from an RVL file
+ *
+ * @param filename the input file
+ * @param depth_img the output 16UC1 depth image, in mm
+ * @retval true  Successfully loaded the image
+ * @retval false Loading failed
+ */
+bool loadDepthRVL(
+  const std::string& filename,
+  cv::Mat& depth_img);
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_RVL_CODEC_H
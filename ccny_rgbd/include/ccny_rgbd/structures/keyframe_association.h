@@ -24,7 +24,9 @@
 #ifndef CCNY_RGBD_KEYFRAME_ASSOCIATION_H
 #define CCNY_RGBD_KEYFRAME_ASSOCIATION_H
 
+#include <string>
 #include <Eigen/StdVector>
+#include <tf/transform_datatypes.h>
 #include <opencv2/features2d/features2d.hpp>
 
 namespace ccny_rgbd {
@@ -70,6 +72,39 @@ class KeyframeAssociation
 typedef Eigen::aligned_allocator<KeyframeAssociation> KeyframeAssociationAllocator;
 typedef std::vector<KeyframeAssociation, KeyframeAssociationAllocator> KeyframeAssociationVector;
 
+/** @brief Saves a vector of keyframe associations to a YAML file.
+* 
+* The RANSAC inlier matches index the keypoints of the keyframes, so
+* they are only meaningful with the same features. The version of the 
+* descriptor set they were computed with is saved along with them.
+* 
+* @param associations the associations being saved
+* @param filename the output file
+* @param descriptor_version the version of the keyframe descriptor set
+*  
+* @retval true  Successfully saved the data
+* @retval false Saving failed - for example, cannot open the file
+*/
+bool saveKeyframeAssociations(
+  const KeyframeAssociationVector& associations,
+  const std::string& filename,
+  const std::string& descriptor_version);
+
+/** @brief Loads a vector of keyframe associations from a YAML file.
+*  
+* @param associations the loaded associations
+* @param filename the input file
+* @param descriptor_version the version of the descriptor set the 
+*  matches were computed with
+*  
+* @retval true  Successfully loaded the data
+* @retval false Loading failed - for example, the file does not exist
+*/
+bool loadKeyframeAssociations(
+  KeyframeAssociationVector& associations,
+  const std::string& filename,
+  std::string& descriptor_version);
+
 } //namespace ccny_rgbd
 
 #endif // CCNY_RGBD_KEYFRAME_ASSOCIATION_H
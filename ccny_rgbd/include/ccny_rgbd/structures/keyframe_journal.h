@@ -0,0 +1,198 @@
+/**
+ *  @file keyframe_journal.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_KEYFRAME_JOURNAL_H
+#define CCNY_RGBD_KEYFRAME_JOURNAL_H
+
+#include <cstdio>
+#include <deque>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "ccny_rgbd/structures/rgbd_keyframe.h"
+
+namespace ccny_rgbd {
+
+/** @brief Append-only, on-disk journal of keyframes and pose updates.
+ *
+ * Records are queued by the caller and written by a background I/O
+ * thread. The queue is bounded: when it is full, the caller blocks
+ * until the I/O thread catches up. Each record is flushed to the
+ * operating system as soon as it is written, so a crash of the
+ * process loses at most the records which were still queued.
+ *
+ * Each record is framed as [type][payload size][payload][checksum].
+ * In keyframe records, the rgb image is stored as PNG and the depth 
+ * image as RVL (see \ref compressDepthRVL), both lossless.
+ * A record which was cut short by a crash fails the size or checksum
+ * test; loading stops there, and reopening the journal truncates it.
+ *
+ * Record types:
+ *  - KEYFRAME: a complete keyframe (images, camera model, pose)
+ *  - POSES:    new poses for all the keyframes so far
+ *  - RESET:    discards all the previous records
+ */
+class KeyframeJournal
+{
+  public:
+
+    /** @brief Constructor
+     * @param max_queue_size maximum number of queued (unwritten) records
+     */
+    KeyframeJournal(unsigned int max_queue_size = 8);
+
+    /** @brief Default destructor. Writes out the queue and closes the file.
+     */
+    virtual ~KeyframeJournal();
+
+    /** @brief Opens a journal for appending, creating it if needed.
+     *
+     * An incomplete record at the end of an existing journal is truncated.
+     *
+     * @param filename the journal file
+     * @retval true  the journal is open
+     * @retval false the file could not be opened, or is not a journal
+     */
+    bool open(const std::string& filename);
+
+    /** @brief Writes out the queue, and closes the journal
+     */
+    void close();
+
+    /** @brief Whether the journal is open
+     */
+    bool isOpen() const { return file_ != NULL; }
+
+    /** @brief Queues a new keyframe record.
+     *
+     * The images are shared with the keyframe, not copied, so they
+     * must not be modified in place afterwards.
+     *
+     * @param keyframe the new keyframe
+     */
+    void addKeyframe(const RGBDKeyframe& keyframe);
+
+    /** @brief Queues a pose update record for all the keyframes
+     * @param keyframes the keyframes, with their updated poses
+     */
+    void updatePoses(const KeyframeVector& keyframes);
+
+    /** @brief Queues a reset record, followed by all the keyframes
+     *
+     * Used when the keyframes are replaced (for example, after loading).
+     *
+     * @param keyframes the new keyframes
+     */
+    void reset(const KeyframeVector& keyframes);
+
+    /** @brief Blocks until all the queued records are written
+     */
+    void flush();
+
+    /** @brief Writes a compacted copy of the journal.
+     *
+     * The keyframe records are copied verbatim, without decoding the
+     * images, and all the pose updates are replaced by a single record
+     * with the current poses.
+     * 
+     * New records can be queued during the copy; only the records 
+     * written during the copy are copied under the lock. The file
+     * can be the journal itself, which is then replaced and reopened.
+     *
+     * @param filename the output file
+     * @param keyframes the keyframes, with their current poses
+     * @retval true  Successfully saved the data
+     * @retval false Saving failed
+     */
+    bool compact(const std::string& filename, const KeyframeVector& keyframes);
+
+    /** @brief Replays a journal into a vector of keyframes.
+     *
+     * Stops (successfully) at the first incomplete record.
+     *
+     * @param filename the journal file
+     * @param keyframes the output keyframes
+     * @retval true  Successfully loaded the data
+     * @retval false Loading failed - file not found, or not a journal
+     */
+    static bool load(const std::string& filename, KeyframeVector& keyframes);
+
+  private:
+
+    enum RecordType { RECORD_KEYFRAME = 1, RECORD_POSES = 2, RECORD_RESET = 3 };
+
+    /** @brief A queued record.
+     *
+     * Serialization happens in the I/O thread, so records only
+     * hold shallow copies of the keyframe data.
+     */
+    struct Record
+    {
+      RecordType type;
+      boost::shared_ptr<RGBDKeyframe> keyframe; ///< for KEYFRAME records
+      std::vector<tf::Transform> poses;         ///< for POSES records
+    };
+
+    unsigned int max_queue_size_; ///< maximum number of queued records
+
+    std::string filename_; ///< the journal file
+    FILE * file_;          ///< the journal file, opened for appending
+
+    boost::mutex mutex_;              ///< guards the queue and the flags
+    boost::condition_variable cond_;  ///< signals changes of the queue
+    boost::thread thread_;            ///< the I/O thread
+
+    std::deque<Record> queue_; ///< records waiting to be written
+    bool running_;             ///< cleared to stop the I/O thread
+    bool writing_;             ///< whether the I/O thread is writing a record
+
+    std::vector<uint8_t> buffer_;       ///< serialization buffer of the I/O thread
+    std::vector<uint8_t> image_buffer_; ///< image compression buffer of the I/O thread
+
+    /** @brief Adds a record to the queue, blocking while the queue is full
+     */
+    void enqueue(const Record& record);
+
+    /** @brief Main loop of the I/O thread
+     */
+    void spin();
+
+    /** @brief Serializes a record into buffer_ and appends it to the file
+     */
+    bool writeRecord(const Record& record);
+
+    /** @brief Returns the position after the last reset record in 
+     * [begin, end) of a journal file, or begin if there is none
+     */
+    static long findLastReset(FILE * file, long begin, long end);
+
+    /** @brief Copies the keyframe records from the current position of
+     * src up to end, to dst
+     */
+    static bool copyKeyframeRecords(FILE * src, long end, FILE * dst);
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_KEYFRAME_JOURNAL_H
@@ -35,6 +35,8 @@
 
 #include "ccny_rgbd/types.h"
 #include "ccny_rgbd/rgbd_util.h"
+#include "ccny_rgbd/depth_traits.h"
+#include "ccny_rgbd/rvl_codec.h"
 
 namespace ccny_rgbd {
 
@@ -58,17 +60,39 @@ class RGBDFrame
     RGBDFrame();
 
     /** @brief Constructor from ROS messages
-     * @param rgb_msg 8UC3 ROS image message
+     * 
+     * The images are shared with the messages, not copied.
+     * 
+     * @param rgb_msg 8UC3 or 8UC1 (mono) ROS image message
      * @param depth_msg 16UC1 ROS depth message (in mm, 0 = invalid data)
+     *        or 32FC1 ROS depth message (in meters, 0 or NaN = invalid data)
      * @param info_msg ROS camera info message, assumed no distortion, applies to both images
      */
     RGBDFrame(const ImageMsg::ConstPtr& rgb_msg,
               const ImageMsg::ConstPtr& depth_msg,
               const CameraInfoMsg::ConstPtr& info_msg);
+
+    /** @brief Re-initializes the frame from ROS messages, with a 
+     * camera model which was already built from the camera info.
+     * 
+     * Used to recycle frames, see \ref RGBDFrameFactory. Call clear() first.
+     * 
+     * @param rgb_msg 8UC3 or 8UC1 (mono) ROS image message
+     * @param depth_msg 16UC1 (mm) or 32FC1 (meters) ROS depth message
+     * @param camera_model the camera model, applies to both images
+     */
+    void init(const ImageMsg::ConstPtr& rgb_msg,
+              const ImageMsg::ConstPtr& depth_msg,
+              const image_geometry::PinholeCameraModel& camera_model);
+
+    /** @brief Releases the images and clears the keypoint data, 
+     * keeping the memory reserved by the keypoint vectors.
+     */
+    void clear();
         
     std_msgs::Header header; ///< Header taken from rgb_msg
-    cv::Mat rgb_img;         ///< RGB image (8UC3)
-    cv::Mat depth_img;       ///< Depth image in mm (16UC1). 0 = invalid data
+    cv::Mat rgb_img;         ///< RGB image (8UC3), or mono image (8UC1)
+    cv::Mat depth_img;       ///< Depth image in mm (16UC1) or meters (32FC1). See \ref DepthTraits
 
     /** @brief The intrinsic matrix which applies to both images. 
      * 
@@ -124,16 +148,20 @@ class RGBDFrame
     * 
     * @param frame Reference to the frame being saved
     * @param path The path to the folder where everything will be stored
+    * @param rvl_depth If true, the depth image is saved as depth.rvl 
+    *        (see \ref compressDepthRVL) instead of depth.png
     *  
     * @retval true  Successfully saved the data
     * @retval false Saving failed - for example, cannot create directory
     */
-    static bool save(const RGBDFrame& frame, const std::string& path);
+    static bool save(const RGBDFrame& frame, const std::string& path,
+                     bool rvl_depth = false);
 
     /** @brief Loads the RGBD frame from disk. 
     * 
     * Loands the RGB and depth images from png, and the header and intrinsic matrix
-    * from .yml files.  
+    * from .yml files. The depth image is read from depth.rvl if present, 
+    * otherwise from depth.png.
     * 
     * @param frame Reference to the frame being loaded
     * @param path The path to the folder where everything was saved.
@@ -164,6 +192,13 @@ class RGBDFrame
      */
     double getStdDevZ(double z) const;
 
+    /** @brief Shares the images of the ROS messages, and copies the header
+     * @param rgb_msg 8UC3 or 8UC1 (mono) ROS image message
+     * @param depth_msg 16UC1 (mm) or 32FC1 (meters) ROS depth message
+     */
+    void setImages(const ImageMsg::ConstPtr& rgb_msg,
+                   const ImageMsg::ConstPtr& depth_msg);
+
     /** @brief Calculates the z distribution (mean and variance) for a given pixel
      * 
      * Calculation is based on the standard quadratic model. See:
@@ -194,6 +229,21 @@ class RGBDFrame
      * @param z_var var(z), will a quadratic function of the mean, in meters^2
      */   
     void getGaussianMixtureDistribution(int u, int v, double& z_mean, double& z_var) const;
+
+    // **** implementations, specialized on the depth pixel type
+
+    template <typename DepthT>
+    void getGaussianDistributionT(int u, int v, double& z_mean, double& z_var) const;
+
+    template <typename DepthT>
+    void getGaussianMixtureDistributionT(int u, int v, double& z_mean, double& z_var) const;
+
+    template <typename DepthT>
+    void computeDistributionsT(double max_z, double max_stdev_z);
+
+    template <typename DepthT>
+    void constructDensePointCloudT(
+      PointCloudT& cloud, double max_z, double max_stdev_z) const;
 };
 
 } // namespace ccny_rgbd
@@ -0,0 +1,93 @@
+/**
+ *  @file rgbd_frame_factory.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ * 
+ *  @section LICENSE
+ * 
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_RGBD_FRAME_FACTORY_H
+#define CCNY_RGBD_RGBD_FRAME_FACTORY_H
+
+#include <boost/shared_ptr.hpp>
+
+#include "ccny_rgbd/structures/rgbd_frame.h"
+
+namespace ccny_rgbd {
+
+typedef boost::shared_ptr<RGBDFrame> RGBDFramePtr;
+
+class RGBDFramePool;
+
+/** @brief Creates RGBDFrames from ROS messages, reusing camera 
+ * models and frame storage between calls.
+ * 
+ * The camera model is only rebuilt when the contents of the 
+ * CameraInfo message change. Frames are returned to a pool when 
+ * the last RGBDFramePtr to them is released, and are handed out 
+ * again by the next create() call, together with the memory 
+ * already reserved by their keypoint vectors.
+ * 
+ * create() should be called from a single thread. The frames 
+ * themselves can be released from any thread, and can outlive 
+ * the factory.
+ */
+class RGBDFrameFactory
+{
+  public:
+
+    /** @brief Constructor
+     * @param pool_size maximum number of idle frames kept for reuse
+     */
+    RGBDFrameFactory(unsigned int pool_size = 2);
+
+    /** @brief Default destructor
+     */
+    virtual ~RGBDFrameFactory();
+
+    /** @brief Creates a frame from ROS messages.
+     * 
+     * Same as the RGBDFrame message constructor.
+     * 
+     * @param rgb_msg 8UC3 or 8UC1 (mono) ROS image message
+     * @param depth_msg 16UC1 (mm) or 32FC1 (meters) ROS depth message
+     * @param info_msg ROS camera info message, applies to both images
+     * @return pointer to the new frame
+     */
+    RGBDFramePtr create(
+      const ImageMsg::ConstPtr& rgb_msg,
+      const ImageMsg::ConstPtr& depth_msg,
+      const CameraInfoMsg::ConstPtr& info_msg);
+
+  private:
+
+    boost::shared_ptr<RGBDFramePool> pool_; ///< idle frames, shared with the frame deleters
+
+    CameraInfoMsg::ConstPtr info_msg_;         ///< the info the cached model was built from
+    image_geometry::PinholeCameraModel model_; ///< the cached camera model
+
+    /** @brief Rebuilds the cached camera model, if the 
+     * calibration in the info message has changed
+     * @param info_msg the camera info message
+     */
+    void updateModel(const CameraInfoMsg::ConstPtr& info_msg);
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_RGBD_FRAME_FACTORY_H
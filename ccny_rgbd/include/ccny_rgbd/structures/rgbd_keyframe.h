@@ -24,6 +24,7 @@
 #ifndef CCNY_RGBD_RGBD_KEYFRAME_H
 #define CCNY_RGBD_RGBD_KEYFRAME_H
 
+#include <deque>
 #include <boost/filesystem.hpp>
 #include <pcl/point_cloud.h>
 #include <pcl_ros/point_cloud.h>
@@ -53,6 +54,15 @@ class RGBDKeyframe: public RGBDFrame
      * @param frame reference to the frame which is being used to create a keyframe
      */
     RGBDKeyframe(const RGBDFrame& frame);
+
+    /** @brief Sets the images, header and camera model from a RGBDFrame.
+     * 
+     * The images are deep copies. Used to fill in a keyframe which
+     * was constructed in place.
+     * 
+     * @param frame reference to the frame which is being used to create a keyframe
+     */
+    void setFrame(const RGBDFrame& frame);
   
     tf::Transform pose; ///< pose of the camera, in some fixed frame
     
@@ -76,12 +86,14 @@ class RGBDKeyframe: public RGBDFrame
     * 
     * @param keyframe Reference to the keyframe being saved
     * @param path The path to the folder where everything will be stored
+    * @param rvl_depth If true, the depth image is saved as depth.rvl
     *  
     * @retval true  Successfully saved the data
     * @retval false Saving failed - for example, cannot create directory
     */
     static bool save(const RGBDKeyframe& keyframe, 
-                     const std::string& path);
+                     const std::string& path,
+                     bool rvl_depth = false);
     
     /** @brief Loads the RGBD keyframe to disk. 
     * 
@@ -98,18 +110,28 @@ class RGBDKeyframe: public RGBDFrame
 };
 
 typedef Eigen::aligned_allocator<RGBDKeyframe> KeyframeAllocator;
-typedef std::vector<RGBDKeyframe, KeyframeAllocator> KeyframeVector;
+
+/** @brief Keyframe storage.
+ * 
+ * A deque, so that appending never relocates (copies) the existing 
+ * keyframes, and references to them stay valid as the map grows.
+ * Keyframes should be appended empty and filled in place (see 
+ * RGBDKeyframe::setFrame), rather than copied in.
+ */
+typedef std::deque<RGBDKeyframe, KeyframeAllocator> KeyframeVector;
 
 /** @brief Saves a vector of RGBD keyframes to disk. 
 * 
 * @param keyframes Reference to the keyframe being saved
 * @param path The path to the folder where everything will be stored
+* @param rvl_depth If true, the depth images are saved as depth.rvl
 *  
 * @retval true  Successfully saved the data
 * @retval false Saving failed - for example, cannot create directory
 */
 bool saveKeyframes(const KeyframeVector& keyframes, 
-                   const std::string& path);
+                   const std::string& path,
+                   bool rvl_depth = false);
 
 /** @brief Loads a vector of RGBD keyframes to disk. 
 *  
@@ -0,0 +1,59 @@
+/**
+ *  @file rvl_publisher.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ * 
+ *  @section LICENSE
+ * 
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_RVL_PUBLISHER_H
+#define CCNY_RGBD_RVL_PUBLISHER_H
+
+#include <image_transport/simple_publisher_plugin.h>
+#include <sensor_msgs/CompressedImage.h>
+
+#include "ccny_rgbd/rvl_codec.h"
+
+namespace ccny_rgbd {
+
+/** @brief image_transport publisher plugin for RVL-compressed depth 
+ * images ("rvl" transport).
+ * 
+ * Accepts 16UC1 (mm) and 32FC1 (m) depth images. The compressed data
+ * is published as a sensor_msgs/CompressedImage, with the format 
+ * "<encoding>; rvl".
+ */
+class RVLPublisher: 
+  public image_transport::SimplePublisherPlugin<sensor_msgs::CompressedImage>
+{
+  public:
+
+    virtual ~RVLPublisher() {}
+
+    virtual std::string getTransportName() const { return "rvl"; }
+
+  protected:
+
+    virtual void publish(
+      const sensor_msgs::Image& message,
+      const PublishFn& publish_fn) const;
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_RVL_PUBLISHER_H
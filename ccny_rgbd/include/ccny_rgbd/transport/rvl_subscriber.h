@@ -0,0 +1,57 @@
+/**
+ *  @file rvl_subscriber.h
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ * 
+ *  @section LICENSE
+ * 
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CCNY_RGBD_RVL_SUBSCRIBER_H
+#define CCNY_RGBD_RVL_SUBSCRIBER_H
+
+#include <image_transport/simple_subscriber_plugin.h>
+#include <sensor_msgs/CompressedImage.h>
+
+#include "ccny_rgbd/rvl_codec.h"
+
+namespace ccny_rgbd {
+
+/** @brief image_transport subscriber plugin for RVL-compressed depth 
+ * images ("rvl" transport).
+ * 
+ * Restores the original encoding (16UC1 or 32FC1) of the image.
+ */
+class RVLSubscriber: 
+  public image_transport::SimpleSubscriberPlugin<sensor_msgs::CompressedImage>
+{
+  public:
+
+    virtual ~RVLSubscriber() {}
+
+    virtual std::string getTransportName() const { return "rvl"; }
+
+  protected:
+
+    virtual void internalCallback(
+      const sensor_msgs::CompressedImageConstPtr& message,
+      const Callback& user_cb);
+};
+
+} // namespace ccny_rgbd
+
+#endif // CCNY_RGBD_RVL_SUBSCRIBER_H
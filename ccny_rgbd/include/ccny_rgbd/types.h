@@ -29,6 +29,7 @@
 #include <pcl/kdtree/kdtree_flann.h>
 #include <pcl/registration/transformation_estimation_svd.h>
 #include <sensor_msgs/image_encodings.h>
+#include <sensor_msgs/PointCloud2.h>
 #include <nav_msgs/Odometry.h>
 #include <nav_msgs/Path.h>
 #include <image_transport/image_transport.h>
@@ -80,6 +81,7 @@ typedef sensor_msgs::Image            ImageMsg;
 typedef sensor_msgs::CameraInfo       CameraInfoMsg;
 typedef nav_msgs::Odometry            OdomMsg;
 typedef nav_msgs::Path                PathMsg;
+typedef sensor_msgs::PointCloud2      PointCloud2Msg;
 
 // ROS publishers, subscribers, services, etc
 
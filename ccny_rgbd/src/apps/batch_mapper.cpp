@@ -0,0 +1,341 @@
+/**
+ *  @file batch_mapper.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/apps/batch_mapper.h"
+
+#include <boost/foreach.hpp>
+#include <boost/filesystem.hpp>
+#include <message_filters/simple_filter.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <tf/tfMessage.h>
+
+#include "ccny_rgbd/rgbd_recording.h"
+
+namespace ccny_rgbd {
+
+/** @brief Feeds messages read from a bag to message filters */
+template <class M>
+class BagSubscriber: public message_filters::SimpleFilter<M>
+{
+  public:
+
+    void newMessage(const boost::shared_ptr<M const>& msg)
+    {
+      this->signalMessage(msg);
+    }
+};
+
+BatchMapper::BatchMapper(
+  const ros::NodeHandle& nh,
+  const ros::NodeHandle& nh_private):
+  nh_(nh),
+  nh_private_(nh_private),
+  initialized_(false),
+  trajectory_file_(NULL),
+  frame_count_(0),
+  keyframe_count_(0)
+{
+  ROS_INFO("Starting RGBD Batch Mapper");
+
+  // **** initialize ROS parameters
+
+  initParams();
+
+  // **** VO and mapper
+
+  visual_odometry_.reset(new VisualOdometry(nh_, nh_private_));
+  keyframe_mapper_.reset(new KeyframeMapper(nh_, nh_private_));
+}
+
+BatchMapper::~BatchMapper()
+{
+  ROS_INFO("Destroying RGBD Batch Mapper");
+
+  if (trajectory_file_) fclose(trajectory_file_);
+}
+
+void BatchMapper::initParams()
+{
+  if (!nh_private_.getParam ("input", input_))
+    input_ = "";
+  if (!nh_private_.getParam ("output_path", output_path_))
+    output_path_ = "batch";
+  if (!nh_private_.getParam ("rgb_topic", rgb_topic_))
+    rgb_topic_ = "/rgbd/rgb";
+  if (!nh_private_.getParam ("depth_topic", depth_topic_))
+    depth_topic_ = "/rgbd/depth";
+  if (!nh_private_.getParam ("info_topic", info_topic_))
+    info_topic_ = "/rgbd/info";
+  if (!nh_private_.getParam ("queue_size", queue_size_))
+    queue_size_ = 5;
+  if (!nh_private_.getParam ("solve_graph", solve_graph_))
+    solve_graph_ = true;
+  if (!nh_private_.getParam ("save_pcd_map", save_pcd_map_))
+    save_pcd_map_ = false;
+}
+
+bool BatchMapper::run()
+{
+  if (input_.empty())
+  {
+    ROS_ERROR("Batch Mapper: the input parameter is not set");
+    return false;
+  }
+
+  boost::filesystem::create_directories(output_path_);
+
+  std::string trajectory_filename = output_path_ + "/trajectory.txt";
+  trajectory_file_ = fopen(trajectory_filename.c_str(), "w");
+  if (trajectory_file_ == NULL)
+  {
+    ROS_ERROR("Can't create trajectory file %s", trajectory_filename.c_str());
+    return false;
+  }
+  fprintf(trajectory_file_, "# timestamp tx ty tz qx qy qz qw\n");
+
+  // **** process all the frames
+
+  ros::WallTime start = ros::WallTime::now();
+
+  bool result;
+  if (boost::filesystem::extension(input_) == ".bag")
+    result = processBag();
+  else
+    result = processRecording();
+
+  if (!result) return false;
+
+  double duration = (ros::WallTime::now() - start).toSec();
+  ROS_INFO("Processed %d frames in %.1f s (%.1f Hz), %d keyframes",
+    frame_count_, duration, duration > 0.0 ? frame_count_ / duration : 0.0,
+    keyframe_count_);
+
+  fclose(trajectory_file_);
+  trajectory_file_ = NULL;
+
+  // **** global alignment
+
+  if (solve_graph_ && keyframe_count_ > 0)
+  {
+    ROS_INFO("Generating and solving the keyframe graph...");
+
+    GenerateGraph::Request generate_request;
+    GenerateGraph::Response generate_response;
+    keyframe_mapper_->generateGraphSrvCallback(generate_request, generate_response);
+
+    SolveGraph::Request solve_request;
+    SolveGraph::Response solve_response;
+    keyframe_mapper_->solveGraphSrvCallback(solve_request, solve_response);
+  }
+
+  return saveOutputs();
+}
+
+bool BatchMapper::processBag()
+{
+  rosbag::Bag bag;
+
+  try
+  {
+    bag.open(input_, rosbag::bagmode::Read);
+  }
+  catch (rosbag::BagException& e)
+  {
+    ROS_ERROR("Can't open bag %s: %s", input_.c_str(), e.what());
+    return false;
+  }
+
+  // **** transforms, for the base to camera tf
+
+  rosbag::View tf_view(bag, rosbag::TopicQuery("/tf"));
+  BOOST_FOREACH(rosbag::MessageInstance const m, tf_view)
+  {
+    tf::tfMessage::ConstPtr tf_msg = m.instantiate<tf::tfMessage>();
+    if (!tf_msg) continue;
+
+    for (unsigned int i = 0; i < tf_msg->transforms.size(); ++i)
+    {
+      tf::StampedTransform transform;
+      tf::transformStampedMsgToTF(tf_msg->transforms[i], transform);
+      bag_tf_.setTransform(transform);
+    }
+  }
+
+  // **** frames
+
+  std::vector<std::string> topics;
+  topics.push_back(rgb_topic_);
+  topics.push_back(depth_topic_);
+  topics.push_back(info_topic_);
+
+  rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+  if (view.size() == 0)
+  {
+    ROS_ERROR("No messages on %s, %s or %s in %s. Bags of raw OpenNI data "
+              "need to be processed with openni_preprocess.launch first.",
+              rgb_topic_.c_str(), depth_topic_.c_str(), info_topic_.c_str(), 
+              input_.c_str());
+    bag.close();
+    return false;
+  }
+
+  BagSubscriber<ImageMsg>      sub_rgb;
+  BagSubscriber<ImageMsg>      sub_depth;
+  BagSubscriber<CameraInfoMsg> sub_info;
+
+  // the same synchronization as the live apps
+  RGBDSynchronizer3 sync(
+    RGBDSyncPolicy3(queue_size_), sub_rgb, sub_depth, sub_info);
+  sync.registerCallback(boost::bind(&BatchMapper::RGBDCallback, this, _1, _2, _3));
+
+  BOOST_FOREACH(rosbag::MessageInstance const m, view)
+  {
+    if (!ros::ok()) break;
+
+    if (m.getTopic() == rgb_topic_)
+    {
+      ImageMsg::ConstPtr msg = m.instantiate<ImageMsg>();
+      if (msg) sub_rgb.newMessage(msg);
+    }
+    else if (m.getTopic() == depth_topic_)
+    {
+      ImageMsg::ConstPtr msg = m.instantiate<ImageMsg>();
+      if (msg) sub_depth.newMessage(msg);
+    }
+    else if (m.getTopic() == info_topic_)
+    {
+      CameraInfoMsg::ConstPtr msg = m.instantiate<CameraInfoMsg>();
+      if (msg) sub_info.newMessage(msg);
+    }
+  }
+
+  bag.close();
+  return true;
+}
+
+bool BatchMapper::processRecording()
+{
+  RGBDRecordingReader reader;
+  if (!reader.open(input_)) return false;
+
+  RGBDRecordingFrame frame;
+
+  for (unsigned int i = 0; i < reader.getNumFrames(); ++i)
+  {
+    if (!ros::ok()) break;
+
+    ImageMsg::Ptr rgb_msg, depth_msg;
+    CameraInfoMsg::ConstPtr info_msg;
+
+    if (!reader.readFrame(i, frame) ||
+        !(info_msg = reader.getCameraInfo(frame.info_id)) ||
+        !decodeRGBDRecordingFrame(frame, rgb_msg, depth_msg))
+    {
+      ROS_WARN("Batch Mapper: skipping corrupted frame %d", i);
+      continue;
+    }
+
+    RGBDCallback(rgb_msg, depth_msg, info_msg);
+  }
+
+  return true;
+}
+
+void BatchMapper::RGBDCallback(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg)
+{
+  if (!initialized_)
+  {
+    initBaseToCameraTf(rgb_msg->header);
+    initialized_ = true;
+  }
+
+  // **** visual odometry
+
+  if (!visual_odometry_->processFrame(rgb_msg, depth_msg, info_msg)) return;
+
+  const tf::Transform& f2b = visual_odometry_->getPose();
+
+  // **** mapping (the mapper expects the camera pose)
+
+  RGBDFramePtr frame = frame_factory_.create(rgb_msg, depth_msg, info_msg);
+  tf::Transform f2c = f2b * visual_odometry_->getBaseToCameraTf();
+
+  if (keyframe_mapper_->processFrame(*frame, f2c)) 
+    keyframe_count_++;
+
+  // **** trajectory
+
+  const tf::Vector3& t = f2b.getOrigin();
+  tf::Quaternion q = f2b.getRotation();
+
+  fprintf(trajectory_file_, "%.6f %f %f %f %f %f %f %f\n",
+    rgb_msg->header.stamp.toSec(),
+    t.x(), t.y(), t.z(), q.x(), q.y(), q.z(), q.w());
+
+  frame_count_++;
+}
+
+void BatchMapper::initBaseToCameraTf(const std_msgs::Header& header)
+{
+  const std::string& base_frame = visual_odometry_->getBaseFrame();
+
+  tf::StampedTransform b2c;
+  try
+  {
+    bag_tf_.lookupTransform(base_frame, header.frame_id, ros::Time(0), b2c);
+    visual_odometry_->setBaseToCameraTf(b2c);
+  }
+  catch (tf::TransformException& ex)
+  {
+    ROS_WARN("No %s to %s transform in the input, assuming identity",
+      base_frame.c_str(), header.frame_id.c_str());
+
+    tf::Transform identity;
+    identity.setIdentity();
+    visual_odometry_->setBaseToCameraTf(identity);
+  }
+}
+
+bool BatchMapper::saveOutputs()
+{
+  Save::Request request;
+  Save::Response response;
+
+  request.filename = output_path_ + "/keyframes";
+  bool result = keyframe_mapper_->saveKeyframesSrvCallback(request, response);
+
+  if (save_pcd_map_)
+  {
+    request.filename = output_path_ + "/map.pcd";
+    result = keyframe_mapper_->savePcdMapSrvCallback(request, response) && result;
+  }
+
+  return result;
+}
+
+} // namespace ccny_rgbd
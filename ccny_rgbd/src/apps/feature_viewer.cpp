@@ -30,7 +30,9 @@ FeatureViewer::FeatureViewer(
   const ros::NodeHandle& nh_private):
   nh_(nh), 
   nh_private_(nh_private),
-  frame_count_(0)
+  frame_count_(0),
+  cloud_subscribed_(false),
+  covariances_subscribed_(false)
 {
   ROS_INFO("Starting RGBD Feature Viewer");
   
@@ -49,10 +51,15 @@ FeatureViewer::FeatureViewer(
 
   // **** publishers
   
+  ros::SubscriberStatusCallback connect_cb = 
+    boost::bind(&FeatureViewer::connectCallback, this);
+
   cloud_publisher_ = nh_.advertise<PointCloudFeature>(
-    "feature/cloud", 1);
+    "feature/cloud", 1, connect_cb, connect_cb);
   covariances_publisher_ = nh_.advertise<visualization_msgs::Marker>(
-    "feature/covariances", 1);
+    "feature/covariances", 1, connect_cb, connect_cb);
+  covariance_marker_publisher_.reset(new CovarianceMarkerPublisher(
+    covariances_publisher_, "covariances", covariances_rate_, 1.0, 1.0, 1.0));
   
   // **** subscribers
   
@@ -89,6 +96,8 @@ void FeatureViewer::initParams()
     publish_cloud_ = false;
   if (!nh_private_.getParam ("feature/publish_covariances", publish_covariances_))
     publish_covariances_ = false;
+  if (!nh_private_.getParam ("feature/publish_covariances_rate", covariances_rate_))
+    covariances_rate_ = 10.0;
 }
 
 void FeatureViewer::resetDetector()
@@ -170,23 +179,25 @@ void FeatureViewer::RGBDCallback(
   ros::WallTime start = ros::WallTime::now();
 
   // create frame
-  RGBDFrame frame(rgb_msg, depth_msg, info_msg);
+  RGBDFramePtr frame = frame_factory_.create(rgb_msg, depth_msg, info_msg);
 
   // find features
-  feature_detector_->findFeatures(frame);
+  feature_detector_->findFeatures(*frame);
  
   ros::WallTime end = ros::WallTime::now();
   
   // visualize 
   
-  if (show_keypoints_) showKeypointImage(frame);
-  if (publish_cloud_) publishFeatureCloud(frame);
-  if (publish_covariances_) publishFeatureCovariances(frame);
+  if (show_keypoints_) showKeypointImage(*frame);
+  if (publish_cloud_ && cloud_subscribed_) 
+    publishFeatureCloud(*frame);
+  if (publish_covariances_ && covariances_subscribed_) 
+    publishFeatureCovariances(*frame);
   
   // print diagnostics
 
-  int n_features = frame.keypoints.size();
-  int n_valid_features = frame.n_valid_keypoints;
+  int n_features = frame->keypoints.size();
+  int n_valid_features = frame->n_valid_keypoints;
 
   double d_total = 1000.0 * (end - start).toSec();
 
@@ -217,71 +228,19 @@ void FeatureViewer::publishFeatureCloud(RGBDFrame& frame)
 
 void FeatureViewer::publishFeatureCovariances(RGBDFrame& frame)
 {
-  // create markers
-  visualization_msgs::Marker marker;
-  marker.header = frame.header;
-  marker.type = visualization_msgs::Marker::LINE_LIST;
-  marker.color.r = 1.0;
-  marker.color.g = 1.0;
-  marker.color.b = 1.0;
-  marker.color.a = 1.0;
-  marker.scale.x = 0.0025;
-  marker.action = visualization_msgs::Marker::ADD;
-  marker.ns = "covariances";
-  marker.id = 0;
-  marker.lifetime = ros::Duration();
-
-  for (unsigned int kp_idx = 0; kp_idx < frame.keypoints.size(); ++kp_idx)
-  {
-    if (!frame.kp_valid[kp_idx]) continue;
-    
-    const Vector3f& kp_mean = frame.kp_means[kp_idx];
-    const Matrix3f& kp_cov  = frame.kp_covariances[kp_idx];
-
-    // transform Eigen to OpenCV matrices
-    cv::Mat m(3, 1, CV_64F);
-    for (int j = 0; j < 3; ++j)
-      m.at<double>(j, 0) = kp_mean(j, 0);
-
-    cv::Mat cov(3, 3, CV_64F);
-    for (int j = 0; j < 3; ++j)
-    for (int i = 0; i < 3; ++i)
-      cov.at<double>(j, i) = kp_cov(j, i);
-
-    // compute eigenvectors
-    cv::Mat evl(1, 3, CV_64F);
-    cv::Mat evt(3, 3, CV_64F);
-    cv::eigen(cov, evl, evt);
+  Vector3fVector means;
+  Matrix3fVector covariances;
+  removeInvalidDistributions(
+    frame.kp_means, frame.kp_covariances, frame.kp_valid,
+    means, covariances);
 
-    double mx = m.at<double>(0,0);
-    double my = m.at<double>(1,0);
-    double mz = m.at<double>(2,0);
-
-    for (int e = 0; e < 3; ++e)
-    {
-      geometry_msgs::Point a;
-      geometry_msgs::Point b;
-
-      double sigma = sqrt(evl.at<double>(0,e));
-      double scale = sigma * 3.0;
-      tf::Vector3 evt_tf(evt.at<double>(e,0), 
-                         evt.at<double>(e,1), 
-                         evt.at<double>(e,2));
-    
-      a.x = mx + evt_tf.getX() * scale;
-      a.y = my + evt_tf.getY() * scale;
-      a.z = mz + evt_tf.getZ() * scale;
-   
-      b.x = mx - evt_tf.getX() * scale;
-      b.y = my - evt_tf.getY() * scale;
-      b.z = mz - evt_tf.getZ() * scale;
-
-      marker.points.push_back(a);
-      marker.points.push_back(b);
-    }
-  }
+  covariance_marker_publisher_->update(frame.header, means, covariances);
+}
 
-  covariances_publisher_.publish(marker);
+void FeatureViewer::connectCallback()
+{
+  cloud_subscribed_       = (cloud_publisher_.getNumSubscribers() > 0);
+  covariances_subscribed_ = (covariances_publisher_.getNumSubscribers() > 0);
 }
 
 void FeatureViewer::reconfigCallback(FeatureDetectorConfig& config, uint32_t level)
@@ -37,21 +37,124 @@ KeyframeMapper::KeyframeMapper(
   // **** init variables
   
   graph_solver_ = new KeyframeGraphSolverG2O(nh, nh_private);
+
+  manual_add_ = false;
+  keyframes_subscribed_ = false;
+  poses_subscribed_     = false;
+  kf_assoc_subscribed_  = false;
+  path_subscribed_      = false;
+  grid_map_subscribed_   = false;
+  grid_tiles_subscribed_ = false;
+  stream_subscribers_    = 0;
+  stream_map_changed_    = true;
+  stream_focus_received_ = false;
+  stream_running_        = false;
+  stream_pending_        = false;
   
   // **** params
   
   initParams();
+
+  // **** journal: recover the previous session, and keep journaling
+  
+  if (!journal_path_.empty())
+  {
+    if (boost::filesystem::exists(journal_path_) &&
+        KeyframeJournal::load(journal_path_, keyframes_))
+    {
+      ROS_INFO("Recovered %d keyframes from %s", 
+        (int)keyframes_.size(), journal_path_.c_str());
+    }
+
+    journal_.reset(new KeyframeJournal(journal_queue_size_));
+    if (!journal_->open(journal_path_)) journal_.reset();
+  }
+
+  // **** live TSDF volume
+
+  if (tsdf_integration_ == "keyframes" || tsdf_integration_ == "frames")
+  {
+    tsdf_.reset(new TSDFVolume(
+      tsdf_res_, tsdf_trunc_, tsdf_max_weight_, tsdf_n_threads_));
+    buildTSDF(*tsdf_);
+  }
+  else if (tsdf_integration_ != "none")
+    ROS_WARN("Unknown tsdf_integration \"%s\", using \"none\"", 
+      tsdf_integration_.c_str());
+
+  // **** live surfel map
+
+  if (surfel_map_)
+  {
+    surfels_.reset(new SurfelMap(
+      surfel_pixel_step_, surfel_assoc_dist_, surfel_assoc_angle_));
+    buildSurfelMap(*surfels_);
+  }
+
+  // **** live query map
+
+  map_query_.setMaxDistance(query_max_distance_);
+
+  if (query_map_)
+  {
+    query_tree_.reset(new octomap::OcTree(octomap_res_));
+    map_query_.setMap(query_tree_);
+    rebuildQueryMap();
+  }
+
+  // **** submaps of the pcd map
+
+  if (submap_size_ > 0)
+  {
+    submaps_.reset(new SubmapManager(
+      submap_size_, pcd_map_res_, max_range_, max_stdev_));
+  }
+
+  // **** live 2D grid
+
+  if (grid_map_)
+  {
+    grid_.reset(new OccupancyGrid2D(grid_res_, grid_min_z_, max_map_z_));
+    updateGrid();
+  }
   
   // **** publishers
   
+  ros::SubscriberStatusCallback connect_cb = 
+    boost::bind(&KeyframeMapper::connectCallback, this);
+
   keyframes_pub_ = nh_.advertise<PointCloudT>(
-    "keyframes", queue_size_);
+    "keyframes", queue_size_, connect_cb, connect_cb);
   poses_pub_ = nh_.advertise<visualization_msgs::Marker>( 
-    "keyframe_poses", queue_size_);
+    "keyframe_poses", queue_size_, connect_cb, connect_cb);
   kf_assoc_pub_ = nh_.advertise<visualization_msgs::Marker>( 
-    "keyframe_associations", queue_size_);
+    "keyframe_associations", queue_size_, connect_cb, connect_cb);
   path_pub_ = nh_.advertise<PathMsg>( 
-    "keyframe_path", queue_size_);
+    "keyframe_path", queue_size_, connect_cb, connect_cb);
+  grid_map_pub_ = nh_.advertise<nav_msgs::OccupancyGrid>( 
+    "map", queue_size_, connect_cb, connect_cb, ros::VoidConstPtr(), true);
+  grid_tiles_pub_ = nh_.advertise<nav_msgs::OccupancyGrid>( 
+    "map_tiles", queue_size_, connect_cb, connect_cb);
+  map_region_pub_ = nh_.advertise<PointCloudT>(
+    "map_region", queue_size_);
+  
+  // **** map stream
+
+  if (stream_map_)
+  {
+    streamer_.reset(new MapStreamer(
+      stream_res_, stream_levels_, stream_focus_radius_));
+
+    map_stream_pub_ = nh_.advertise<MapStreamChunk>(
+      "map_stream", 100, connect_cb, connect_cb);
+    stream_focus_sub_ = nh_.subscribe(
+      "stream_focus", 1, &KeyframeMapper::streamFocusCallback, this);
+    stream_timer_ = nh_.createTimer(ros::Duration(1.0 / stream_rate_), 
+      &KeyframeMapper::streamTimerCallback, this);
+
+    stream_running_ = true;
+    stream_thread_ = boost::thread(&KeyframeMapper::spinStream, this);
+  }
   
   // **** services
   
@@ -69,6 +172,24 @@ KeyframeMapper::KeyframeMapper(
 
   save_octomap_service_ = nh_.advertiseService(
     "save_octomap", &KeyframeMapper::saveOctomapSrvCallback, this);
+
+  save_mesh_service_ = nh_.advertiseService(
+    "save_mesh", &KeyframeMapper::saveMeshSrvCallback, this);
+
+  save_surfel_map_service_ = nh_.advertiseService(
+    "save_surfel_map", &KeyframeMapper::saveSurfelMapSrvCallback, this);
+
+  save_tiled_map_service_ = nh_.advertiseService(
+    "save_tiled_map", &KeyframeMapper::saveTiledMapSrvCallback, this);
+  load_map_region_service_ = nh_.advertiseService(
+    "load_map_region", &KeyframeMapper::loadMapRegionSrvCallback, this);
+
+  query_occupancy_service_ = nh_.advertiseService(
+    "query_occupancy", &KeyframeMapper::queryOccupancySrvCallback, this);
+  cast_rays_service_ = nh_.advertiseService(
+    "cast_rays", &KeyframeMapper::castRaysSrvCallback, this);
+  query_distance_service_ = nh_.advertiseService(
+    "query_distance", &KeyframeMapper::queryDistanceSrvCallback, this);
     
   add_manual_keyframe_service_ = nh_.advertiseService(
     "add_manual_keyframe", &KeyframeMapper::addManualKeyframeSrvCallback, this);
@@ -95,6 +216,13 @@ KeyframeMapper::KeyframeMapper(
 
 KeyframeMapper::~KeyframeMapper()
 {
+  {
+    boost::mutex::scoped_lock lock(stream_mutex_);
+    stream_running_ = false;
+  }
+  stream_cond_.notify_one();
+  if (stream_thread_.joinable()) stream_thread_.join();
+
   delete graph_solver_;
 }
 
@@ -110,6 +238,14 @@ void KeyframeMapper::initParams()
     octomap_res_ = 0.05;
   if (!nh_private_.getParam ("octomap_with_color", octomap_with_color_))
    octomap_with_color_ = true;
+  if (!nh_private_.getParam ("octomap_shard_size", octomap_shard_size_))
+    octomap_shard_size_ = 6.4;
+  if (!nh_private_.getParam ("octomap_n_threads", octomap_n_threads_))
+    octomap_n_threads_ = 0;
+  if (!nh_private_.getParam ("octomap_discretize", octomap_discretize_))
+    octomap_discretize_ = false;
+  if (!nh_private_.getParam ("octomap_max_range", octomap_max_range_))
+    octomap_max_range_ = -1.0;
   if (!nh_private_.getParam ("kf_dist_eps", kf_dist_eps_))
     kf_dist_eps_  = 0.10;
   if (!nh_private_.getParam ("kf_angle_eps", kf_angle_eps_))
@@ -120,6 +256,60 @@ void KeyframeMapper::initParams()
     max_stdev_  = 0.03;
   if (!nh_private_.getParam ("max_map_z", max_map_z_))
     max_map_z_ = std::numeric_limits<double>::infinity();
+  if (!nh_private_.getParam ("journal_path", journal_path_))
+    journal_path_ = "";
+  if (!nh_private_.getParam ("journal_queue_size", journal_queue_size_))
+    journal_queue_size_ = 8;
+  if (!nh_private_.getParam ("save_depth_rvl", save_depth_rvl_))
+    save_depth_rvl_ = false;
+  if (!nh_private_.getParam ("tsdf_res", tsdf_res_))
+    tsdf_res_ = 0.01;
+  if (!nh_private_.getParam ("tsdf_trunc", tsdf_trunc_))
+    tsdf_trunc_ = 0.04;
+  if (!nh_private_.getParam ("tsdf_max_weight", tsdf_max_weight_))
+    tsdf_max_weight_ = 64.0;
+  if (!nh_private_.getParam ("tsdf_n_threads", tsdf_n_threads_))
+    tsdf_n_threads_ = 0;
+  if (!nh_private_.getParam ("tsdf_integration", tsdf_integration_))
+    tsdf_integration_ = "none";
+  if (!nh_private_.getParam ("surfel_map", surfel_map_))
+    surfel_map_ = false;
+  if (!nh_private_.getParam ("surfel_pixel_step", surfel_pixel_step_))
+    surfel_pixel_step_ = 2;
+  if (!nh_private_.getParam ("surfel_assoc_dist", surfel_assoc_dist_))
+    surfel_assoc_dist_ = 0.05;
+  if (!nh_private_.getParam ("surfel_assoc_angle", surfel_assoc_angle_))
+    surfel_assoc_angle_ = 30.0 * M_PI / 180.0;
+  if (!nh_private_.getParam ("surfel_min_confidence", surfel_min_confidence_))
+    surfel_min_confidence_ = 1.0;
+  if (!nh_private_.getParam ("query_map", query_map_))
+    query_map_ = false;
+  if (!nh_private_.getParam ("query_max_distance", query_max_distance_))
+    query_max_distance_ = 1.0;
+  if (!nh_private_.getParam ("submap_size", submap_size_))
+    submap_size_ = 0;
+  if (!nh_private_.getParam ("map_tile_size", map_tile_size_))
+    map_tile_size_ = 10.0;
+  if (!nh_private_.getParam ("stream_map", stream_map_))
+    stream_map_ = false;
+  if (!nh_private_.getParam ("stream_res", stream_res_))
+    stream_res_ = 0.05;
+  if (!nh_private_.getParam ("stream_levels", stream_levels_))
+    stream_levels_ = 4;
+  if (!nh_private_.getParam ("stream_focus_radius", stream_focus_radius_))
+    stream_focus_radius_ = 5.0;
+  if (!nh_private_.getParam ("stream_rate", stream_rate_))
+    stream_rate_ = 2.0;
+  if (!nh_private_.getParam ("stream_bandwidth", stream_bandwidth_))
+    stream_bandwidth_ = 200000;
+  if (!nh_private_.getParam ("stream_update_period", stream_update_period_))
+    stream_update_period_ = 10.0;
+  if (!nh_private_.getParam ("grid_map", grid_map_))
+    grid_map_ = false;
+  if (!nh_private_.getParam ("grid_res", grid_res_))
+    grid_res_ = 0.05;
+  if (!nh_private_.getParam ("grid_min_z", grid_min_z_))
+    grid_min_z_ = 0.05;
 }
   
 void KeyframeMapper::RGBDCallback(
@@ -141,9 +331,10 @@ void KeyframeMapper::RGBDCallback(
   {
     return;
   }
-  RGBDFrame frame(rgb_msg, depth_msg, info_msg);
-  bool result = processFrame(frame, transform);
-  if (result) publishKeyframeData(keyframes_.size() - 1);
+  RGBDFramePtr frame = frame_factory_.create(rgb_msg, depth_msg, info_msg);
+  bool result = processFrame(*frame, transform);
+  if (result && keyframes_subscribed_) 
+    publishKeyframeData(keyframes_.size() - 1);
 }
 
 bool KeyframeMapper::processFrame(
@@ -170,8 +361,36 @@ bool KeyframeMapper::processFrame(
   if (result)
   {
     addKeyframe(frame, pose);
-    publishPath();
+    if (path_subscribed_) publishPath();
+  }
+
+  if (tsdf_ && (result || tsdf_integration_ == "frames"))
+    tsdf_->integrate(frame, pose, max_range_);
+
+  if (surfels_ && result)
+    surfels_->integrate(frame, pose, keyframes_.size() - 1, max_range_);
+
+  if (query_tree_ && result)
+  {
+    insertKeyframeScan(*query_tree_, keyframes_.back());
+    map_query_.invalidate();
   }
+
+  if (submaps_ && result)
+    submaps_->update(keyframes_);
+
+  if (streamer_ && result)
+  {
+    stream_map_changed_ = true;
+    if (!stream_focus_received_) streamer_->setFocus(pose.getOrigin());
+  }
+
+  if (grid_ && result)
+  {
+    insertGridScan(keyframes_.size() - 1);
+    publishGrid();
+  }
+
   return result;
 }
 
@@ -179,7 +398,12 @@ void KeyframeMapper::addKeyframe(
   const RGBDFrame& frame, 
   const tf::Transform& pose)
 {
-  RGBDKeyframe keyframe(frame);
+  // construct in place: appending an empty keyframe is cheap, 
+  // and does not relocate the existing ones
+  keyframes_.push_back(RGBDKeyframe());
+  RGBDKeyframe& keyframe = keyframes_.back();
+
+  keyframe.setFrame(frame);
   keyframe.pose = pose;
   
   if (manual_add_)
@@ -188,7 +412,8 @@ void KeyframeMapper::addKeyframe(
     manual_add_ = false;
     keyframe.manually_added = true;
   }
-  keyframes_.push_back(keyframe);
+
+  if (journal_) journal_->addKeyframe(keyframe);
 }
 
 bool KeyframeMapper::publishKeyframeSrvCallback(
@@ -275,6 +500,8 @@ void KeyframeMapper::publishKeyframeData(int i)
 
 void KeyframeMapper::publishKeyframeAssociations()
 {
+  if (!kf_assoc_subscribed_) return;
+
   visualization_msgs::Marker marker;
   marker.header.stamp = ros::Time::now();
   marker.header.frame_id = fixed_frame_;
@@ -333,6 +560,8 @@ void KeyframeMapper::publishKeyframeAssociations()
 
 void KeyframeMapper::publishKeyframePoses()
 {
+  if (!poses_subscribed_) return;
+
   for(unsigned int kf_idx = 0; kf_idx < keyframes_.size(); ++kf_idx)
   {
     publishKeyframePose(kf_idx);
@@ -414,7 +643,22 @@ bool KeyframeMapper::saveKeyframesSrvCallback(
 {
   ROS_INFO("Saving keyframes...");
   std::string path = request.filename;
-  bool result = saveKeyframes(keyframes_, path);
+  bool result;
+  
+  if (journal_)
+  {
+    // the keyframes are already on disk: only compact the journal
+    boost::filesystem::create_directories(path);
+    result = journal_->compact(path + "/keyframes.journal", keyframes_);
+  }
+  else
+    result = saveKeyframes(keyframes_, path, save_depth_rvl_);
+
+  // the associations, so the graph can be solved after loading
+  if (result)
+    result = saveKeyframeAssociations(
+      associations_, path + "/associations.yml", 
+      graph_detector_.getDescriptorVersion());
   
   if (result) ROS_INFO("Keyframes saved to %s", path.c_str());
   else ROS_ERROR("Keyframe saving failed!");
@@ -428,7 +672,34 @@ bool KeyframeMapper::loadKeyframesSrvCallback(
 {
   ROS_INFO("Loading keyframes...");
   std::string path = request.filename;
-  bool result = loadKeyframes(keyframes_, path);
+  std::string journal_filename = path + "/keyframes.journal";
+  bool result;
+
+  if (boost::filesystem::exists(journal_filename))
+    result = KeyframeJournal::load(journal_filename, keyframes_);
+  else
+    result = loadKeyframes(keyframes_, path);
+
+  if (result) loadAssociations(path + "/associations.yml");
+
+  // the loaded keyframes replace the journaled ones
+  if (result && journal_) journal_->reset(keyframes_);
+  if (result) rebuildLiveTSDF();
+  if (result && surfels_) buildSurfelMap(*surfels_);
+  if (result) rebuildQueryMap();
+  if (result && submaps_) submaps_->clear();
+  if (result) stream_map_changed_ = true;
+  if (result && grid_)
+  {
+    grid_->clear();
+    updateGrid();
+  }
+  
+  if (result)
+  {
+    publishKeyframePoses();
+    publishKeyframeAssociations();
+  }
   
   if (result) ROS_INFO("Keyframes loaded successfully");
   else ROS_ERROR("Keyframe loading failed!");
@@ -436,6 +707,51 @@ bool KeyframeMapper::loadKeyframesSrvCallback(
   return result;
 }
 
+void KeyframeMapper::loadAssociations(const std::string& filename)
+{
+  associations_.clear();
+  if (!boost::filesystem::exists(filename)) return;
+
+  std::string descriptor_version;
+  if (!loadKeyframeAssociations(associations_, filename, descriptor_version))
+  {
+    ROS_WARN("Error loading keyframe associations");
+    associations_.clear();
+    return;
+  }
+
+  // drop the associations which reference missing keyframes
+  int n_kf = keyframes_.size();
+  unsigned int n_kept = 0;
+  for (unsigned int as_idx = 0; as_idx < associations_.size(); ++as_idx)
+  {
+    const KeyframeAssociation& association = associations_[as_idx];
+    if (association.kf_idx_a < 0 || association.kf_idx_a >= n_kf ||
+        association.kf_idx_b < 0 || association.kf_idx_b >= n_kf) continue;
+
+    if (n_kept != as_idx) associations_[n_kept] = association;
+    ++n_kept;
+  }
+
+  if (n_kept < associations_.size())
+  {
+    ROS_WARN("Dropped %d keyframe associations which reference missing keyframes",
+             (int)(associations_.size() - n_kept));
+    associations_.erase(associations_.begin() + n_kept, associations_.end());
+  }
+
+  // the transforms are still valid for solving the graph, and the 
+  // number of inliers still weights them, but the inliers themselves 
+  // refer to keypoints from a different descriptor set
+  if (descriptor_version != graph_detector_.getDescriptorVersion())
+    ROS_WARN("Keyframe associations were matched with descriptors \"%s\", "
+             "not \"%s\": the RANSAC inliers are out of date", 
+             descriptor_version.c_str(), 
+             graph_detector_.getDescriptorVersion().c_str());
+
+  ROS_INFO("Loaded %d keyframe associations", (int)associations_.size());
+}
+
 bool KeyframeMapper::savePcdMapSrvCallback(
   Save::Request& request,
   Save::Response& response)
@@ -464,6 +780,173 @@ bool KeyframeMapper::saveOctomapSrvCallback(
   return result;
 }
 
+bool KeyframeMapper::saveMeshSrvCallback(
+  Save::Request& request,
+  Save::Response& response)
+{
+  ROS_INFO("Saving map as TSDF mesh...");
+  const std::string& path = request.filename;
+  bool result = saveMesh(path);
+    
+  if (result) ROS_INFO("Mesh saved to %s", path.c_str());
+  else ROS_ERROR("Mesh saving failed");
+    
+  return result;
+}
+
+bool KeyframeMapper::saveSurfelMapSrvCallback(
+  Save::Request& request,
+  Save::Response& response)
+{
+  ROS_INFO("Saving surfel map...");
+  const std::string& path = request.filename;
+  bool result;
+
+  if (surfels_)
+    result = saveSurfelMapPLY(path, *surfels_, surfel_min_confidence_);
+  else
+  {
+    SurfelMap map(surfel_pixel_step_, surfel_assoc_dist_, surfel_assoc_angle_);
+    buildSurfelMap(map);
+    result = saveSurfelMapPLY(path, map, surfel_min_confidence_);
+  }
+    
+  if (result) ROS_INFO("Surfel map saved to %s", path.c_str());
+  else ROS_ERROR("Surfel map saving failed");
+    
+  return result;
+}
+
+bool KeyframeMapper::saveTiledMapSrvCallback(
+  Save::Request& request,
+  Save::Response& response)
+{
+  ROS_INFO("Saving tiled map...");
+  const std::string& path = request.filename;
+
+  PointCloudT pcd_map;
+  buildPcdMap(pcd_map);
+  bool result = saveTiledMap(path, pcd_map, map_tile_size_);
+
+  if (result) ROS_INFO("Tiled map saved to %s", path.c_str());
+  else ROS_ERROR("Tiled map saving failed");
+
+  return result;
+}
+
+bool KeyframeMapper::loadMapRegionSrvCallback(
+  LoadMapRegion::Request& request,
+  LoadMapRegion::Response& response)
+{
+  TiledMapIndex index;
+  if (!loadTiledMapIndex(request.path, index))
+  {
+    ROS_ERROR("Could not load the tiled map index from %s", request.path.c_str());
+    return false;
+  }
+
+  const geometry_msgs::Point& min_p = request.min_point;
+  const geometry_msgs::Point& max_p = request.max_point;
+
+  PointCloudT::Ptr region(new PointCloudT());
+  response.n_tiles = loadTiledMapRegion(request.path, index,
+    tf::Vector3(min_p.x, min_p.y, min_p.z), 
+    tf::Vector3(max_p.x, max_p.y, max_p.z), *region);
+
+  if (response.n_tiles < 0)
+  {
+    ROS_ERROR("Could not load the tiles from %s", request.path.c_str());
+    return false;
+  }
+
+  ROS_INFO("Loaded %d of %d tiles", response.n_tiles, (int)index.tiles.size());
+
+  region->header.frame_id = fixed_frame_;
+  map_region_pub_.publish(region);
+
+  return true;
+}
+
+bool KeyframeMapper::queryOccupancySrvCallback(
+  QueryOccupancy::Request& request,
+  QueryOccupancy::Response& response)
+{
+  if (!map_query_.hasMap())
+  {
+    ROS_ERROR("No map to query, the query_map parameter is not set");
+    return false;
+  }
+
+  response.occupancy.resize(request.points.size());
+  for (unsigned int pt_idx = 0; pt_idx < request.points.size(); ++pt_idx)
+  {
+    const geometry_msgs::Point& p = request.points[pt_idx];
+    response.occupancy[pt_idx] = 
+      map_query_.getOccupancy(octomap::point3d(p.x, p.y, p.z));
+  }
+
+  return true;
+}
+
+bool KeyframeMapper::castRaysSrvCallback(
+  CastRays::Request& request,
+  CastRays::Response& response)
+{
+  if (!map_query_.hasMap())
+  {
+    ROS_ERROR("No map to query, the query_map parameter is not set");
+    return false;
+  }
+
+  if (request.origins.size() != request.directions.size())
+  {
+    ROS_ERROR("The number of ray origins and directions does not match");
+    return false;
+  }
+
+  unsigned int n_rays = request.origins.size();
+  response.hit.resize(n_rays);
+  response.end_points.resize(n_rays);
+
+  for (unsigned int ray_idx = 0; ray_idx < n_rays; ++ray_idx)
+  {
+    const geometry_msgs::Point& o = request.origins[ray_idx];
+    const geometry_msgs::Vector3& d = request.directions[ray_idx];
+    
+    octomap::point3d end;
+    response.hit[ray_idx] = map_query_.castRay(
+      octomap::point3d(o.x, o.y, o.z), octomap::point3d(d.x, d.y, d.z),
+      request.max_range, request.ignore_unknown, end);
+
+    response.end_points[ray_idx].x = end.x();
+    response.end_points[ray_idx].y = end.y();
+    response.end_points[ray_idx].z = end.z();
+  }
+
+  return true;
+}
+
+bool KeyframeMapper::queryDistanceSrvCallback(
+  QueryDistance::Request& request,
+  QueryDistance::Response& response)
+{
+  if (!map_query_.hasMap())
+  {
+    ROS_ERROR("No map to query, the query_map parameter is not set");
+    return false;
+  }
+
+  response.distances.resize(request.points.size());
+  for (unsigned int pt_idx = 0; pt_idx < request.points.size(); ++pt_idx)
+  {
+    const geometry_msgs::Point& p = request.points[pt_idx];
+    response.distances[pt_idx] = 
+      map_query_.getDistance(octomap::point3d(p.x, p.y, p.z));
+  }
+
+  return true;
+}
+
 bool KeyframeMapper::addManualKeyframeSrvCallback(
   AddManualKeyframe::Request& request,
   AddManualKeyframe::Response& response)
@@ -492,6 +975,22 @@ bool KeyframeMapper::solveGraphSrvCallback(
 {
   graph_solver_->solve(keyframes_, associations_);
 
+  if (journal_) journal_->updatePoses(keyframes_);
+  rebuildLiveTSDF();
+
+  // the surfels move with their keyframes, without re-fusing
+  if (surfels_)
+  {
+    std::vector<tf::Transform> poses(keyframes_.size());
+    for (unsigned int kf_idx = 0; kf_idx < keyframes_.size(); ++kf_idx)
+      poses[kf_idx] = keyframes_[kf_idx].pose;
+    surfels_->deform(poses);
+  }
+
+  rebuildQueryMap();
+  if (grid_) updateGrid();
+  stream_map_changed_ = true;
+
   publishKeyframePoses();
   publishKeyframeAssociations();
 
@@ -513,6 +1012,15 @@ bool KeyframeMapper::savePcdMap(const std::string& path)
 
 void KeyframeMapper::buildPcdMap(PointCloudT& map_cloud)
 {
+  if (submaps_)
+  {
+    // only the submaps with moved or new keyframes are fused
+    submaps_->update(keyframes_);
+    submaps_->compose(keyframes_, map_cloud, max_map_z_);
+    map_cloud.header.frame_id = fixed_frame_;
+    return;
+  }
+
   PointCloudT::Ptr aggregate_cloud(new PointCloudT());
   aggregate_cloud->header.frame_id = fixed_frame_;
 
@@ -564,37 +1072,331 @@ bool KeyframeMapper::saveOctomap(const std::string& path)
 void KeyframeMapper::buildOctomap(octomap::OcTree& tree)
 {
   ROS_INFO("Building Octomap...");
-  
-  octomap::point3d sensor_origin(0.0, 0.0, 0.0);  
+
+  // the rays are cast in parallel, into spatial shards
+  ShardedOctreeBuilder builder(
+    tree.getResolution(), octomap_shard_size_, octomap_n_threads_,
+    octomap_discretize_, octomap_max_range_);
 
   for (unsigned int kf_idx = 0; kf_idx < keyframes_.size(); ++kf_idx)
   {
     ROS_INFO("Processing keyframe %u", kf_idx);
     const RGBDKeyframe& keyframe = keyframes_[kf_idx];
     
-    PointCloudT cloud;
-    keyframe.constructDensePointCloud(cloud, max_range_, max_stdev_);
-           
     octomap::pose6d frame_origin = poseTfToOctomap(keyframe.pose);
 
-    // build octomap cloud from pcl cloud
     octomap::Pointcloud octomap_cloud;
-    for (unsigned int pt_idx = 0; pt_idx < cloud.points.size(); ++pt_idx)
+    buildKeyframeScan(keyframe, octomap_cloud);
+    octomap_cloud.transform(frame_origin);
+
+    builder.insertScan(octomap_cloud, frame_origin.trans());
+  }
+
+  builder.merge(tree);
+  ROS_INFO("Merged %d octomap shards", builder.getNumShards());
+}
+
+void KeyframeMapper::buildKeyframeScan(
+  const RGBDKeyframe& keyframe,
+  octomap::Pointcloud& scan)
+{
+  PointCloudT cloud;
+  keyframe.constructDensePointCloud(cloud, max_range_, max_stdev_);
+
+  // build octomap cloud from pcl cloud
+  scan.clear();
+  for (unsigned int pt_idx = 0; pt_idx < cloud.points.size(); ++pt_idx)
+  {
+    const PointT& p = cloud.points[pt_idx];
+    if (!std::isnan(p.z))
+      scan.push_back(p.x, p.y, p.z);
+  }
+}
+
+void KeyframeMapper::insertKeyframeScan(
+  octomap::OcTree& tree,
+  const RGBDKeyframe& keyframe)
+{
+  octomap::point3d sensor_origin(0.0, 0.0, 0.0);  
+  octomap::pose6d frame_origin = poseTfToOctomap(keyframe.pose);
+
+  octomap::Pointcloud octomap_cloud;
+  buildKeyframeScan(keyframe, octomap_cloud);
+  
+  if (octomap_discretize_)
+  {
+    octomap_cloud.transform(frame_origin);
+    insertDiscreteScan(
+      tree, octomap_cloud, frame_origin.trans(), octomap_max_range_);
+  }
+  else
+    tree.insertScan(
+      octomap_cloud, sensor_origin, frame_origin, octomap_max_range_);
+}
+
+void KeyframeMapper::rebuildQueryMap()
+{
+  if (!query_tree_) return;
+
+  query_tree_->clear();
+  buildOctomap(*query_tree_);
+  map_query_.invalidate();
+}
+
+void KeyframeMapper::insertGridScan(int kf_idx)
+{
+  const RGBDKeyframe& keyframe = keyframes_[kf_idx];
+
+  PointCloudT cloud;
+  keyframe.constructDensePointCloud(cloud, max_range_, max_stdev_);
+
+  PointCloudT cloud_tf;
+  pcl::transformPointCloud(cloud, cloud_tf, eigenFromTf(keyframe.pose));
+
+  grid_->insertScan(kf_idx, cloud_tf, keyframe.pose);
+}
+
+void KeyframeMapper::updateGrid()
+{
+  // a keyframe is re-projected if it moved by more than half a cell,
+  // or rotated enough to move its farthest points by half a cell
+  double max_dist  = 0.5 * grid_res_;
+  double max_angle = 0.5 * grid_res_ / max_range_;
+
+  int n_updated = 0;
+  for (unsigned int kf_idx = 0; kf_idx < keyframes_.size(); ++kf_idx)
+  {
+    if (grid_->hasScan(kf_idx))
     {
-      const PointT& p = cloud.points[pt_idx];
-      if (!std::isnan(p.z))
-        octomap_cloud.push_back(p.x, p.y, p.z);
+      double dist, angle;
+      getTfDifference(
+        keyframes_[kf_idx].pose, grid_->getScanPose(kf_idx), dist, angle);
+      if (dist <= max_dist && angle <= max_angle) continue;
     }
-    
-    tree.insertScan(octomap_cloud, sensor_origin, frame_origin);
+
+    insertGridScan(kf_idx);
+    ++n_updated;
+  }
+
+  ROS_INFO("Projected %d of %d keyframes into the 2D grid", 
+    n_updated, (int)keyframes_.size());
+
+  publishGrid();
+}
+
+void KeyframeMapper::publishGrid()
+{
+  // always consumed, so the changes do not pile up
+  std::vector<VoxelIndex> tiles;
+  grid_->getChangedTiles(tiles);
+
+  if (grid_tiles_subscribed_)
+  {
+    for (unsigned int t_idx = 0; t_idx < tiles.size(); ++t_idx)
+    {
+      nav_msgs::OccupancyGrid::Ptr tile_msg(new nav_msgs::OccupancyGrid());
+      grid_->getTileMsg(tiles[t_idx], *tile_msg);
+      tile_msg->header.stamp = ros::Time::now();
+      tile_msg->header.frame_id = fixed_frame_;
+      tile_msg->info.map_load_time = tile_msg->header.stamp;
+      grid_tiles_pub_.publish(tile_msg);
+    }
+  }
+
+  if (grid_map_subscribed_ && !tiles.empty()) publishGridMap();
+}
+
+void KeyframeMapper::streamFocusCallback(
+  const geometry_msgs::PointStamped::ConstPtr& focus_msg)
+{
+  geometry_msgs::PointStamped focus;
+  try
+  {
+    tf_listener_.transformPoint(fixed_frame_, *focus_msg, focus);
+  }
+  catch(tf::TransformException& ex)
+  {
+    ROS_WARN("Could not transform the stream focus: %s", ex.what());
+    return;
+  }
+
+  streamer_->setFocus(tf::Vector3(focus.point.x, focus.point.y, focus.point.z));
+  stream_focus_received_ = true;
+}
+
+void KeyframeMapper::streamTimerCallback(const ros::TimerEvent& event)
+{
+  if (stream_subscribers_ == 0) return;
+
+  // **** hand the changed map to the stream thread, at most once 
+  // per update period, and only when the last rebuild is done
+
+  ros::Time now = ros::Time::now();
+  if (stream_map_changed_ && 
+      (stream_map_time_.isZero() || 
+       (now - stream_map_time_).toSec() >= stream_update_period_))
+  {
+    boost::mutex::scoped_lock lock(stream_mutex_);
+    if (!stream_pending_)
+    {
+      // shallow copies: the images are shared, not duplicated
+      stream_keyframes_.clear();
+      for (unsigned int kf_idx = 0; kf_idx < keyframes_.size(); ++kf_idx)
+      {
+        const RGBDKeyframe& keyframe = keyframes_[kf_idx];
+        RGBDKeyframe snapshot;
+        snapshot.header    = keyframe.header;
+        snapshot.rgb_img   = keyframe.rgb_img;
+        snapshot.depth_img = keyframe.depth_img;
+        snapshot.model     = keyframe.model;
+        snapshot.pose      = keyframe.pose;
+        stream_keyframes_.push_back(snapshot);
+      }
+
+      stream_pending_ = true;
+      stream_cond_.notify_one();
+
+      stream_map_changed_ = false;
+      stream_map_time_ = now;
+    }
+  }
+
+  // **** send the next chunks
+
+  std::vector<MapStreamChunk::Ptr> chunks;
+  streamer_->getChunks((int)(stream_bandwidth_ / stream_rate_), chunks);
+
+  for (unsigned int c_idx = 0; c_idx < chunks.size(); ++c_idx)
+  {
+    chunks[c_idx]->header.stamp = now;
+    chunks[c_idx]->header.frame_id = fixed_frame_;
+    map_stream_pub_.publish(chunks[c_idx]);
   }
 }
 
+void KeyframeMapper::spinStream()
+{
+  while (true)
+  {
+    KeyframeVector keyframes;
+
+    {
+      boost::mutex::scoped_lock lock(stream_mutex_);
+      while (stream_running_ && !stream_pending_) stream_cond_.wait(lock);
+      if (!stream_running_) return;
+      keyframes.swap(stream_keyframes_);
+    }
+
+    PointCloudT map_cloud;
+    buildStreamMap(keyframes, map_cloud);
+    streamer_->setMap(map_cloud);
+
+    boost::mutex::scoped_lock lock(stream_mutex_);
+    stream_pending_ = false;
+  }
+}
+
+void KeyframeMapper::buildStreamMap(
+  const KeyframeVector& keyframes, 
+  PointCloudT& map_cloud) const
+{
+  map_cloud.header.frame_id = fixed_frame_;
+
+  for (unsigned int kf_idx = 0; kf_idx < keyframes.size(); ++kf_idx)
+  {
+    const RGBDKeyframe& keyframe = keyframes[kf_idx];
+
+    PointCloudT::Ptr cloud(new PointCloudT());
+    keyframe.constructDensePointCloud(*cloud, max_range_, max_stdev_);
+
+    PointCloudT::Ptr cloud_tf(new PointCloudT());
+    pcl::transformPointCloud(*cloud, *cloud_tf, eigenFromTf(keyframe.pose));
+
+    // the streamer never resolves finer than stream_res_
+    PointCloudT cloud_ds;
+    pcl::VoxelGrid<PointT> vgf;
+    vgf.setInputCloud(cloud_tf);
+    vgf.setLeafSize(stream_res_, stream_res_, stream_res_);
+    vgf.setFilterFieldName("z");
+    vgf.setFilterLimits (-std::numeric_limits<double>::infinity(), max_map_z_);
+    vgf.filter(cloud_ds);
+
+    map_cloud += cloud_ds;
+  }
+}
+
+void KeyframeMapper::publishGridMap()
+{
+  nav_msgs::OccupancyGrid::Ptr map_msg(new nav_msgs::OccupancyGrid());
+  grid_->getMapMsg(*map_msg);
+  map_msg->header.stamp = ros::Time::now();
+  map_msg->header.frame_id = fixed_frame_;
+  map_msg->info.map_load_time = map_msg->header.stamp;
+  grid_map_pub_.publish(map_msg);
+}
+
+bool KeyframeMapper::saveMesh(const std::string& path)
+{
+  TriangleMesh mesh;
+
+  if (tsdf_)
+    tsdf_->extractMesh(mesh);
+  else
+  {
+    TSDFVolume volume(tsdf_res_, tsdf_trunc_, tsdf_max_weight_, tsdf_n_threads_);
+    buildTSDF(volume);
+    volume.extractMesh(mesh);
+  }
+
+  ROS_INFO("Mesh has %d vertices and %d triangles", 
+    (int)mesh.vertices.size(), (int)mesh.getNumTriangles());
+
+  return saveMeshPLY(path, mesh);
+}
+
+void KeyframeMapper::buildTSDF(TSDFVolume& volume)
+{
+  volume.clear();
+
+  for (unsigned int kf_idx = 0; kf_idx < keyframes_.size(); ++kf_idx)
+  {
+    const RGBDKeyframe& keyframe = keyframes_[kf_idx];
+    volume.integrate(keyframe, keyframe.pose, max_range_);
+  }
+}
+
+void KeyframeMapper::rebuildLiveTSDF()
+{
+  if (!tsdf_) return;
+
+  // the non-keyframe data is not stored, so only the keyframes remain
+  if (tsdf_integration_ == "frames")
+    ROS_INFO("Rebuilding the TSDF volume from the keyframes only");
+
+  buildTSDF(*tsdf_);
+}
+
+void KeyframeMapper::buildSurfelMap(SurfelMap& map)
+{
+  map.clear();
+
+  for (unsigned int kf_idx = 0; kf_idx < keyframes_.size(); ++kf_idx)
+  {
+    const RGBDKeyframe& keyframe = keyframes_[kf_idx];
+    map.integrate(keyframe, keyframe.pose, kf_idx, max_range_);
+  }
+
+  ROS_INFO("Surfel map has %d surfels", (int)map.getSurfels().size());
+}
+
 void KeyframeMapper::buildColorOctomap(octomap::ColorOcTree& tree)
 {
   ROS_INFO("Building Octomap with color...");
 
-  octomap::point3d sensor_origin(0.0, 0.0, 0.0);  
+  // the rays are cast in parallel, into spatial shards
+  ShardedOctreeBuilder builder(
+    tree.getResolution(), octomap_shard_size_, octomap_n_threads_,
+    octomap_discretize_, octomap_max_range_);
 
   for (unsigned int kf_idx = 0; kf_idx < keyframes_.size(); ++kf_idx)
   {
@@ -613,38 +1415,27 @@ void KeyframeMapper::buildColorOctomap(octomap::ColorOcTree& tree)
     pass.setFilterFieldName ("z");
     pass.setFilterLimits (-std::numeric_limits<double>::infinity(), max_map_z_);
     pass.filter(cloud);
-    pcl::transformPointCloud(cloud, cloud, eigenFromTf(keyframe.pose.inverse()));
     
     octomap::pose6d frame_origin = poseTfToOctomap(keyframe.pose);
     
-    // build octomap cloud from pcl cloud
+    // build octomap cloud from pcl cloud, in the fixed frame, with colors
     octomap::Pointcloud octomap_cloud;
+    std::vector<ShardedOctreeBuilder::Color> colors;
     for (unsigned int pt_idx = 0; pt_idx < cloud.points.size(); ++pt_idx)
     {
       const PointT& p = cloud.points[pt_idx];
-      if (!std::isnan(p.z))
-        octomap_cloud.push_back(p.x, p.y, p.z);
-    }
-    
-    // insert scan (only xyz considered, no colors)
-    tree.insertScan(octomap_cloud, sensor_origin, frame_origin);
-    
-    // insert colors
-    PointCloudT cloud_tf;
-    pcl::transformPointCloud(cloud, cloud_tf, eigenFromTf(keyframe.pose));
-    for (unsigned int pt_idx = 0; pt_idx < cloud_tf.points.size(); ++pt_idx)
-    {
-      const PointT& p = cloud_tf.points[pt_idx];
       if (!std::isnan(p.z))
       {
-        octomap::point3d endpoint(p.x, p.y, p.z);
-        octomap::ColorOcTreeNode* n = tree.search(endpoint);
-        if (n) n->setColor(p.r, p.g, p.b); 
+        octomap_cloud.push_back(p.x, p.y, p.z);
+        colors.push_back(ShardedOctreeBuilder::Color(p.r, p.g, p.b));
       }
     }
     
-    tree.updateInnerOccupancy();
+    builder.insertScan(octomap_cloud, frame_origin.trans(), colors);
   }
+
+  builder.merge(tree);
+  ROS_INFO("Merged %d octomap shards", builder.getNumShards());
 }
 
 void KeyframeMapper::publishPath()
@@ -666,4 +1457,27 @@ void KeyframeMapper::publishPath()
   path_pub_.publish(path_msg_);
 }
 
+void KeyframeMapper::connectCallback()
+{
+  keyframes_subscribed_ = (keyframes_pub_.getNumSubscribers() > 0);
+  poses_subscribed_     = (poses_pub_.getNumSubscribers() > 0);
+  kf_assoc_subscribed_  = (kf_assoc_pub_.getNumSubscribers() > 0);
+  path_subscribed_      = (path_pub_.getNumSubscribers() > 0);
+
+  bool grid_map_subscribed = grid_map_subscribed_;
+  grid_map_subscribed_   = (grid_map_pub_.getNumSubscribers() > 0);
+  grid_tiles_subscribed_ = (grid_tiles_pub_.getNumSubscribers() > 0);
+
+  // new subscribers of the stream get the whole map
+  int stream_subscribers = map_stream_pub_.getNumSubscribers();
+  if (streamer_ && stream_subscribers > stream_subscribers_) 
+    streamer_->resend();
+  stream_subscribers_ = stream_subscribers;
+
+  // the map topic is latched, but the grid may have changed while 
+  // nobody was subscribed: refresh it for the first new subscriber
+  if (grid_ && grid_map_subscribed_ && !grid_map_subscribed)
+    publishGridMap();
+}
+
 } // namespace ccny_rgbd
@@ -0,0 +1,78 @@
+/**
+ *  @file map_stream_viewer.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/apps/map_stream_viewer.h"
+
+namespace ccny_rgbd {
+
+MapStreamViewer::MapStreamViewer(
+  const ros::NodeHandle& nh,
+  const ros::NodeHandle& nh_private):
+  nh_(nh),
+  nh_private_(nh_private),
+  changed_(false)
+{
+  ROS_INFO("Starting Map Stream Viewer");
+
+  // **** initialize ROS parameters
+
+  initParams();
+
+  // **** publishers and subscribers
+
+  cloud_pub_ = nh_.advertise<PointCloudT>("map_stream_cloud", 1);
+  stream_sub_ = nh_.subscribe(
+    "map_stream", 100, &MapStreamViewer::streamCallback, this);
+  publish_timer_ = nh_.createTimer(ros::Duration(1.0 / publish_rate_), 
+    &MapStreamViewer::publishTimerCallback, this);
+}
+
+MapStreamViewer::~MapStreamViewer()
+{
+  ROS_INFO("Destroying Map Stream Viewer");
+}
+
+void MapStreamViewer::initParams()
+{
+  if (!nh_private_.getParam ("publish_rate", publish_rate_))
+    publish_rate_ = 1.0;
+}
+
+void MapStreamViewer::streamCallback(const MapStreamChunk::ConstPtr& chunk_msg)
+{
+  assembler_.addChunk(*chunk_msg);
+  changed_ = true;
+}
+
+void MapStreamViewer::publishTimerCallback(const ros::TimerEvent& event)
+{
+  if (!changed_ || cloud_pub_.getNumSubscribers() == 0) return;
+
+  PointCloudT::Ptr cloud(new PointCloudT());
+  assembler_.getCloud(*cloud);
+  cloud_pub_.publish(cloud);
+
+  changed_ = false;
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,88 @@
+/**
+ *  @file multi_visual_odometry.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/apps/multi_visual_odometry.h"
+
+namespace ccny_rgbd {
+
+MultiVisualOdometry::MultiVisualOdometry(
+  const ros::NodeHandle& nh,
+  const ros::NodeHandle& nh_private):
+  nh_(nh),
+  nh_private_(nh_private)
+{
+  ROS_INFO("Starting RGBD Multi Visual Odometry");
+
+  // **** initialize ROS parameters
+
+  initParams();
+
+  if (stream_names_.empty())
+    ROS_ERROR("Multi Visual Odometry: no streams (set the ~streams list)");
+
+  // **** streams
+
+  for (unsigned int i = 0; i < stream_names_.size(); ++i)
+  {
+    const std::string& name = stream_names_[i];
+    ROS_INFO("Adding VO stream %s", name.c_str());
+
+    streams_.push_back(boost::shared_ptr<VisualOdometry>(new VisualOdometry(
+      ros::NodeHandle(nh_, name), ros::NodeHandle(nh_private_, name))));
+  }
+
+  // **** shared threads
+
+  spinner_.reset(new ros::AsyncSpinner(n_threads_));
+  spinner_->start();
+}
+
+MultiVisualOdometry::~MultiVisualOdometry()
+{
+  ROS_INFO("Destroying RGBD Multi Visual Odometry");
+
+  // stop the callbacks before destroying the streams
+  spinner_->stop();
+  streams_.clear();
+}
+
+void MultiVisualOdometry::initParams()
+{
+  XmlRpc::XmlRpcValue streams;
+  if (nh_private_.getParam ("streams", streams) &&
+      streams.getType() == XmlRpc::XmlRpcValue::TypeArray)
+  {
+    for (int i = 0; i < streams.size(); ++i)
+    {
+      if (streams[i].getType() == XmlRpc::XmlRpcValue::TypeString)
+        stream_names_.push_back(static_cast<std::string>(streams[i]));
+      else
+        ROS_WARN("Multi Visual Odometry: ignoring non-string stream %d", i);
+    }
+  }
+
+  if (!nh_private_.getParam ("n_threads", n_threads_))
+    n_threads_ = 0;
+}
+
+} // namespace ccny_rgbd
@@ -25,6 +25,54 @@
 
 namespace ccny_rgbd {
 
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME        = 1099511628211ULL;
+
+/** @brief Adds bytes to a 64 bit FNV-1a hash. Unlike boost::hash, the
+ * result is the same for every build, so it can name cache files.
+ */
+static void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < size; ++i)
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+}
+
+/** @brief Adds the bytes of a value to a 64 bit FNV-1a hash
+ */
+template <typename T>
+static void hashValue(uint64_t& hash, const T& value)
+{
+  hashBytes(hash, &value, sizeof(value));
+}
+
+/** @brief Functor which runs the rgb (0) or the depth (1) branch
+ */
+class RectifyBranches
+{
+  public:
+
+    RectifyBranches(
+      const RGBDImageProc& proc,
+      const cv::Mat& rgb_img,
+      const cv::Mat& depth_img,
+      RectifiedFrame& frame):
+      proc_(proc), rgb_img_(rgb_img), depth_img_(depth_img), frame_(frame) { }
+
+    void operator()(int branch) const
+    {
+      if (branch == 0) proc_.rectifyRGB(rgb_img_, frame_);
+      else             proc_.rectifyDepth(depth_img_, frame_);
+    }
+
+  private:
+
+    const RGBDImageProc& proc_;
+    const cv::Mat& rgb_img_;
+    const cv::Mat& depth_img_;
+    RectifiedFrame& frame_;
+};
+
 RGBDImageProc::RGBDImageProc(
   const ros::NodeHandle& nh, 
   const ros::NodeHandle& nh_private):
@@ -32,7 +80,10 @@ RGBDImageProc::RGBDImageProc(
   rgb_image_transport_(nh_),
   depth_image_transport_(nh_), 
   config_server_(nh_private_),
-  size_in_(0,0)
+  cloud_subscribed_(false),
+  pyramid_levels_needed_(1),
+  maps_building_(false),
+  output_running_(true)
 { 
   // parameters 
   if (!nh_private_.getParam ("queue_size", queue_size_))
@@ -45,11 +96,39 @@ RGBDImageProc::RGBDImageProc(
     verbose_ = false;
   if (!nh_private_.getParam("publish_cloud", publish_cloud_))
     publish_cloud_ = true;
+  if (!nh_private_.getParam("cloud_organized", cloud_organized_))
+    cloud_organized_ = true;
+  if (!nh_private_.getParam("cloud_compact", cloud_compact_))
+    cloud_compact_ = false;
+  if (!nh_private_.getParam("pyramid_levels", pyramid_levels_))
+    pyramid_levels_ = 1;
+  if (!nh_private_.getParam("parallel", parallel_))
+    parallel_ = true;
+
+  std::string pyramid_pool;
+  if (!nh_private_.getParam("pyramid_depth_pool", pyramid_pool))
+    pyramid_pool = "median";
+
+  if (pyramid_pool == "min")
+    pyramid_pool_mode_ = DEPTH_POOL_MIN;
+  else if (pyramid_pool == "median")
+    pyramid_pool_mode_ = DEPTH_POOL_MEDIAN;
+  else
+  {
+    ROS_WARN("Unknown pyramid_depth_pool %s, using median", pyramid_pool.c_str());
+    pyramid_pool_mode_ = DEPTH_POOL_MEDIAN;
+  }
+
   if (!nh_private_.getParam("calib_path", calib_path_))
   {
     std::string home_path = getenv("HOME");
     calib_path_ = home_path + "./ros/rgbd_calibration";
   }
+  if (!nh_private_.getParam("maps_cache_path", maps_cache_path_))
+  {
+    std::string home_path = getenv("HOME");
+    maps_cache_path_ = home_path + "/.ros/rgbd_image_proc_cache";
+  }
 
   calib_extr_filename_ = calib_path_ + "/extr.yml";
   calib_warp_filename_ = calib_path_ + "/warp.yml";
@@ -74,9 +153,35 @@ RGBDImageProc::RGBDImageProc(
   info_publisher_  = nh_.advertise<CameraInfoMsg>(
     "rgbd/info", queue_size_);
 
-  if(publish_cloud_)
-    cloud_publisher_ = nh_.advertise<PointCloudT>(
-          "rgbd/cloud", queue_size_);
+  if(publish_cloud_) advertiseCloud();
+
+  ros::SubscriberStatusCallback connect_cb = 
+    boost::bind(&RGBDImageProc::connectCallback, this);
+  image_transport::SubscriberStatusCallback image_connect_cb = 
+    boost::bind(&RGBDImageProc::connectCallback, this);
+
+  // sized up front, since connectCallback can run while advertising
+  int n_pyr = std::max(pyramid_levels_ - 1, 0);
+  pyr_rgb_publishers_.resize(n_pyr);
+  pyr_depth_publishers_.resize(n_pyr);
+  pyr_info_publishers_.resize(n_pyr);
+
+  for (int level = 1; level < pyramid_levels_; ++level)
+  {
+    std::stringstream ss;
+    ss << "rgbd/pyr" << level << "/";
+    
+    pyr_rgb_publishers_[level - 1] = rgb_image_transport_.advertise(
+      ss.str() + "rgb", queue_size_, image_connect_cb, image_connect_cb);
+    pyr_depth_publishers_[level - 1] = depth_image_transport_.advertise(
+      ss.str() + "depth", queue_size_, image_connect_cb, image_connect_cb);
+    pyr_info_publishers_[level - 1] = nh_.advertise<CameraInfoMsg>(
+      ss.str() + "info", queue_size_, connect_cb, connect_cb);
+  }
+
+  // output thread, started before any frame can arrive
+  if (parallel_)
+    output_thread_ = boost::thread(&RGBDImageProc::spinOutput, this);
 
   // dynamic reconfigure
   ProcConfigServer::CallbackType f = boost::bind(&RGBDImageProc::reconfigCallback, this, _1, _2);
@@ -103,6 +208,15 @@ RGBDImageProc::RGBDImageProc(
 RGBDImageProc::~RGBDImageProc()
 {
   ROS_INFO("Destroying RGBDImageProc"); 
+
+  {
+    boost::mutex::scoped_lock lock(output_mutex_);
+    output_running_ = false;
+  }
+  output_cond_.notify_all();
+  output_thread_.join();
+
+  maps_thread_.join();
 }
 
 bool RGBDImageProc::loadCalibration()
@@ -145,12 +259,11 @@ bool RGBDImageProc::loadUnwarpCalibration()
 
 void RGBDImageProc::initMaps(
   const CameraInfoMsg::ConstPtr& rgb_info_msg,
-  const CameraInfoMsg::ConstPtr& depth_info_msg)
+  const CameraInfoMsg::ConstPtr& depth_info_msg,
+  RectificationMaps& maps)
 { 
-  boost::mutex::scoped_lock(mutex_);
-  
-  ROS_INFO("Initializing rectification maps");
-  
+  const cv::Size& size_in = maps.size_in;
+
   // **** get OpenCV matrices from CameraInfo messages
   cv::Mat intr_rgb, intr_depth;
   cv::Mat dist_rgb, dist_depth;
@@ -161,12 +274,12 @@ void RGBDImageProc::initMaps(
   // **** sizes 
   double alpha = 0.0;
     
-  if (size_in_.width  != (int)rgb_info_msg->width || 
-      size_in_.height != (int)rgb_info_msg->height)
+  if (size_in.width  != (int)rgb_info_msg->width || 
+      size_in.height != (int)rgb_info_msg->height)
   {
     ROS_WARN("Image size does not match CameraInfo size. Rescaling.");
-    double w_factor = (double)size_in_.width  / (double)rgb_info_msg->width;
-    double h_factor = (double)size_in_.height / (double)rgb_info_msg->height;
+    double w_factor = (double)size_in.width  / (double)rgb_info_msg->width;
+    double h_factor = (double)size_in.height / (double)rgb_info_msg->height;
     
     intr_rgb.at<double>(0,0) *= w_factor;
     intr_rgb.at<double>(1,1) *= h_factor;   
@@ -180,44 +293,238 @@ void RGBDImageProc::initMaps(
   }
   
   cv::Size size_out;
-  size_out.height = size_in_.height * scale_;
-  size_out.width  = size_in_.width  * scale_;
+  size_out.height = size_in.height * maps.scale;
+  size_out.width  = size_in.width  * maps.scale;
    
   // **** get optimal camera matrices
-  intr_rect_rgb_ = cv::getOptimalNewCameraMatrix(
-    intr_rgb, dist_rgb, size_in_, alpha, size_out);
+  maps.intr_rect_rgb = cv::getOptimalNewCameraMatrix(
+    intr_rgb, dist_rgb, size_in, alpha, size_out);
  
-  intr_rect_depth_ = cv::getOptimalNewCameraMatrix(
-    intr_depth, dist_depth, size_in_, alpha, size_out);
+  maps.intr_rect_depth = cv::getOptimalNewCameraMatrix(
+    intr_depth, dist_depth, size_in, alpha, size_out);
       
   // **** create undistortion maps
   cv::initUndistortRectifyMap(
-    intr_rgb, dist_rgb, cv::Mat(), intr_rect_rgb_, 
-    size_out, CV_16SC2, map_rgb_1_, map_rgb_2_);
+    intr_rgb, dist_rgb, cv::Mat(), maps.intr_rect_rgb, 
+    size_out, CV_16SC2, maps.map_rgb_1, maps.map_rgb_2);
   
   cv::initUndistortRectifyMap(
-    intr_depth, dist_depth, cv::Mat(), intr_rect_depth_, 
-    size_out, CV_16SC2, map_depth_1_, map_depth_2_);  
+    intr_depth, dist_depth, cv::Mat(), maps.intr_rect_depth, 
+    size_out, CV_16SC2, maps.map_depth_1, maps.map_depth_2);  
   
   // **** rectify the coefficient images
   if(unwarp_)
   {
-    cv::remap(coeff_0_, coeff_0_rect_, map_depth_1_, map_depth_2_,  cv::INTER_NEAREST);
-    cv::remap(coeff_1_, coeff_1_rect_, map_depth_1_, map_depth_2_,  cv::INTER_NEAREST);
-    cv::remap(coeff_2_, coeff_2_rect_, map_depth_1_, map_depth_2_,  cv::INTER_NEAREST);
+    cv::remap(coeff_0_, maps.coeff_0_rect, maps.map_depth_1, maps.map_depth_2, cv::INTER_NEAREST);
+    cv::remap(coeff_1_, maps.coeff_1_rect, maps.map_depth_1, maps.map_depth_2, cv::INTER_NEAREST);
+    cv::remap(coeff_2_, maps.coeff_2_rect, maps.map_depth_1, maps.map_depth_2, cv::INTER_NEAREST);
+  }
+}
+
+void RGBDImageProc::buildMaps(
+  CameraInfoMsg::ConstPtr rgb_info_msg,
+  CameraInfoMsg::ConstPtr depth_info_msg,
+  cv::Size size_in,
+  double scale)
+{
+  ros::WallTime start = ros::WallTime::now();
+
+  RectificationMapsPtr maps(new RectificationMaps());
+  maps->size_in = size_in;
+  maps->scale = scale;
+
+  std::string cache_filename;
+  if (!maps_cache_path_.empty())
+  {
+    cache_filename = getMapsCacheFilename(
+      *rgb_info_msg, *depth_info_msg, size_in, scale);
+  }
+
+  // an exception would terminate the process from this thread
+  bool loaded = false;
+  try
+  {
+    loaded = !cache_filename.empty() && loadMapsFromCache(cache_filename, *maps);
+  }
+  catch(const std::exception& e)
+  {
+    ROS_WARN("Error reading rectification map cache %s: %s", 
+      cache_filename.c_str(), e.what());
+  }
+
+  if (loaded)
+  {
+    ROS_INFO("Loaded rectification maps from %s", cache_filename.c_str());
+  }
+  else
+  {
+    ROS_INFO("Initializing rectification maps");
+    try
+    {
+      initMaps(rgb_info_msg, depth_info_msg, *maps);
+    }
+    catch(const std::exception& e)
+    {
+      ROS_ERROR("Error building rectification maps: %s", e.what());
+
+      // retried on the next image
+      boost::mutex::scoped_lock lock(mutex_);
+      maps_building_ = false;
+      return;
+    }
+
+    if (!cache_filename.empty() && !saveMapsToCache(cache_filename, *maps))
+      ROS_WARN("Could not cache rectification maps to %s", cache_filename.c_str());
   }
 
   // **** save new intrinsics as camera models
-  rgb_rect_info_msg_.header = rgb_info_msg->header;
-  rgb_rect_info_msg_.width  = size_out.width;
-  rgb_rect_info_msg_.height = size_out.height;  
+  cv::Size size_out = maps->map_rgb_1.size();
+  
+  maps->rgb_rect_info_msg.header = rgb_info_msg->header;
+  maps->rgb_rect_info_msg.width  = size_out.width;
+  maps->rgb_rect_info_msg.height = size_out.height;  
+
+  maps->depth_rect_info_msg.header = depth_info_msg->header;
+  maps->depth_rect_info_msg.width  = size_out.width;
+  maps->depth_rect_info_msg.height = size_out.height;  
+  
+  convertMatToCameraInfo(maps->intr_rect_rgb,   maps->rgb_rect_info_msg);
+  convertMatToCameraInfo(maps->intr_rect_depth, maps->depth_rect_info_msg);  
+
+  // **** swap in the new maps
+  boost::mutex::scoped_lock lock(mutex_);
+  maps_ = maps;
+  maps_building_ = false;
+
+  if (verbose_) ROS_INFO("Rectification maps ready in %.1f ms", getMsDuration(start));
+}
+
+std::string RGBDImageProc::getMapsCacheFilename(
+  const CameraInfoMsg& rgb_info_msg,
+  const CameraInfoMsg& depth_info_msg,
+  const cv::Size& size_in,
+  double scale)
+{
+  // format version of the cache file, part of the key
+  const int version = 2;
+
+  uint64_t hash = FNV_OFFSET_BASIS;
+  hashValue(hash, version);
+  hashValue(hash, size_in.width);
+  hashValue(hash, size_in.height);
+  hashValue(hash, scale);
+
+  const CameraInfoMsg* infos[2] = { &rgb_info_msg, &depth_info_msg };
+  for (int c = 0; c < 2; ++c)
+  {
+    const CameraInfoMsg& info = *infos[c];
+    hashValue(hash, info.width);
+    hashValue(hash, info.height);
+    hashBytes(hash, &info.K[0], info.K.size() * sizeof(double));
+    if (!info.D.empty())
+      hashBytes(hash, &info.D[0], info.D.size() * sizeof(double));
+  }
+
+  // the unwarp coefficients only matter when unwarping
+  hashValue(hash, (uint8_t)unwarp_);
+  if (unwarp_)
+  {
+    const cv::Mat* coeffs[3] = { &coeff_0_, &coeff_1_, &coeff_2_ };
+    for (int c = 0; c < 3; ++c)
+    {
+      const cv::Mat& coeff = *coeffs[c];
+      hashValue(hash, coeff.rows);
+      hashValue(hash, coeff.cols);
+      size_t row_size = coeff.cols * coeff.elemSize();
+      for (int v = 0; v < coeff.rows; ++v)
+        hashBytes(hash, coeff.ptr(v), row_size);
+    }
+  }
+
+  std::stringstream ss;
+  ss << maps_cache_path_ << "/maps_" << std::hex << hash << ".bin";
+  return ss.str();
+}
+
+bool RGBDImageProc::loadMapsFromCache(
+  const std::string& filename, 
+  RectificationMaps& maps)
+{
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open()) return false;
+
+  bool result = 
+    readMatBinary(file, maps.map_rgb_1)       &&
+    readMatBinary(file, maps.map_rgb_2)       &&
+    readMatBinary(file, maps.map_depth_1)     &&
+    readMatBinary(file, maps.map_depth_2)     &&
+    readMatBinary(file, maps.coeff_0_rect)    &&
+    readMatBinary(file, maps.coeff_1_rect)    &&
+    readMatBinary(file, maps.coeff_2_rect)    &&
+    readMatBinary(file, maps.intr_rect_rgb)   &&
+    readMatBinary(file, maps.intr_rect_depth);
+
+  if (!result)
+  {
+    ROS_WARN("Invalid rectification map cache file %s", filename.c_str());
+    return false;
+  }
+
+  return true;
+}
 
-  depth_rect_info_msg_.header = depth_info_msg->header;
-  depth_rect_info_msg_.width  = size_out.width;
-  depth_rect_info_msg_.height = size_out.height;  
+bool RGBDImageProc::saveMapsToCache(
+  const std::string& filename, 
+  const RectificationMaps& maps)
+{
+  try
+  {
+    boost::filesystem::create_directories(maps_cache_path_);
+  }
+  catch(...)
+  {
+    return false;
+  }
+
+  // write to a temporary file first, so that a crash (or another 
+  // instance) never leaves a partial file under the final name
+  std::stringstream ss_tmp;
+  ss_tmp << filename << ".tmp" << getpid();
+  std::string tmp_filename = ss_tmp.str();
+
+  std::ofstream file(tmp_filename.c_str(), std::ios::out | std::ios::binary);
+  if (!file.is_open()) return false;
+
+  bool result = 
+    writeMatBinary(file, maps.map_rgb_1)       &&
+    writeMatBinary(file, maps.map_rgb_2)       &&
+    writeMatBinary(file, maps.map_depth_1)     &&
+    writeMatBinary(file, maps.map_depth_2)     &&
+    writeMatBinary(file, maps.coeff_0_rect)    &&
+    writeMatBinary(file, maps.coeff_1_rect)    &&
+    writeMatBinary(file, maps.coeff_2_rect)    &&
+    writeMatBinary(file, maps.intr_rect_rgb)   &&
+    writeMatBinary(file, maps.intr_rect_depth);
+
+  file.close();
+
+  if (result)
+  {
+    try
+    {
+      boost::filesystem::rename(tmp_filename, filename);
+      return true;
+    }
+    catch(...) { }
+  }
+
+  try
+  {
+    boost::filesystem::remove(tmp_filename);
+  }
+  catch(...) { }
   
-  convertMatToCameraInfo(intr_rect_rgb_,   rgb_rect_info_msg_);
-  convertMatToCameraInfo(intr_rect_depth_, depth_rect_info_msg_);  
+  return false;
 }
 
 void RGBDImageProc::RGBDCallback(
@@ -226,11 +533,6 @@ void RGBDImageProc::RGBDCallback(
   const CameraInfoMsg::ConstPtr& rgb_info_msg,
   const CameraInfoMsg::ConstPtr& depth_info_msg)
 {  
-  boost::mutex::scoped_lock(mutex_);
-  
-  // for profiling
-  double dur_unwarp, dur_rectify, dur_reproject, dur_cloud, dur_allocate; 
-  
   // **** images need to be the same size
   if (rgb_msg->height != depth_msg->height || 
       rgb_msg->width  != depth_msg->width)
@@ -239,65 +541,151 @@ void RGBDImageProc::RGBDCallback(
     return;
   }
   
-  // **** initialize if needed
-  if (size_in_.height != (int)rgb_msg->height ||
-      size_in_.width  != (int)rgb_msg->width)
+  RectifiedFramePtr frame(new RectifiedFrame());
+
+  // **** get the current maps and outputs, and request new maps if needed
   {
-    ROS_INFO("Initializing");
-  
-    size_in_.height = (int)rgb_msg->height;
-    size_in_.width  = (int)rgb_msg->width;
+    boost::mutex::scoped_lock lock(mutex_);
+
+    cv::Size size_in(rgb_msg->width, rgb_msg->height);
+    bool size_ok  = maps_ && maps_->size_in == size_in;
+    bool scale_ok = maps_ && maps_->scale == scale_;
+
+    if (!(size_ok && scale_ok) && !maps_building_)
+    {
+      maps_building_ = true;
+      maps_thread_.join(); // previous thread has already finished
+      maps_thread_ = boost::thread(&RGBDImageProc::buildMaps, this, 
+        rgb_info_msg, depth_info_msg, size_in, scale_);
+    }
+
+    // the old maps stay in use while new ones are built for a scale
+    // change; images of a different size can't use them
+    if (!size_ok) return;
     
-    initMaps(rgb_info_msg, depth_info_msg);
+    frame->maps = maps_;
+    frame->cloud = publish_cloud_ && cloud_subscribed_;
+    if (frame->cloud) frame->cloud_publisher = cloud_publisher_;
+    frame->cloud_organized = cloud_organized_;
+    frame->cloud_compact = cloud_compact_;
+    frame->pyramid_levels = pyramid_levels_needed_;
   }
+
+  frame->rgb_header     = rgb_msg->header;
+  frame->depth_header   = depth_msg->header;
+  frame->info_header    = rgb_info_msg->header;
+  frame->rgb_encoding   = rgb_msg->encoding;
+  frame->depth_encoding = depth_msg->encoding;
   
   // **** convert ros images to opencv Mat
   cv_bridge::CvImageConstPtr rgb_ptr   = cv_bridge::toCvShare(rgb_msg);
   cv_bridge::CvImageConstPtr depth_ptr = cv_bridge::toCvShare(depth_msg);
 
-  const cv::Mat& rgb_img   = rgb_ptr->image;
-  const cv::Mat& depth_img = depth_ptr->image;
-  
-  //cv::imshow("RGB", rgb_img);
-  //cv::imshow("Depth", depth_img);
+  //cv::imshow("RGB", rgb_ptr->image);
+  //cv::imshow("Depth", depth_ptr->image);
   //cv::waitKey(1);
   
-  // **** rectify
-  ros::WallTime start_rectify = ros::WallTime::now();
-  cv::Mat rgb_img_rect, depth_img_rect;
-  cv::remap(rgb_img, rgb_img_rect, map_rgb_1_, map_rgb_2_, cv::INTER_LINEAR);
-  cv::remap(depth_img, depth_img_rect, map_depth_1_, map_depth_2_,  cv::INTER_NEAREST);
-  dur_rectify = getMsDuration(start_rectify);
+  // **** rectify: the rgb and depth branches are independent; the 
+  // second branch runs on a persistent pool thread
+  ros::WallTime start_branches = ros::WallTime::now();
+  RectifyBranches branches(*this, rgb_ptr->image, depth_ptr->image, *frame);
+  parallelFor(0, 2, branches, parallel_ ? 2 : 1);
+  frame->dur_branches = getMsDuration(start_branches);
   
-  //cv::imshow("RGB Rect", rgb_img_rect);
-  //cv::imshow("Depth Rect", depth_img_rect);
+  //cv::imshow("RGB Rect", frame->rgb_img_rect);
+  //cv::imshow("Depth Rect", frame->depth_img_rect_reg);
   //cv::waitKey(1);
+
+  // **** cloud, messages and pyramid
+  if (parallel_) queueFrame(frame);
+  else publishFrame(*frame);
+}
+
+void RGBDImageProc::rectifyRGB(
+  const cv::Mat& rgb_img, 
+  RectifiedFrame& frame) const
+{
+  const RectificationMaps& maps = *frame.maps;
+
+  ros::WallTime start_rgb = ros::WallTime::now();
+  cv::remap(rgb_img, frame.rgb_img_rect, maps.map_rgb_1, maps.map_rgb_2, cv::INTER_LINEAR);
+  frame.dur_rgb = getMsDuration(start_rgb);
+}
+
+void RGBDImageProc::rectifyDepth(
+  const cv::Mat& depth_img, 
+  RectifiedFrame& frame) const
+{
+  const RectificationMaps& maps = *frame.maps;
+
+  // **** rectify
+  ros::WallTime start_rectify = ros::WallTime::now();
+  cv::Mat depth_img_rect;
+  cv::remap(depth_img, depth_img_rect, maps.map_depth_1, maps.map_depth_2,  cv::INTER_NEAREST);
+  frame.dur_rectify = getMsDuration(start_rectify);
   
   // **** unwarp 
   if (unwarp_) 
   {    
     ros::WallTime start_unwarp = ros::WallTime::now();
-    unwarpDepthImage(depth_img_rect, coeff_0_rect_, coeff_1_rect_, coeff_2_rect_, fit_mode_);
-    dur_unwarp = getMsDuration(start_unwarp);
+    unwarpDepthImage(depth_img_rect, maps.coeff_0_rect, maps.coeff_1_rect, maps.coeff_2_rect, fit_mode_);
+    frame.dur_unwarp = getMsDuration(start_unwarp);
   }
-  else dur_unwarp = 0.0;
+  else frame.dur_unwarp = 0.0;
   
   // **** reproject
   ros::WallTime start_reproject = ros::WallTime::now();
-  cv::Mat depth_img_rect_reg;
-  buildRegisteredDepthImage(intr_rect_depth_, intr_rect_rgb_, ir2rgb_,
-                            depth_img_rect, depth_img_rect_reg);
-  dur_reproject = getMsDuration(start_reproject);
+  buildRegisteredDepthImage(maps.intr_rect_depth, maps.intr_rect_rgb, ir2rgb_,
+                            depth_img_rect, frame.depth_img_rect_reg);
+  frame.dur_reproject = getMsDuration(start_reproject);
+}
+
+void RGBDImageProc::queueFrame(const RectifiedFramePtr& frame)
+{
+  boost::mutex::scoped_lock lock(output_mutex_);
+
+  // at most one frame waits, so the output can't fall behind
+  while (output_running_ && output_frame_) output_cond_.wait(lock);
+
+  output_frame_ = frame;
+  output_cond_.notify_all();
+}
+
+void RGBDImageProc::spinOutput()
+{
+  while(true)
+  {
+    RectifiedFramePtr frame;
+    {
+      boost::mutex::scoped_lock lock(output_mutex_);
+      while (output_running_ && !output_frame_) output_cond_.wait(lock);
+      if (!output_running_) return;
+
+      frame.swap(output_frame_);
+    }
+
+    // the next frame can be queued while this one is published
+    output_cond_.notify_all();
+    publishFrame(*frame);
+  }
+}
+
+void RGBDImageProc::publishFrame(const RectifiedFrame& frame)
+{  
+  // for profiling
+  double dur_cloud, dur_allocate; 
+
+  const RectificationMaps& maps = *frame.maps;
 
   // **** point cloud
-  if (publish_cloud_)
+  if (frame.cloud)
   {
     ros::WallTime start_cloud = ros::WallTime::now();
-    PointCloudT::Ptr cloud_ptr;
-    cloud_ptr.reset(new PointCloudT());
-    buildPointCloud(depth_img_rect_reg, rgb_img_rect, intr_rect_rgb_, *cloud_ptr);
-    cloud_ptr->header = rgb_info_msg->header;
-    cloud_publisher_.publish(cloud_ptr);
+    PointCloud2Msg::Ptr cloud_msg(new PointCloud2Msg());
+    buildPointCloud2(frame.depth_img_rect_reg, frame.rgb_img_rect, maps.intr_rect_rgb, 
+                     *cloud_msg, frame.cloud_organized, frame.cloud_compact);
+    cloud_msg->header = frame.info_header;
+    frame.cloud_publisher.publish(cloud_msg);
     dur_cloud = getMsDuration(start_cloud);
   }
   else dur_cloud = 0.0;
@@ -305,53 +693,150 @@ void RGBDImageProc::RGBDCallback(
   // **** allocate registered rgb image
   ros::WallTime start_allocate = ros::WallTime::now();
 
-  cv_bridge::CvImage cv_img_rgb(rgb_msg->header, rgb_msg->encoding, rgb_img_rect);
+  cv_bridge::CvImage cv_img_rgb(frame.rgb_header, frame.rgb_encoding, frame.rgb_img_rect);
   ImageMsg::Ptr rgb_out_msg = cv_img_rgb.toImageMsg();
 
   // **** allocate registered depth image
-  cv_bridge::CvImage cv_img_depth(depth_msg->header, depth_msg->encoding, depth_img_rect_reg);
+  cv_bridge::CvImage cv_img_depth(frame.depth_header, frame.depth_encoding, frame.depth_img_rect_reg);
   ImageMsg::Ptr depth_out_msg = cv_img_depth.toImageMsg();
   
   // **** update camera info (single, since both images are in rgb frame)
-  rgb_rect_info_msg_.header = rgb_info_msg->header;
+  CameraInfoMsg::Ptr info_out_msg(new CameraInfoMsg(maps.rgb_rect_info_msg));
+  info_out_msg->header = frame.info_header;
   
   dur_allocate = getMsDuration(start_allocate); 
 
   // **** print diagnostics
-  
-  double dur_total = dur_rectify + dur_reproject + dur_unwarp + dur_cloud + dur_allocate;
+
+  // the rgb and depth branches overlap, so the total counts them once
+  double dur_total = frame.dur_branches + dur_cloud + dur_allocate;
   if(verbose_)
   {
-    ROS_INFO("Rect %.1f Reproj %.1f Unwarp %.1f Cloud %.1f Alloc %.1f Total %.1f ms",
-             dur_rectify, dur_reproject,  dur_unwarp, dur_cloud, dur_allocate,
-             dur_total);
+    ROS_INFO("RGB %.1f Rect %.1f Unwarp %.1f Reproj %.1f Cloud %.1f Alloc %.1f Total %.1f ms",
+             frame.dur_rgb, frame.dur_rectify, frame.dur_unwarp, frame.dur_reproject, 
+             dur_cloud, dur_allocate, dur_total);
   }
   // **** publish
   rgb_publisher_.publish(rgb_out_msg);
   depth_publisher_.publish(depth_out_msg);
-  info_publisher_.publish(rgb_rect_info_msg_);
+  info_publisher_.publish(info_out_msg);
+
+  // **** pyramid
+  if (frame.pyramid_levels > 1)
+  {
+    publishPyramid(maps, frame.pyramid_levels, 
+                   frame.rgb_img_rect, frame.depth_img_rect_reg, 
+                   frame.rgb_header,   frame.rgb_encoding,
+                   frame.depth_header, frame.depth_encoding);
+  }
+}
+
+void RGBDImageProc::publishPyramid(
+  const RectificationMaps& maps,
+  int n_levels,
+  const cv::Mat& rgb_img_rect,
+  const cv::Mat& depth_img_rect_reg,
+  const std_msgs::Header& rgb_header,
+  const std::string& rgb_encoding,
+  const std_msgs::Header& depth_header,
+  const std::string& depth_encoding)
+{
+  cv::Mat rgb_prev   = rgb_img_rect;
+  cv::Mat depth_prev = depth_img_rect_reg;
+  cv::Mat intr_prev  = maps.intr_rect_rgb;
+
+  for (int level = 1; level < n_levels; ++level)
+  {
+    cv::Mat rgb_level, depth_level, intr_level;
+    pyrDownImage(rgb_prev, rgb_level);
+    pyrDownDepthImage(depth_prev, depth_level, pyramid_pool_mode_);
+    pyrDownIntrinsics(intr_prev, intr_level);
+
+    ImagePublisher& rgb_pub   = pyr_rgb_publishers_[level - 1];
+    ImagePublisher& depth_pub = pyr_depth_publishers_[level - 1];
+    ros::Publisher& info_pub  = pyr_info_publishers_[level - 1];
+
+    if (rgb_pub.getNumSubscribers() > 0)
+    {
+      cv_bridge::CvImage cv_img_rgb(rgb_header, rgb_encoding, rgb_level);
+      rgb_pub.publish(cv_img_rgb.toImageMsg());
+    }
+    if (depth_pub.getNumSubscribers() > 0)
+    {
+      cv_bridge::CvImage cv_img_depth(depth_header, depth_encoding, depth_level);
+      depth_pub.publish(cv_img_depth.toImageMsg());
+    }
+    if (info_pub.getNumSubscribers() > 0)
+    {
+      CameraInfoMsg::Ptr info_msg(new CameraInfoMsg(maps.rgb_rect_info_msg));
+      info_msg->header = rgb_header;
+      info_msg->width  = rgb_level.cols;
+      info_msg->height = rgb_level.rows;
+      convertMatToCameraInfo(intr_level, *info_msg);
+      info_pub.publish(info_msg);
+    }
+
+    rgb_prev   = rgb_level;
+    depth_prev = depth_level;
+    intr_prev  = intr_level;
+  }
 }
 
 void RGBDImageProc::reconfigCallback(ProcConfig& config, uint32_t level)
 {
-  boost::mutex::scoped_lock(mutex_);
+  boost::mutex::scoped_lock lock(mutex_);
   bool old_publish_cloud = publish_cloud_;
       publish_cloud_ = config.publish_cloud;
   if(!old_publish_cloud && publish_cloud_)
   {
-    cloud_publisher_ = nh_.advertise<PointCloudT>(
-        "rgbd/cloud", queue_size_);
+    advertiseCloud();
   }
   else
   {
     if(old_publish_cloud && !publish_cloud_)
+    {
       cloud_publisher_.shutdown();
+      cloud_subscribed_ = false;
+    }
   }
 
 
+  cloud_organized_ = config.cloud_organized;
+  cloud_compact_ = config.cloud_compact;
+
+  // new maps will be built in the background on the next image callback
   scale_ = config.scale;
-  size_in_ = cv::Size(0,0); // force a reinitialization on the next image callback
   ROS_INFO("Resampling scale set to %.2f", scale_);
 }
 
+void RGBDImageProc::advertiseCloud()
+{
+  ros::SubscriberStatusCallback connect_cb = 
+    boost::bind(&RGBDImageProc::connectCallback, this);
+
+  cloud_publisher_ = nh_.advertise<PointCloud2Msg>(
+    "rgbd/cloud", queue_size_, connect_cb, connect_cb);
+}
+
+void RGBDImageProc::connectCallback()
+{
+  // roscpp queues connect callbacks, so this never runs from within 
+  // advertiseCloud() while reconfigCallback() holds the lock
+  boost::mutex::scoped_lock lock(mutex_);
+
+  cloud_subscribed_ = (cloud_publisher_.getNumSubscribers() > 0);
+
+  // levels are built from the previous level, so everything up to
+  // the deepest subscribed level is needed
+  int levels_needed = 1;
+  for (int level = 1; level < pyramid_levels_; ++level)
+  {
+    if (pyr_rgb_publishers_[level - 1].getNumSubscribers() > 0 ||
+        pyr_depth_publishers_[level - 1].getNumSubscribers() > 0 ||
+        pyr_info_publishers_[level - 1].getNumSubscribers() > 0)
+      levels_needed = level + 1;
+  }
+  pyramid_levels_needed_ = levels_needed;
+}
+
 } //namespace ccny_rgbd
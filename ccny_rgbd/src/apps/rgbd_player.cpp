@@ -0,0 +1,213 @@
+/**
+ *  @file rgbd_player.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/apps/rgbd_player.h"
+
+#include <rosgraph_msgs/Clock.h>
+
+namespace ccny_rgbd {
+
+RGBDPlayer::RGBDPlayer(
+  const ros::NodeHandle& nh,
+  const ros::NodeHandle& nh_private):
+  nh_(nh),
+  nh_private_(nh_private),
+  rgb_image_transport_(nh_),
+  depth_image_transport_(nh_),
+  decoding_done_(false),
+  running_(true)
+{
+  ROS_INFO("Starting RGBD Player");
+
+  // **** initialize ROS parameters
+
+  initParams();
+
+  // **** recording
+
+  if (!reader_.open(filename_))
+  {
+    ROS_ERROR("RGBD Player: could not open %s", filename_.c_str());
+    return;
+  }
+
+  unsigned int n_frames = reader_.getNumFrames();
+  if (n_frames == 0)
+  {
+    ROS_WARN("RGBD Player: %s has no frames", filename_.c_str());
+    return;
+  }
+
+  ros::Time start_time = reader_.getStamp(0) + ros::Duration(start_);
+  unsigned int first_frame = 0;
+  while (first_frame < n_frames && reader_.getStamp(first_frame) < start_time)
+    ++first_frame;
+
+  ROS_INFO("Playing back %d frames from %s", 
+    n_frames - first_frame, filename_.c_str());
+
+  // **** publishers
+
+  rgb_publisher_   = rgb_image_transport_.advertise(
+    "rgbd/rgb", queue_size_);
+  depth_publisher_ = depth_image_transport_.advertise(
+    "rgbd/depth", queue_size_);
+  info_publisher_  = nh_.advertise<CameraInfoMsg>(
+    "rgbd/info", queue_size_);
+
+  if (publish_clock_)
+    clock_publisher_ = nh_.advertise<rosgraph_msgs::Clock>("/clock", 1);
+
+  // **** threads
+
+  decoder_thread_  = boost::thread(&RGBDPlayer::spinDecoder, this, first_frame);
+  playback_thread_ = boost::thread(&RGBDPlayer::spinPlayback, this);
+}
+
+RGBDPlayer::~RGBDPlayer()
+{
+  ROS_INFO("Destroying RGBD Player");
+
+  mutex_.lock();
+  running_ = false;
+  mutex_.unlock();
+  cond_.notify_all();
+
+  if (decoder_thread_.joinable())  decoder_thread_.join();
+  if (playback_thread_.joinable()) playback_thread_.join();
+}
+
+void RGBDPlayer::initParams()
+{
+  if (!nh_private_.getParam ("filename", filename_))
+    filename_ = "rgbd.rec";
+  if (!nh_private_.getParam ("queue_size", queue_size_))
+    queue_size_ = 5;
+  if (!nh_private_.getParam ("rate", rate_))
+    rate_ = 1.0;
+  if (!nh_private_.getParam ("start", start_))
+    start_ = 0.0;
+  if (!nh_private_.getParam ("publish_clock", publish_clock_))
+    publish_clock_ = false;
+  if (!nh_private_.getParam ("prefetch_size", prefetch_size_))
+    prefetch_size_ = 10;
+
+  prefetch_size_ = std::max(prefetch_size_, 1);
+}
+
+void RGBDPlayer::spinDecoder(unsigned int first_frame)
+{
+  RGBDRecordingFrame frame;
+
+  for (unsigned int i = first_frame; i < reader_.getNumFrames(); ++i)
+  {
+    DecodedFrame decoded;
+    CameraInfoMsg::ConstPtr info_msg;
+
+    if (!reader_.readFrame(i, frame) || 
+        !(info_msg = reader_.getCameraInfo(frame.info_id)) ||
+        !decodeRGBDRecordingFrame(frame, decoded.rgb_msg, decoded.depth_msg))
+    {
+      ROS_WARN("RGBD Player: skipping corrupted frame %d", i);
+      continue;
+    }
+
+    decoded.info_msg.reset(new CameraInfoMsg(*info_msg));
+    decoded.info_msg->header = frame.rgb_header;
+
+    boost::mutex::scoped_lock lock(mutex_);
+    while (running_ && decoded_.size() >= (unsigned int)prefetch_size_)
+      cond_.wait(lock);
+    if (!running_) return;
+
+    decoded_.push_back(decoded);
+    cond_.notify_all();
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  decoding_done_ = true;
+  cond_.notify_all();
+}
+
+void RGBDPlayer::spinPlayback()
+{
+  // time of the first frame, on the wall clock and in the recording
+  bool started = false;
+  ros::WallTime wall_start;
+  ros::Time     recording_start;
+
+  int frame_count = 0;
+
+  while(true)
+  {
+    DecodedFrame decoded;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (running_ && decoded_.empty() && !decoding_done_)
+        cond_.wait(lock);
+      if (!running_ || decoded_.empty()) break;
+
+      decoded = decoded_.front();
+      decoded_.pop_front();
+      cond_.notify_all();
+    }
+
+    const ros::Time& stamp = decoded.rgb_msg->header.stamp;
+
+    if (!started)
+    {
+      started = true;
+      wall_start = ros::WallTime::now();
+      recording_start = stamp;
+    }
+    else if (rate_ > 0.0)
+    {
+      ros::WallTime due = wall_start + 
+        ros::WallDuration((stamp - recording_start).toSec() / rate_);
+      ros::WallDuration wait = due - ros::WallTime::now();
+      if (wait > ros::WallDuration(0.0)) wait.sleep();
+    }
+
+    if (publish_clock_)
+    {
+      rosgraph_msgs::Clock clock_msg;
+      clock_msg.clock = stamp;
+      clock_publisher_.publish(clock_msg);
+    }
+
+    rgb_publisher_.publish(decoded.rgb_msg);
+    depth_publisher_.publish(decoded.depth_msg);
+    info_publisher_.publish(decoded.info_msg);
+
+    ++frame_count;
+  }
+
+  if (started)
+  {
+    double duration = (ros::WallTime::now() - wall_start).toSec();
+    ROS_INFO("RGBD Player: published %d frames in %.1f s (%.1f Hz)",
+      frame_count, duration, duration > 0.0 ? frame_count / duration : 0.0);
+  }
+}
+
+} // namespace ccny_rgbd
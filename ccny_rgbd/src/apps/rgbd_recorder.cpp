@@ -0,0 +1,213 @@
+/**
+ *  @file rgbd_recorder.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/apps/rgbd_recorder.h"
+
+namespace ccny_rgbd {
+
+RGBDRecorder::RGBDRecorder(
+  const ros::NodeHandle& nh,
+  const ros::NodeHandle& nh_private):
+  nh_(nh),
+  nh_private_(nh_private),
+  next_seq_(0),
+  next_write_(0),
+  n_pending_(0),
+  n_dropped_(0),
+  running_(true)
+{
+  ROS_INFO("Starting RGBD Recorder");
+
+  // **** initialize ROS parameters
+
+  initParams();
+
+  // **** recording
+
+  writer_.reset(new RGBDRecordingWriter(chunk_size_));
+  if (!writer_->open(filename_))
+  {
+    ROS_ERROR("RGBD Recorder: could not open %s", filename_.c_str());
+    return;
+  }
+
+  ROS_INFO("Recording to %s", filename_.c_str());
+
+  // **** threads
+
+  work_.reset(new boost::asio::io_service::work(io_service_));
+  for (int i = 0; i < n_threads_; ++i)
+    encoder_threads_.create_thread(
+      boost::bind(&boost::asio::io_service::run, &io_service_));
+
+  io_thread_ = boost::thread(&RGBDRecorder::spinWriter, this);
+
+  // **** subscribers
+
+  ImageTransport rgb_it(nh_);
+  ImageTransport depth_it(nh_);
+
+  sub_rgb_.subscribe(rgb_it,     "/rgbd/rgb",   queue_size_);
+  sub_depth_.subscribe(depth_it, "/rgbd/depth", queue_size_);
+  sub_info_.subscribe(nh_,       "/rgbd/info",  queue_size_);
+
+  // Synchronize inputs.
+  sync_.reset(new RGBDSynchronizer3(
+                RGBDSyncPolicy3(queue_size_), sub_rgb_, sub_depth_, sub_info_));
+
+  sync_->registerCallback(boost::bind(&RGBDRecorder::RGBDCallback, this, _1, _2, _3));
+}
+
+RGBDRecorder::~RGBDRecorder()
+{
+  ROS_INFO("Destroying RGBD Recorder");
+
+  sync_.reset();
+
+  // finish the encoding jobs, then let the I/O thread drain the queue
+  work_.reset();
+  encoder_threads_.join_all();
+
+  mutex_.lock();
+  running_ = false;
+  mutex_.unlock();
+  cond_.notify_all();
+
+  if (io_thread_.joinable()) io_thread_.join();
+
+  if (writer_->isOpen())
+  {
+    ROS_INFO("Recorded %d frames (%d dropped) to %s",
+      writer_->getNumFrames(), n_dropped_, filename_.c_str());
+    writer_->close();
+  }
+}
+
+void RGBDRecorder::initParams()
+{
+  if (!nh_private_.getParam ("filename", filename_))
+    filename_ = "rgbd.rec";
+  if (!nh_private_.getParam ("queue_size", queue_size_))
+    queue_size_ = 5;
+  if (!nh_private_.getParam ("jpeg_quality", jpeg_quality_))
+    jpeg_quality_ = 90;
+  if (!nh_private_.getParam ("n_threads", n_threads_))
+    n_threads_ = 2;
+  if (!nh_private_.getParam ("chunk_size", chunk_size_))
+    chunk_size_ = 30;
+  if (!nh_private_.getParam ("max_queue_size", max_queue_size_))
+    max_queue_size_ = 60;
+
+  n_threads_      = std::max(n_threads_, 1);
+  chunk_size_     = std::max(chunk_size_, 1);
+  max_queue_size_ = std::max(max_queue_size_, 1);
+}
+
+void RGBDRecorder::RGBDCallback(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg)
+{
+  unsigned int seq;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (n_pending_ >= (unsigned int)max_queue_size_)
+    {
+      ++n_dropped_;
+      ROS_WARN_THROTTLE(1.0, 
+        "RGBD Recorder: queue full, dropped %d frames so far", n_dropped_);
+      return;
+    }
+
+    seq = next_seq_++;
+    ++n_pending_;
+  }
+
+  io_service_.post(boost::bind(&RGBDRecorder::encodeFrame, this,
+    seq, rgb_msg, depth_msg, info_msg));
+}
+
+void RGBDRecorder::encodeFrame(
+  unsigned int seq,
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg)
+{
+  EncodedFramePtr encoded(new EncodedFrame);
+  encoded->info_msg = info_msg;
+
+  try
+  {
+    if (!encodeRGBDRecordingFrame(rgb_msg, depth_msg, jpeg_quality_, encoded->frame))
+      encoded.reset();
+  }
+  catch (std::exception& e)
+  {
+    ROS_ERROR("RGBD Recorder: could not encode frame %u: %s", seq, e.what());
+    encoded.reset();
+  }
+
+  // the writer waits for every seq in order, so failed frames are 
+  // queued too (as null), to be skipped
+  boost::mutex::scoped_lock lock(mutex_);
+  encoded_[seq] = encoded;
+  cond_.notify_all();
+}
+
+void RGBDRecorder::spinWriter()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  while(true)
+  {
+    std::map<unsigned int, EncodedFramePtr>::iterator it = 
+      encoded_.find(next_write_);
+
+    if (it == encoded_.end())
+    {
+      // all the jobs are done when running_ is cleared
+      if (!running_) break;
+      cond_.wait(lock);
+      continue;
+    }
+
+    EncodedFramePtr encoded = it->second;
+    encoded_.erase(it);
+    ++next_write_;
+
+    // write without holding the lock
+    lock.unlock();
+
+    if (encoded)
+    {
+      encoded->frame.info_id = writer_->addCameraInfo(*encoded->info_msg);
+      writer_->addFrame(encoded->frame);
+    }
+
+    lock.lock();
+    --n_pending_;
+  }
+}
+
+} // namespace ccny_rgbd
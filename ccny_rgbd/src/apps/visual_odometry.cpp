@@ -30,8 +30,11 @@ VisualOdometry::VisualOdometry(
   const ros::NodeHandle& nh_private):
   nh_(nh), 
   nh_private_(nh_private),
+  diagnostics_file_(NULL),
   initialized_(false),
-  frame_count_(0)
+  frame_count_(0),
+  drop_count_(0),
+  cloud_subscribed_(false)
 {
   ROS_INFO("Starting RGBD Visual Odometry");
 
@@ -43,14 +46,21 @@ VisualOdometry::VisualOdometry(
   
   f2b_.setIdentity();
 
+  // only needed until the base to camera transform is found
+  tf_listener_.reset(new tf::TransformListener());
+
   // **** publishers
 
   odom_publisher_ = nh_.advertise<OdomMsg>(
     "vo", queue_size_);
   pose_stamped_publisher_ = nh_.advertise<geometry_msgs::PoseStamped>(
       "pose", queue_size_);
+  
+  ros::SubscriberStatusCallback connect_cb = 
+    boost::bind(&VisualOdometry::connectCallback, this);
+  
   cloud_publisher_ = nh_.advertise<PointCloudFeature>(
-    "feature/cloud", 1);
+    "feature/cloud", 1, connect_cb, connect_cb);
   path_pub_ = nh_.advertise<PathMsg>(
     "path", queue_size_);
   
@@ -59,9 +69,9 @@ VisualOdometry::VisualOdometry(
   ImageTransport rgb_it(nh_);
   ImageTransport depth_it(nh_);
 
-  sub_rgb_.subscribe(rgb_it,     "/rgbd/rgb",   queue_size_);
-  sub_depth_.subscribe(depth_it, "/rgbd/depth", queue_size_);
-  sub_info_.subscribe(nh_,       "/rgbd/info",  queue_size_);
+  sub_rgb_.subscribe(rgb_it,     "rgbd/rgb",   queue_size_);
+  sub_depth_.subscribe(depth_it, "rgbd/depth", queue_size_);
+  sub_info_.subscribe(nh_,       "rgbd/info",  queue_size_);
   
   // Synchronize inputs.
   sync_.reset(new RGBDSynchronizer3(
@@ -72,7 +82,7 @@ VisualOdometry::VisualOdometry(
 
 VisualOdometry::~VisualOdometry()
 {
-  fclose(diagnostics_file_);
+  if (diagnostics_file_) fclose(diagnostics_file_);
   ROS_INFO("Destroying RGBD Visual Odometry"); 
 }
 
@@ -92,6 +102,8 @@ void VisualOdometry::initParams()
     base_frame_ = "/camera_link";
   if (!nh_private_.getParam ("queue_size", queue_size_))
     queue_size_ = 5;
+  if (!nh_private_.getParam ("max_latency", max_latency_))
+    max_latency_ = 0.0;
 
   // detector params
   
@@ -230,6 +242,39 @@ void VisualOdometry::RGBDCallback(
   const ImageMsg::ConstPtr& rgb_msg,
   const ImageMsg::ConstPtr& depth_msg,
   const CameraInfoMsg::ConstPtr& info_msg)
+{
+  // when several streams share the spinner threads, a stream which
+  // falls behind drops frames instead of queueing them
+  boost::mutex::scoped_try_lock lock(mutex_);
+
+  bool late = max_latency_ > 0.0 && 
+    (ros::Time::now() - rgb_msg->header.stamp).toSec() > max_latency_;
+
+  if (!lock || late)
+  {
+    drop_count_++;
+    ROS_WARN_THROTTLE(5.0, "VO in %s: dropped %d frames (max. latency %.3f s)",
+      nh_.getNamespace().c_str(), drop_count_, max_latency_);
+    return;
+  }
+
+  processFrame(rgb_msg, depth_msg, info_msg);
+}
+
+void VisualOdometry::setBaseToCameraTf(const tf::Transform& b2c)
+{
+  b2c_ = b2c;
+  motion_estimation_->setBaseToCameraTf(b2c_);
+  initialized_ = true;
+
+  // stop receiving tf
+  tf_listener_.reset();
+}
+
+bool VisualOdometry::processFrame(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg)
 {
   ros::WallTime start = ros::WallTime::now();
 
@@ -237,29 +282,28 @@ void VisualOdometry::RGBDCallback(
 
   if (!initialized_)
   {
-    initialized_ = getBaseToCameraTf(rgb_msg->header);
+    if (!lookupBaseToCameraTf(rgb_msg->header)) return false;
     init_time_ = rgb_msg->header.stamp;
-    if (!initialized_) return;
 
-    motion_estimation_->setBaseToCameraTf(b2c_);
+    setBaseToCameraTf(b2c_);
   }
 
   // **** create frame *************************************************
 
   ros::WallTime start_frame = ros::WallTime::now();
-  RGBDFrame frame(rgb_msg, depth_msg, info_msg);
+  RGBDFramePtr frame = frame_factory_.create(rgb_msg, depth_msg, info_msg);
   ros::WallTime end_frame = ros::WallTime::now();
 
   // **** find features ************************************************
 
   ros::WallTime start_features = ros::WallTime::now();
-  feature_detector_->findFeatures(frame);
+  feature_detector_->findFeatures(*frame);
   ros::WallTime end_features = ros::WallTime::now();
 
   // **** registration *************************************************
   
   ros::WallTime start_reg = ros::WallTime::now();
-  tf::Transform motion = motion_estimation_->getMotionEstimation(frame);
+  tf::Transform motion = motion_estimation_->getMotionEstimation(*frame);
   f2b_ = motion * f2b_;
   ros::WallTime end_reg = ros::WallTime::now();
 
@@ -269,7 +313,7 @@ void VisualOdometry::RGBDCallback(
   if (publish_odom_) publishOdom(rgb_msg->header);
   if (publish_path_) publishPath(rgb_msg->header);
   if (publish_pose_) publishPoseStamped(rgb_msg->header);
-  if (publish_cloud_) publishFeatureCloud(frame);
+  if (publish_cloud_ && cloud_subscribed_) publishFeatureCloud(*frame);
 
   // **** print diagnostics *******************************************
 
@@ -277,8 +321,8 @@ void VisualOdometry::RGBDCallback(
 
   frame_count_++;
   
-  int n_features = frame.keypoints.size();
-  int n_valid_features = frame.n_valid_keypoints;
+  int n_features = frame->keypoints.size();
+  int n_valid_features = frame->n_valid_keypoints;
   int n_model_pts = motion_estimation_->getModelSize();
 
   double d_frame    = 1000.0 * (end_frame    - start_frame   ).toSec();
@@ -288,6 +332,8 @@ void VisualOdometry::RGBDCallback(
 
   diagnostics(n_features, n_valid_features, n_model_pts,
               d_frame, d_features, d_reg, d_total);
+
+  return true;
 }
 
 void VisualOdometry::publishTf(const std_msgs::Header& header)
@@ -339,15 +385,21 @@ void VisualOdometry::publishFeatureCloud(RGBDFrame& frame)
   cloud_publisher_.publish(cloud);
 }
 
-bool VisualOdometry::getBaseToCameraTf(const std_msgs::Header& header)
+void VisualOdometry::connectCallback()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  cloud_subscribed_ = (cloud_publisher_.getNumSubscribers() > 0);
+}
+
+bool VisualOdometry::lookupBaseToCameraTf(const std_msgs::Header& header)
 {
   tf::StampedTransform tf_m;
 
   try
   {
-    tf_listener_.waitForTransform(
+    tf_listener_->waitForTransform(
       base_frame_, header.frame_id, header.stamp, ros::Duration(1.0));
-    tf_listener_.lookupTransform (
+    tf_listener_->lookupTransform (
       base_frame_, header.frame_id, header.stamp, tf_m);
   }
   catch (tf::TransformException& ex)
@@ -363,6 +415,9 @@ bool VisualOdometry::getBaseToCameraTf(const std_msgs::Header& header)
 
 void VisualOdometry::gftReconfigCallback(GftDetectorConfig& config, uint32_t level)
 {
+  // wait for the frame in progress: the detector may be replaced
+  boost::mutex::scoped_lock lock(mutex_);
+
   GftDetectorPtr gft_detector = 
     boost::static_pointer_cast<GftDetector>(feature_detector_);
     
@@ -372,6 +427,8 @@ void VisualOdometry::gftReconfigCallback(GftDetectorConfig& config, uint32_t lev
 
 void VisualOdometry::starReconfigCallback(StarDetectorConfig& config, uint32_t level)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   StarDetectorPtr star_detector = 
     boost::static_pointer_cast<StarDetector>(feature_detector_);
     
@@ -381,6 +438,8 @@ void VisualOdometry::starReconfigCallback(StarDetectorConfig& config, uint32_t l
 
 void VisualOdometry::surfReconfigCallback(SurfDetectorConfig& config, uint32_t level)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   SurfDetectorPtr surf_detector = 
     boost::static_pointer_cast<SurfDetector>(feature_detector_);
     
@@ -389,6 +448,8 @@ void VisualOdometry::surfReconfigCallback(SurfDetectorConfig& config, uint32_t l
     
 void VisualOdometry::orbReconfigCallback(OrbDetectorConfig& config, uint32_t level)
 {
+  boost::mutex::scoped_lock lock(mutex_);
+
   OrbDetectorPtr orb_detector = 
     boost::static_pointer_cast<OrbDetector>(feature_detector_);
     
@@ -0,0 +1,149 @@
+/**
+ *  @file covariance_marker_publisher.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/covariance_marker_publisher.h"
+
+namespace ccny_rgbd {
+
+CovarianceMarkerPublisher::CovarianceMarkerPublisher(
+  const ros::Publisher& publisher,
+  const std::string& ns,
+  double rate,
+  float r, float g, float b):
+  publisher_(publisher),
+  ns_(ns),
+  r_(r), g_(g), b_(b),
+  running_(true),
+  pending_(false)
+{
+  if (rate > 0.0)
+    period_ = ros::WallDuration(1.0 / rate);
+  else
+    period_ = ros::WallDuration(0.0);
+
+  thread_ = boost::thread(&CovarianceMarkerPublisher::spin, this);
+}
+
+CovarianceMarkerPublisher::~CovarianceMarkerPublisher()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    running_ = false;
+  }
+  cond_.notify_one();
+  thread_.join();
+}
+
+bool CovarianceMarkerPublisher::update(
+  const std_msgs::Header& header,
+  const Vector3fVector& means,
+  const Matrix3fVector& covariances)
+{
+  ros::WallTime now = ros::WallTime::now();
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (pending_ || now - last_update_ < period_) return false;
+
+    header_ = header;
+    means_ = means;
+    covariances_.assign(covariances);
+
+    pending_ = true;
+    last_update_ = now;
+  }
+
+  cond_.notify_one();
+  return true;
+}
+
+void CovarianceMarkerPublisher::spin()
+{
+  while(true)
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (running_ && !pending_) cond_.wait(lock);
+      if (!running_) return;
+
+      // take ownership of the snapshot; the swapped-out buffers
+      // keep their capacity for the next update()
+      w_header_ = header_;
+      w_means_.swap(means_);
+      std::swap(w_covariances_, covariances_);
+      pending_ = false;
+    }
+
+    publishMarker();
+  }
+}
+
+void CovarianceMarkerPublisher::publishMarker()
+{
+  eigenSymmetric3x3(w_covariances_, w_eigenvalues_, w_eigenvectors_);
+
+  visualization_msgs::Marker marker;
+  marker.header = w_header_;
+  marker.type = visualization_msgs::Marker::LINE_LIST;
+  marker.color.r = r_;
+  marker.color.g = g_;
+  marker.color.b = b_;
+  marker.color.a = 1.0;
+  marker.scale.x = 0.0025;
+  marker.action = visualization_msgs::Marker::ADD;
+  marker.ns = ns_;
+  marker.id = 0;
+  marker.lifetime = ros::Duration();
+
+  marker.points.resize(w_means_.size() * 6);
+
+  unsigned int p_idx = 0;
+  for (unsigned int i = 0; i < w_means_.size(); ++i)
+  {
+    const Vector3f& mean = w_means_[i];
+    const Vector3f& evl = w_eigenvalues_[i];
+    const Matrix3f& evt = w_eigenvectors_[i];
+
+    for (int e = 0; e < 3; ++e)
+    {
+      double sigma = sqrt(std::abs(evl(e)));
+      double scale = sigma * 3.0;
+
+      geometry_msgs::Point& a = marker.points[p_idx++];
+      geometry_msgs::Point& b = marker.points[p_idx++];
+
+      a.x = mean(0) + evt(e,0) * scale;
+      a.y = mean(1) + evt(e,1) * scale;
+      a.z = mean(2) + evt(e,2) * scale;
+
+      b.x = mean(0) - evt(e,0) * scale;
+      b.y = mean(1) - evt(e,1) * scale;
+      b.z = mean(2) - evt(e,2) * scale;
+    }
+  }
+
+  publisher_.publish(marker);
+}
+
+} // namespace ccny_rgbd
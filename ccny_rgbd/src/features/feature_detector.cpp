@@ -42,15 +42,21 @@ void FeatureDetector::findFeatures(RGBDFrame& frame)
   
   const cv::Mat& input_img = frame.rgb_img;
 
-  // convert from RGB to grayscale
-  cv::Mat gray_img(input_img.rows, input_img.cols, CV_8UC1);
-  cvtColor(input_img, gray_img, CV_BGR2GRAY);
-
-  // blur if needed
+  // convert from RGB to grayscale; mono input is used as is
+  cv::Mat gray_img;
+  if (input_img.channels() == 1)
+    gray_img = input_img;
+  else
+    cvtColor(input_img, gray_img, CV_BGR2GRAY);
+
+  // blur if needed (into a new image, since gray_img might 
+  // share its data with the frame)
   if(smooth_ > 0)
   {
     int blur_size = smooth_*2 + 1;
-    cv::GaussianBlur(gray_img, gray_img, cv::Size(blur_size, blur_size), 0);
+    cv::Mat blurred_img;
+    cv::GaussianBlur(gray_img, blurred_img, cv::Size(blur_size, blur_size), 0);
+    gray_img = blurred_img;
   }
 
   // find the 2D coordinates of keypoints
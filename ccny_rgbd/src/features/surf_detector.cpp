@@ -38,8 +38,8 @@ SurfDetector::~SurfDetector()
 
 void SurfDetector::findFeatures(RGBDFrame& frame, const cv::Mat& input_img)
 {
-  cv::Mat mask(frame.depth_img.size(), CV_8UC1);
-  frame.depth_img.convertTo(mask, CV_8U);
+  // valid depth mask (also excludes NaN for 32FC1 depth)
+  cv::Mat mask = frame.depth_img > 0;
 
   surf_detector_->detect(input_img, frame.keypoints, mask);
 
@@ -52,6 +52,10 @@ KeyframeGraphDetector::KeyframeGraphDetector(
     max_corresp_dist_eucl_ = 0.03;
   if (!nh_private_.getParam ("graph/n_keypoints", n_keypoints_))
     n_keypoints_ = 200;
+  if (!nh_private_.getParam ("graph/init_surf_threshold", init_surf_threshold_))
+    init_surf_threshold_ = 400.0;
+  if (!nh_private_.getParam ("graph/min_surf_threshold", min_surf_threshold_))
+    min_surf_threshold_ = 25.0;
     
   // derived params
   max_corresp_dist_eucl_sq_ = max_corresp_dist_eucl_ * max_corresp_dist_eucl_;
@@ -75,12 +79,17 @@ void KeyframeGraphDetector::generateKeyframeAssociations(
   //manualBruteForceAssociations(keyframes, associations);
 }
 
+std::string KeyframeGraphDetector::getDescriptorVersion() const
+{
+  std::stringstream ss;
+  ss << "SURF " << n_keypoints_ << " " 
+     << init_surf_threshold_ << " " << min_surf_threshold_;
+  return ss.str();
+}
+
 void KeyframeGraphDetector::prepareFeaturesForRANSAC(
   KeyframeVector& keyframes)
 {
-  double init_surf_threshold = 400.0;
-  double min_surf_threshold = 25;
-
   printf("preparing SURF features for RANSAC associations...\n");  
 
   cv::SurfDescriptorExtractor extractor;
@@ -89,9 +98,9 @@ void KeyframeGraphDetector::prepareFeaturesForRANSAC(
   { 
     RGBDKeyframe& keyframe = keyframes[kf_idx];
 
-    double surf_threshold = init_surf_threshold;
+    double surf_threshold = init_surf_threshold_;
 
-    while (surf_threshold >= min_surf_threshold)
+    while (surf_threshold >= min_surf_threshold_)
     {
       cv::SurfFeatureDetector detector(surf_threshold);
       keyframe.keypoints.clear();
@@ -0,0 +1,232 @@
+/**
+ *  @file map_query.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/map_query.h"
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+namespace ccny_rgbd {
+
+/** @brief 1D squared distance transform of a sampled function
+ * 
+ * @param f the input function
+ * @param d the output squared distances
+ * @param n number of samples
+ * @param v work buffer of size n (parabola locations)
+ * @param z work buffer of size n + 1 (parabola boundaries)
+ */
+static void distanceTransform1D(
+  const float * f, float * d, int n, int * v, float * z)
+{
+  const float inf = std::numeric_limits<float>::infinity();
+
+  int k = 0;
+  v[0] = 0;
+  z[0] = -inf;
+  z[1] =  inf;
+
+  for (int q = 1; q < n; ++q)
+  {
+    float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+    while (s <= z[k])
+    {
+      --k;
+      s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+    }
+
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = inf;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; ++q)
+  {
+    while (z[k + 1] < q) ++k;
+    float dq = q - v[k];
+    d[q] = dq * dq + f[v[k]];
+  }
+}
+
+MapQuery::MapQuery(double max_distance):
+  max_distance_(max_distance)
+{
+
+}
+
+MapQuery::~MapQuery()
+{
+
+}
+
+void MapQuery::setMap(const boost::shared_ptr<const octomap::OcTree>& tree)
+{
+  tree_ = tree;
+  invalidate();
+}
+
+void MapQuery::setMaxDistance(double max_distance)
+{
+  max_distance_ = max_distance;
+  invalidate();
+}
+
+void MapQuery::invalidate()
+{
+  distance_cache_.clear();
+}
+
+MapQuery::Occupancy MapQuery::getOccupancy(const octomap::point3d& point) const
+{
+  if (!tree_) return UNKNOWN;
+
+  octomap::OcTreeNode * node = tree_->search(point);
+  if (!node) return UNKNOWN;
+
+  return tree_->isNodeOccupied(node) ? OCCUPIED : FREE;
+}
+
+bool MapQuery::castRay(
+  const octomap::point3d& origin,
+  const octomap::point3d& direction,
+  double max_range,
+  bool ignore_unknown,
+  octomap::point3d& end) const
+{
+  end = origin;
+  if (!tree_ || direction.norm() <= 0.0) return false;
+
+  return tree_->castRay(origin, direction, end, ignore_unknown, max_range);
+}
+
+double MapQuery::getDistance(const octomap::point3d& point) const
+{
+  octomap::OcTreeKey key;
+  if (!tree_ || !tree_->coordToKeyChecked(point, key)) return max_distance_;
+
+  VoxelIndex index(key[0] / BLOCK_SIZE, key[1] / BLOCK_SIZE, key[2] / BLOCK_SIZE);
+
+  DistanceBlockMap::iterator it = distance_cache_.find(index);
+  if (it == distance_cache_.end())
+  {
+    DistanceBlockPtr block(new DistanceBlock());
+    computeDistanceBlock(index, *block);
+    it = distance_cache_.insert(DistanceBlockMap::value_type(index, block)).first;
+  }
+
+  int x = key[0] % BLOCK_SIZE;
+  int y = key[1] % BLOCK_SIZE;
+  int z = key[2] % BLOCK_SIZE;
+  return it->second->distance[(z * BLOCK_SIZE + y) * BLOCK_SIZE + x];
+}
+
+void MapQuery::computeDistanceBlock(
+  const VoxelIndex& index, 
+  DistanceBlock& block) const
+{
+  // **** a dense grid around the block, padded by the maximum distance
+
+  const double resolution = tree_->getResolution();
+  const int padding = (int)ceil(max_distance_ / resolution);
+  const int n = BLOCK_SIZE + 2 * padding;
+
+  // key of the grid origin
+  const int origin[3] = { 
+    index.x * BLOCK_SIZE - padding, 
+    index.y * BLOCK_SIZE - padding, 
+    index.z * BLOCK_SIZE - padding };
+
+  // larger than any distance in the grid, but finite
+  const float far = 3.0f * n * n;
+  std::vector<float> grid(n * n * n, far);
+
+  // **** mark the occupied voxels, expanding pruned leaves
+
+  const int max_key = std::numeric_limits<octomap::key_type>::max();
+  octomap::OcTreeKey min_key, max_key_bbx;
+  for (int a = 0; a < 3; ++a)
+  {
+    min_key[a]     = std::max(0, origin[a]);
+    max_key_bbx[a] = std::min(max_key, origin[a] + n - 1);
+  }
+
+  octomap::OcTree::leaf_bbx_iterator it;
+  for (it = tree_->begin_leafs_bbx(min_key, max_key_bbx); 
+       it != tree_->end_leafs_bbx(); ++it)
+  {
+    if (!tree_->isNodeOccupied(*it)) continue;
+
+    double half_size = 0.5 * (it.getSize() - resolution);
+    octomap::point3d center = it.getCoordinate();
+
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; ++a)
+    {
+      lo[a] = std::max(0,     (int)tree_->coordToKey(center(a) - half_size) - origin[a]);
+      hi[a] = std::min(n - 1, (int)tree_->coordToKey(center(a) + half_size) - origin[a]);
+    }
+
+    for (int z = lo[2]; z <= hi[2]; ++z)
+    for (int y = lo[1]; y <= hi[1]; ++y)
+    for (int x = lo[0]; x <= hi[0]; ++x)
+      grid[(z * n + y) * n + x] = 0.0f;
+  }
+
+  // **** squared distance transform, one axis at a time
+
+  std::vector<float> f(n), d(n), zb(n + 1);
+  std::vector<int> v(n);
+
+  const int strides[3] = { 1, n, n * n };
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    int stride = strides[axis];
+    int other_a = strides[(axis + 1) % 3];
+    int other_b = strides[(axis + 2) % 3];
+
+    for (int i = 0; i < n; ++i)
+    for (int j = 0; j < n; ++j)
+    {
+      float * line = &grid[i * other_a + j * other_b];
+      for (int k = 0; k < n; ++k) f[k] = line[k * stride];
+      distanceTransform1D(&f[0], &d[0], n, &v[0], &zb[0]);
+      for (int k = 0; k < n; ++k) line[k * stride] = d[k];
+    }
+  }
+
+  // **** keep the block, in meters
+
+  for (int z = 0; z < BLOCK_SIZE; ++z)
+  for (int y = 0; y < BLOCK_SIZE; ++y)
+  for (int x = 0; x < BLOCK_SIZE; ++x)
+  {
+    float d2 = grid[((z + padding) * n + y + padding) * n + x + padding];
+    block.distance[(z * BLOCK_SIZE + y) * BLOCK_SIZE + x] = 
+      std::min((double)sqrt(d2) * resolution, max_distance_);
+  }
+}
+
+} // namespace ccny_rgbd
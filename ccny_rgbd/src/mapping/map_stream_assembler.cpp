@@ -0,0 +1,134 @@
+/**
+ *  @file map_stream_assembler.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/map_stream_assembler.h"
+
+namespace ccny_rgbd {
+
+MapStreamAssembler::MapStreamAssembler()
+{
+
+}
+
+MapStreamAssembler::~MapStreamAssembler()
+{
+
+}
+
+void MapStreamAssembler::addChunk(const MapStreamChunk& chunk)
+{
+  int level = chunk.level;
+  if (level >= (int)levels_.size())
+  {
+    levels_.resize(level + 1);
+    voxel_sizes_.resize(level + 1, 0.0);
+    block_sizes_.resize(level + 1, 0);
+  }
+
+  voxel_sizes_[level] = chunk.voxel_size;
+  block_sizes_[level] = chunk.block_size;
+  frame_id_ = chunk.header.frame_id;
+
+  VoxelIndex index(chunk.x, chunk.y, chunk.z);
+
+  if (chunk.voxels.empty())
+  {
+    levels_[level].erase(index);
+    return;
+  }
+
+  if (chunk.voxels.size() % 3 != 0 || 
+      chunk.colors.size() != chunk.voxels.size()) return;
+
+  Block& block = levels_[level][index];
+  block.voxels = chunk.voxels;
+  block.colors = chunk.colors;
+}
+
+void MapStreamAssembler::clear()
+{
+  levels_.clear();
+  voxel_sizes_.clear();
+  block_sizes_.clear();
+}
+
+int MapStreamAssembler::getNumBlocks() const
+{
+  int n_blocks = 0;
+  for (unsigned int level = 0; level < levels_.size(); ++level)
+    n_blocks += levels_[level].size();
+  return n_blocks;
+}
+
+void MapStreamAssembler::getCloud(PointCloudT& cloud) const
+{
+  cloud.points.clear();
+  cloud.header.frame_id = frame_id_;
+
+  for (unsigned int level = 0; level < levels_.size(); ++level)
+  {
+    double voxel_size = voxel_sizes_[level];
+    int block_size = block_sizes_[level];
+
+    // the finer level, which covers each block with 2x2x2 blocks
+    const BlockMap * finer = 
+      level + 1 < levels_.size() ? &levels_[level + 1] : NULL;
+
+    BlockMap::const_iterator it;
+    for (it = levels_[level].begin(); it != levels_[level].end(); ++it)
+    {
+      const VoxelIndex& index = it->first;
+      const Block& block = it->second;
+
+      for (unsigned int v_idx = 0; v_idx < block.voxels.size(); v_idx += 3)
+      {
+        int x = block.voxels[v_idx];
+        int y = block.voxels[v_idx + 1];
+        int z = block.voxels[v_idx + 2];
+
+        if (finer)
+        {
+          VoxelIndex child(2 * index.x + 2 * x / block_size,
+                           2 * index.y + 2 * y / block_size,
+                           2 * index.z + 2 * z / block_size);
+          if (finer->find(child) != finer->end()) continue;
+        }
+
+        PointT p;
+        p.x = (index.x * block_size + x + 0.5) * voxel_size;
+        p.y = (index.y * block_size + y + 0.5) * voxel_size;
+        p.z = (index.z * block_size + z + 0.5) * voxel_size;
+        p.r = block.colors[v_idx];
+        p.g = block.colors[v_idx + 1];
+        p.b = block.colors[v_idx + 2];
+        cloud.points.push_back(p);
+      }
+    }
+  }
+
+  cloud.width = cloud.points.size();
+  cloud.height = 1;
+  cloud.is_dense = true;
+}
+
+} // namespace ccny_rgbd
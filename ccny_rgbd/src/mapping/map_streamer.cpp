@@ -0,0 +1,319 @@
+/**
+ *  @file map_streamer.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/map_streamer.h"
+
+#include <algorithm>
+
+namespace ccny_rgbd {
+
+// **** helpers
+
+static const uint64_t NOT_SENT_SIGNATURE = 0; ///< the chunk was never sent
+static const uint64_t EMPTY_SIGNATURE    = 1; ///< the chunk is a removal
+
+/** @brief FNV-1a hash of the content of a chunk
+ */
+static uint64_t computeSignature(
+  const std::vector<uint8_t>& voxels, 
+  const std::vector<uint8_t>& colors)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned int i = 0; i < voxels.size(); ++i)
+    hash = (hash ^ voxels[i]) * 1099511628211ULL;
+  for (unsigned int i = 0; i < colors.size(); ++i)
+    hash = (hash ^ colors[i]) * 1099511628211ULL;
+
+  // keep the reserved values free
+  return hash > EMPTY_SIGNATURE ? hash : hash + 2;
+}
+
+/** @brief Floor division
+ */
+static inline int floorDiv(int a, int b)
+{
+  return a >= 0 ? a / b : (a + 1) / b - 1;
+}
+
+/** @brief Color sum of the points in a voxel
+ */
+struct ColorSum
+{
+  int r, g, b, n;
+  ColorSum(): r(0), g(0), b(0), n(0) { }
+};
+
+/** @brief A chunk waiting to be sent
+ */
+struct ChunkCandidate
+{
+  int level;
+  double dist;
+  VoxelIndex index;
+
+  bool operator<(const ChunkCandidate& other) const
+  {
+    if (level != other.level) return level < other.level;
+    return dist < other.dist;
+  }
+};
+
+// **** MapStreamer
+
+MapStreamer::MapStreamer(
+  double resolution, 
+  int n_levels,
+  double focus_radius):
+  resolution_(resolution),
+  n_levels_(std::max(n_levels, 1)),
+  focus_radius_(focus_radius),
+  focus_(0.0, 0.0, 0.0),
+  levels_(n_levels_)
+{
+
+}
+
+MapStreamer::~MapStreamer()
+{
+
+}
+
+void MapStreamer::buildLevel(
+  const PointCloudT& cloud, 
+  int level, 
+  ChunkMap& chunks) const
+{
+  double inv_size = 1.0 / getVoxelSize(level);
+
+  // **** voxelize
+
+  boost::unordered_map<VoxelIndex, ColorSum, VoxelIndexHash> voxels;
+  for (unsigned int pt_idx = 0; pt_idx < cloud.points.size(); ++pt_idx)
+  {
+    const PointT& p = cloud.points[pt_idx];
+    if (std::isnan(p.z)) continue;
+
+    ColorSum& sum = voxels[VoxelIndex::fromPoint(p.x, p.y, p.z, inv_size)];
+    sum.r += p.r;
+    sum.g += p.g;
+    sum.b += p.b;
+    ++sum.n;
+  }
+
+  // **** group the voxels into blocks, by index within the block
+
+  typedef std::vector<std::pair<int, const ColorSum*> > BlockVoxels;
+  boost::unordered_map<VoxelIndex, BlockVoxels, VoxelIndexHash> blocks;
+
+  boost::unordered_map<VoxelIndex, ColorSum, VoxelIndexHash>::const_iterator it;
+  for (it = voxels.begin(); it != voxels.end(); ++it)
+  {
+    const VoxelIndex& v = it->first;
+    VoxelIndex block(floorDiv(v.x, BLOCK_SIZE), 
+                     floorDiv(v.y, BLOCK_SIZE), 
+                     floorDiv(v.z, BLOCK_SIZE));
+
+    int x = v.x - block.x * BLOCK_SIZE;
+    int y = v.y - block.y * BLOCK_SIZE;
+    int z = v.z - block.z * BLOCK_SIZE;
+    blocks[block].push_back(std::make_pair(
+      (z * BLOCK_SIZE + y) * BLOCK_SIZE + x, &it->second));
+  }
+
+  // **** the chunks, in a canonical order so the signatures are stable
+
+  boost::unordered_map<VoxelIndex, BlockVoxels, VoxelIndexHash>::iterator b_it;
+  for (b_it = blocks.begin(); b_it != blocks.end(); ++b_it)
+  {
+    BlockVoxels& block_voxels = b_it->second;
+    std::sort(block_voxels.begin(), block_voxels.end());
+
+    ChunkPtr chunk(new Chunk());
+    chunk->voxels.reserve(3 * block_voxels.size());
+    chunk->colors.reserve(3 * block_voxels.size());
+
+    for (unsigned int v_idx = 0; v_idx < block_voxels.size(); ++v_idx)
+    {
+      int i = block_voxels[v_idx].first;
+      const ColorSum& sum = *block_voxels[v_idx].second;
+
+      chunk->voxels.push_back(i % BLOCK_SIZE);
+      chunk->voxels.push_back((i / BLOCK_SIZE) % BLOCK_SIZE);
+      chunk->voxels.push_back(i / (BLOCK_SIZE * BLOCK_SIZE));
+      chunk->colors.push_back(sum.r / sum.n);
+      chunk->colors.push_back(sum.g / sum.n);
+      chunk->colors.push_back(sum.b / sum.n);
+    }
+
+    chunk->signature = computeSignature(chunk->voxels, chunk->colors);
+    chunk->sent_signature = NOT_SENT_SIGNATURE;
+    chunks[b_it->first] = chunk;
+  }
+}
+
+void MapStreamer::setMap(const PointCloudT& cloud)
+{
+  // voxelize without blocking the sender
+  std::vector<ChunkMap> new_levels(n_levels_);
+  for (int level = 0; level < n_levels_; ++level)
+    buildLevel(cloud, level, new_levels[level]);
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  for (int level = 0; level < n_levels_; ++level)
+  {
+    ChunkMap& old_chunks = levels_[level];
+    ChunkMap& new_chunks = new_levels[level];
+
+    // keep track of what the viewers already have
+    ChunkMap::iterator it;
+    for (it = new_chunks.begin(); it != new_chunks.end(); ++it)
+    {
+      ChunkMap::const_iterator old_it = old_chunks.find(it->first);
+      if (old_it != old_chunks.end())
+        it->second->sent_signature = old_it->second->sent_signature;
+    }
+
+    // blocks which the viewers have, but which are now empty
+    for (it = old_chunks.begin(); it != old_chunks.end(); ++it)
+    {
+      uint64_t sent_signature = it->second->sent_signature;
+      if (sent_signature == NOT_SENT_SIGNATURE || 
+          sent_signature == EMPTY_SIGNATURE) continue;
+      if (new_chunks.find(it->first) != new_chunks.end()) continue;
+
+      ChunkPtr removal(new Chunk());
+      removal->signature = EMPTY_SIGNATURE;
+      removal->sent_signature = sent_signature;
+      new_chunks[it->first] = removal;
+    }
+
+    old_chunks.swap(new_chunks);
+  }
+}
+
+void MapStreamer::setFocus(const tf::Vector3& focus)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  focus_ = focus;
+}
+
+void MapStreamer::resend()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  for (int level = 0; level < n_levels_; ++level)
+  {
+    ChunkMap& chunks = levels_[level];
+    for (ChunkMap::iterator it = chunks.begin(); it != chunks.end(); )
+    {
+      // new viewers have nothing to remove
+      if (it->second->signature == EMPTY_SIGNATURE)
+        it = chunks.erase(it);
+      else
+      {
+        it->second->sent_signature = NOT_SENT_SIGNATURE;
+        ++it;
+      }
+    }
+  }
+}
+
+int MapStreamer::getChunks(
+  int max_bytes, 
+  std::vector<MapStreamChunk::Ptr>& chunks)
+{
+  chunks.clear();
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  // **** the pending chunks in range, by priority
+
+  std::vector<ChunkCandidate> candidates;
+  for (int level = 0; level < n_levels_; ++level)
+  {
+    double block_size = BLOCK_SIZE * getVoxelSize(level);
+    double radius = focus_radius_ * (1 << (n_levels_ - 1 - level));
+
+    ChunkMap::const_iterator it;
+    for (it = levels_[level].begin(); it != levels_[level].end(); ++it)
+    {
+      const Chunk& chunk = *it->second;
+      if (chunk.signature == chunk.sent_signature) continue;
+
+      const VoxelIndex& index = it->first;
+      tf::Vector3 center((index.x + 0.5) * block_size, 
+                         (index.y + 0.5) * block_size, 
+                         (index.z + 0.5) * block_size);
+      double dist = (center - focus_).length();
+
+      // outdated chunks are always sent, new ones only in range
+      if (level > 0 && dist > radius && 
+          chunk.sent_signature == NOT_SENT_SIGNATURE) continue;
+
+      ChunkCandidate candidate;
+      candidate.level = level;
+      candidate.dist  = dist;
+      candidate.index = index;
+      candidates.push_back(candidate);
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+
+  // **** fill the budget
+
+  int bytes = 0;
+  for (unsigned int c_idx = 0; c_idx < candidates.size(); ++c_idx)
+  {
+    const ChunkCandidate& candidate = candidates[c_idx];
+    ChunkMap& level_chunks = levels_[candidate.level];
+    ChunkMap::iterator it = level_chunks.find(candidate.index);
+    Chunk& chunk = *it->second;
+
+    int size = sizeof(MapStreamChunk) + chunk.voxels.size() + chunk.colors.size();
+    if (!chunks.empty() && bytes + size > max_bytes) break;
+    bytes += size;
+
+    MapStreamChunk::Ptr msg(new MapStreamChunk());
+    msg->level      = candidate.level;
+    msg->voxel_size = getVoxelSize(candidate.level);
+    msg->block_size = BLOCK_SIZE;
+    msg->x = candidate.index.x;
+    msg->y = candidate.index.y;
+    msg->z = candidate.index.z;
+    msg->voxels = chunk.voxels;
+    msg->colors = chunk.colors;
+    chunks.push_back(msg);
+
+    // removals are forgotten once sent
+    if (chunk.signature == EMPTY_SIGNATURE)
+      level_chunks.erase(it);
+    else
+      chunk.sent_signature = chunk.signature;
+  }
+
+  return bytes;
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,273 @@
+/**
+ *  @file occupancy_grid_2d.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/occupancy_grid_2d.h"
+
+namespace ccny_rgbd {
+
+OccupancyGrid2D::OccupancyGrid2D(
+  double resolution,
+  double min_z,
+  double max_z,
+  int tile_size):
+  resolution_(resolution),
+  min_z_(min_z),
+  max_z_(max_z),
+  tile_size_(tile_size)
+{
+  // log-odds of the hit and miss probabilities (0.7 and 0.4)
+  log_odds_hit_  = log(0.7 / 0.3);
+  log_odds_miss_ = log(0.4 / 0.6);
+}
+
+OccupancyGrid2D::~OccupancyGrid2D()
+{
+
+}
+
+void OccupancyGrid2D::clear()
+{
+  // the tiles which had data are reported as changed (now unknown)
+  TileMap::const_iterator it;
+  for (it = tiles_.begin(); it != tiles_.end(); ++it)
+    changed_tiles_.insert(it->first);
+
+  tiles_.clear();
+  scans_.clear();
+}
+
+bool OccupancyGrid2D::hasScan(int id) const
+{
+  return scans_.find(id) != scans_.end();
+}
+
+const tf::Transform& OccupancyGrid2D::getScanPose(int id) const
+{
+  return scans_.find(id)->second.pose;
+}
+
+void OccupancyGrid2D::insertScan(
+  int id,
+  const PointCloudT& cloud,
+  const tf::Transform& pose)
+{
+  double inv_res = 1.0 / resolution_;
+
+  // **** bin the points into unique cells
+
+  boost::unordered_set<uint64_t> end_cells;  // ray end points
+  boost::unordered_set<uint64_t> hit_cells;  // obstacles
+
+  for (unsigned int pt_idx = 0; pt_idx < cloud.points.size(); ++pt_idx)
+  {
+    const PointT& p = cloud.points[pt_idx];
+    if (std::isnan(p.z) || p.z > max_z_) continue;
+
+    uint64_t key = cellKey((int)floor(p.x * inv_res), (int)floor(p.y * inv_res));
+    end_cells.insert(key);
+    if (p.z >= min_z_) hit_cells.insert(key);
+  }
+
+  // **** one 2D ray per end cell
+
+  int x0 = (int)floor(pose.getOrigin().getX() * inv_res);
+  int y0 = (int)floor(pose.getOrigin().getY() * inv_res);
+
+  boost::unordered_set<uint64_t> free_cells;
+
+  boost::unordered_set<uint64_t>::const_iterator it;
+  for (it = end_cells.begin(); it != end_cells.end(); ++it)
+  {
+    int x1 = (int32_t)(*it >> 32);
+    int y1 = (int32_t)(*it & 0xFFFFFFFF);
+
+    // Bresenham's line, without the end cell
+    int dx =  abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    int x = x0, y = y0;
+
+    while (x != x1 || y != y1)
+    {
+      free_cells.insert(cellKey(x, y));
+      int e2 = 2 * err;
+      if (e2 >= dy) { err += dy; x += sx; }
+      if (e2 <= dx) { err += dx; y += sy; }
+    }
+
+    // floor end points are free too
+    if (hit_cells.find(*it) == hit_cells.end())
+      free_cells.insert(*it);
+  }
+
+  // **** the scan contribution: each cell is updated once
+
+  Scan scan;
+  scan.pose = pose;
+  scan.cells.reserve(free_cells.size() + hit_cells.size());
+
+  for (it = hit_cells.begin(); it != hit_cells.end(); ++it)
+    scan.cells.push_back(std::make_pair(*it, log_odds_hit_));
+
+  for (it = free_cells.begin(); it != free_cells.end(); ++it)
+    if (hit_cells.find(*it) == hit_cells.end())
+      scan.cells.push_back(std::make_pair(*it, log_odds_miss_));
+
+  removeScan(id);
+  applyScan(scan, 1);
+  scans_[id] = scan;
+}
+
+void OccupancyGrid2D::removeScan(int id)
+{
+  boost::unordered_map<int, Scan>::iterator it = scans_.find(id);
+  if (it == scans_.end()) return;
+
+  applyScan(it->second, -1);
+  scans_.erase(it);
+}
+
+void OccupancyGrid2D::applyScan(const Scan& scan, int sign)
+{
+  VoxelIndex tile_index(0, 0, 0);
+  Tile * tile = NULL;
+
+  for (unsigned int c_idx = 0; c_idx < scan.cells.size(); ++c_idx)
+  {
+    uint64_t key = scan.cells[c_idx].first;
+    int x = (int32_t)(key >> 32);
+    int y = (int32_t)(key & 0xFFFFFFFF);
+
+    // neighboring cells are usually in the same tile
+    VoxelIndex index(tileOf(x), tileOf(y), 0);
+    if (!tile || index != tile_index)
+    {
+      TilePtr& tile_ptr = tiles_[index];
+      if (!tile_ptr)
+      {
+        tile_ptr.reset(new Tile());
+        tile_ptr->log_odds.assign(tile_size_ * tile_size_, 0.0f);
+        tile_ptr->n_scans.assign(tile_size_ * tile_size_, 0);
+      }
+      tile = tile_ptr.get();
+      tile_index = index;
+      changed_tiles_.insert(index);
+    }
+
+    int i = (y - index.y * tile_size_) * tile_size_ + (x - index.x * tile_size_);
+    tile->log_odds[i] += sign * scan.cells[c_idx].second;
+    tile->n_scans[i]  += sign;
+  }
+}
+
+int8_t OccupancyGrid2D::getCellValue(const Tile& tile, int i) const
+{
+  if (tile.n_scans[i] == 0) return -1;
+
+  double p = 1.0 / (1.0 + exp(-tile.log_odds[i]));
+  return (int8_t)(p * 100.0 + 0.5);
+}
+
+void OccupancyGrid2D::getChangedTiles(std::vector<VoxelIndex>& tiles)
+{
+  tiles.assign(changed_tiles_.begin(), changed_tiles_.end());
+  changed_tiles_.clear();
+}
+
+void OccupancyGrid2D::getTileMsg(
+  const VoxelIndex& tile, 
+  nav_msgs::OccupancyGrid& msg) const
+{
+  msg.info.resolution = resolution_;
+  msg.info.width  = tile_size_;
+  msg.info.height = tile_size_;
+  msg.info.origin.position.x = tile.x * tile_size_ * resolution_;
+  msg.info.origin.position.y = tile.y * tile_size_ * resolution_;
+  msg.info.origin.position.z = 0.0;
+  msg.info.origin.orientation.x = 0.0;
+  msg.info.origin.orientation.y = 0.0;
+  msg.info.origin.orientation.z = 0.0;
+  msg.info.origin.orientation.w = 1.0;
+
+  msg.data.assign(tile_size_ * tile_size_, -1);
+
+  TileMap::const_iterator it = tiles_.find(tile);
+  if (it == tiles_.end()) return;
+
+  for (int i = 0; i < tile_size_ * tile_size_; ++i)
+    msg.data[i] = getCellValue(*it->second, i);
+}
+
+void OccupancyGrid2D::getMapMsg(nav_msgs::OccupancyGrid& msg) const
+{
+  msg.info.resolution = resolution_;
+  msg.info.origin.position.z = 0.0;
+  msg.info.origin.orientation.x = 0.0;
+  msg.info.origin.orientation.y = 0.0;
+  msg.info.origin.orientation.z = 0.0;
+  msg.info.origin.orientation.w = 1.0;
+
+  if (tiles_.empty())
+  {
+    msg.info.width = msg.info.height = 0;
+    msg.info.origin.position.x = msg.info.origin.position.y = 0.0;
+    msg.data.clear();
+    return;
+  }
+
+  // **** bounding box of the tiles
+
+  TileMap::const_iterator it = tiles_.begin();
+  int min_x = it->first.x, max_x = it->first.x;
+  int min_y = it->first.y, max_y = it->first.y;
+  for (; it != tiles_.end(); ++it)
+  {
+    min_x = std::min(min_x, it->first.x); max_x = std::max(max_x, it->first.x);
+    min_y = std::min(min_y, it->first.y); max_y = std::max(max_y, it->first.y);
+  }
+
+  int width  = (max_x - min_x + 1) * tile_size_;
+  int height = (max_y - min_y + 1) * tile_size_;
+
+  msg.info.width  = width;
+  msg.info.height = height;
+  msg.info.origin.position.x = min_x * tile_size_ * resolution_;
+  msg.info.origin.position.y = min_y * tile_size_ * resolution_;
+
+  // **** copy the tiles in
+
+  msg.data.assign(width * height, -1);
+
+  for (it = tiles_.begin(); it != tiles_.end(); ++it)
+  {
+    int offset_x = (it->first.x - min_x) * tile_size_;
+    int offset_y = (it->first.y - min_y) * tile_size_;
+
+    for (int y = 0; y < tile_size_; ++y)
+    for (int x = 0; x < tile_size_; ++x)
+      msg.data[(offset_y + y) * width + offset_x + x] = 
+        getCellValue(*it->second, y * tile_size_ + x);
+  }
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,105 @@
+/**
+ *  @file octree_util.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/octree_util.h"
+
+namespace ccny_rgbd {
+
+/** @brief Adds the leaves on the ray to the center of a leaf (without
+ * the leaf itself) to a set
+ */
+static void addRayKeys(
+  const octomap::OcTree& tree,
+  const octomap::point3d& origin,
+  const octomap::OcTreeKey& key,
+  octomap::KeyRay& ray,
+  octomap::KeySet& cells)
+{
+  if (tree.computeRayKeys(origin, tree.keyToCoord(key), ray))
+    cells.insert(ray.begin(), ray.end());
+}
+
+void computeDiscreteUpdate(
+  const octomap::OcTree& tree,
+  const octomap::Pointcloud& scan,
+  const octomap::point3d& origin,
+  double max_range,
+  octomap::KeySet& free_cells,
+  octomap::KeySet& occupied_cells)
+{
+  free_cells.clear();
+  occupied_cells.clear();
+
+  // **** bin the end points into unique leaves
+
+  octomap::KeySet truncated_cells; // ends of the rays cut at the maximum range
+
+  octomap::Pointcloud::const_iterator it;
+  for (it = scan.begin(); it != scan.end(); ++it)
+  {
+    octomap::point3d direction = *it - origin;
+    octomap::OcTreeKey key;
+
+    if (max_range > 0.0 && direction.norm() > max_range)
+    {
+      octomap::point3d end = origin + direction.normalized() * max_range;
+      if (tree.coordToKeyChecked(end, key)) truncated_cells.insert(key);
+    }
+    else if (tree.coordToKeyChecked(*it, key))
+      occupied_cells.insert(key);
+  }
+
+  // **** one ray per unique leaf, into a shared free set
+
+  octomap::KeyRay ray;
+  octomap::KeySet::const_iterator k_it;
+
+  for (k_it = occupied_cells.begin(); k_it != occupied_cells.end(); ++k_it)
+    addRayKeys(tree, origin, *k_it, ray, free_cells);
+
+  // like computeUpdate, the leaf at the cut is not marked free
+  for (k_it = truncated_cells.begin(); k_it != truncated_cells.end(); ++k_it)
+    addRayKeys(tree, origin, *k_it, ray, free_cells);
+
+  // occupied leaves are never updated as free by the same scan
+  for (k_it = occupied_cells.begin(); k_it != occupied_cells.end(); ++k_it)
+    free_cells.erase(*k_it);
+}
+
+void insertDiscreteScan(
+  octomap::OcTree& tree,
+  const octomap::Pointcloud& scan,
+  const octomap::point3d& origin,
+  double max_range)
+{
+  octomap::KeySet free_cells, occupied_cells;
+  computeDiscreteUpdate(tree, scan, origin, max_range, free_cells, occupied_cells);
+
+  octomap::KeySet::const_iterator it;
+  for (it = free_cells.begin(); it != free_cells.end(); ++it)
+    tree.updateNode(*it, false);
+  for (it = occupied_cells.begin(); it != occupied_cells.end(); ++it)
+    tree.updateNode(*it, true);
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,302 @@
+/**
+ *  @file sharded_octree_builder.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/sharded_octree_builder.h"
+
+#include <boost/unordered_set.hpp>
+
+#include "ccny_rgbd/parallel_for.h"
+#include "ccny_rgbd/mapping/octree_util.h"
+
+namespace ccny_rgbd {
+
+// **** helpers
+
+/** @brief Functor which computes the update of one queued scan
+ */
+class ComputeScanUpdates
+{
+  public:
+
+    ComputeScanUpdates(
+      const ShardedOctreeBuilder& builder,
+      std::vector<ShardedOctreeBuilder::ScanUpdate>& updates):
+      builder_(builder), updates_(updates) { }
+
+    void operator()(int i) const
+    {
+      builder_.computeScanUpdate(builder_.queue_[i], updates_[i]);
+    }
+
+  private:
+
+    const ShardedOctreeBuilder& builder_;
+    std::vector<ShardedOctreeBuilder::ScanUpdate>& updates_;
+};
+
+/** @brief Functor which applies the updates of a batch to one shard
+ */
+class ApplyShardUpdates
+{
+  public:
+
+    ApplyShardUpdates(
+      ShardedOctreeBuilder& builder,
+      const std::vector<VoxelIndex>& shards,
+      const std::vector<ShardedOctreeBuilder::ScanUpdate>& updates):
+      builder_(builder), shards_(shards), updates_(updates) { }
+
+    void operator()(int i) const
+    {
+      builder_.applyShardUpdates(shards_[i], updates_);
+    }
+
+  private:
+
+    ShardedOctreeBuilder& builder_;
+    const std::vector<VoxelIndex>& shards_;
+    const std::vector<ShardedOctreeBuilder::ScanUpdate>& updates_;
+};
+
+// **** ShardedOctreeBuilder
+
+ShardedOctreeBuilder::ShardedOctreeBuilder(
+  double resolution,
+  double shard_size,
+  int n_threads,
+  bool discretize,
+  double max_range):
+  resolution_(resolution),
+  discretize_(discretize),
+  max_range_(max_range)
+{
+  // the shards are aligned with octree nodes
+  shard_shift_ = 0;
+  while (shard_shift_ < 16 && resolution_ * (1 << shard_shift_) < shard_size) 
+    ++shard_shift_;
+
+  if (n_threads <= 0) 
+    n_threads = std::max(1u, boost::thread::hardware_concurrency());
+  n_threads_ = n_threads;
+
+  // enough scans to keep all the threads busy casting rays
+  batch_size_ = 2 * n_threads_;
+}
+
+ShardedOctreeBuilder::~ShardedOctreeBuilder()
+{
+
+}
+
+void ShardedOctreeBuilder::clear()
+{
+  queue_.clear();
+  shards_.clear();
+}
+
+void ShardedOctreeBuilder::insertScan(
+  const octomap::Pointcloud& scan, 
+  const octomap::point3d& origin)
+{
+  queue_.push_back(QueuedScan());
+  queue_.back().points = scan;
+  queue_.back().origin = origin;
+
+  if (queue_.size() >= batch_size_) flush();
+}
+
+void ShardedOctreeBuilder::insertScan(
+  const octomap::Pointcloud& scan, 
+  const octomap::point3d& origin,
+  const std::vector<Color>& colors)
+{
+  queue_.push_back(QueuedScan());
+  queue_.back().points = scan;
+  queue_.back().origin = origin;
+  queue_.back().colors = colors;
+
+  if (queue_.size() >= batch_size_) flush();
+}
+
+void ShardedOctreeBuilder::flush()
+{
+  if (queue_.empty()) return;
+
+  // **** cast the rays of each scan
+
+  std::vector<ScanUpdate> updates(queue_.size());
+  parallelFor(0, queue_.size(), ComputeScanUpdates(*this, updates), n_threads_);
+  queue_.clear();
+
+  // **** allocate the shards touched by the batch
+
+  boost::unordered_set<VoxelIndex, VoxelIndexHash> touched;
+  for (unsigned int u_idx = 0; u_idx < updates.size(); ++u_idx)
+  {
+    ScanUpdate::const_iterator it;
+    for (it = updates[u_idx].begin(); it != updates[u_idx].end(); ++it)
+    {
+      ShardPtr& shard = shards_[it->first];
+      if (!shard)
+      {
+        shard.reset(new Shard());
+        shard->tree.reset(new octomap::OcTree(resolution_));
+      }
+      touched.insert(it->first);
+    }
+  }
+
+  // **** update each shard
+
+  std::vector<VoxelIndex> shards(touched.begin(), touched.end());
+  parallelFor(0, shards.size(), ApplyShardUpdates(*this, shards, updates), n_threads_);
+}
+
+void ShardedOctreeBuilder::computeScanUpdate(
+  const QueuedScan& scan, 
+  ScanUpdate& update) const
+{
+  // the octree keeps a scratch ray for computeUpdate, so each 
+  // scan gets its own (empty) octree
+  octomap::OcTree scratch(resolution_);
+
+  octomap::KeySet free_cells, occupied_cells;
+  if (discretize_)
+    computeDiscreteUpdate(
+      scratch, scan.points, scan.origin, max_range_, free_cells, occupied_cells);
+  else
+    scratch.computeUpdate(
+      scan.points, scan.origin, free_cells, occupied_cells, max_range_);
+
+  octomap::KeySet::const_iterator it;
+  for (it = free_cells.begin(); it != free_cells.end(); ++it)
+    update[shardOf(*it)].free.push_back(*it);
+  for (it = occupied_cells.begin(); it != occupied_cells.end(); ++it)
+    update[shardOf(*it)].occupied.push_back(*it);
+
+  if (scan.colors.empty()) return;
+
+  octomap::Pointcloud::const_iterator pt_it = scan.points.begin();
+  for (unsigned int pt_idx = 0; pt_idx < scan.colors.size(); ++pt_idx, ++pt_it)
+  {
+    octomap::OcTreeKey key;
+    if (scratch.coordToKeyChecked(*pt_it, key))
+      update[shardOf(key)].colors.push_back(std::make_pair(key, scan.colors[pt_idx]));
+  }
+}
+
+void ShardedOctreeBuilder::applyShardUpdates(
+  const VoxelIndex& index, 
+  const std::vector<ScanUpdate>& updates)
+{
+  // the shard map is not modified while the shards are updated
+  Shard& shard = *shards_.find(index)->second;
+  octomap::OcTree& tree = *shard.tree;
+
+  for (unsigned int u_idx = 0; u_idx < updates.size(); ++u_idx)
+  {
+    ScanUpdate::const_iterator it = updates[u_idx].find(index);
+    if (it == updates[u_idx].end()) continue;
+
+    const ShardUpdate& update = it->second;
+
+    for (unsigned int k_idx = 0; k_idx < update.free.size(); ++k_idx)
+      tree.updateNode(update.free[k_idx], false, true);
+    for (unsigned int k_idx = 0; k_idx < update.occupied.size(); ++k_idx)
+      tree.updateNode(update.occupied[k_idx], true, true);
+    for (unsigned int c_idx = 0; c_idx < update.colors.size(); ++c_idx)
+      shard.colors[update.colors[c_idx].first] = update.colors[c_idx].second;
+  }
+
+  tree.updateInnerOccupancy();
+  tree.prune();
+}
+
+template <typename TreeT>
+void ShardedOctreeBuilder::mergeOccupancy(TreeT& tree)
+{
+  flush();
+
+  ShardMap::const_iterator it;
+  for (it = shards_.begin(); it != shards_.end(); ++it)
+  {
+    octomap::OcTree& shard_tree = *it->second->tree;
+
+    octomap::OcTree::leaf_iterator leaf;
+    for (leaf = shard_tree.begin_leafs(); leaf != shard_tree.end_leafs(); ++leaf)
+    {
+      float log_odds = leaf->getLogOdds();
+
+      if (leaf.getDepth() == shard_tree.getTreeDepth())
+      {
+        tree.updateNode(leaf.getKey(), log_odds);
+        continue;
+      }
+
+      // pruned leaf: expand it to the leaf size
+      double half_size = 0.5 * (leaf.getSize() - resolution_);
+      octomap::point3d center = leaf.getCoordinate();
+
+      octomap::OcTreeKey lo, hi, key;
+      for (int a = 0; a < 3; ++a)
+      {
+        lo[a] = shard_tree.coordToKey(center(a) - half_size);
+        hi[a] = shard_tree.coordToKey(center(a) + half_size);
+      }
+
+      for (int z = lo[2]; z <= hi[2]; ++z)
+      for (int y = lo[1]; y <= hi[1]; ++y)
+      for (int x = lo[0]; x <= hi[0]; ++x)
+      {
+        key[0] = x; key[1] = y; key[2] = z;
+        tree.updateNode(key, log_odds);
+      }
+    }
+  }
+}
+
+void ShardedOctreeBuilder::merge(octomap::OcTree& tree)
+{
+  mergeOccupancy(tree);
+  tree.prune();
+}
+
+void ShardedOctreeBuilder::merge(octomap::ColorOcTree& tree)
+{
+  mergeOccupancy(tree);
+
+  ShardMap::const_iterator it;
+  for (it = shards_.begin(); it != shards_.end(); ++it)
+  {
+    ColorMap::const_iterator c_it;
+    for (c_it = it->second->colors.begin(); c_it != it->second->colors.end(); ++c_it)
+    {
+      octomap::ColorOcTreeNode * node = tree.search(c_it->first);
+      if (node) node->setColor(c_it->second);
+    }
+  }
+
+  tree.updateInnerOccupancy();
+}
+
+} // namespace ccny_rgbd
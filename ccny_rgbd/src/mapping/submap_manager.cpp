@@ -0,0 +1,203 @@
+/**
+ *  @file submap_manager.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/submap_manager.h"
+
+#include "ccny_rgbd/parallel_for.h"
+
+namespace ccny_rgbd {
+
+// **** helpers
+
+/** @brief Functor which brings one submap up to date
+ */
+class UpdateSubmaps
+{
+  public:
+
+    UpdateSubmaps(
+      SubmapManager& manager,
+      const std::vector<int>& submaps,
+      const KeyframeVector& keyframes):
+      manager_(manager), submaps_(submaps), keyframes_(keyframes) { }
+
+    void operator()(int i) const
+    {
+      manager_.updateSubmap(manager_.submaps_[submaps_[i]], keyframes_);
+    }
+
+  private:
+
+    SubmapManager& manager_;
+    const std::vector<int>& submaps_;
+    const KeyframeVector& keyframes_;
+};
+
+// **** SubmapManager
+
+SubmapManager::SubmapManager(
+  int submap_size,
+  double resolution,
+  double max_range,
+  double max_stdev,
+  int n_threads):
+  submap_size_(std::max(submap_size, 1)),
+  resolution_(resolution),
+  max_range_(max_range),
+  max_stdev_(max_stdev),
+  n_threads_(n_threads)
+{
+
+}
+
+SubmapManager::~SubmapManager()
+{
+
+}
+
+void SubmapManager::clear()
+{
+  submaps_.clear();
+}
+
+void SubmapManager::update(const KeyframeVector& keyframes)
+{
+  int n_keyframes = keyframes.size();
+  int n_submaps = (n_keyframes + submap_size_ - 1) / submap_size_;
+  submaps_.resize(n_submaps);
+
+  // **** find the submaps with new or moved keyframes
+
+  std::vector<int> changed;
+  for (int s_idx = 0; s_idx < n_submaps; ++s_idx)
+  {
+    Submap& submap = submaps_[s_idx];
+    submap.anchor = s_idx * submap_size_;
+    submap.size = std::min(submap_size_, n_keyframes - submap.anchor);
+
+    if ((int)submap.relative_poses.size() != submap.size || 
+        isStale(submap, keyframes))
+      changed.push_back(s_idx);
+  }
+
+  // **** fuse them
+
+  parallelFor(0, changed.size(), 
+    UpdateSubmaps(*this, changed, keyframes), n_threads_);
+}
+
+bool SubmapManager::isStale(
+  const Submap& submap, 
+  const KeyframeVector& keyframes) const
+{
+  // stale if a point at the maximum range moved by half a voxel
+  double max_dist  = 0.5 * resolution_;
+  double max_angle = 0.5 * resolution_ / max_range_;
+
+  const tf::Transform& anchor_pose = keyframes[submap.anchor].pose;
+  tf::Transform anchor_pose_inv = anchor_pose.inverse();
+
+  int n = std::min((int)submap.relative_poses.size(), submap.size);
+  for (int i = 1; i < n; ++i)
+  {
+    tf::Transform relative_pose = 
+      anchor_pose_inv * keyframes[submap.anchor + i].pose;
+
+    double dist, angle;
+    getTfDifference(relative_pose, submap.relative_poses[i], dist, angle);
+    if (dist > max_dist || angle > max_angle) return true;
+  }
+
+  return false;
+}
+
+void SubmapManager::updateSubmap(
+  Submap& submap, 
+  const KeyframeVector& keyframes)
+{
+  if ((int)submap.relative_poses.size() > submap.size || 
+      isStale(submap, keyframes))
+  {
+    submap.relative_poses.clear();
+    submap.cloud.clear();
+  }
+
+  const tf::Transform& anchor_pose = keyframes[submap.anchor].pose;
+  tf::Transform anchor_pose_inv = anchor_pose.inverse();
+
+  // **** aggregate the new keyframes, in the anchor frame
+
+  PointCloudT::Ptr aggregate_cloud(new PointCloudT(submap.cloud));
+
+  for (int i = submap.relative_poses.size(); i < submap.size; ++i)
+  {
+    const RGBDKeyframe& keyframe = keyframes[submap.anchor + i];
+    tf::Transform relative_pose = anchor_pose_inv * keyframe.pose;
+
+    PointCloudT cloud;   
+    keyframe.constructDensePointCloud(cloud, max_range_, max_stdev_);
+
+    PointCloudT cloud_tf;
+    pcl::transformPointCloud(cloud, cloud_tf, eigenFromTf(relative_pose));
+    *aggregate_cloud += cloud_tf;
+
+    submap.relative_poses.push_back(relative_pose);
+  }
+
+  // **** filter using voxel grid
+
+  pcl::VoxelGrid<PointT> vgf;
+  vgf.setInputCloud(aggregate_cloud);
+  vgf.setLeafSize(resolution_, resolution_, resolution_);
+  vgf.filter(submap.cloud);
+}
+
+void SubmapManager::compose(
+  const KeyframeVector& keyframes, 
+  PointCloudT& map_cloud,
+  double max_z) const
+{
+  PointCloudT::Ptr aggregate_cloud(new PointCloudT());
+
+  // move each submap with its anchor
+  for (unsigned int s_idx = 0; s_idx < submaps_.size(); ++s_idx)
+  {
+    const Submap& submap = submaps_[s_idx];
+
+    PointCloudT cloud_tf;
+    pcl::transformPointCloud(
+      submap.cloud, cloud_tf, eigenFromTf(keyframes[submap.anchor].pose));
+    *aggregate_cloud += cloud_tf;
+  }
+
+  // filter cloud using voxel grid, and for max z
+  pcl::VoxelGrid<PointT> vgf;
+  vgf.setInputCloud(aggregate_cloud);
+  vgf.setLeafSize(resolution_, resolution_, resolution_);
+  vgf.setFilterFieldName("z");
+  vgf.setFilterLimits (-std::numeric_limits<double>::infinity(), max_z);
+
+  vgf.filter(map_cloud);
+}
+
+} // namespace ccny_rgbd
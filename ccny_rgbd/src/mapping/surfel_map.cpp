@@ -0,0 +1,553 @@
+/**
+ *  @file surfel_map.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/surfel_map.h"
+
+#include <cstdio>
+
+#include "ccny_rgbd/parallel_for.h"
+
+namespace ccny_rgbd {
+
+// **** helpers
+
+/** @brief Functor which computes one row of the measurement grid
+ */
+template <typename DepthT>
+class ComputeSurfelMeasurements
+{
+  public:
+
+    ComputeSurfelMeasurements(
+      SurfelMap& map,
+      const RGBDFrame& frame,
+      const tf::Transform& pose,
+      int anchor,
+      double max_range):
+      map_(map), frame_(frame), pose_(pose), 
+      anchor_(anchor), max_range_(max_range) { }
+
+    void operator()(int row) const
+    {
+      map_.computeMeasurementsT<DepthT>(frame_, pose_, anchor_, max_range_, row);
+    }
+
+  private:
+
+    SurfelMap& map_;
+    const RGBDFrame& frame_;
+    const tf::Transform& pose_;
+    int anchor_;
+    double max_range_;
+};
+
+/** @brief Sum of the measurements associated with a surfel
+ */
+struct SurfelAccumulator
+{
+  double x, y, z;
+  double nx, ny, nz;
+  double r, g, b;
+  float radius;
+  int n;
+
+  SurfelAccumulator(): 
+    x(0.0), y(0.0), z(0.0), nx(0.0), ny(0.0), nz(0.0), 
+    r(0.0), g(0.0), b(0.0), radius(0.0f), n(0) { }
+
+  void add(const Surfel& s)
+  {
+    x  += s.x;  y  += s.y;  z  += s.z;
+    nx += s.nx; ny += s.ny; nz += s.nz;
+    r  += s.r;  g  += s.g;  b  += s.b;
+    radius = n ? std::min(radius, s.radius) : s.radius;
+    ++n;
+  }
+};
+
+// **** SurfelMap
+
+SurfelMap::SurfelMap(
+  int pixel_step,
+  double assoc_dist,
+  double assoc_angle,
+  double max_confidence,
+  double cell_size):
+  pixel_step_(std::max(pixel_step, 1)),
+  assoc_dist_(assoc_dist),
+  cos_assoc_angle_(cos(assoc_angle)),
+  max_confidence_(max_confidence),
+  cell_size_(cell_size)
+{
+
+}
+
+SurfelMap::~SurfelMap()
+{
+
+}
+
+void SurfelMap::clear()
+{
+  surfels_.clear();
+  cells_.clear();
+  anchor_poses_.clear();
+}
+
+void SurfelMap::integrate(
+  const RGBDFrame& frame,
+  const tf::Transform& pose,
+  int anchor,
+  double max_range)
+{
+  // **** measure the frame
+
+  int rows = frame.depth_img.rows / pixel_step_;
+  int cols = frame.depth_img.cols / pixel_step_;
+  measurements_.resize(rows * cols);
+
+  if (frame.depth_img.depth() == CV_32F)
+    parallelFor(0, rows, 
+      ComputeSurfelMeasurements<float>(*this, frame, pose, anchor, max_range));
+  else
+    parallelFor(0, rows, 
+      ComputeSurfelMeasurements<uint16_t>(*this, frame, pose, anchor, max_range));
+
+  // **** associate the measurements with the surfels in view
+
+  buildIndexMap(frame, pose, rows, cols);
+
+  boost::unordered_map<unsigned int, SurfelAccumulator> associated;
+  std::vector<Surfel> new_surfels;
+
+  for (unsigned int m_idx = 0; m_idx < measurements_.size(); ++m_idx)
+  {
+    const Measurement& m = measurements_[m_idx];
+    if (!m.valid) continue;
+
+    int s_idx = index_map_[m_idx];
+    if (s_idx >= 0)
+    {
+      const Surfel& s = surfels_[s_idx];
+      float dist = (m.surfel.x - s.x) * s.nx + 
+                   (m.surfel.y - s.y) * s.ny + 
+                   (m.surfel.z - s.z) * s.nz;
+      float cos_angle = m.surfel.nx * s.nx + m.surfel.ny * s.ny + m.surfel.nz * s.nz;
+
+      if (fabs(dist) < assoc_dist_ && cos_angle > cos_assoc_angle_)
+      {
+        associated[s_idx].add(m.surfel);
+        continue;
+      }
+    }
+
+    new_surfels.push_back(m.surfel);
+  }
+
+  // **** fuse: each surfel gets the average of its measurements,
+  // weighted as one observation
+
+  boost::unordered_map<unsigned int, SurfelAccumulator>::const_iterator it;
+  for (it = associated.begin(); it != associated.end(); ++it)
+  {
+    Surfel& s = surfels_[it->first];
+    const SurfelAccumulator& acc = it->second;
+    VoxelIndex old_cell = getCell(s);
+
+    float w = s.confidence;
+    float inv_n = 1.0f / acc.n;
+    float inv_w = 1.0f / (w + 1.0f);
+
+    s.x = (s.x * w + acc.x * inv_n) * inv_w;
+    s.y = (s.y * w + acc.y * inv_n) * inv_w;
+    s.z = (s.z * w + acc.z * inv_n) * inv_w;
+
+    float nx = s.nx * w + acc.nx * inv_n;
+    float ny = s.ny * w + acc.ny * inv_n;
+    float nz = s.nz * w + acc.nz * inv_n;
+    float norm = sqrt(nx * nx + ny * ny + nz * nz);
+    if (norm > 0.0f)
+    {
+      s.nx = nx / norm;
+      s.ny = ny / norm;
+      s.nz = nz / norm;
+    }
+
+    s.r = (s.r * w + acc.r * inv_n) * inv_w + 0.5f;
+    s.g = (s.g * w + acc.g * inv_n) * inv_w + 0.5f;
+    s.b = (s.b * w + acc.b * inv_n) * inv_w + 0.5f;
+
+    // closer views give finer surfels
+    s.radius = std::min(s.radius, acc.radius);
+    s.confidence = std::min(w + 1.0f, (float)max_confidence_);
+
+    rehashSurfel(it->first, old_cell);
+  }
+
+  // **** add the unassociated measurements as new surfels
+
+  for (unsigned int n_idx = 0; n_idx < new_surfels.size(); ++n_idx)
+  {
+    unsigned int s_idx = surfels_.size();
+    surfels_.push_back(new_surfels[n_idx]);
+    cells_[getCell(surfels_.back())].push_back(s_idx);
+  }
+
+  if (anchor >= (int)anchor_poses_.size())
+    anchor_poses_.resize(anchor + 1, tf::Transform::getIdentity());
+  anchor_poses_[anchor] = pose;
+}
+
+template <typename DepthT>
+void SurfelMap::computeMeasurementsT(
+  const RGBDFrame& frame,
+  const tf::Transform& pose,
+  int anchor,
+  double max_range,
+  int row)
+{
+  const cv::Mat& depth_img = frame.depth_img;
+
+  const int step = pixel_step_;
+  const int cols = depth_img.cols / step;
+  const int v = row * step;
+
+  const float fx = frame.model.fx();
+  const float fy = frame.model.fy();
+  const float cx = frame.model.cx();
+  const float cy = frame.model.cy();
+
+  // half the diagonal of the area covered by a measurement, at 1m
+  const float radius_factor = 0.5f * sqrt(2.0f) * step / fx;
+
+  for (int col = 0; col < cols; ++col)
+  {
+    Measurement& m = measurements_[row * cols + col];
+    m.valid = false;
+
+    // the normal needs the neighbors on all sides
+    int u = col * step;
+    if (u < step || u + step >= depth_img.cols ||
+        v < step || v + step >= depth_img.rows) continue;
+
+    DepthT z_raw = depth_img.ptr<DepthT>(v)[u];
+    if (!DepthTraits<DepthT>::valid(z_raw)) continue;
+    float z = DepthTraits<DepthT>::toMeters(z_raw);
+    if (z > max_range) continue;
+
+    DepthT neighbors_raw[4] = { 
+      depth_img.ptr<DepthT>(v)[u - step], depth_img.ptr<DepthT>(v)[u + step],
+      depth_img.ptr<DepthT>(v - step)[u], depth_img.ptr<DepthT>(v + step)[u] };
+
+    // no normals across depth discontinuities
+    float neighbors[4];
+    bool smooth = true;
+    for (int n = 0; n < 4 && smooth; ++n)
+    {
+      smooth = DepthTraits<DepthT>::valid(neighbors_raw[n]);
+      neighbors[n] = DepthTraits<DepthT>::toMeters(neighbors_raw[n]);
+      smooth = smooth && fabs(neighbors[n] - z) < 0.05f * z;
+    }
+    if (!smooth) continue;
+
+    // **** point and normal, in the camera frame
+
+    float px = (u - cx) * z / fx;
+    float py = (v - cy) * z / fy;
+    float pz = z;
+
+    // central differences along u and v
+    float du[3] = { 
+      ((u + step - cx) * neighbors[1] - (u - step - cx) * neighbors[0]) / fx,
+      (v - cy) * (neighbors[1] - neighbors[0]) / fy,
+      neighbors[1] - neighbors[0] };
+    float dv[3] = { 
+      (u - cx) * (neighbors[3] - neighbors[2]) / fx,
+      ((v + step - cy) * neighbors[3] - (v - step - cy) * neighbors[2]) / fy,
+      neighbors[3] - neighbors[2] };
+
+    float nx = du[1] * dv[2] - du[2] * dv[1];
+    float ny = du[2] * dv[0] - du[0] * dv[2];
+    float nz = du[0] * dv[1] - du[1] * dv[0];
+    float norm = sqrt(nx * nx + ny * ny + nz * nz);
+    if (norm <= 0.0f) continue;
+    
+    // towards the camera
+    if (nx * px + ny * py + nz * pz > 0.0f) norm = -norm;
+    nx /= norm; ny /= norm; nz /= norm;
+
+    // skip grazing views, where the depth is unreliable
+    float range = sqrt(px * px + py * py + pz * pz);
+    float cos_view = -(nx * px + ny * py + nz * pz) / range;
+    if (cos_view < 0.2f) continue;
+
+    // **** the surfel, in the map frame
+
+    tf::Vector3 p = pose * tf::Vector3(px, py, pz);
+    tf::Vector3 n = pose.getBasis() * tf::Vector3(nx, ny, nz);
+
+    Surfel& s = m.surfel;
+    s.x  = p.getX(); s.y  = p.getY(); s.z  = p.getZ();
+    s.nx = n.getX(); s.ny = n.getY(); s.nz = n.getZ();
+    s.radius = radius_factor * z / std::max(cos_view, 0.3f);
+    s.confidence = 1.0f;
+    s.anchor = anchor;
+    getPixelColor(frame.rgb_img, u, v, s.r, s.g, s.b);
+
+    m.valid = true;
+  }
+}
+
+void SurfelMap::buildIndexMap(
+  const RGBDFrame& frame,
+  const tf::Transform& pose,
+  int rows, int cols)
+{
+  index_map_.assign(rows * cols, -1);
+  depth_map_.assign(rows * cols, std::numeric_limits<float>::infinity());
+
+  // **** the surfels near the measurements
+
+  double min_p[3], max_p[3];
+  bool empty = true;
+
+  for (unsigned int m_idx = 0; m_idx < measurements_.size(); ++m_idx)
+  {
+    const Measurement& m = measurements_[m_idx];
+    if (!m.valid) continue;
+
+    double p[3] = { m.surfel.x, m.surfel.y, m.surfel.z };
+    for (int a = 0; a < 3; ++a)
+    {
+      min_p[a] = empty ? p[a] : std::min(min_p[a], p[a]);
+      max_p[a] = empty ? p[a] : std::max(max_p[a], p[a]);
+    }
+    empty = false;
+  }
+
+  if (empty) return;
+
+  std::vector<unsigned int> candidates;
+  findSurfels(min_p[0] - assoc_dist_, min_p[1] - assoc_dist_, min_p[2] - assoc_dist_,
+              max_p[0] + assoc_dist_, max_p[1] + assoc_dist_, max_p[2] + assoc_dist_,
+              candidates);
+
+  // **** splat them into the measurement grid, keeping the closest
+
+  const double fx = frame.model.fx();
+  const double fy = frame.model.fy();
+  const double cx = frame.model.cx();
+  const double cy = frame.model.cy();
+  const double inv_step = 1.0 / pixel_step_;
+
+  tf::Transform pose_inv = pose.inverse();
+  const tf::Matrix3x3& rotation = pose_inv.getBasis();
+
+  for (unsigned int c_idx = 0; c_idx < candidates.size(); ++c_idx)
+  {
+    unsigned int s_idx = candidates[c_idx];
+    const Surfel& s = surfels_[s_idx];
+
+    tf::Vector3 p = pose_inv * tf::Vector3(s.x, s.y, s.z);
+    if (p.getZ() <= 0.0) continue;
+
+    // back faces can not be seen
+    tf::Vector3 n = rotation * tf::Vector3(s.nx, s.ny, s.nz);
+    if (n.dot(p) >= 0.0) continue;
+
+    double inv_z = 1.0 / p.getZ();
+    int col = floor((fx * p.getX() * inv_z + cx) * inv_step + 0.5);
+    int row = floor((fy * p.getY() * inv_z + cy) * inv_step + 0.5);
+    
+    // the disk covers a few grid cells at most
+    int half_size = std::min(2, (int)(s.radius * fx * inv_z * inv_step));
+
+    for (int r = row - half_size; r <= row + half_size; ++r)
+    for (int c = col - half_size; c <= col + half_size; ++c)
+    {
+      if (r < 0 || r >= rows || c < 0 || c >= cols) continue;
+
+      int k = r * cols + c;
+      if (p.getZ() < depth_map_[k])
+      {
+        depth_map_[k] = p.getZ();
+        index_map_[k] = s_idx;
+      }
+    }
+  }
+}
+
+void SurfelMap::findSurfels(
+  double min_x, double min_y, double min_z,
+  double max_x, double max_y, double max_z,
+  std::vector<unsigned int>& indices) const
+{
+  indices.clear();
+
+  double inv_size = 1.0 / cell_size_;
+  VoxelIndex min_cell = VoxelIndex::fromPoint(min_x, min_y, min_z, inv_size);
+  VoxelIndex max_cell = VoxelIndex::fromPoint(max_x, max_y, max_z, inv_size);
+
+  double n_box_cells = 
+    (double)(max_cell.x - min_cell.x + 1) * 
+    (double)(max_cell.y - min_cell.y + 1) * 
+    (double)(max_cell.z - min_cell.z + 1);
+
+  std::vector<const std::vector<unsigned int>*> found;
+
+  if (n_box_cells > cells_.size())
+  {
+    // large box: go through the allocated cells
+    CellMap::const_iterator it;
+    for (it = cells_.begin(); it != cells_.end(); ++it)
+    {
+      const VoxelIndex& cell = it->first;
+      if (cell.x >= min_cell.x && cell.x <= max_cell.x &&
+          cell.y >= min_cell.y && cell.y <= max_cell.y &&
+          cell.z >= min_cell.z && cell.z <= max_cell.z)
+        found.push_back(&it->second);
+    }
+  }
+  else
+  {
+    // small box: look up its cells
+    for (int z = min_cell.z; z <= max_cell.z; ++z)
+    for (int y = min_cell.y; y <= max_cell.y; ++y)
+    for (int x = min_cell.x; x <= max_cell.x; ++x)
+    {
+      CellMap::const_iterator it = cells_.find(VoxelIndex(x, y, z));
+      if (it != cells_.end()) found.push_back(&it->second);
+    }
+  }
+
+  for (unsigned int f_idx = 0; f_idx < found.size(); ++f_idx)
+  for (unsigned int i = 0; i < found[f_idx]->size(); ++i)
+  {
+    unsigned int s_idx = (*found[f_idx])[i];
+    const Surfel& s = surfels_[s_idx];
+    if (s.x >= min_x && s.x <= max_x &&
+        s.y >= min_y && s.y <= max_y &&
+        s.z >= min_z && s.z <= max_z)
+      indices.push_back(s_idx);
+  }
+}
+
+void SurfelMap::rehashSurfel(unsigned int index, const VoxelIndex& old_cell)
+{
+  VoxelIndex new_cell = getCell(surfels_[index]);
+  if (new_cell == old_cell) return;
+
+  std::vector<unsigned int>& old_indices = cells_[old_cell];
+  for (unsigned int i = 0; i < old_indices.size(); ++i)
+    if (old_indices[i] == index)
+    {
+      old_indices[i] = old_indices.back();
+      old_indices.pop_back();
+      break;
+    }
+  if (old_indices.empty()) cells_.erase(old_cell);
+
+  cells_[new_cell].push_back(index);
+}
+
+void SurfelMap::deform(const std::vector<tf::Transform>& anchor_poses)
+{
+  // change of each anchor pose
+  unsigned int n_anchors = std::min(anchor_poses.size(), anchor_poses_.size());
+  std::vector<tf::Transform> corrections(n_anchors);
+  for (unsigned int a = 0; a < n_anchors; ++a)
+  {
+    corrections[a] = anchor_poses[a] * anchor_poses_[a].inverse();
+    anchor_poses_[a] = anchor_poses[a];
+  }
+
+  cells_.clear();
+
+  for (unsigned int s_idx = 0; s_idx < surfels_.size(); ++s_idx)
+  {
+    Surfel& s = surfels_[s_idx];
+
+    if (s.anchor >= 0 && s.anchor < (int)n_anchors)
+    {
+      const tf::Transform& correction = corrections[s.anchor];
+      tf::Vector3 p = correction * tf::Vector3(s.x, s.y, s.z);
+      tf::Vector3 n = correction.getBasis() * tf::Vector3(s.nx, s.ny, s.nz);
+      s.x  = p.getX(); s.y  = p.getY(); s.z  = p.getZ();
+      s.nx = n.getX(); s.ny = n.getY(); s.nz = n.getZ();
+    }
+
+    cells_[getCell(s)].push_back(s_idx);
+  }
+}
+
+bool saveSurfelMapPLY(
+  const std::string& path, 
+  const SurfelMap& map,
+  double min_confidence)
+{
+  const std::vector<Surfel>& surfels = map.getSurfels();
+
+  unsigned int n_surfels = 0;
+  for (unsigned int s_idx = 0; s_idx < surfels.size(); ++s_idx)
+    if (surfels[s_idx].confidence >= min_confidence) ++n_surfels;
+
+  FILE * file = fopen(path.c_str(), "wb");
+  if (!file) return false;
+
+  fprintf(file, 
+    "ply\n"
+    "format binary_little_endian 1.0\n"
+    "element vertex %u\n"
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "property float nx\n"
+    "property float ny\n"
+    "property float nz\n"
+    "property uchar red\n"
+    "property uchar green\n"
+    "property uchar blue\n"
+    "property float radius\n"
+    "property float confidence\n"
+    "end_header\n",
+    n_surfels);
+
+  bool result = true;
+  
+  for (unsigned int s_idx = 0; result && s_idx < surfels.size(); ++s_idx)
+  {
+    const Surfel& s = surfels[s_idx];
+    if (s.confidence < min_confidence) continue;
+
+    float geometry[6] = { s.x, s.y, s.z, s.nx, s.ny, s.nz };
+    uint8_t rgb[3] = { s.r, s.g, s.b };
+    float extra[2] = { s.radius, s.confidence };
+    result = fwrite(geometry, sizeof(geometry), 1, file) == 1 &&
+             fwrite(rgb, sizeof(rgb), 1, file) == 1 &&
+             fwrite(extra, sizeof(extra), 1, file) == 1;
+  }
+
+  return (fclose(file) == 0) && result;
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,257 @@
+/**
+ *  @file tiled_map.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/tiled_map.h"
+
+#include <cstdio>
+#include <boost/filesystem.hpp>
+#include <boost/unordered_map.hpp>
+#include <pcl/io/pcd_io.h>
+#include <opencv2/core/core.hpp>
+
+#include "ccny_rgbd/parallel_for.h"
+
+namespace ccny_rgbd {
+
+// **** helpers
+
+typedef boost::unordered_map<VoxelIndex, std::vector<int>, VoxelIndexHash> TilePointMap;
+
+static std::string tileFilename(const VoxelIndex& index)
+{
+  char filename[64];
+  snprintf(filename, sizeof(filename), 
+    "tile_%d_%d_%d.pcd", index.x, index.y, index.z);
+  return filename;
+}
+
+/** @brief Functor which writes out one tile of a map
+ */
+class WriteMapTiles
+{
+  public:
+
+    WriteMapTiles(
+      const std::string& path,
+      const PointCloudT& cloud,
+      const std::vector<TiledMapIndex::Tile>& tiles,
+      const TilePointMap& tile_points,
+      std::vector<int>& results):
+      path_(path), cloud_(cloud), tiles_(tiles), 
+      tile_points_(tile_points), results_(results) { }
+
+    void operator()(int i) const
+    {
+      const TiledMapIndex::Tile& tile = tiles_[i];
+      const std::vector<int>& indices = tile_points_.find(tile.index)->second;
+
+      PointCloudT tile_cloud;
+      tile_cloud.header = cloud_.header;
+      tile_cloud.points.resize(indices.size());
+      for (unsigned int pt_idx = 0; pt_idx < indices.size(); ++pt_idx)
+        tile_cloud.points[pt_idx] = cloud_.points[indices[pt_idx]];
+      tile_cloud.width  = indices.size();
+      tile_cloud.height = 1;
+      tile_cloud.is_dense = true;
+
+      pcl::PCDWriter writer;
+      results_[i] = writer.writeBinary<PointT>(
+        path_ + "/" + tile.filename, tile_cloud) >= 0;
+    }
+
+  private:
+
+    const std::string& path_;
+    const PointCloudT& cloud_;
+    const std::vector<TiledMapIndex::Tile>& tiles_;
+    const TilePointMap& tile_points_;
+    std::vector<int>& results_;
+};
+
+/** @brief Functor which reads one tile of a map
+ */
+class LoadMapTiles
+{
+  public:
+
+    LoadMapTiles(
+      const std::string& path,
+      const std::vector<const TiledMapIndex::Tile*>& tiles,
+      std::vector<PointCloudT>& clouds,
+      std::vector<int>& results):
+      path_(path), tiles_(tiles), clouds_(clouds), results_(results) { }
+
+    void operator()(int i) const
+    {
+      pcl::PCDReader reader;
+      results_[i] = reader.read<PointT>(
+        path_ + "/" + tiles_[i]->filename, clouds_[i]) >= 0;
+    }
+
+  private:
+
+    const std::string& path_;
+    const std::vector<const TiledMapIndex::Tile*>& tiles_;
+    std::vector<PointCloudT>& clouds_;
+    std::vector<int>& results_;
+};
+
+// **** tiled maps
+
+bool saveTiledMap(
+  const std::string& path,
+  const PointCloudT& cloud,
+  double tile_size,
+  int n_threads)
+{
+  boost::filesystem::create_directories(path);
+
+  // **** bin the points into tiles
+
+  double inv_size = 1.0 / tile_size;
+
+  TilePointMap tile_points;
+  for (unsigned int pt_idx = 0; pt_idx < cloud.points.size(); ++pt_idx)
+  {
+    const PointT& p = cloud.points[pt_idx];
+    if (std::isnan(p.z)) continue;
+    tile_points[VoxelIndex::fromPoint(p.x, p.y, p.z, inv_size)].push_back(pt_idx);
+  }
+
+  TiledMapIndex index;
+  index.tile_size = tile_size;
+
+  TilePointMap::const_iterator it;
+  for (it = tile_points.begin(); it != tile_points.end(); ++it)
+  {
+    TiledMapIndex::Tile tile;
+    tile.index    = it->first;
+    tile.n_points = it->second.size();
+    tile.filename = tileFilename(it->first);
+    index.tiles.push_back(tile);
+  }
+
+  // **** write the tiles
+
+  std::vector<int> results(index.tiles.size(), 0);
+  parallelFor(0, index.tiles.size(), 
+    WriteMapTiles(path, cloud, index.tiles, tile_points, results), n_threads);
+
+  for (unsigned int t_idx = 0; t_idx < results.size(); ++t_idx)
+    if (!results[t_idx]) return false;
+
+  // **** write the index last, so it only lists complete tiles
+
+  cv::FileStorage fs(path + "/index.yml", cv::FileStorage::WRITE);
+  if (!fs.isOpened()) return false;
+
+  fs << "tile_size" << index.tile_size;
+  fs << "tiles" << "[";
+  for (unsigned int t_idx = 0; t_idx < index.tiles.size(); ++t_idx)
+  {
+    const TiledMapIndex::Tile& tile = index.tiles[t_idx];
+    fs << "{" << "x" << tile.index.x << "y" << tile.index.y << "z" << tile.index.z
+       << "n_points" << tile.n_points << "filename" << tile.filename << "}";
+  }
+  fs << "]";
+
+  return true;
+}
+
+bool loadTiledMapIndex(
+  const std::string& path,
+  TiledMapIndex& index)
+{
+  cv::FileStorage fs(path + "/index.yml", cv::FileStorage::READ);
+  if (!fs.isOpened()) return false;
+
+  index.tiles.clear();
+  fs["tile_size"] >> index.tile_size;
+  if (index.tile_size <= 0.0) return false;
+
+  cv::FileNode tiles = fs["tiles"];
+  cv::FileNodeIterator it;
+  for (it = tiles.begin(); it != tiles.end(); ++it)
+  {
+    TiledMapIndex::Tile tile;
+    tile.index.x  = (int)(*it)["x"];
+    tile.index.y  = (int)(*it)["y"];
+    tile.index.z  = (int)(*it)["z"];
+    tile.n_points = (int)(*it)["n_points"];
+    tile.filename = (std::string)(*it)["filename"];
+    index.tiles.push_back(tile);
+  }
+
+  return true;
+}
+
+int loadTiledMapRegion(
+  const std::string& path,
+  const TiledMapIndex& index,
+  const tf::Vector3& min_point,
+  const tf::Vector3& max_point,
+  PointCloudT& cloud,
+  int n_threads)
+{
+  double inv_size = 1.0 / index.tile_size;
+
+  VoxelIndex min_index = VoxelIndex::fromPoint(
+    min_point.getX(), min_point.getY(), min_point.getZ(), inv_size);
+  VoxelIndex max_index = VoxelIndex::fromPoint(
+    max_point.getX(), max_point.getY(), max_point.getZ(), inv_size);
+
+  // **** the tiles which overlap the box
+
+  std::vector<const TiledMapIndex::Tile*> tiles;
+  for (unsigned int t_idx = 0; t_idx < index.tiles.size(); ++t_idx)
+  {
+    const VoxelIndex& t = index.tiles[t_idx].index;
+    if (t.x >= min_index.x && t.x <= max_index.x &&
+        t.y >= min_index.y && t.y <= max_index.y &&
+        t.z >= min_index.z && t.z <= max_index.z)
+      tiles.push_back(&index.tiles[t_idx]);
+  }
+
+  // **** read them
+
+  std::vector<PointCloudT> clouds(tiles.size());
+  std::vector<int> results(tiles.size(), 0);
+  parallelFor(0, tiles.size(), 
+    LoadMapTiles(path, tiles, clouds, results), n_threads);
+
+  cloud.points.clear();
+  for (unsigned int t_idx = 0; t_idx < tiles.size(); ++t_idx)
+  {
+    if (!results[t_idx]) return -1;
+    cloud.points.insert(cloud.points.end(), 
+      clouds[t_idx].points.begin(), clouds[t_idx].points.end());
+  }
+
+  cloud.width  = cloud.points.size();
+  cloud.height = 1;
+  cloud.is_dense = true;
+
+  return tiles.size();
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,76 @@
+/**
+ *  @file triangle_mesh.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/triangle_mesh.h"
+
+#include <cstdio>
+
+namespace ccny_rgbd {
+
+bool saveMeshPLY(const std::string& path, const TriangleMesh& mesh)
+{
+  FILE * file = fopen(path.c_str(), "wb");
+  if (!file) return false;
+
+  fprintf(file, 
+    "ply\n"
+    "format binary_little_endian 1.0\n"
+    "element vertex %u\n"
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "property uchar red\n"
+    "property uchar green\n"
+    "property uchar blue\n"
+    "element face %u\n"
+    "property list uchar int vertex_indices\n"
+    "end_header\n",
+    (unsigned int)mesh.vertices.size(), 
+    (unsigned int)mesh.getNumTriangles());
+
+  // the records are packed, so they are written field by field
+  bool result = true;
+  
+  for (unsigned int v_idx = 0; result && v_idx < mesh.vertices.size(); ++v_idx)
+  {
+    const MeshVertex& v = mesh.vertices[v_idx];
+    float xyz[3] = { v.x, v.y, v.z };
+    uint8_t rgb[3] = { v.r, v.g, v.b };
+    result = fwrite(xyz, sizeof(xyz), 1, file) == 1 &&
+             fwrite(rgb, sizeof(rgb), 1, file) == 1;
+  }
+
+  for (unsigned int t_idx = 0; result && t_idx < mesh.getNumTriangles(); ++t_idx)
+  {
+    uint8_t n = 3;
+    int32_t face[3] = { (int32_t)mesh.indices[t_idx * 3 + 0],
+                        (int32_t)mesh.indices[t_idx * 3 + 1],
+                        (int32_t)mesh.indices[t_idx * 3 + 2] };
+    result = fwrite(&n, 1, 1, file) == 1 &&
+             fwrite(face, sizeof(face), 1, file) == 1;
+  }
+
+  return (fclose(file) == 0) && result;
+}
+
+} // namespace ccny_rgbd
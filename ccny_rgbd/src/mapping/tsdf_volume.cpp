@@ -0,0 +1,598 @@
+/**
+ *  @file tsdf_volume.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/mapping/tsdf_volume.h"
+
+#include <algorithm>
+#include <boost/unordered_set.hpp>
+
+#include "ccny_rgbd/parallel_for.h"
+
+namespace ccny_rgbd {
+
+// **** marching cubes table
+
+/** @brief Marching cubes triangle table, generated from the cube 
+ * topology instead of being typed in.
+ * 
+ * Cube corner c is at (c & 1, (c >> 1) & 1, (c >> 2) & 1). Edges 0-3
+ * are along x, 4-7 along y, and 8-11 along z. A corner is inside
+ * when its value is negative.
+ * 
+ * For each configuration, the crossing edges of every face are
+ * paired into segments. On ambiguous faces (two diagonal inside 
+ * corners) the inside corners are always separated; the choice only
+ * depends on the face, so neighboring cubes agree and the mesh is 
+ * closed. The segments form closed loops, which are oriented so that 
+ * their normal points from the inside to the outside corners, and 
+ * triangulated as fans.
+ */
+class MarchingCubesTable
+{
+  public:
+
+    int edge_corners[12][2];  ///< the two corners of each edge, lowest first
+    int triangles[256][16];   ///< edge triplets, terminated by -1
+
+    MarchingCubesTable()
+    {
+      int e = 0;
+      for (int axis = 0; axis < 3; ++axis)
+      for (int c = 0; c < 8; ++c)
+        if (!(c & (1 << axis)))
+        {
+          edge_corners[e][0] = c;
+          edge_corners[e][1] = c | (1 << axis);
+          ++e;
+        }
+
+      for (int config = 0; config < 256; ++config)
+        buildConfiguration(config);
+    }
+
+  private:
+
+    int findEdge(int a, int b) const
+    {
+      for (int e = 0; e < 12; ++e)
+        if ((edge_corners[e][0] == a && edge_corners[e][1] == b) ||
+            (edge_corners[e][0] == b && edge_corners[e][1] == a))
+          return e;
+      return -1;
+    }
+
+    void buildConfiguration(int config)
+    {
+      // **** pair the crossing edges of each face
+
+      std::vector<int> links[12];
+
+      for (int axis = 0; axis < 3; ++axis)
+      for (int side = 0; side < 2; ++side)
+      {
+        // face corners, in cyclic order
+        int a1 = 1 << ((axis + 1) % 3);
+        int a2 = 1 << ((axis + 2) % 3);
+        int base = side << axis;
+        int corners[4] = { base, base | a1, base | a1 | a2, base | a2 };
+
+        int edges[4];
+        bool inside[4];
+        int n_crossings = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+          edges[i] = findEdge(corners[i], corners[(i + 1) % 4]);
+          inside[i] = (config >> corners[i]) & 1;
+        }
+        for (int i = 0; i < 4; ++i)
+          if (inside[i] != inside[(i + 1) % 4]) ++n_crossings;
+
+        if (n_crossings == 2)
+        {
+          int pair[2], n = 0;
+          for (int i = 0; i < 4; ++i)
+            if (inside[i] != inside[(i + 1) % 4]) pair[n++] = edges[i];
+          links[pair[0]].push_back(pair[1]);
+          links[pair[1]].push_back(pair[0]);
+        }
+        else if (n_crossings == 4)
+        {
+          // cut off each inside corner
+          for (int i = 0; i < 4; ++i)
+            if (inside[i])
+            {
+              int e_prev = edges[(i + 3) % 4];
+              links[e_prev].push_back(edges[i]);
+              links[edges[i]].push_back(e_prev);
+            }
+        }
+      }
+
+      // **** follow the loops, orient them and triangulate
+
+      int n_entries = 0;
+      bool visited[12] = { false };
+
+      for (int start = 0; start < 12; ++start)
+      {
+        if (visited[start] || links[start].empty()) continue;
+
+        std::vector<int> loop;
+        int previous = -1, current = start;
+        do
+        {
+          loop.push_back(current);
+          visited[current] = true;
+          int next = (links[current][0] != previous) ? 
+            links[current][0] : links[current][1];
+          previous = current;
+          current = next;
+        }
+        while (current != start);
+
+        // Newell normal of the edge midpoints, and the direction
+        // from the inside to the outside corners of the loop edges
+        double normal[3] = { 0.0, 0.0, 0.0 };
+        double outward[3] = { 0.0, 0.0, 0.0 };
+        for (unsigned int i = 0; i < loop.size(); ++i)
+        {
+          double p[3], q[3];
+          edgeMidpoint(loop[i], p);
+          edgeMidpoint(loop[(i + 1) % loop.size()], q);
+          normal[0] += (p[1] - q[1]) * (p[2] + q[2]);
+          normal[1] += (p[2] - q[2]) * (p[0] + q[0]);
+          normal[2] += (p[0] - q[0]) * (p[1] + q[1]);
+
+          for (int j = 0; j < 2; ++j)
+          {
+            int c = edge_corners[loop[i]][j];
+            double sign = ((config >> c) & 1) ? -1.0 : 1.0;
+            for (int a = 0; a < 3; ++a)
+              outward[a] += sign * ((c >> a) & 1);
+          }
+        }
+
+        double dot = normal[0] * outward[0] + 
+                     normal[1] * outward[1] + 
+                     normal[2] * outward[2];
+        if (dot < 0.0) std::reverse(loop.begin(), loop.end());
+
+        for (unsigned int i = 1; i + 1 < loop.size(); ++i)
+        {
+          triangles[config][n_entries++] = loop[0];
+          triangles[config][n_entries++] = loop[i];
+          triangles[config][n_entries++] = loop[i + 1];
+        }
+      }
+
+      // at most 5 triangles per configuration
+      triangles[config][n_entries] = -1;
+    }
+
+    void edgeMidpoint(int e, double * p) const
+    {
+      for (int a = 0; a < 3; ++a)
+        p[a] = 0.5 * (((edge_corners[e][0] >> a) & 1) + 
+                      ((edge_corners[e][1] >> a) & 1));
+    }
+};
+
+static const MarchingCubesTable MC_TABLE;
+
+// **** helpers
+
+/** @brief Functor which integrates a frame into one of the blocks
+ */
+template <typename DepthT>
+class IntegrateBlocks
+{
+  public:
+
+    IntegrateBlocks(
+      const TSDFVolume& volume,
+      const RGBDFrame& frame,
+      const tf::Transform& pose_inv,
+      double max_range,
+      const std::vector<TSDFVolume::BlockMap::value_type*>& blocks):
+      volume_(volume), frame_(frame), pose_inv_(pose_inv), 
+      max_range_(max_range), blocks_(blocks) { }
+
+    void operator()(int i) const
+    {
+      volume_.integrateBlockT<DepthT>(
+        frame_, pose_inv_, max_range_, blocks_[i]->first, *blocks_[i]->second);
+    }
+
+  private:
+
+    const TSDFVolume& volume_;
+    const RGBDFrame& frame_;
+    const tf::Transform& pose_inv_;
+    double max_range_;
+    const std::vector<TSDFVolume::BlockMap::value_type*>& blocks_;
+};
+
+// **** TSDFVolume
+
+TSDFVolume::Block::Block()
+{
+  std::fill(tsdf,   tsdf   + BLOCK_VOXELS, 1.0f);
+  std::fill(weight, weight + BLOCK_VOXELS, 0.0f);
+  std::fill(r, r + BLOCK_VOXELS, 0);
+  std::fill(g, g + BLOCK_VOXELS, 0);
+  std::fill(b, b + BLOCK_VOXELS, 0);
+}
+
+TSDFVolume::TSDFVolume(
+  double voxel_size,
+  double truncation,
+  double max_weight,
+  int n_threads):
+  voxel_size_(voxel_size),
+  truncation_(truncation),
+  max_weight_(max_weight),
+  n_threads_(n_threads)
+{
+
+}
+
+TSDFVolume::~TSDFVolume()
+{
+
+}
+
+void TSDFVolume::clear()
+{
+  blocks_.clear();
+}
+
+const TSDFVolume::Block * TSDFVolume::findBlock(const BlockIndex& index) const
+{
+  BlockMap::const_iterator it = blocks_.find(index);
+  return (it == blocks_.end()) ? NULL : it->second.get();
+}
+
+void TSDFVolume::integrate(
+  const RGBDFrame& frame,
+  const tf::Transform& pose,
+  double max_range)
+{
+  std::vector<BlockMap::value_type*> blocks;
+  tf::Transform pose_inv = pose.inverse();
+
+  if (frame.depth_img.depth() == CV_32F)
+  {
+    allocateBlocksT<float>(frame, pose, max_range, blocks);
+    parallelFor(0, blocks.size(), 
+      IntegrateBlocks<float>(*this, frame, pose_inv, max_range, blocks),
+      n_threads_, 4);
+  }
+  else
+  {
+    allocateBlocksT<uint16_t>(frame, pose, max_range, blocks);
+    parallelFor(0, blocks.size(), 
+      IntegrateBlocks<uint16_t>(*this, frame, pose_inv, max_range, blocks),
+      n_threads_, 4);
+  }
+}
+
+template <typename DepthT>
+void TSDFVolume::allocateBlocksT(
+  const RGBDFrame& frame,
+  const tf::Transform& pose,
+  double max_range,
+  std::vector<BlockMap::value_type*>& blocks)
+{
+  // every other pixel is enough to find the blocks, which
+  // are much larger than the pixel footprint
+  const int pixel_step = 2;
+
+  const float cx = frame.model.cx();
+  const float cy = frame.model.cy();
+  const float inv_fx = 1.0 / frame.model.fx();
+  const float inv_fy = 1.0 / frame.model.fy();
+
+  const float block_side = voxel_size_ * BLOCK_SIZE;
+  const float inv_block_side = 1.0 / block_side;
+  const float trunc = truncation_;
+
+  // samples along the truncation band, at most half a block apart
+  const int n_samples = (int)ceil(2.0 * trunc / (0.5 * block_side)) + 1;
+  const float sample_step = 2.0 * trunc / (n_samples - 1);
+
+  const tf::Matrix3x3& basis = pose.getBasis();
+  float rot[3][3];
+  for (int i = 0; i < 3; ++i)
+  for (int j = 0; j < 3; ++j)
+    rot[i][j] = basis[i][j];
+  const float tx = pose.getOrigin().getX();
+  const float ty = pose.getOrigin().getY();
+  const float tz = pose.getOrigin().getZ();
+
+  boost::unordered_set<BlockIndex, VoxelIndexHash> visible;
+
+  for (int v = 0; v < frame.depth_img.rows; v += pixel_step)
+  {
+    const DepthT * depth_row = frame.depth_img.ptr<DepthT>(v);
+
+    for (int u = 0; u < frame.depth_img.cols; u += pixel_step)
+    {
+      DepthT z_raw = depth_row[u];
+      if (!DepthTraits<DepthT>::valid(z_raw)) continue;
+      float z = DepthTraits<DepthT>::toMeters(z_raw);
+      if (z > max_range) continue;
+
+      // ray through the pixel, with unit z
+      float ray_x = (u - cx) * inv_fx;
+      float ray_y = (v - cy) * inv_fy;
+
+      for (int s_idx = 0; s_idx < n_samples; ++s_idx)
+      {
+        float s = z - trunc + s_idx * sample_step;
+        if (s <= 0.0f) continue;
+
+        float px = s * ray_x, py = s * ray_y, pz = s;
+        float wx = rot[0][0] * px + rot[0][1] * py + rot[0][2] * pz + tx;
+        float wy = rot[1][0] * px + rot[1][1] * py + rot[1][2] * pz + ty;
+        float wz = rot[2][0] * px + rot[2][1] * py + rot[2][2] * pz + tz;
+
+        visible.insert(BlockIndex::fromPoint(wx, wy, wz, inv_block_side));
+      }
+    }
+  }
+
+  blocks.clear();
+  blocks.reserve(visible.size());
+
+  boost::unordered_set<BlockIndex, VoxelIndexHash>::const_iterator it;
+  for (it = visible.begin(); it != visible.end(); ++it)
+  {
+    BlockMap::iterator block_it = blocks_.find(*it);
+    if (block_it == blocks_.end())
+      block_it = blocks_.insert(BlockMap::value_type(*it, BlockPtr(new Block()))).first;
+
+    // elements of the map do not move when it grows
+    blocks.push_back(&(*block_it));
+  }
+}
+
+template <typename DepthT>
+void TSDFVolume::integrateBlockT(
+  const RGBDFrame& frame,
+  const tf::Transform& pose_inv,
+  double max_range,
+  const BlockIndex& index,
+  Block& block) const
+{
+  const cv::Mat& depth_img = frame.depth_img;
+  const cv::Mat& rgb_img = frame.rgb_img;
+
+  const float fx = frame.model.fx();
+  const float fy = frame.model.fy();
+  const float cx = frame.model.cx();
+  const float cy = frame.model.cy();
+
+  const float max_u = depth_img.cols - 0.5f;
+  const float max_v = depth_img.rows - 0.5f;
+
+  const float trunc = truncation_;
+  const float inv_trunc = 1.0 / truncation_;
+  const float max_weight = max_weight_;
+  const float max_z = max_range;
+
+  // camera coordinates of the first voxel of the block, and the 
+  // camera-frame steps between neighboring voxels along x, y and z
+  const double vs = voxel_size_;
+  tf::Vector3 origin = pose_inv * tf::Vector3(
+    index.x * BLOCK_SIZE * vs, 
+    index.y * BLOCK_SIZE * vs, 
+    index.z * BLOCK_SIZE * vs);
+
+  const tf::Matrix3x3& basis = pose_inv.getBasis();
+  float step[3][3];
+  for (int axis = 0; axis < 3; ++axis)
+  for (int i = 0; i < 3; ++i)
+    step[axis][i] = basis[i][axis] * vs;
+
+  float cam_z[BLOCK_SIZE];
+  float img_u[BLOCK_SIZE], img_v[BLOCK_SIZE];
+
+  for (int z = 0; z < BLOCK_SIZE; ++z)
+  for (int y = 0; y < BLOCK_SIZE; ++y)
+  {
+    const float row_x = origin.getX() + y * step[1][0] + z * step[2][0];
+    const float row_y = origin.getY() + y * step[1][1] + z * step[2][1];
+    const float row_z = origin.getZ() + y * step[1][2] + z * step[2][2];
+
+    // project the whole row: a fixed-width loop without branches,
+    // which the compiler vectorizes
+    for (int x = 0; x < BLOCK_SIZE; ++x)
+    {
+      float px = row_x + x * step[0][0];
+      float py = row_y + x * step[0][1];
+      float pz = row_z + x * step[0][2];
+      float inv_z = 1.0f / pz;
+
+      cam_z[x] = pz;
+      img_u[x] = fx * px * inv_z + cx;
+      img_v[x] = fy * py * inv_z + cy;
+    }
+
+    // update the voxels which project onto a valid depth measurement
+    int row_offset = (z * BLOCK_SIZE + y) * BLOCK_SIZE;
+
+    for (int x = 0; x < BLOCK_SIZE; ++x)
+    {
+      if (cam_z[x] <= 0.0f) continue;
+
+      // also rejects NaN
+      if (!(img_u[x] >= -0.5f && img_u[x] < max_u &&
+            img_v[x] >= -0.5f && img_v[x] < max_v)) continue;
+
+      int u = (int)(img_u[x] + 0.5f);
+      int v = (int)(img_v[x] + 0.5f);
+
+      DepthT z_raw = depth_img.ptr<DepthT>(v)[u];
+      if (!DepthTraits<DepthT>::valid(z_raw)) continue;
+      float depth = DepthTraits<DepthT>::toMeters(z_raw);
+      if (depth > max_z) continue;
+
+      float sdf = depth - cam_z[x];
+      if (sdf < -trunc) continue; // occluded
+
+      int i = row_offset + x;
+      float tsdf = std::min(1.0f, sdf * inv_trunc);
+      float w = block.weight[i];
+      float inv_w = 1.0f / (w + 1.0f);
+
+      block.tsdf[i] = (block.tsdf[i] * w + tsdf) * inv_w;
+
+      // colors only come from near the surface
+      if (sdf < trunc)
+      {
+        uint8_t r, g, b;
+        getPixelColor(rgb_img, u, v, r, g, b);
+        block.r[i] = (block.r[i] * w + r) * inv_w + 0.5f;
+        block.g[i] = (block.g[i] * w + g) * inv_w + 0.5f;
+        block.b[i] = (block.b[i] * w + b) * inv_w + 0.5f;
+      }
+
+      block.weight[i] = std::min(w + 1.0f, max_weight);
+    }
+  }
+}
+
+void TSDFVolume::extractMesh(TriangleMesh& mesh) const
+{
+  mesh.clear();
+
+  boost::unordered_map<uint64_t, uint32_t> edge_vertices;
+
+  BlockMap::const_iterator it;
+  for (it = blocks_.begin(); it != blocks_.end(); ++it)
+    extractBlockMesh(it->first, *it->second, mesh, edge_vertices);
+}
+
+void TSDFVolume::extractBlockMesh(
+  const BlockIndex& index,
+  const Block& block,
+  TriangleMesh& mesh,
+  boost::unordered_map<uint64_t, uint32_t>& edge_vertices) const
+{
+  // the cubes on the upper faces of the block use voxels of the
+  // neighboring blocks, indexed as (dz << 2) | (dy << 1) | dx
+  const Block * neighbors[8];
+  for (int n = 0; n < 8; ++n)
+    neighbors[n] = (n == 0) ? &block : findBlock(BlockIndex(
+      index.x + (n & 1), index.y + ((n >> 1) & 1), index.z + ((n >> 2) & 1)));
+
+  // coordinates are offset so the edge keys are positive
+  const int64_t key_offset = 1 << 19;
+
+  float values[8];
+  const Block * corner_blocks[8];
+  int corner_indices[8];
+
+  for (int z = 0; z < BLOCK_SIZE; ++z)
+  for (int y = 0; y < BLOCK_SIZE; ++y)
+  for (int x = 0; x < BLOCK_SIZE; ++x)
+  {
+    // **** gather the corner values
+
+    int config = 0;
+    bool observed = true;
+    for (int c = 0; c < 8 && observed; ++c)
+    {
+      int cx = x + (c & 1), cy = y + ((c >> 1) & 1), cz = z + ((c >> 2) & 1);
+      int n = ((cz == BLOCK_SIZE) << 2) | ((cy == BLOCK_SIZE) << 1) | (cx == BLOCK_SIZE);
+
+      const Block * corner_block = neighbors[n];
+      if (!corner_block) { observed = false; break; }
+
+      int i = ((cz % BLOCK_SIZE) * BLOCK_SIZE + cy % BLOCK_SIZE) * BLOCK_SIZE + cx % BLOCK_SIZE;
+      if (corner_block->weight[i] <= 0.0f) { observed = false; break; }
+
+      corner_blocks[c] = corner_block;
+      corner_indices[c] = i;
+      values[c] = corner_block->tsdf[i];
+      if (values[c] < 0.0f) config |= 1 << c;
+    }
+
+    if (!observed || config == 0 || config == 255) continue;
+
+    // **** emit the triangles, sharing the vertices on each edge
+
+    int gx = index.x * BLOCK_SIZE + x;
+    int gy = index.y * BLOCK_SIZE + y;
+    int gz = index.z * BLOCK_SIZE + z;
+
+    const int * triangles = MC_TABLE.triangles[config];
+    for (int t = 0; triangles[t] >= 0; ++t)
+    {
+      int e = triangles[t];
+      int axis = e / 4;
+      int a = MC_TABLE.edge_corners[e][0];
+      int b = MC_TABLE.edge_corners[e][1];
+
+      int ax = gx + (a & 1), ay = gy + ((a >> 1) & 1), az = gz + ((a >> 2) & 1);
+
+      uint64_t key = 
+        ((uint64_t)((ax + key_offset) & 0xFFFFF))       |
+        ((uint64_t)((ay + key_offset) & 0xFFFFF) << 20) |
+        ((uint64_t)((az + key_offset) & 0xFFFFF) << 40) |
+        ((uint64_t)axis << 60);
+
+      boost::unordered_map<uint64_t, uint32_t>::iterator v_it = edge_vertices.find(key);
+      if (v_it != edge_vertices.end())
+      {
+        mesh.indices.push_back(v_it->second);
+        continue;
+      }
+
+      // interpolate the zero crossing
+      float w = values[a] / (values[a] - values[b]);
+      float p[3] = { (float)ax, (float)ay, (float)az };
+      p[axis] += w;
+
+      const Block& block_a = *corner_blocks[a];
+      const Block& block_b = *corner_blocks[b];
+      int i_a = corner_indices[a];
+      int i_b = corner_indices[b];
+
+      MeshVertex vertex;
+      vertex.x = p[0] * voxel_size_;
+      vertex.y = p[1] * voxel_size_;
+      vertex.z = p[2] * voxel_size_;
+      vertex.r = block_a.r[i_a] + w * (block_b.r[i_b] - block_a.r[i_a]) + 0.5f;
+      vertex.g = block_a.g[i_a] + w * (block_b.g[i_b] - block_a.g[i_a]) + 0.5f;
+      vertex.b = block_a.b[i_a] + w * (block_b.b[i_b] - block_a.b[i_a]) + 0.5f;
+
+      uint32_t v_idx = mesh.vertices.size();
+      mesh.vertices.push_back(vertex);
+      mesh.indices.push_back(v_idx);
+      edge_vertices[key] = v_idx;
+    }
+  }
+}
+
+} // namespace ccny_rgbd
@@ -93,4 +93,120 @@ void unwarpDepthImage(
   }
 }
 
+void pyrDownDepthImage(
+  const cv::Mat& depth_img_in,
+  cv::Mat& depth_img_out,
+  int pool_mode)
+{
+  int w = depth_img_in.cols / 2;
+  int h = depth_img_in.rows / 2;
+
+  depth_img_out.create(h, w, CV_16UC1);
+
+  for (int v = 0; v < h; ++v)
+  {
+    const uint16_t* row_0 = depth_img_in.ptr<uint16_t>(2*v);
+    const uint16_t* row_1 = depth_img_in.ptr<uint16_t>(2*v + 1);
+    uint16_t* row_out = depth_img_out.ptr<uint16_t>(v);
+
+    for (int u = 0; u < w; ++u)
+    {
+      // gather the valid readings of the 2x2 block
+      uint16_t d[4];
+      int n = 0;
+      if (row_0[2*u]     != 0) d[n++] = row_0[2*u];
+      if (row_0[2*u + 1] != 0) d[n++] = row_0[2*u + 1];
+      if (row_1[2*u]     != 0) d[n++] = row_1[2*u];
+      if (row_1[2*u + 1] != 0) d[n++] = row_1[2*u + 1];
+
+      if (n == 0)
+      {
+        row_out[u] = 0;
+      }
+      else if (pool_mode == DEPTH_POOL_MIN)
+      {
+        uint16_t d_min = d[0];
+        for (int k = 1; k < n; ++k) 
+          if (d[k] < d_min) d_min = d[k];
+        row_out[u] = d_min;
+      }
+      else
+      {
+        // lower median: sort the (at most 4) readings
+        for (int k = 1; k < n; ++k)
+        for (int j = k; j > 0 && d[j-1] > d[j]; --j)
+          std::swap(d[j-1], d[j]);
+        row_out[u] = d[(n - 1) / 2];
+      }
+    }
+  }
+}
+
+void pyrDownImage(
+  const cv::Mat& img_in,
+  cv::Mat& img_out)
+{
+  // INTER_AREA with an integer factor of 2 is a 2x2 box filter
+  cv::Size size_out(img_in.cols / 2, img_in.rows / 2);
+  cv::resize(img_in, img_out, size_out, 0, 0, cv::INTER_AREA);
+}
+
+void pyrDownIntrinsics(
+  const cv::Mat& intr_in,
+  cv::Mat& intr_out)
+{
+  intr_out = intr_in.clone();
+
+  // pixel centers: u_out = (u_in + 0.5) / 2 - 0.5
+  intr_out.at<double>(0,0) = intr_in.at<double>(0,0) * 0.5;
+  intr_out.at<double>(1,1) = intr_in.at<double>(1,1) * 0.5;
+  intr_out.at<double>(0,2) = (intr_in.at<double>(0,2) + 0.5) * 0.5 - 0.5;
+  intr_out.at<double>(1,2) = (intr_in.at<double>(1,2) + 0.5) * 0.5 - 0.5;
+}
+
+bool writeMatBinary(std::ostream& stream, const cv::Mat& mat)
+{
+  int32_t header[3] = { mat.type(), mat.rows, mat.cols };
+  stream.write((const char*)header, sizeof(header));
+
+  // write row by row, in case the matrix is not continuous
+  size_t row_size = mat.cols * mat.elemSize();
+  for (int v = 0; v < mat.rows; ++v)
+    stream.write((const char*)mat.ptr(v), row_size);
+
+  return stream.good();
+}
+
+bool readMatBinary(std::istream& stream, cv::Mat& mat)
+{
+  int32_t header[3];
+  stream.read((char*)header, sizeof(header));
+  if (!stream.good()) return false;
+
+  int type = header[0];
+  int rows = header[1];
+  int cols = header[2];
+  if (rows < 0 || cols < 0) return false;
+
+  // the header comes from a file, so check it before allocating
+  if ((type & ~CV_MAT_TYPE_MASK) != 0 || CV_MAT_DEPTH(type) > CV_64F) 
+    return false;
+
+  uint64_t size = (uint64_t)rows * (uint64_t)cols * CV_ELEM_SIZE(type);
+
+  std::streampos pos = stream.tellg();
+  if (pos < 0) return false;
+  stream.seekg(0, std::ios::end);
+  std::streampos end = stream.tellg();
+  stream.seekg(pos);
+  if (!stream.good() || end < pos || size > (uint64_t)(end - pos)) 
+    return false;
+
+  mat.create(rows, cols, type);
+  if (rows > 0 && cols > 0)
+    stream.read((char*)mat.data, mat.total() * mat.elemSize());
+
+  return stream.good();
+}
+
 } // namespace ccny_rgbd
\ No newline at end of file
@@ -30,7 +30,9 @@ MotionEstimationICPProbModel::MotionEstimationICPProbModel(
   const ros::NodeHandle& nh_private):
   MotionEstimation(nh, nh_private),
   model_idx_(0),
-  model_size_(0)
+  model_size_(0),
+  model_subscribed_(false),
+  model_cov_subscribed_(false)
 {
   // **** init params
 
@@ -61,6 +63,8 @@ MotionEstimationICPProbModel::MotionEstimationICPProbModel(
     publish_model_ = false;
   if (!nh_private_.getParam ("reg/ICPProbModel/publish_model_covariances", publish_model_cov_))
     publish_model_cov_ = false;
+  if (!nh_private_.getParam ("reg/ICPProbModel/publish_model_covariances_rate", model_cov_rate_))
+    model_cov_rate_ = 1.0;
 
   // **** variables
 
@@ -76,15 +80,21 @@ MotionEstimationICPProbModel::MotionEstimationICPProbModel(
 
   // **** publishers
 
+  ros::SubscriberStatusCallback connect_cb = 
+    boost::bind(&MotionEstimationICPProbModel::connectCallback, this);
+
   if (publish_model_)
   {
     model_publisher_ = nh_.advertise<PointCloudFeature>(
-      "model/cloud", 1);
+      "model/cloud", 1, connect_cb, connect_cb);
   }
   if (publish_model_cov_)
   {
     covariances_publisher_ = nh_.advertise<visualization_msgs::Marker>(
-      "model/covariances", 1);
+      "model/covariances", 1, connect_cb, connect_cb);
+    covariance_marker_publisher_.reset(new CovarianceMarkerPublisher(
+      covariances_publisher_, "model_covariances", model_cov_rate_, 
+      1.0, 1.0, 0.0));
   }
 
   // **** services
@@ -183,9 +193,9 @@ bool MotionEstimationICPProbModel::getMotionEstimationImpl(
   model_ptr_->width = model_ptr_->points.size();
 
   // publish data for visualization
-  if (publish_model_)
+  if (publish_model_ && model_subscribed_)
     model_publisher_.publish(model_ptr_);
-  if (publish_model_cov_)
+  if (publish_model_cov_ && model_cov_subscribed_)
     publishCovariances();
 
   return result;
@@ -412,66 +422,17 @@ void MotionEstimationICPProbModel::updateModelFromData(
 
 void MotionEstimationICPProbModel::publishCovariances()
 {
-  // create markers
-  visualization_msgs::Marker marker;
-  marker.header.frame_id = fixed_frame_;
-  marker.header.stamp = model_ptr_->header.stamp;
-  marker.type = visualization_msgs::Marker::LINE_LIST;
-  marker.color.r = 1.0;
-  marker.color.g = 1.0;
-  marker.color.b = 0.0;
-  marker.color.a = 1.0;
-  marker.scale.x = 0.0025;
-  marker.action = visualization_msgs::Marker::ADD;
-  marker.ns = "model_covariances";
-  marker.id = 0;
-  marker.lifetime = ros::Duration();
-
-  for (unsigned int i = 0; i < model_ptr_->points.size(); ++i)
-  {  
-    // compute eigenvectors
-    cv::Mat evl(1, 3, CV_64F);
-    cv::Mat evt(3, 3, CV_64F);
-
-    const Matrix3f& cov_eigen = covariances_[i];
-
-    cv::Mat cov(3,3,CV_64F);
-    for(int j = 0; j < 3; ++j)  
-    for(int i = 0; i < 3; ++i)
-      cov.at<double>(j,i) = cov_eigen(j,i);
-
-    cv::eigen(cov, evl, evt);
-
-    double mx = model_ptr_->points[i].x;
-    double my = model_ptr_->points[i].y;
-    double mz = model_ptr_->points[i].z;
-
-    for (int e = 0; e < 3; ++e)
-    {
-      geometry_msgs::Point a;
-      geometry_msgs::Point b;
-
-      double sigma = sqrt(std::abs(evl.at<double>(0,e)));
-      double scale = sigma * 3.0;
-
-      tf::Vector3 evt_tf(evt.at<double>(e,0), 
-                         evt.at<double>(e,1), 
-                         evt.at<double>(e,2));
-
-      a.x = mx + evt_tf.getX() * scale;
-      a.y = my + evt_tf.getY() * scale;
-      a.z = mz + evt_tf.getZ() * scale;
-   
-      b.x = mx - evt_tf.getX() * scale;
-      b.y = my - evt_tf.getY() * scale;
-      b.z = mz - evt_tf.getZ() * scale;
+  std_msgs::Header header;
+  header.frame_id = fixed_frame_;
+  header.stamp = model_ptr_->header.stamp;
 
-      marker.points.push_back(a);
-      marker.points.push_back(b);
-    }
-  }
+  covariance_marker_publisher_->update(header, means_, covariances_);
+}
 
-  covariances_publisher_.publish(marker);
+void MotionEstimationICPProbModel::connectCallback()
+{
+  model_subscribed_     = (model_publisher_.getNumSubscribers() > 0);
+  model_cov_subscribed_ = (covariances_publisher_.getNumSubscribers() > 0);
 }
 
 bool MotionEstimationICPProbModel::saveSrvCallback(
@@ -0,0 +1,523 @@
+/**
+ *  @file rgbd_recording.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/rgbd_recording.h"
+
+#include <cstring>
+#include <algorithm>
+#include <cv_bridge/cv_bridge.h>
+#include <sensor_msgs/image_encodings.h>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "ccny_rgbd/payload.h"
+#include "ccny_rgbd/rgbd_util.h"
+#include "ccny_rgbd/rvl_codec.h"
+
+namespace ccny_rgbd {
+
+// **** file format helpers
+
+// The file starts with RECORDING_MAGIC, followed by framed chunks.
+// A data chunk payload is a sequence of [type][size][data] records.
+// The footer is [index chunk offset][FOOTER_MAGIC].
+
+static const char RECORDING_MAGIC[8] = { 'C','C','N','Y','R','G','B','1' };
+static const char FOOTER_MAGIC[8]    = { 'C','C','N','Y','I','D','X','1' };
+
+enum ChunkType  { CHUNK_DATA = 1, CHUNK_INDEX = 2 };
+enum RecordType { RECORD_INFO = 1, RECORD_FRAME = 2 };
+
+static const size_t CHUNK_HEADER_SIZE  = 2 * sizeof(uint32_t); ///< type, size
+static const size_t CHUNK_FOOTER_SIZE  = sizeof(uint32_t);     ///< checksum
+static const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t); ///< type, size
+static const size_t FOOTER_SIZE = sizeof(uint64_t) + sizeof(FOOTER_MAGIC);
+
+static void serializeFrame(const RGBDRecordingFrame& frame, std::vector<uint8_t>& buffer)
+{
+  PayloadWriter writer(buffer);
+  writer.putMsg(frame.rgb_header);
+  writer.putMsg(frame.depth_header);
+  writer.put(frame.info_id);
+  writer.putString(frame.rgb_encoding);
+  writer.putBlob(frame.rgb_data);
+  writer.putString(frame.depth_encoding);
+  writer.putBlob(frame.depth_data);
+}
+
+static bool deserializeFrame(const std::vector<uint8_t>& buffer, RGBDRecordingFrame& frame)
+{
+  PayloadReader reader(buffer);
+  return
+    reader.getMsg(frame.rgb_header) &&
+    reader.getMsg(frame.depth_header) &&
+    reader.get(frame.info_id) &&
+    reader.getString(frame.rgb_encoding) &&
+    reader.getBlob(frame.rgb_data) &&
+    reader.getString(frame.depth_encoding) &&
+    reader.getBlob(frame.depth_data);
+}
+
+// **** frame encoding
+
+bool encodeRGBDRecordingFrame(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  int jpeg_quality,
+  RGBDRecordingFrame& frame)
+{
+  namespace enc = sensor_msgs::image_encodings;
+
+  if (depth_msg->encoding != enc::TYPE_16UC1 && 
+      depth_msg->encoding != enc::TYPE_32FC1)
+  {
+    ROS_ERROR("Unsupported depth image encoding %s (expected 16UC1 or 32FC1)",
+      depth_msg->encoding.c_str());
+    return false;
+  }
+
+  cv_bridge::CvImageConstPtr rgb_ptr;
+  try
+  {
+    if (rgb_msg->encoding == enc::MONO8)
+      rgb_ptr = cv_bridge::toCvShare(rgb_msg);
+    else
+      rgb_ptr = cv_bridge::toCvShare(rgb_msg, enc::BGR8);
+  }
+  catch (cv_bridge::Exception& e)
+  {
+    ROS_ERROR("Unsupported RGB image encoding %s: %s",
+      rgb_msg->encoding.c_str(), e.what());
+    return false;
+  }
+
+  try
+  {
+    cv_bridge::CvImageConstPtr depth_ptr = cv_bridge::toCvShare(depth_msg);
+
+    std::vector<int> params(2);
+    params[0] = CV_IMWRITE_JPEG_QUALITY;
+    params[1] = jpeg_quality;
+    if (!cv::imencode(".jpg", rgb_ptr->image, frame.rgb_data, params))
+      return false;
+
+    compressDepthRVL(depth_ptr->image, frame.depth_data);
+  }
+  catch (std::exception& e)
+  {
+    ROS_ERROR("Could not encode RGBD frame: %s", e.what());
+    return false;
+  }
+
+  frame.rgb_header     = rgb_msg->header;
+  frame.depth_header   = depth_msg->header;
+  frame.rgb_encoding   = rgb_ptr->encoding;
+  frame.depth_encoding = depth_msg->encoding;
+
+  return true;
+}
+
+bool decodeRGBDRecordingFrame(
+  const RGBDRecordingFrame& frame,
+  ImageMsg::Ptr& rgb_msg,
+  ImageMsg::Ptr& depth_msg)
+{
+  namespace enc = sensor_msgs::image_encodings;
+
+  cv_bridge::CvImage rgb_img;
+  rgb_img.header   = frame.rgb_header;
+  rgb_img.encoding = frame.rgb_encoding;
+
+  int flags = (frame.rgb_encoding == enc::MONO8) ? 
+    CV_LOAD_IMAGE_GRAYSCALE : CV_LOAD_IMAGE_COLOR;
+  rgb_img.image = cv::imdecode(frame.rgb_data, flags);
+  if (rgb_img.image.empty()) return false;
+
+  cv::Mat depth_img_16;
+  if (frame.depth_data.empty() ||
+      !decompressDepthRVL(&frame.depth_data[0], frame.depth_data.size(), depth_img_16))
+    return false;
+
+  cv_bridge::CvImage depth_img;
+  depth_img.header   = frame.depth_header;
+  depth_img.encoding = frame.depth_encoding;
+
+  if (frame.depth_encoding == enc::TYPE_32FC1)
+    depthImage16bitToFloat(depth_img_16, depth_img.image);
+  else
+    depth_img.image = depth_img_16;
+
+  rgb_msg   = rgb_img.toImageMsg();
+  depth_msg = depth_img.toImageMsg();
+  return true;
+}
+
+// **** writer
+
+RGBDRecordingWriter::RGBDRecordingWriter(unsigned int chunk_size):
+  chunk_size_(std::max(chunk_size, 1u)),
+  file_(NULL),
+  file_offset_(0),
+  chunk_frames_(0),
+  has_info_(false)
+{
+
+}
+
+RGBDRecordingWriter::~RGBDRecordingWriter()
+{
+  close();
+}
+
+bool RGBDRecordingWriter::open(const std::string& filename)
+{
+  close();
+
+  file_ = fopen(filename.c_str(), "wb");
+  if (!file_ || fwrite(RECORDING_MAGIC, sizeof(RECORDING_MAGIC), 1, file_) != 1)
+  {
+    ROS_ERROR("Could not create RGBD recording %s", filename.c_str());
+    if (file_) fclose(file_);
+    file_ = NULL;
+    return false;
+  }
+
+  file_offset_ = sizeof(RECORDING_MAGIC);
+
+  chunk_.clear();
+  chunk_frames_ = 0;
+  has_info_ = false;
+  info_offsets_.clear();
+  frame_offsets_.clear();
+  frame_stamps_.clear();
+
+  return true;
+}
+
+bool RGBDRecordingWriter::close()
+{
+  if (!file_) return true;
+
+  bool result = writeChunk();
+
+  // **** index chunk
+
+  uint64_t index_offset = file_offset_;
+
+  PayloadWriter writer(record_);
+  writer.put<uint32_t>(info_offsets_.size());
+  for (unsigned int i = 0; i < info_offsets_.size(); ++i)
+    writer.put(info_offsets_[i]);
+
+  writer.put<uint32_t>(frame_offsets_.size());
+  for (unsigned int i = 0; i < frame_offsets_.size(); ++i)
+  {
+    writer.put(frame_offsets_[i]);
+    writer.put(frame_stamps_[i].sec);
+    writer.put(frame_stamps_[i].nsec);
+  }
+
+  // **** footer
+
+  result = result &&
+    writeFramedRecord(file_, CHUNK_INDEX, record_) &&
+    fwrite(&index_offset, sizeof(index_offset), 1, file_) == 1 &&
+    fwrite(FOOTER_MAGIC, sizeof(FOOTER_MAGIC), 1, file_) == 1;
+
+  result = (fclose(file_) == 0) && result;
+  file_ = NULL;
+
+  if (!result) ROS_ERROR("Failed to write the RGBD recording index");
+  return result;
+}
+
+uint32_t RGBDRecordingWriter::addCameraInfo(const CameraInfoMsg& info_msg)
+{
+  if (!has_info_ || !sameCameraCalibration(last_info_, info_msg))
+  {
+    PayloadWriter writer(record_);
+    writer.putMsg(info_msg);
+    info_offsets_.push_back(appendRecord(RECORD_INFO));
+
+    last_info_ = info_msg;
+    has_info_ = true;
+  }
+
+  return info_offsets_.size() - 1;
+}
+
+bool RGBDRecordingWriter::addFrame(const RGBDRecordingFrame& frame)
+{
+  if (!file_) return false;
+
+  serializeFrame(frame, record_);
+  frame_offsets_.push_back(appendRecord(RECORD_FRAME));
+  frame_stamps_.push_back(frame.rgb_header.stamp);
+
+  if (++chunk_frames_ >= chunk_size_)
+    return writeChunk();
+
+  return true;
+}
+
+uint64_t RGBDRecordingWriter::appendRecord(uint32_t type)
+{
+  uint64_t offset = file_offset_ + CHUNK_HEADER_SIZE + chunk_.size();
+
+  uint32_t size = record_.size();
+  size_t pos = chunk_.size();
+  chunk_.resize(pos + RECORD_HEADER_SIZE + size);
+
+  memcpy(&chunk_[pos], &type, sizeof(type));
+  memcpy(&chunk_[pos + sizeof(type)], &size, sizeof(size));
+  if (size > 0) memcpy(&chunk_[pos + RECORD_HEADER_SIZE], &record_[0], size);
+
+  return offset;
+}
+
+bool RGBDRecordingWriter::writeChunk()
+{
+  if (chunk_.empty()) return true;
+
+  bool result = 
+    writeFramedRecord(file_, CHUNK_DATA, chunk_) &&
+    fflush(file_) == 0;
+
+  file_offset_ += CHUNK_HEADER_SIZE + chunk_.size() + CHUNK_FOOTER_SIZE;
+
+  // keeps the capacity, so the next chunk is not reallocated
+  chunk_.clear();
+  chunk_frames_ = 0;
+
+  if (!result) ROS_ERROR("Failed to write to the RGBD recording");
+  return result;
+}
+
+// **** reader
+
+RGBDRecordingReader::RGBDRecordingReader():
+  file_(NULL)
+{
+
+}
+
+RGBDRecordingReader::~RGBDRecordingReader()
+{
+  close();
+}
+
+bool RGBDRecordingReader::open(const std::string& filename)
+{
+  close();
+
+  file_ = fopen(filename.c_str(), "rb");
+  if (!file_)
+  {
+    ROS_ERROR("Could not open RGBD recording %s", filename.c_str());
+    return false;
+  }
+
+  char magic[sizeof(RECORDING_MAGIC)];
+  if (fread(magic, sizeof(magic), 1, file_) != 1 ||
+      memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0)
+  {
+    ROS_ERROR("%s is not an RGBD recording", filename.c_str());
+    close();
+    return false;
+  }
+
+  if (!readIndex())
+  {
+    ROS_WARN("RGBD recording %s has no valid index, rebuilding it", 
+      filename.c_str());
+
+    if (!scanChunks())
+    {
+      ROS_ERROR("RGBD recording %s is corrupted", filename.c_str());
+      close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void RGBDRecordingReader::close()
+{
+  if (file_) fclose(file_);
+  file_ = NULL;
+
+  infos_.clear();
+  frame_offsets_.clear();
+  frame_stamps_.clear();
+}
+
+CameraInfoMsg::ConstPtr RGBDRecordingReader::getCameraInfo(uint32_t id) const
+{
+  if (id < infos_.size()) return infos_[id];
+  return CameraInfoMsg::ConstPtr();
+}
+
+bool RGBDRecordingReader::readFrame(unsigned int i, RGBDRecordingFrame& frame)
+{
+  if (!file_ || i >= frame_offsets_.size()) return false;
+
+  uint32_t type;
+  return 
+    readRecord(frame_offsets_[i], type) && 
+    type == RECORD_FRAME &&
+    deserializeFrame(record_, frame);
+}
+
+bool RGBDRecordingReader::readIndex()
+{
+  infos_.clear();
+  frame_offsets_.clear();
+  frame_stamps_.clear();
+
+  // **** footer
+
+  uint64_t index_offset;
+  char magic[sizeof(FOOTER_MAGIC)];
+
+  if (fseeko(file_, -(off_t)FOOTER_SIZE, SEEK_END) != 0 ||
+      fread(&index_offset, sizeof(index_offset), 1, file_) != 1 ||
+      fread(magic, sizeof(magic), 1, file_) != 1 ||
+      memcmp(magic, FOOTER_MAGIC, sizeof(magic)) != 0)
+    return false;
+
+  // **** index chunk
+
+  uint32_t type;
+  if (fseeko(file_, index_offset, SEEK_SET) != 0 ||
+      !readFramedRecord(file_, type, record_) ||
+      type != CHUNK_INDEX)
+    return false;
+
+  PayloadReader reader(record_);
+
+  uint32_t n_infos;
+  if (!reader.get(n_infos)) return false;
+
+  std::vector<uint64_t> info_offsets(n_infos);
+  for (unsigned int i = 0; i < n_infos; ++i)
+    if (!reader.get(info_offsets[i])) return false;
+
+  uint32_t n_frames;
+  if (!reader.get(n_frames)) return false;
+
+  for (unsigned int i = 0; i < n_frames; ++i)
+  {
+    uint64_t offset;
+    uint32_t sec, nsec;
+    if (!reader.get(offset) || !reader.get(sec) || !reader.get(nsec))
+      return false;
+
+    frame_offsets_.push_back(offset);
+    frame_stamps_.push_back(ros::Time(sec, nsec));
+  }
+
+  // **** camera infos (few and small, read up front)
+
+  for (unsigned int i = 0; i < n_infos; ++i)
+  {
+    if (!readRecord(info_offsets[i], type) || type != RECORD_INFO)
+      return false;
+
+    CameraInfoMsg::Ptr info_msg(new CameraInfoMsg);
+    PayloadReader info_reader(record_);
+    if (!info_reader.getMsg(*info_msg)) return false;
+    infos_.push_back(info_msg);
+  }
+
+  return true;
+}
+
+bool RGBDRecordingReader::scanChunks()
+{
+  infos_.clear();
+  frame_offsets_.clear();
+  frame_stamps_.clear();
+
+  uint64_t chunk_offset = sizeof(RECORDING_MAGIC);
+  if (fseeko(file_, chunk_offset, SEEK_SET) != 0) return false;
+
+  // stops at the first incomplete chunk
+  uint32_t chunk_type;
+  std::vector<uint8_t> chunk;
+  while (readFramedRecord(file_, chunk_type, chunk) && chunk_type == CHUNK_DATA)
+  {
+    size_t pos = 0;
+    while (pos + RECORD_HEADER_SIZE <= chunk.size())
+    {
+      uint32_t type, size;
+      memcpy(&type, &chunk[pos], sizeof(type));
+      memcpy(&size, &chunk[pos + sizeof(type)], sizeof(size));
+
+      size_t begin = pos + RECORD_HEADER_SIZE;
+      if (begin + size > chunk.size()) return false;
+      record_.assign(chunk.begin() + begin, chunk.begin() + begin + size);
+
+      PayloadReader reader(record_);
+
+      if (type == RECORD_INFO)
+      {
+        CameraInfoMsg::Ptr info_msg(new CameraInfoMsg);
+        if (!reader.getMsg(*info_msg)) return false;
+        infos_.push_back(info_msg);
+      }
+      else if (type == RECORD_FRAME)
+      {
+        std_msgs::Header header;
+        if (!reader.getMsg(header)) return false;
+        frame_offsets_.push_back(chunk_offset + CHUNK_HEADER_SIZE + pos);
+        frame_stamps_.push_back(header.stamp);
+      }
+
+      pos = begin + size;
+    }
+
+    chunk_offset += CHUNK_HEADER_SIZE + chunk.size() + CHUNK_FOOTER_SIZE;
+  }
+
+  ROS_INFO("Recovered %d frames from the RGBD recording", 
+    (int)frame_offsets_.size());
+
+  return true;
+}
+
+bool RGBDRecordingReader::readRecord(uint64_t offset, uint32_t& type)
+{
+  uint32_t size;
+  if (fseeko(file_, offset, SEEK_SET) != 0 ||
+      fread(&type, sizeof(type), 1, file_) != 1 ||
+      fread(&size, sizeof(size), 1, file_) != 1)
+    return false;
+
+  const uint32_t max_size = 256 * 1024 * 1024;
+  if (size > max_size) return false;
+
+  record_.resize(size);
+  return size == 0 || fread(&record_[0], size, 1, file_) == 1;
+}
+
+} // namespace ccny_rgbd
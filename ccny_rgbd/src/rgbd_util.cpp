@@ -22,6 +22,7 @@
  */
 
 #include "ccny_rgbd/rgbd_util.h"
+#include "ccny_rgbd/depth_traits.h"
 
 namespace ccny_rgbd {
 
@@ -247,6 +248,25 @@ void convertMatToCameraInfo(
     camera_info_msg.P[j*4 + i] = intr.at<double>(j,i);
 }
 
+bool sameCameraCalibration(
+  const CameraInfoMsg& a,
+  const CameraInfoMsg& b)
+{
+  return 
+    a.width  == b.width  && 
+    a.height == b.height &&
+    a.distortion_model == b.distortion_model &&
+    a.D == b.D && a.K == b.K && a.R == b.R && a.P == b.P &&
+    a.binning_x == b.binning_x &&
+    a.binning_y == b.binning_y &&
+    a.roi.x_offset   == b.roi.x_offset   &&
+    a.roi.y_offset   == b.roi.y_offset   &&
+    a.roi.width      == b.roi.width      &&
+    a.roi.height     == b.roi.height     &&
+    a.roi.do_rectify == b.roi.do_rectify &&
+    a.header.frame_id == b.header.frame_id;
+}
+
 void transformMeans(
   Vector3fVector& means,
   const tf::Transform& transform)
@@ -305,7 +325,8 @@ void pointCloudFromMeans(
 }
 
 
-void buildPointCloud(
+template <typename DepthT>
+static void buildPointCloudT(
   const cv::Mat& depth_img_rect,
   const cv::Mat& intr_rect_ir,
   PointCloudT& cloud)
@@ -323,12 +344,12 @@ void buildPointCloud(
   for (int u = 0; u < w; ++u)
   for (int v = 0; v < h; ++v)
   {
-    uint16_t z = depth_img_rect.at<uint16_t>(v, u);   
+    DepthT z = depth_img_rect.at<DepthT>(v, u);   
     PointT& pt = cloud.points[v*w + u];
     
-    if (z != 0)
+    if (DepthTraits<DepthT>::valid(z))
     {  
-      double z_metric = z * 0.001;
+      double z_metric = DepthTraits<DepthT>::toMeters(z);
              
       pt.x = z_metric * ((u - cx) * fx_inv);
       pt.y = z_metric * ((v - cy) * fy_inv);
@@ -346,6 +367,18 @@ void buildPointCloud(
 }
 
 void buildPointCloud(
+  const cv::Mat& depth_img_rect,
+  const cv::Mat& intr_rect_ir,
+  PointCloudT& cloud)
+{
+  if (depth_img_rect.depth() == CV_32F)
+    buildPointCloudT<float>(depth_img_rect, intr_rect_ir, cloud);
+  else
+    buildPointCloudT<uint16_t>(depth_img_rect, intr_rect_ir, cloud);
+}
+
+template <typename DepthT>
+static void buildPointCloudT(
   const cv::Mat& depth_img_rect_reg,
   const cv::Mat& rgb_img_rect,
   const cv::Mat& intr_rect_rgb,
@@ -364,22 +397,19 @@ void buildPointCloud(
   for (int u = 0; u < w; ++u)
   for (int v = 0; v < h; ++v)
   {
-    uint16_t z = depth_img_rect_reg.at<uint16_t>(v, u);
-    const cv::Vec3b& c = rgb_img_rect.at<cv::Vec3b>(v, u);
+    DepthT z = depth_img_rect_reg.at<DepthT>(v, u);
     
     PointT& pt = cloud.points[v*w + u];
     
-    if (z != 0)
+    if (DepthTraits<DepthT>::valid(z))
     {  
-      double z_metric = z * 0.001;
+      double z_metric = DepthTraits<DepthT>::toMeters(z);
              
       pt.x = z_metric * ((u - cx) * fx_inv);
       pt.y = z_metric * ((v - cy) * fy_inv);
       pt.z = z_metric;
   
-      pt.r = c[2];
-      pt.g = c[1];
-      pt.b = c[0];
+      getPixelColor(rgb_img_rect, u, v, pt.r, pt.g, pt.b);
     }
     else
     {
@@ -392,6 +422,169 @@ void buildPointCloud(
   cloud.is_dense = true;
 }
 
+void buildPointCloud(
+  const cv::Mat& depth_img_rect_reg,
+  const cv::Mat& rgb_img_rect,
+  const cv::Mat& intr_rect_rgb,
+  PointCloudT& cloud)
+{
+  if (depth_img_rect_reg.depth() == CV_32F)
+    buildPointCloudT<float>(depth_img_rect_reg, rgb_img_rect, intr_rect_rgb, cloud);
+  else
+    buildPointCloudT<uint16_t>(depth_img_rect_reg, rgb_img_rect, intr_rect_rgb, cloud);
+}
+
+template <typename DepthT>
+static void buildPointCloud2T(
+  const cv::Mat& depth_img_rect_reg,
+  const cv::Mat& rgb_img_rect,
+  const cv::Mat& intr_rect_rgb,
+  PointCloud2Msg& cloud,
+  bool organized,
+  bool compact)
+{
+  int w = rgb_img_rect.cols;
+  int h = rgb_img_rect.rows;
+  
+  double cx = intr_rect_rgb.at<double>(0,2);
+  double cy = intr_rect_rgb.at<double>(1,2);
+  double fx_inv = 1.0 / intr_rect_rgb.at<double>(0,0);
+  double fy_inv = 1.0 / intr_rect_rgb.at<double>(1,1);
+
+  // **** fields
+  
+  uint8_t xyz_type = compact ? 
+    sensor_msgs::PointField::INT16 : sensor_msgs::PointField::FLOAT32;
+  int xyz_size = compact ? 2 : 4;
+
+  // the compact fields have their own names, so that consumers which
+  // expect x, y, z in meters don't misread them
+  const char* names_metric[4]  = { "x", "y", "z", "rgb" };
+  const char* names_compact[4] = { "x_mm", "y_mm", "z_mm", "rgb" };
+  const char** names = compact ? names_compact : names_metric;
+
+  cloud.fields.resize(4);
+  for (int f = 0; f < 4; ++f)
+  {
+    cloud.fields[f].name = names[f];
+    cloud.fields[f].offset = f * xyz_size;
+    cloud.fields[f].datatype = xyz_type;
+    cloud.fields[f].count = 1;
+  }
+  cloud.fields[3].datatype = sensor_msgs::PointField::FLOAT32;
+
+  cloud.point_step = 3 * xyz_size + 4;
+  cloud.is_bigendian = false;
+
+  // the buffer is sized for the organized case; the dense case shrinks it
+  // afterwards (which does not reallocate)
+  cloud.data.resize(w * h * cloud.point_step);
+  uint8_t* ptr = cloud.data.empty() ? NULL : &cloud.data[0];
+
+  // pre-compute the ray directions
+  std::vector<float> ray_x(w), ray_y(h);
+  for (int u = 0; u < w; ++u) ray_x[u] = (u - cx) * fx_inv;
+  for (int v = 0; v < h; ++v) ray_y[v] = (v - cy) * fy_inv;
+
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+
+  // mono images are stored as gray points
+  bool mono = rgb_img_rect.channels() == 1;
+
+  int n_points = 0;
+  for (int v = 0; v < h; ++v)
+  {
+    const DepthT* depth_row = depth_img_rect_reg.ptr<DepthT>(v);
+    const uint8_t* rgb_row = rgb_img_rect.ptr<uint8_t>(v);
+
+    for (int u = 0; u < w; ++u)
+    {
+      DepthT z = depth_row[u];
+      bool z_valid = DepthTraits<DepthT>::valid(z);
+      if (!z_valid && !organized) continue;
+
+      uint32_t rgb;
+      if (mono)
+      {
+        uint32_t c = rgb_row[u];
+        rgb = (c << 16) | (c << 8) | c;
+      }
+      else
+      {
+        const uint8_t* c = rgb_row + 3 * u;
+        rgb = ((uint32_t)c[2] << 16) | ((uint32_t)c[1] << 8) | (uint32_t)c[0];
+      }
+
+      if (compact)
+      {
+        int16_t xyz[3];
+        if (z_valid)
+        {
+          float z_mm = std::min(DepthTraits<DepthT>::toMillimeters(z),
+                                (float)std::numeric_limits<int16_t>::max());
+          xyz[0] = (int16_t)lrintf(z_mm * ray_x[u]);
+          xyz[1] = (int16_t)lrintf(z_mm * ray_y[v]);
+          xyz[2] = (int16_t)lrintf(z_mm);
+        }
+        else
+          xyz[0] = xyz[1] = xyz[2] = 0;
+        memcpy(ptr, xyz, sizeof(xyz));
+        memcpy(ptr + sizeof(xyz), &rgb, sizeof(rgb));
+      }
+      else
+      {
+        float xyz[3];
+        if (z_valid)
+        {
+          float z_metric = DepthTraits<DepthT>::toMeters(z);
+          xyz[0] = z_metric * ray_x[u];
+          xyz[1] = z_metric * ray_y[v];
+          xyz[2] = z_metric;
+        }
+        else
+          xyz[0] = xyz[1] = xyz[2] = nan;
+        memcpy(ptr, xyz, sizeof(xyz));
+        memcpy(ptr + sizeof(xyz), &rgb, sizeof(rgb));
+      }
+
+      ptr += cloud.point_step;
+      ++n_points;
+    }
+  }
+
+  if (organized)
+  {
+    cloud.width = w;
+    cloud.height = h;
+    cloud.is_dense = false;
+  }
+  else
+  {
+    cloud.width = n_points;
+    cloud.height = 1;
+    cloud.is_dense = true;
+    cloud.data.resize(n_points * cloud.point_step);
+  }
+
+  cloud.row_step = cloud.width * cloud.point_step;
+}
+
+void buildPointCloud2(
+  const cv::Mat& depth_img_rect_reg,
+  const cv::Mat& rgb_img_rect,
+  const cv::Mat& intr_rect_rgb,
+  PointCloud2Msg& cloud,
+  bool organized,
+  bool compact)
+{
+  if (depth_img_rect_reg.depth() == CV_32F)
+    buildPointCloud2T<float>(
+      depth_img_rect_reg, rgb_img_rect, intr_rect_rgb, cloud, organized, compact);
+  else
+    buildPointCloud2T<uint16_t>(
+      depth_img_rect_reg, rgb_img_rect, intr_rect_rgb, cloud, organized, compact);
+}
+
 void buildRegisteredDepthImage(
   const cv::Mat& intr_rect_ir,
   const cv::Mat& intr_rect_rgb,
@@ -479,4 +672,300 @@ void depthImageFloatTo16bit(
   depth_image_in.convertTo(depth_image_out, CV_16UC1, 1000.0);
 }
 
+void depthImage16bitToFloat(
+  const cv::Mat& depth_image_in,
+  cv::Mat& depth_image_out)
+{
+  depth_image_in.convertTo(depth_image_out, CV_32FC1, 0.001);
+  depth_image_out.setTo(
+    std::numeric_limits<float>::quiet_NaN(), depth_image_in == 0);
+}
+
+void SymmetricMatrix3fBatch::resize(unsigned int size)
+{
+  xx.resize(size);
+  xy.resize(size);
+  xz.resize(size);
+  yy.resize(size);
+  yz.resize(size);
+  zz.resize(size);
+}
+
+void SymmetricMatrix3fBatch::assign(const Matrix3fVector& matrices)
+{
+  unsigned int size = matrices.size();
+  resize(size);
+
+  for (unsigned int i = 0; i < size; ++i)
+  {
+    const Matrix3f& m = matrices[i];
+    xx[i] = m(0,0);
+    xy[i] = m(0,1);
+    xz[i] = m(0,2);
+    yy[i] = m(1,1);
+    yz[i] = m(1,2);
+    zz[i] = m(2,2);
+  }
+}
+
+static inline void cross3(const double* u, const double* v, double* w)
+{
+  w[0] = u[1]*v[2] - u[2]*v[1];
+  w[1] = u[2]*v[0] - u[0]*v[2];
+  w[2] = u[0]*v[1] - u[1]*v[0];
+}
+
+static inline double dot3(const double* u, const double* v)
+{
+  return u[0]*v[0] + u[1]*v[1] + u[2]*v[2];
+}
+
+// a = {a00, a01, a02, a11, a12, a22}. Finds the eigenvector of a
+// simple eigenvalue as the largest cross product of two rows of (A - eval*I)
+static void eigenvectorFromRows(const double* a, double eval, double* evec)
+{
+  double r0[3] = { a[0] - eval, a[1], a[2] };
+  double r1[3] = { a[1], a[3] - eval, a[4] };
+  double r2[3] = { a[2], a[4], a[5] - eval };
+
+  double c[3][3];
+  cross3(r0, r1, c[0]);
+  cross3(r0, r2, c[1]);
+  cross3(r1, r2, c[2]);
+
+  int best = 0;
+  double best_d = dot3(c[0], c[0]);
+  for (int k = 1; k < 3; ++k)
+  {
+    double d = dot3(c[k], c[k]);
+    if (d > best_d) { best_d = d; best = k; }
+  }
+
+  if (best_d > 0.0)
+  {
+    double inv = 1.0 / sqrt(best_d);
+    evec[0] = c[best][0] * inv;
+    evec[1] = c[best][1] * inv;
+    evec[2] = c[best][2] * inv;
+  }
+  else
+  {
+    evec[0] = 1.0; evec[1] = 0.0; evec[2] = 0.0;
+  }
+}
+
+// Finds the eigenvector of eval, which lies in the plane orthogonal
+// to the (already known) unit eigenvector w
+static void eigenvectorInPlane(
+  const double* a, const double* w, double eval, double* evec)
+{
+  // orthonormal basis {u, v} of the plane orthogonal to w
+  double u[3], v[3];
+  if (fabs(w[0]) > fabs(w[1]))
+  {
+    double inv = 1.0 / sqrt(w[0]*w[0] + w[2]*w[2]);
+    u[0] = -w[2]*inv; u[1] = 0.0; u[2] = w[0]*inv;
+  }
+  else
+  {
+    double inv = 1.0 / sqrt(w[1]*w[1] + w[2]*w[2]);
+    u[0] = 0.0; u[1] = w[2]*inv; u[2] = -w[1]*inv;
+  }
+  cross3(w, u, v);
+
+  double au[3] = {
+    a[0]*u[0] + a[1]*u[1] + a[2]*u[2],
+    a[1]*u[0] + a[3]*u[1] + a[4]*u[2],
+    a[2]*u[0] + a[4]*u[1] + a[5]*u[2] };
+  double av[3] = {
+    a[0]*v[0] + a[1]*v[1] + a[2]*v[2],
+    a[1]*v[0] + a[3]*v[1] + a[4]*v[2],
+    a[2]*v[0] + a[4]*v[1] + a[5]*v[2] };
+
+  // 2x2 system in the {u, v} basis
+  double m00 = dot3(u, au) - eval;
+  double m01 = dot3(u, av);
+  double m11 = dot3(v, av) - eval;
+
+  double abs00 = fabs(m00);
+  double abs01 = fabs(m01);
+  double abs11 = fabs(m11);
+
+  double cu = 1.0, cv = 0.0;
+  if (abs00 >= abs11)
+  {
+    if (std::max(abs00, abs01) > 0.0)
+    {
+      if (abs00 >= abs01)
+      {
+        m01 /= m00; m00 = 1.0 / sqrt(1.0 + m01*m01); m01 *= m00;
+      }
+      else
+      {
+        m00 /= m01; m01 = 1.0 / sqrt(1.0 + m00*m00); m00 *= m01;
+      }
+      cu = m01; cv = -m00;
+    }
+  }
+  else
+  {
+    if (std::max(abs11, abs01) > 0.0)
+    {
+      if (abs11 >= abs01)
+      {
+        m01 /= m11; m11 = 1.0 / sqrt(1.0 + m01*m01); m01 *= m11;
+      }
+      else
+      {
+        m11 /= m01; m01 = 1.0 / sqrt(1.0 + m11*m11); m11 *= m01;
+      }
+      cu = m11; cv = -m01;
+    }
+  }
+
+  evec[0] = cu*u[0] + cv*v[0];
+  evec[1] = cu*u[1] + cv*v[1];
+  evec[2] = cu*u[2] + cv*v[2];
+}
+
+// a = {a00, a01, a02, a11, a12, a22}
+// evals in descending order, evecs[k] is the eigenvector of evals[k]
+static void eigenSymmetric3x3(const double* a_in, double* evals, double evecs[3][3])
+{
+  // scale to [-1, 1] to avoid overflow
+  double max_abs = 0.0;
+  for (int k = 0; k < 6; ++k)
+    max_abs = std::max(max_abs, fabs(a_in[k]));
+
+  if (max_abs == 0.0)
+  {
+    for (int k = 0; k < 3; ++k)
+    {
+      evals[k] = 0.0;
+      for (int j = 0; j < 3; ++j) evecs[k][j] = (k == j) ? 1.0 : 0.0;
+    }
+    return;
+  }
+
+  double inv_max = 1.0 / max_abs;
+  double a[6];
+  for (int k = 0; k < 6; ++k)
+    a[k] = a_in[k] * inv_max;
+
+  double off = a[1]*a[1] + a[2]*a[2] + a[4]*a[4];
+
+  // ascending order
+  double e[3];
+  double v[3][3];
+
+  if (off > 0.0)
+  {
+    double q = (a[0] + a[3] + a[5]) / 3.0;
+    double b00 = a[0] - q;
+    double b11 = a[3] - q;
+    double b22 = a[5] - q;
+    double p = sqrt((b00*b00 + b11*b11 + b22*b22 + 2.0*off) / 6.0);
+
+    double c00 = b11*b22 - a[4]*a[4];
+    double c01 = a[1]*b22 - a[4]*a[2];
+    double c02 = a[1]*a[4] - b11*a[2];
+    double half_det = 0.5 * (b00*c00 - a[1]*c01 + a[2]*c02) / (p*p*p);
+    half_det = std::min(1.0, std::max(-1.0, half_det));
+
+    double angle = acos(half_det) / 3.0;
+    double beta2 = 2.0 * cos(angle);
+    double beta0 = 2.0 * cos(angle + 2.0 * M_PI / 3.0);
+    double beta1 = -(beta0 + beta2);
+
+    e[0] = q + p*beta0;
+    e[1] = q + p*beta1;
+    e[2] = q + p*beta2;
+
+    // start from the eigenvalue furthest from the other two,
+    // which is the best separated one
+    if (half_det >= 0.0)
+    {
+      eigenvectorFromRows(a, e[2], v[2]);
+      eigenvectorInPlane(a, v[2], e[1], v[1]);
+      cross3(v[1], v[2], v[0]);
+    }
+    else
+    {
+      eigenvectorFromRows(a, e[0], v[0]);
+      eigenvectorInPlane(a, v[0], e[1], v[1]);
+      cross3(v[0], v[1], v[2]);
+    }
+  }
+  else
+  {
+    // diagonal matrix
+    int idx[3] = { 0, 1, 2 };
+    double d[3] = { a[0], a[3], a[5] };
+    if (d[idx[0]] > d[idx[1]]) std::swap(idx[0], idx[1]);
+    if (d[idx[1]] > d[idx[2]]) std::swap(idx[1], idx[2]);
+    if (d[idx[0]] > d[idx[1]]) std::swap(idx[0], idx[1]);
+
+    for (int k = 0; k < 3; ++k)
+    {
+      e[k] = d[idx[k]];
+      for (int j = 0; j < 3; ++j) v[k][j] = (j == idx[k]) ? 1.0 : 0.0;
+    }
+  }
+
+  // reverse to descending order and undo the scaling
+  for (int k = 0; k < 3; ++k)
+  {
+    evals[k] = e[2-k] * max_abs;
+    for (int j = 0; j < 3; ++j) evecs[k][j] = v[2-k][j];
+  }
+}
+
+void eigenSymmetric3x3(
+  const Matrix3f& m,
+  Vector3f& eigenvalues,
+  Matrix3f& eigenvectors)
+{
+  double a[6] = { m(0,0), m(0,1), m(0,2), m(1,1), m(1,2), m(2,2) };
+  double evals[3];
+  double evecs[3][3];
+
+  eigenSymmetric3x3(a, evals, evecs);
+
+  for (int k = 0; k < 3; ++k)
+  {
+    eigenvalues(k) = evals[k];
+    for (int j = 0; j < 3; ++j)
+      eigenvectors(k,j) = evecs[k][j];
+  }
+}
+
+void eigenSymmetric3x3(
+  const SymmetricMatrix3fBatch& batch,
+  Vector3fVector& eigenvalues,
+  Matrix3fVector& eigenvectors)
+{
+  unsigned int size = batch.size();
+  eigenvalues.resize(size);
+  eigenvectors.resize(size);
+
+  for (unsigned int i = 0; i < size; ++i)
+  {
+    double a[6] = { batch.xx[i], batch.xy[i], batch.xz[i],
+                    batch.yy[i], batch.yz[i], batch.zz[i] };
+    double evals[3];
+    double evecs[3][3];
+
+    eigenSymmetric3x3(a, evals, evecs);
+
+    Vector3f& evl = eigenvalues[i];
+    Matrix3f& evt = eigenvectors[i];
+    for (int k = 0; k < 3; ++k)
+    {
+      evl(k) = evals[k];
+      for (int j = 0; j < 3; ++j)
+        evt(k,j) = evecs[k][j];
+    }
+  }
+}
+
 } //namespace ccny_rgbd
@@ -0,0 +1,295 @@
+/**
+ *  @file rvl_codec.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/rvl_codec.h"
+
+#include <fstream>
+#include <cstring>
+
+#include "ccny_rgbd/rgbd_util.h"
+
+namespace ccny_rgbd {
+
+// The compressed data is a header of two uint32 (cols, rows), followed
+// by 32-bit words of packed 4-bit nibbles, most significant nibble first.
+// Each value is coded in groups of 3 bits, least significant group
+// first; the 4th bit of a nibble is set if more groups follow.
+
+static const size_t RVL_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+/** @brief Largest accepted image width or height, well above any 
+ * depth sensor. All-invalid images code to a few bytes, so the payload 
+ * size alone can't bound the image size.
+ */
+static const uint32_t RVL_MAX_SIZE = 16384;
+
+/** @brief Packs variable-length values into 32-bit words */
+class NibbleWriter
+{
+  public:
+
+    NibbleWriter(uint32_t* out): out_(out), begin_(out), word_(0), n_(0) { }
+
+    inline void put(uint32_t value)
+    {
+      do
+      {
+        uint32_t nibble = value & 0x7;
+        value >>= 3;
+        if (value) nibble |= 0x8;
+
+        word_ = (word_ << 4) | nibble;
+        if (++n_ == 8)
+        {
+          *out_++ = word_;
+          word_ = 0;
+          n_ = 0;
+        }
+      }
+      while (value);
+    }
+
+    /** @brief Writes out the last, partial word
+     * @return the number of words written
+     */
+    size_t finish()
+    {
+      if (n_) *out_++ = word_ << (4 * (8 - n_));
+      return out_ - begin_;
+    }
+
+  private:
+
+    uint32_t* out_;
+    uint32_t* begin_;
+    uint32_t word_;
+    int n_;
+};
+
+/** @brief Unpacks variable-length values from 32-bit words */
+class NibbleReader
+{
+  public:
+
+    NibbleReader(const uint32_t* in, const uint32_t* end):
+      in_(in), end_(end), word_(0), n_(0) { }
+
+    inline bool get(uint32_t& value)
+    {
+      value = 0;
+      int shift = 0;
+      uint32_t nibble;
+
+      do
+      {
+        if (n_ == 0)
+        {
+          if (in_ == end_) return false;
+          word_ = *in_++;
+          n_ = 8;
+        }
+
+        nibble = word_ >> 28;
+        word_ <<= 4;
+        --n_;
+
+        value |= (nibble & 0x7) << shift;
+        shift += 3;
+      }
+      while ((nibble & 0x8) && shift < 32);
+
+      return true;
+    }
+
+  private:
+
+    const uint32_t* in_;
+    const uint32_t* end_;
+    uint32_t word_;
+    int n_;
+};
+
+void compressDepthRVL(
+  const cv::Mat& depth_img,
+  std::vector<uint8_t>& buffer)
+{
+  cv::Mat depth_img_16;
+  if (depth_img.depth() == CV_32F)
+    depthImageFloatTo16bit(depth_img, depth_img_16);
+  else if (depth_img.isContinuous())
+    depth_img_16 = depth_img;
+  else
+    depth_img_16 = depth_img.clone();
+
+  const uint16_t* in  = depth_img_16.ptr<uint16_t>();
+  const uint16_t* end = in + depth_img_16.total();
+
+  // worst case: a pixel costs at most 8 nibbles (one word)
+  size_t max_words = depth_img_16.total() + 4;
+  buffer.resize(RVL_HEADER_SIZE + max_words * sizeof(uint32_t));
+
+  uint32_t header[2] = { depth_img_16.cols, depth_img_16.rows };
+  memcpy(&buffer[0], header, RVL_HEADER_SIZE);
+
+  NibbleWriter writer((uint32_t*)&buffer[RVL_HEADER_SIZE]);
+
+  int previous = 0;
+  while (in != end)
+  {
+    // run of invalid pixels
+    const uint16_t* run = in;
+    while (in != end && *in == 0) ++in;
+    writer.put(in - run);
+
+    // run of valid pixels
+    run = in;
+    while (in != end && *in != 0) ++in;
+    writer.put(in - run);
+
+    // zig-zag deltas of the valid pixels
+    for (; run != in; ++run)
+    {
+      int current = *run;
+      int delta = current - previous;
+      writer.put(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+      previous = current;
+    }
+  }
+
+  size_t n_words = writer.finish();
+  buffer.resize(RVL_HEADER_SIZE + n_words * sizeof(uint32_t));
+}
+
+bool decompressDepthRVL(
+  const uint8_t* data,
+  size_t size,
+  cv::Mat& depth_img)
+{
+  if (size < RVL_HEADER_SIZE) return false;
+
+  uint32_t header[2];
+  memcpy(header, data, RVL_HEADER_SIZE);
+  if (header[0] > RVL_MAX_SIZE || header[1] > RVL_MAX_SIZE) return false;
+  int cols = header[0];
+  int rows = header[1];
+
+  // the words are read in place; the buffer is word-aligned in practice,
+  // otherwise it is copied once
+  size_t n_words = (size - RVL_HEADER_SIZE) / sizeof(uint32_t);
+  const uint8_t* words = data + RVL_HEADER_SIZE;
+  std::vector<uint32_t> aligned;
+  if (((size_t)words) % sizeof(uint32_t) != 0)
+  {
+    aligned.resize(n_words);
+    if (n_words > 0) memcpy(&aligned[0], words, n_words * sizeof(uint32_t));
+    words = (const uint8_t*)(aligned.empty() ? NULL : &aligned[0]);
+  }
+
+  // **** check that the payload codes exactly rows * cols pixels,
+  // before allocating the image
+
+  uint32_t n_pixels = rows * cols;
+  uint32_t n_coded = 0;
+
+  NibbleReader checker((const uint32_t*)words, (const uint32_t*)words + n_words);
+  while (n_coded != n_pixels)
+  {
+    uint32_t zeros, nonzeros, value;
+
+    if (!checker.get(zeros) || zeros > n_pixels - n_coded) return false;
+    n_coded += zeros;
+
+    if (!checker.get(nonzeros) || nonzeros > n_pixels - n_coded) return false;
+    n_coded += nonzeros;
+
+    for (uint32_t i = 0; i < nonzeros; ++i)
+      if (!checker.get(value)) return false;
+  }
+
+  // **** decode
+
+  depth_img.create(rows, cols, CV_16UC1);
+
+  NibbleReader reader((const uint32_t*)words, (const uint32_t*)words + n_words);
+
+  uint16_t* out = depth_img.ptr<uint16_t>();
+  uint16_t* end = out + depth_img.total();
+
+  int previous = 0;
+  while (out != end)
+  {
+    uint32_t zeros, nonzeros;
+
+    if (!reader.get(zeros) || zeros > (uint32_t)(end - out)) return false;
+    memset(out, 0, zeros * sizeof(uint16_t));
+    out += zeros;
+
+    if (!reader.get(nonzeros) || nonzeros > (uint32_t)(end - out)) return false;
+    for (uint16_t* run_end = out + nonzeros; out != run_end; ++out)
+    {
+      uint32_t positive;
+      if (!reader.get(positive)) return false;
+
+      int delta = (int)(positive >> 1) ^ -(int)(positive & 1);
+      int current = previous + delta;
+      *out = current;
+      previous = current;
+    }
+  }
+
+  return true;
+}
+
+bool saveDepthRVL(
+  const std::string& filename,
+  const cv::Mat& depth_img)
+{
+  std::vector<uint8_t> buffer;
+  compressDepthRVL(depth_img, buffer);
+
+  std::ofstream file(filename.c_str(), std::ios::binary);
+  file.write((const char*)&buffer[0], buffer.size());
+  return file.good();
+}
+
+bool loadDepthRVL(
+  const std::string& filename,
+  cv::Mat& depth_img)
+{
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  if (!file.is_open()) return false;
+
+  file.seekg(0, std::ios::end);
+  std::streamoff size = file.tellg();
+  file.seekg(0, std::ios::beg);
+  if (size <= 0) return false;
+
+  // word-sized storage keeps the data aligned for the decoder
+  std::vector<uint32_t> buffer((size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+  file.read((char*)&buffer[0], size);
+  if (!file) return false;
+
+  return decompressDepthRVL((const uint8_t*)&buffer[0], size, depth_img);
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,134 @@
+/**
+ *  @file keyframe_association.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/structures/keyframe_association.h"
+
+#include <boost/filesystem.hpp>
+#include <ros/ros.h>
+
+#include "ccny_rgbd/rgbd_util.h"
+
+namespace ccny_rgbd {
+
+bool saveKeyframeAssociations(
+  const KeyframeAssociationVector& associations,
+  const std::string& filename,
+  const std::string& descriptor_version)
+{
+  cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+  if (!fs.isOpened()) return false;
+
+  fs << "descriptor_version" << descriptor_version;
+  fs << "associations" << "[";
+
+  for (unsigned int as_idx = 0; as_idx < associations.size(); ++as_idx)
+  {
+    const KeyframeAssociation& association = associations[as_idx];
+
+    // a2b as OpenCV rmat and tvec
+    cv::Mat rmat, tvec;
+    tfToOpenCVRt(association.a2b, rmat, tvec);
+
+    fs << "{";
+    fs << "type"     << (int)association.type;
+    fs << "kf_idx_a" << association.kf_idx_a;
+    fs << "kf_idx_b" << association.kf_idx_b;
+    fs << "rmat"     << rmat;
+    fs << "tvec"     << tvec;
+
+    // inlier matches, one row each: query, train, image, distance
+    if (!association.matches.empty())
+    {
+      cv::Mat matches(association.matches.size(), 4, CV_64F);
+      for (unsigned int m_idx = 0; m_idx < association.matches.size(); ++m_idx)
+      {
+        const cv::DMatch& match = association.matches[m_idx];
+        matches.at<double>(m_idx, 0) = match.queryIdx;
+        matches.at<double>(m_idx, 1) = match.trainIdx;
+        matches.at<double>(m_idx, 2) = match.imgIdx;
+        matches.at<double>(m_idx, 3) = match.distance;
+      }
+      fs << "matches" << matches;
+    }
+
+    fs << "}";
+  }
+
+  fs << "]";
+  return true;
+}
+
+bool loadKeyframeAssociations(
+  KeyframeAssociationVector& associations,
+  const std::string& filename,
+  std::string& descriptor_version)
+{
+  associations.clear();
+
+  if (!boost::filesystem::exists(filename))
+  {
+    ROS_ERROR("file for loading associations not found");
+    return false;
+  }
+
+  cv::FileStorage fs(filename, cv::FileStorage::READ);
+  if (!fs.isOpened()) return false;
+
+  fs["descriptor_version"] >> descriptor_version;
+
+  cv::FileNode node = fs["associations"];
+  for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it)
+  {
+    KeyframeAssociation association;
+
+    int type;
+    (*it)["type"]     >> type;
+    (*it)["kf_idx_a"] >> association.kf_idx_a;
+    (*it)["kf_idx_b"] >> association.kf_idx_b;
+    association.type = (KeyframeAssociation::Type)type;
+
+    cv::Mat rmat, tvec;
+    (*it)["rmat"] >> rmat;
+    (*it)["tvec"] >> tvec;
+    openCVRtToTf(rmat, tvec, association.a2b);
+
+    cv::Mat matches;
+    if (!(*it)["matches"].empty()) (*it)["matches"] >> matches;
+    
+    association.matches.resize(matches.rows);
+    for (int m_idx = 0; m_idx < matches.rows; ++m_idx)
+    {
+      cv::DMatch& match = association.matches[m_idx];
+      match.queryIdx = (int)matches.at<double>(m_idx, 0);
+      match.trainIdx = (int)matches.at<double>(m_idx, 1);
+      match.imgIdx   = (int)matches.at<double>(m_idx, 2);
+      match.distance = (float)matches.at<double>(m_idx, 3);
+    }
+
+    associations.push_back(association);
+  }
+
+  return true;
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,592 @@
+/**
+ *  @file keyframe_journal.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ *
+ *  @section LICENSE
+ *
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/structures/keyframe_journal.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include "ccny_rgbd/payload.h"
+#include "ccny_rgbd/rvl_codec.h"
+
+namespace ccny_rgbd {
+
+// **** file format helpers
+
+// version 2: images are stored compressed (see ImageCodec)
+static const char JOURNAL_MAGIC[8] = { 'C','C','N','Y','K','F','J','2' };
+
+/** @brief How an image is stored in a keyframe record */
+enum ImageCodec 
+{ 
+  IMAGE_RAW = 0,  ///< raw matrix data
+  IMAGE_PNG = 1,  ///< PNG (rgb and mono images)
+  IMAGE_RVL = 2   ///< RVL (depth images), followed by a 32FC1 flag
+};
+
+static bool readMagic(FILE * file)
+{
+  char magic[sizeof(JOURNAL_MAGIC)];
+  return fread(magic, sizeof(magic), 1, file) == 1 &&
+         memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) == 0;
+}
+
+static void putImage(
+  PayloadWriter& writer, 
+  const cv::Mat& img, 
+  ImageCodec codec,
+  std::vector<uint8_t>& data)
+{
+  if (codec == IMAGE_RVL)
+  {
+    // 32FC1 depth is stored in mm, as in the keyframe directories
+    compressDepthRVL(img, data);
+    writer.put<uint8_t>(IMAGE_RVL);
+    writer.put<uint8_t>(img.depth() == CV_32F);
+    writer.putBlob(data);
+    return;
+  }
+
+  if (codec == IMAGE_PNG && !img.empty())
+  {
+    // fast, light compression: the I/O thread has to keep up
+    std::vector<int> params(2);
+    params[0] = CV_IMWRITE_PNG_COMPRESSION;
+    params[1] = 1;
+    if (cv::imencode(".png", img, data, params))
+    {
+      writer.put<uint8_t>(IMAGE_PNG);
+      writer.putBlob(data);
+      return;
+    }
+  }
+
+  writer.put<uint8_t>(IMAGE_RAW);
+  writer.putMat(img);
+}
+
+static bool getImage(PayloadReader& reader, cv::Mat& img)
+{
+  uint8_t codec;
+  if (!reader.get(codec)) return false;
+
+  if (codec == IMAGE_RAW) return reader.getMat(img);
+
+  std::vector<uint8_t> data;
+
+  if (codec == IMAGE_PNG)
+  {
+    if (!reader.getBlob(data) || data.empty()) return false;
+    // unchanged, to keep mono keyframes mono
+    img = cv::imdecode(data, -1);
+    return !img.empty();
+  }
+
+  if (codec == IMAGE_RVL)
+  {
+    uint8_t is_float;
+    cv::Mat img_16;
+    if (!reader.get(is_float) || !reader.getBlob(data) || data.empty() ||
+        !decompressDepthRVL(&data[0], data.size(), img_16))
+      return false;
+
+    if (is_float) depthImage16bitToFloat(img_16, img);
+    else img = img_16;
+    return true;
+  }
+
+  return false;
+}
+
+static void serializeKeyframe(
+  const RGBDKeyframe& keyframe, 
+  std::vector<uint8_t>& buffer,
+  std::vector<uint8_t>& image_buffer)
+{
+  PayloadWriter writer(buffer);
+  writer.putMsg(keyframe.header);
+  writer.putMsg(keyframe.model.cameraInfo());
+  writer.putTransform(keyframe.pose);
+  writer.put<uint8_t>(keyframe.manually_added);
+  writer.put(keyframe.path_length_linear);
+  writer.put(keyframe.path_length_angular);
+  putImage(writer, keyframe.rgb_img,   IMAGE_PNG, image_buffer);
+  putImage(writer, keyframe.depth_img, IMAGE_RVL, image_buffer);
+}
+
+static bool deserializeKeyframe(const std::vector<uint8_t>& buffer, RGBDKeyframe& keyframe)
+{
+  PayloadReader reader(buffer);
+
+  CameraInfoMsg info_msg;
+  uint8_t manually_added;
+
+  bool result =
+    reader.getMsg(keyframe.header) &&
+    reader.getMsg(info_msg) &&
+    reader.getTransform(keyframe.pose) &&
+    reader.get(manually_added) &&
+    reader.get(keyframe.path_length_linear) &&
+    reader.get(keyframe.path_length_angular) &&
+    getImage(reader, keyframe.rgb_img) &&
+    getImage(reader, keyframe.depth_img);
+
+  if (!result) return false;
+
+  keyframe.manually_added = manually_added;
+  keyframe.model.fromCameraInfo(info_msg);
+  return true;
+}
+
+static void serializePoses(const std::vector<tf::Transform>& poses, std::vector<uint8_t>& buffer)
+{
+  PayloadWriter writer(buffer);
+  writer.put<uint32_t>(poses.size());
+  for (unsigned int i = 0; i < poses.size(); ++i)
+    writer.putTransform(poses[i]);
+}
+
+static bool deserializePoses(const std::vector<uint8_t>& buffer, std::vector<tf::Transform>& poses)
+{
+  PayloadReader reader(buffer);
+  uint32_t size;
+  if (!reader.get(size)) return false;
+
+  // check the size against the payload before allocating
+  if (size > buffer.size() / (7 * sizeof(double))) return false;
+
+  poses.resize(size);
+  for (unsigned int i = 0; i < size; ++i)
+    if (!reader.getTransform(poses[i])) return false;
+  return true;
+}
+
+// **** KeyframeJournal
+
+KeyframeJournal::KeyframeJournal(unsigned int max_queue_size):
+  max_queue_size_(std::max(max_queue_size, 1u)),
+  file_(NULL),
+  running_(false),
+  writing_(false)
+{
+
+}
+
+KeyframeJournal::~KeyframeJournal()
+{
+  close();
+}
+
+bool KeyframeJournal::open(const std::string& filename)
+{
+  close();
+
+  // **** check an existing journal, and cut off an incomplete last record
+
+  if (boost::filesystem::exists(filename) && boost::filesystem::file_size(filename) > 0)
+  {
+    FILE * file = fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+      ROS_ERROR("Could not open keyframe journal %s", filename.c_str());
+      return false;
+    }
+
+    if (!readMagic(file))
+    {
+      ROS_ERROR("%s is not a keyframe journal", filename.c_str());
+      fclose(file);
+      return false;
+    }
+
+    long valid_end = ftell(file);
+    uint32_t type;
+    std::vector<uint8_t> payload;
+    while (readFramedRecord(file, type, payload)) valid_end = ftell(file);
+    fclose(file);
+
+    if ((uintmax_t)valid_end < boost::filesystem::file_size(filename))
+    {
+      ROS_WARN("Truncating incomplete record at the end of %s", filename.c_str());
+      boost::filesystem::resize_file(filename, valid_end);
+    }
+
+    file_ = fopen(filename.c_str(), "ab");
+  }
+  else
+  {
+    file_ = fopen(filename.c_str(), "wb");
+    if (file_ && fwrite(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 1, file_) != 1)
+    {
+      fclose(file_);
+      file_ = NULL;
+    }
+  }
+
+  if (!file_)
+  {
+    ROS_ERROR("Could not open keyframe journal %s", filename.c_str());
+    return false;
+  }
+
+  fflush(file_);
+  filename_ = filename;
+
+  running_ = true;
+  thread_ = boost::thread(&KeyframeJournal::spin, this);
+  return true;
+}
+
+void KeyframeJournal::close()
+{
+  if (!file_) return;
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    running_ = false;
+  }
+  cond_.notify_all();
+  thread_.join();
+
+  fclose(file_);
+  file_ = NULL;
+}
+
+void KeyframeJournal::addKeyframe(const RGBDKeyframe& keyframe)
+{
+  Record record;
+  record.type = RECORD_KEYFRAME;
+
+  // shallow copy of the data which is journaled
+  record.keyframe.reset(new RGBDKeyframe());
+  record.keyframe->header              = keyframe.header;
+  record.keyframe->model               = keyframe.model;
+  record.keyframe->pose                = keyframe.pose;
+  record.keyframe->manually_added      = keyframe.manually_added;
+  record.keyframe->path_length_linear  = keyframe.path_length_linear;
+  record.keyframe->path_length_angular = keyframe.path_length_angular;
+  record.keyframe->rgb_img             = keyframe.rgb_img;
+  record.keyframe->depth_img           = keyframe.depth_img;
+
+  enqueue(record);
+}
+
+void KeyframeJournal::updatePoses(const KeyframeVector& keyframes)
+{
+  Record record;
+  record.type = RECORD_POSES;
+  record.poses.resize(keyframes.size());
+  for (unsigned int kf_idx = 0; kf_idx < keyframes.size(); ++kf_idx)
+    record.poses[kf_idx] = keyframes[kf_idx].pose;
+
+  enqueue(record);
+}
+
+void KeyframeJournal::reset(const KeyframeVector& keyframes)
+{
+  Record record;
+  record.type = RECORD_RESET;
+  enqueue(record);
+
+  for (unsigned int kf_idx = 0; kf_idx < keyframes.size(); ++kf_idx)
+    addKeyframe(keyframes[kf_idx]);
+}
+
+void KeyframeJournal::enqueue(const Record& record)
+{
+  if (!file_) return;
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (queue_.size() >= max_queue_size_)
+    {
+      ROS_WARN("Keyframe journal queue is full, waiting for the disk");
+      while (queue_.size() >= max_queue_size_) cond_.wait(lock);
+    }
+
+    queue_.push_back(record);
+  }
+
+  cond_.notify_all();
+}
+
+void KeyframeJournal::flush()
+{
+  if (!file_) return;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  while (!queue_.empty() || writing_) cond_.wait(lock);
+}
+
+void KeyframeJournal::spin()
+{
+  while(true)
+  {
+    Record record;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (running_ && queue_.empty()) cond_.wait(lock);
+
+      // the queue is written out before stopping
+      if (queue_.empty()) return;
+
+      record = queue_.front();
+      queue_.pop_front();
+      writing_ = true;
+    }
+
+    // wake up callers waiting for space in the queue
+    cond_.notify_all();
+
+    if (!writeRecord(record))
+      ROS_ERROR("Error writing to keyframe journal %s", filename_.c_str());
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      writing_ = false;
+    }
+
+    // wake up callers waiting in flush()
+    cond_.notify_all();
+  }
+}
+
+bool KeyframeJournal::writeRecord(const Record& record)
+{
+  switch(record.type)
+  {
+    case RECORD_KEYFRAME: serializeKeyframe(*record.keyframe, buffer_, image_buffer_); break;
+    case RECORD_POSES:    serializePoses(record.poses, buffer_);        break;
+    case RECORD_RESET:    buffer_.clear();                              break;
+  }
+
+  bool result = writeFramedRecord(file_, record.type, buffer_);
+  return fflush(file_) == 0 && result;
+}
+
+bool KeyframeJournal::compact(
+  const std::string& filename,
+  const KeyframeVector& keyframes)
+{
+  if (!file_) return false;
+
+  // **** snapshot the end of the journal, once the queue is written out.
+  // The records up to there are complete, so they are copied without
+  // holding the lock, while new records keep being appended.
+
+  long end;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!queue_.empty() || writing_) cond_.wait(lock);
+
+    fseek(file_, 0, SEEK_END);
+    end = ftell(file_);
+  }
+
+  FILE * src = fopen(filename_.c_str(), "rb");
+  if (!src || !readMagic(src))
+  {
+    if (src) fclose(src);
+    return false;
+  }
+
+  // **** pass 1: find the start of the current session (the last reset)
+
+  long start = findLastReset(src, ftell(src), end);
+
+  // **** pass 2: copy the keyframe records of the session
+
+  std::string tmp_filename = filename + ".tmp";
+  FILE * dst = fopen(tmp_filename.c_str(), "wb");
+  if (!dst)
+  {
+    fclose(src);
+    return false;
+  }
+
+  bool result = fwrite(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 1, dst) == 1;
+
+  fseek(src, start, SEEK_SET);
+  if (result) result = copyKeyframeRecords(src, end, dst);
+
+  // **** under the lock: copy the records written since the snapshot,
+  // write the current poses, and swap the files
+
+  boost::mutex::scoped_lock lock(mutex_);
+  while (!queue_.empty() || writing_) cond_.wait(lock);
+
+  fseek(file_, 0, SEEK_END);
+  long tail_end = ftell(file_);
+
+  // a reset in the tail discards everything copied so far
+  long tail_start = findLastReset(src, end, tail_end);
+  if (result && tail_start != end)
+  {
+    fclose(dst);
+    dst = fopen(tmp_filename.c_str(), "wb");
+    if (!dst)
+    {
+      fclose(src);
+      return false;
+    }
+    result = fwrite(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 1, dst) == 1;
+  }
+
+  fseek(src, tail_start, SEEK_SET);
+  if (result) result = copyKeyframeRecords(src, tail_end, dst);
+  fclose(src);
+
+  if (result)
+  {
+    std::vector<tf::Transform> poses(keyframes.size());
+    for (unsigned int kf_idx = 0; kf_idx < keyframes.size(); ++kf_idx)
+      poses[kf_idx] = keyframes[kf_idx].pose;
+
+    std::vector<uint8_t> payload;
+    serializePoses(poses, payload);
+    result = writeFramedRecord(dst, RECORD_POSES, payload);
+  }
+
+  result = (fclose(dst) == 0) && result;
+
+  // the live journal can be the destination: it is then replaced by 
+  // the compacted copy, and reopened so that new records go there
+  bool live = 
+    boost::filesystem::exists(filename) &&
+    boost::filesystem::equivalent(filename, filename_);
+
+  // replace the destination atomically
+  if (result) result = rename(tmp_filename.c_str(), filename.c_str()) == 0;
+  if (!result) remove(tmp_filename.c_str());
+
+  if (result && live)
+  {
+    FILE * file = fopen(filename_.c_str(), "ab");
+    if (file)
+    {
+      fclose(file_);
+      file_ = file;
+    }
+    else
+    {
+      ROS_ERROR("Could not reopen keyframe journal %s", filename_.c_str());
+      result = false;
+    }
+  }
+
+  return result;
+}
+
+long KeyframeJournal::findLastReset(FILE * file, long begin, long end)
+{
+  long start = begin;
+  uint32_t type;
+  std::vector<uint8_t> payload;
+
+  fseek(file, begin, SEEK_SET);
+  while (ftell(file) < end && readFramedRecord(file, type, payload))
+    if (type == RECORD_RESET) start = ftell(file);
+
+  return start;
+}
+
+bool KeyframeJournal::copyKeyframeRecords(FILE * src, long end, FILE * dst)
+{
+  uint32_t type;
+  std::vector<uint8_t> payload;
+
+  // the records are copied verbatim, without decoding the images
+  while (ftell(src) < end && readFramedRecord(src, type, payload))
+    if (type == RECORD_KEYFRAME && !writeFramedRecord(dst, type, payload))
+      return false;
+
+  return true;
+}
+
+bool KeyframeJournal::load(const std::string& filename, KeyframeVector& keyframes)
+{
+  keyframes.clear();
+
+  FILE * file = fopen(filename.c_str(), "rb");
+  if (!file)
+  {
+    ROS_ERROR("Could not open keyframe journal %s", filename.c_str());
+    return false;
+  }
+
+  if (!readMagic(file))
+  {
+    ROS_ERROR("%s is not a keyframe journal", filename.c_str());
+    fclose(file);
+    return false;
+  }
+
+  uint32_t type;
+  std::vector<uint8_t> payload;
+  std::vector<tf::Transform> poses;
+
+  while (readFramedRecord(file, type, payload))
+  {
+    if (type == RECORD_KEYFRAME)
+    {
+      // load in place
+      keyframes.push_back(RGBDKeyframe());
+
+      // a corrupted record stops the replay, as an incomplete one does
+      bool result;
+      try
+      {
+        result = deserializeKeyframe(payload, keyframes.back());
+      }
+      catch(const std::exception& e)
+      {
+        ROS_WARN("Error decoding keyframe record: %s", e.what());
+        result = false;
+      }
+
+      if (!result)
+      {
+        keyframes.pop_back();
+        break;
+      }
+    }
+    else if (type == RECORD_POSES)
+    {
+      if (!deserializePoses(payload, poses)) break;
+
+      unsigned int n = std::min(poses.size(), keyframes.size());
+      for (unsigned int kf_idx = 0; kf_idx < n; ++kf_idx)
+        keyframes[kf_idx].pose = poses[kf_idx];
+    }
+    else if (type == RECORD_RESET)
+    {
+      keyframes.clear();
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+} // namespace ccny_rgbd
@@ -35,19 +35,48 @@ RGBDFrame::RGBDFrame(
   const ImageMsg::ConstPtr& depth_msg,
   const CameraInfoMsg::ConstPtr& info_msg)
 { 
+  setImages(rgb_msg, depth_msg);
+  model.fromCameraInfo(info_msg);
+}
+
+void RGBDFrame::init(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const image_geometry::PinholeCameraModel& camera_model)
+{
+  setImages(rgb_msg, depth_msg);
+  model = camera_model;
+}
+
+void RGBDFrame::clear()
+{
+  header = std_msgs::Header();
+  rgb_img.release();
+  depth_img.release();
+
+  // clear() keeps the capacity of the vectors
+  keypoints.clear();
+  descriptors.release();
+  kp_valid.clear();
+  kp_means.clear();
+  kp_covariances.clear();
+  n_valid_keypoints = 0;
+}
+
+void RGBDFrame::setImages(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg)
+{
   rgb_img = cv_bridge::toCvShare(rgb_msg)->image;
   
-  // handles 16UC1 natively
-  // 32FC1 need to be converted into 16UC1
+  // handles 16UC1 and 32FC1 natively (no copy)
   const std::string& enc = depth_msg->encoding; 
-  if (enc.compare("16UC1") == 0)
+  if (enc.compare("16UC1") == 0 || enc.compare("32FC1") == 0)
     depth_img = cv_bridge::toCvShare(depth_msg)->image;
-  else if (enc.compare("32FC1") == 0)
-    depthImageFloatTo16bit(cv_bridge::toCvShare(depth_msg)->image, depth_img);
+  else
+    ROS_ERROR("Unsupported depth encoding %s", enc.c_str());
       
   header = rgb_msg->header;
-
-  model.fromCameraInfo(info_msg);
 }
 
 double RGBDFrame::getStdDevZ(double z) const
@@ -64,11 +93,21 @@ double RGBDFrame::getVarZ(double z) const
 void RGBDFrame::getGaussianDistribution(
   int u, int v, double& z_mean, double& z_var) const
 {
-  // get raw z value (in mm)
-  uint16_t z_raw = depth_img.at<uint16_t>(v, u);
+  if (depth_img.depth() == CV_32F)
+    getGaussianDistributionT<float>(u, v, z_mean, z_var);
+  else
+    getGaussianDistributionT<uint16_t>(u, v, z_mean, z_var);
+}
+
+template <typename DepthT>
+void RGBDFrame::getGaussianDistributionT(
+  int u, int v, double& z_mean, double& z_var) const
+{
+  // get raw z value
+  DepthT z_raw = depth_img.at<DepthT>(v, u);
 
   // z [meters]
-  z_mean = z_raw * 0.001;
+  z_mean = DepthTraits<DepthT>::toMeters(z_raw);
 
   // var_z [meters]
   z_var = getVarZ(z_mean);
@@ -76,6 +115,16 @@ void RGBDFrame::getGaussianDistribution(
 
 void RGBDFrame::getGaussianMixtureDistribution(
   int u, int v, double& z_mean, double& z_var) const
+{
+  if (depth_img.depth() == CV_32F)
+    getGaussianMixtureDistributionT<float>(u, v, z_mean, z_var);
+  else
+    getGaussianMixtureDistributionT<uint16_t>(u, v, z_mean, z_var);
+}
+
+template <typename DepthT>
+void RGBDFrame::getGaussianMixtureDistributionT(
+  int u, int v, double& z_mean, double& z_var) const
 {
   /// @todo Different window sizes? based on sigma_u, sigma_v?
   int w = 1;
@@ -93,11 +142,11 @@ void RGBDFrame::getGaussianMixtureDistribution(
   for (int uu = u_start; uu <= u_end; ++uu)
   for (int vv = v_start; vv <= v_end; ++vv)
   {
-    uint16_t z_neighbor_raw = depth_img.at<uint16_t>(vv, uu);
+    DepthT z_neighbor_raw = depth_img.at<DepthT>(vv, uu);
  
-    if (z_neighbor_raw != 0)
+    if (DepthTraits<DepthT>::valid(z_neighbor_raw))
     {
-      double z_neighbor = z_neighbor_raw * 0.001;
+      double z_neighbor = DepthTraits<DepthT>::toMeters(z_neighbor_raw);
 
       // determine and aggregate weight
       double weight;
@@ -122,6 +171,17 @@ void RGBDFrame::getGaussianMixtureDistribution(
 void RGBDFrame::computeDistributions(
   double max_z,
   double max_stdev_z)
+{
+  if (depth_img.depth() == CV_32F)
+    computeDistributionsT<float>(max_z, max_stdev_z);
+  else
+    computeDistributionsT<uint16_t>(max_z, max_stdev_z);
+}
+
+template <typename DepthT>
+void RGBDFrame::computeDistributionsT(
+  double max_z,
+  double max_stdev_z)
 {
   double max_var_z = max_stdev_z * max_stdev_z; // maximum allowed z variance
 
@@ -161,10 +221,10 @@ void RGBDFrame::computeDistributions(
     double v = keypoints[kp_idx].pt.y;  
 
     // get raw z value
-    uint16_t z_raw = depth_img.at<uint16_t>((int)v, (int)u);
+    DepthT z_raw = depth_img.at<DepthT>((int)v, (int)u);
 
     // skip bad values  
-    if (z_raw == 0)
+    if (!DepthTraits<DepthT>::valid(z_raw))
     {
       kp_valid[kp_idx] = false;
       continue;
@@ -173,7 +233,7 @@ void RGBDFrame::computeDistributions(
     // get z: mean and variance
     double z, var_z;
     //getGaussianDistribution(u, v, z, var_z);
-    getGaussianMixtureDistribution(u, v, z, var_z);
+    getGaussianMixtureDistributionT<DepthT>(u, v, z, var_z);
 
     // skip bad values - too far away, or z-variance too big
     if (z > max_z || var_z > max_var_z)
@@ -248,6 +308,18 @@ void RGBDFrame::constructDensePointCloud(
   PointCloudT& cloud,
   double max_z,
   double max_stdev_z) const
+{
+  if (depth_img.depth() == CV_32F)
+    constructDensePointCloudT<float>(cloud, max_z, max_stdev_z);
+  else
+    constructDensePointCloudT<uint16_t>(cloud, max_z, max_stdev_z);
+}
+
+template <typename DepthT>
+void RGBDFrame::constructDensePointCloudT(
+  PointCloudT& cloud,
+  double max_z,
+  double max_stdev_z) const
 {
   double max_var_z = max_stdev_z * max_stdev_z; // maximum allowed z variance
 
@@ -268,18 +340,18 @@ void RGBDFrame::constructDensePointCloud(
   {
     unsigned int index = v * rgb_img.cols + u;
 
-    uint16_t z_raw = depth_img.at<uint16_t>(v, u);
+    DepthT z_raw = depth_img.at<DepthT>(v, u);
 
-    float z = z_raw * 0.001; //convert to meters
+    float z = DepthTraits<DepthT>::toMeters(z_raw); //convert to meters
 
     PointT& p = cloud.points[index];
 
     double z_mean, z_var; 
 
     // check for out of range or bad measurements
-    if (z_raw != 0)
+    if (DepthTraits<DepthT>::valid(z_raw))
     {
-      getGaussianMixtureDistribution(u, v, z_mean, z_var);
+      getGaussianMixtureDistributionT<DepthT>(u, v, z_mean, z_var);
 
       // check for variance and z limits     
       if (z_var < max_var_z && z_mean < max_z)
@@ -300,10 +372,7 @@ void RGBDFrame::constructDensePointCloud(
     }
  
     // fill out color
-    const cv::Vec3b& color = rgb_img.at<cv::Vec3b>(v,u);
-    p.r = color[2];
-    p.g = color[1];
-    p.b = color[0];
+    getPixelColor(rgb_img, u, v, p.r, p.g, p.b);
   }
 
   cloud.header = header;
@@ -314,11 +383,12 @@ void RGBDFrame::constructDensePointCloud(
 
 bool RGBDFrame::save(
   const RGBDFrame& frame, 
-  const std::string& path)
+  const std::string& path,
+  bool rvl_depth)
 {
   // set the filenames
   std::string rgb_filename    = path + "/rgb.png";
-  std::string depth_filename  = path + "/depth.png";
+  std::string depth_filename  = path + (rvl_depth ? "/depth.rvl" : "/depth.png");
   std::string header_filename = path + "/header.yml";
   std::string intr_filename   = path + "/intr.yml"; 
   std::string cloud_filename  = path + "/cloud.pcd";
@@ -361,7 +431,24 @@ bool RGBDFrame::save(
 
   // save images 
   cv::imwrite(rgb_filename,   frame.rgb_img);
-  cv::imwrite(depth_filename, frame.depth_img);
+
+  // depth is always saved as 16UC1, in mm
+  if (rvl_depth)
+  {
+    if (!saveDepthRVL(depth_filename, frame.depth_img))
+    {
+      ROS_ERROR("Could not save %s", depth_filename.c_str());
+      return false;
+    }
+  }
+  else if (frame.depth_img.depth() == CV_32F)
+  {
+    cv::Mat depth_img_16;
+    depthImageFloatTo16bit(frame.depth_img, depth_img_16);
+    cv::imwrite(depth_filename, depth_img_16);
+  }
+  else
+    cv::imwrite(depth_filename, frame.depth_img);
   
   // save intrinsic matrix
   cv::FileStorage fs_mat(intr_filename, cv::FileStorage::WRITE);
@@ -379,6 +466,11 @@ bool RGBDFrame::load(RGBDFrame& frame, const std::string& path)
   std::string header_filename = path + "/header.yml";
   std::string intr_filename   = path + "/intr.yml"; 
 
+  // prefer the RVL-compressed depth image, if present
+  std::string rvl_filename = path + "/depth.rvl";
+  bool rvl_depth = boost::filesystem::exists(rvl_filename);
+  if (rvl_depth) depth_filename = rvl_filename;
+
   // check if files exist
   if (!boost::filesystem::exists(rgb_filename)    ||
       !boost::filesystem::exists(depth_filename)  ||
@@ -403,8 +495,18 @@ bool RGBDFrame::load(RGBDFrame& frame, const std::string& path)
   frame.header.stamp.nsec = nsec;
 
   // load images
-  frame.rgb_img = cv::imread(rgb_filename);
-  frame.depth_img = cv::imread(depth_filename, -1);
+  // unchanged, to keep mono keyframes mono
+  frame.rgb_img = cv::imread(rgb_filename, -1);
+  if (rvl_depth)
+  {
+    if (!loadDepthRVL(depth_filename, frame.depth_img))
+    {
+      ROS_ERROR("Could not load %s", depth_filename.c_str());
+      return false;
+    }
+  }
+  else
+    frame.depth_img = cv::imread(depth_filename, -1);
 
   // load intrinsic matrix
   cv::FileStorage fs_mat(intr_filename, cv::FileStorage::READ);
@@ -0,0 +1,128 @@
+/**
+ *  @file rgbd_frame_factory.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ * 
+ *  @section LICENSE
+ * 
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/structures/rgbd_frame_factory.h"
+
+#include <boost/thread/mutex.hpp>
+
+namespace ccny_rgbd {
+
+/** @brief The idle frames of a factory. 
+ * 
+ * Owned jointly by the factory and by the deleters of the frames 
+ * it handed out, so frames can be released after the factory is gone.
+ */
+class RGBDFramePool
+{
+  public:
+
+    RGBDFramePool(unsigned int capacity): capacity_(capacity) { }
+
+    ~RGBDFramePool()
+    {
+      for (unsigned int i = 0; i < frames_.size(); ++i)
+        delete frames_[i];
+    }
+
+    /** @brief Takes an idle frame, or NULL if there are none */
+    RGBDFrame * acquire()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (frames_.empty()) return NULL;
+      RGBDFrame * frame = frames_.back();
+      frames_.pop_back();
+      return frame;
+    }
+
+    /** @brief Returns a frame to the pool, or deletes it if the pool is full */
+    void release(RGBDFrame * frame)
+    {
+      // drop the images (and the messages they share) right away
+      frame->clear();
+
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (frames_.size() < capacity_)
+        {
+          frames_.push_back(frame);
+          return;
+        }
+      }
+
+      delete frame;
+    }
+
+  private:
+
+    boost::mutex mutex_;
+    unsigned int capacity_;
+    std::vector<RGBDFrame*> frames_;
+};
+
+/** @brief shared_ptr deleter which recycles frames into a pool */
+struct RGBDFrameRecycler
+{
+  boost::shared_ptr<RGBDFramePool> pool;
+
+  RGBDFrameRecycler(const boost::shared_ptr<RGBDFramePool>& pool): pool(pool) { }
+
+  void operator()(RGBDFrame * frame) const { pool->release(frame); }
+};
+
+RGBDFrameFactory::RGBDFrameFactory(unsigned int pool_size):
+  pool_(new RGBDFramePool(pool_size))
+{
+
+}
+
+RGBDFrameFactory::~RGBDFrameFactory()
+{
+
+}
+
+RGBDFramePtr RGBDFrameFactory::create(
+  const ImageMsg::ConstPtr& rgb_msg,
+  const ImageMsg::ConstPtr& depth_msg,
+  const CameraInfoMsg::ConstPtr& info_msg)
+{
+  updateModel(info_msg);
+
+  RGBDFrame * frame = pool_->acquire();
+  if (!frame) frame = new RGBDFrame();
+
+  frame->init(rgb_msg, depth_msg, model_);
+
+  return RGBDFramePtr(frame, RGBDFrameRecycler(pool_));
+}
+
+void RGBDFrameFactory::updateModel(const CameraInfoMsg::ConstPtr& info_msg)
+{
+  if (info_msg_ == info_msg) return;
+
+  if (!info_msg_ || !sameCameraCalibration(*info_msg_, *info_msg))
+    model_.fromCameraInfo(info_msg);
+
+  info_msg_ = info_msg;
+}
+
+} // namespace ccny_rgbd
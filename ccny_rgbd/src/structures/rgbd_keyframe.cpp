@@ -34,6 +34,11 @@ RGBDKeyframe::RGBDKeyframe():
 RGBDKeyframe::RGBDKeyframe(const RGBDFrame& frame):
   RGBDFrame(),
   manually_added(false)
+{
+  setFrame(frame);
+}
+
+void RGBDKeyframe::setFrame(const RGBDFrame& frame)
 {
   rgb_img   = frame.rgb_img.clone();
   depth_img = frame.depth_img.clone();
@@ -43,13 +48,14 @@ RGBDKeyframe::RGBDKeyframe(const RGBDFrame& frame):
 
 bool RGBDKeyframe::save(
   const RGBDKeyframe& keyframe, 
-  const std::string& path)
+  const std::string& path,
+  bool rvl_depth)
 {  
   std::string pose_filename  = path + "/pose.yaml";
   std::string prop_filename  = path + "/properties.yaml"; 
 
   // save frame  
-  bool save_frame_result = RGBDFrame::save(keyframe, path);
+  bool save_frame_result = RGBDFrame::save(keyframe, path, rvl_depth);
   if (!save_frame_result) return false;
   
   // save pose as OpenCV rmat and tvec
@@ -107,7 +113,8 @@ bool RGBDKeyframe::load(RGBDKeyframe& keyframe, const std::string& path)
 
 bool saveKeyframes(
   const KeyframeVector& keyframes, 
-  const std::string& path)
+  const std::string& path,
+  bool rvl_depth)
 {
   for (unsigned int kf_idx = 0; kf_idx < keyframes.size(); ++kf_idx)
   {
@@ -116,7 +123,7 @@ bool saveKeyframes(
     
     std::string kf_path = path + "/" + ss_idx.str();
 
-    bool save_result = RGBDKeyframe::save(keyframes[kf_idx], kf_path); 
+    bool save_result = RGBDKeyframe::save(keyframes[kf_idx], kf_path, rvl_depth); 
     if (!save_result) return false;
   }
 
@@ -141,11 +148,13 @@ bool loadKeyframes(
     if (boost::filesystem::exists(path_kf))
     {
       ROS_INFO("Loading %s", path_kf.c_str());
-      RGBDKeyframe keyframe;
-      bool result_load = RGBDKeyframe::load(keyframe, path_kf);
-      if (result_load) keyframes.push_back(keyframe);
-      else
+
+      // load in place
+      keyframes.push_back(RGBDKeyframe());
+      bool result_load = RGBDKeyframe::load(keyframes.back(), path_kf);
+      if (!result_load)
       {
+        keyframes.pop_back();
         ROS_WARN("Error loading"); 
         return false;
       }
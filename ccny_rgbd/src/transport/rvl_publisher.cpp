@@ -0,0 +1,58 @@
+/**
+ *  @file rvl_publisher.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ * 
+ *  @section LICENSE
+ * 
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/transport/rvl_publisher.h"
+
+namespace ccny_rgbd {
+
+void RVLPublisher::publish(
+  const sensor_msgs::Image& message,
+  const PublishFn& publish_fn) const
+{
+  int type;
+  if (message.encoding == "16UC1")
+    type = CV_16UC1;
+  else if (message.encoding == "32FC1")
+    type = CV_32FC1;
+  else
+  {
+    ROS_ERROR("RVL transport: unsupported encoding %s (expected 16UC1 or 32FC1)",
+      message.encoding.c_str());
+    return;
+  }
+
+  if (message.data.empty()) return;
+
+  // wrap the message data, without copying it
+  const cv::Mat depth_img(message.height, message.width, type, 
+    const_cast<uint8_t*>(&message.data[0]), message.step);
+
+  sensor_msgs::CompressedImage compressed;
+  compressed.header = message.header;
+  compressed.format = message.encoding + "; rvl";
+  compressDepthRVL(depth_img, compressed.data);
+
+  publish_fn(compressed);
+}
+
+} // namespace ccny_rgbd
@@ -0,0 +1,62 @@
+/**
+ *  @file rvl_subscriber.cpp
+ *  @author Ivan Dryanovski <ivan.dryanovski@gmail.com>
+ * 
+ *  @section LICENSE
+ * 
+ *  Copyright (C) 2013, City University of New York
+ *  CCNY Robotics Lab <http://robotics.ccny.cuny.edu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ccny_rgbd/transport/rvl_subscriber.h"
+
+#include <cv_bridge/cv_bridge.h>
+
+#include "ccny_rgbd/rgbd_util.h"
+
+namespace ccny_rgbd {
+
+void RVLSubscriber::internalCallback(
+  const sensor_msgs::CompressedImageConstPtr& message,
+  const Callback& user_cb)
+{
+  cv_bridge::CvImage cv_img;
+  cv_img.header = message->header;
+
+  cv::Mat depth_img;
+  if (message->data.empty() || 
+      !decompressDepthRVL(&message->data[0], message->data.size(), depth_img))
+  {
+    ROS_ERROR("RVL transport: could not decode depth image");
+    return;
+  }
+
+  // restore float images, in meters (NaN = invalid)
+  if (message->format.compare(0, 5, "32FC1") == 0)
+  {
+    depthImage16bitToFloat(depth_img, cv_img.image);
+    cv_img.encoding = "32FC1";
+  }
+  else
+  {
+    cv_img.image = depth_img;
+    cv_img.encoding = "16UC1";
+  }
+
+  user_cb(cv_img.toImageMsg());
+}
+
+} // namespace ccny_rgbd